@@ -1,3 +1,4 @@
+const fs = require('fs');
 const ieeeExtended = require('./ieeeextended');
 const {
   BufferStruct,
@@ -289,7 +290,17 @@ function makeAIFFChunk(ckID, chunkData) {
   });
 }
 
-function serializeAIFF({
+function makeAIFFChunkHeader(ckID, ckSize) {
+  const header = Buffer.alloc(8);
+  header.write(ckID, 0, 4, 'utf8');
+  header.writeInt32BE(ckSize, 4);
+  return header;
+}
+
+// serializes an AIFF as a list of buffers which concatenate to the file, with
+// the sound data included as is rather than copied, so the file can be written
+// out with writev
+function serializeAIFFPieces({
   soundData,
   numChannels,
   sampleRate,
@@ -337,17 +348,21 @@ function serializeAIFF({
         })
   );
 
-  const soundDataChunk = makeAIFFChunk(
-    'SSND',
-    AIFFSoundDataStruct.serialize(
-      {
-        offset: 0,
-        blockSize: 0,
-        soundData,
-      },
-      {soundDataSize: soundData.length}
-    )
+  const soundDataHeader = AIFFSoundDataStruct.serialize(
+    {
+      offset: 0,
+      blockSize: 0,
+      soundData: Buffer.alloc(0),
+    },
+    {soundDataSize: 0}
   );
+  const soundDataChunk = [
+    makeAIFFChunkHeader('SSND', soundDataHeader.length + soundData.length),
+    soundDataHeader,
+    soundData,
+    // chunks are padded to an even length
+    soundData.length % 2 ? Buffer.alloc(1) : null,
+  ];
 
   const serializedChunks = [];
   (chunks || []).forEach((parsedChunk) => {
@@ -402,21 +417,80 @@ function serializeAIFF({
     'utf8'
   );
 
-  const aiffFileContents = makeAIFFChunk(
-    'FORM',
-    Buffer.concat(
-      [
-        formTypeSerialized,
-        formatChunk,
-        commChunk,
-        soundDataChunk,
-        ...serializedChunks,
-        ...(rawChunks || []),
-      ].filter(Boolean)
-    )
-  );
+  const formData = [
+    formTypeSerialized,
+    formatChunk,
+    commChunk,
+    ...soundDataChunk,
+    ...serializedChunks,
+    ...(rawChunks || []),
+  ].filter(Boolean);
+  const formSize = formData.reduce((size, piece) => size + piece.length, 0);
+
+  return [
+    makeAIFFChunkHeader('FORM', formSize),
+    ...formData,
+    formSize % 2 ? Buffer.alloc(1) : null,
+  ].filter(Boolean);
+}
+
+function serializeAIFF(aiffData) {
+  return Buffer.concat(serializeAIFFPieces(aiffData));
+}
+
+// parse the data of a FORM local chunk into chunk.parsed, copying the COMM and
+// SSND fields to output
+function parseLocalChunk(chunk, formType, output) {
+  switch (chunk.ckID) {
+    case 'COMM':
+      chunk.parsed =
+        formType === 'AIFC'
+          ? AIFCCommonStruct.parse(chunk.chunkData)
+          : AIFFCommonStruct.parse(chunk.chunkData);
+      chunk.parsed.sampleRate = ieeeExtended.ConvertFromIeeeExtended(
+        chunk.parsed.sampleRate
+      );
 
-  return aiffFileContents;
+      output.sampleRate = chunk.parsed.sampleRate;
+      output.sampleSize = chunk.parsed.sampleSize;
+      output.numChannels = chunk.parsed.numChannels;
+      output.compressionType = chunk.parsed.compressionType;
+      output.compressionName = chunk.parsed.compressionName;
+      break;
+    case 'SSND':
+      chunk.parsed = AIFFSoundDataStruct.parse(chunk.chunkData, 0, {
+        soundDataSize: chunk.ckSize - AIFF_SOUND_DATA_CHUNK_SIZE_EXCL_SOUNDDATA,
+      });
+      output.soundData = chunk.parsed.soundData;
+      break;
+    case 'MARK':
+      chunk.parsed = AIFFMarkerChunkStruct.parse(chunk.chunkData, 0);
+      break;
+    case 'COMT':
+      chunk.parsed = AIFFCommentStruct.parse(chunk.chunkData, 0);
+      break;
+    case 'INST':
+      chunk.parsed = AIFFInstrumentStruct.parse(chunk.chunkData, 0);
+      break;
+    case AIFFNameChunkID:
+    case AIFFAuthorChunkID:
+    case AIFFCopyrightChunkID:
+    case AIFFAnnotationChunkID:
+      chunk.parsed = AIFFTextStruct.parse(chunk.chunkData, 0, {
+        dataSize: chunk.ckSize,
+      });
+      break;
+    case 'APPL':
+      chunk.parsed = AIFCApplicationSpecificStruct.parse(chunk.chunkData, 0, {
+        dataSize: chunk.ckSize - AIFC_APPL_CHUNK_SIZE_EXCL_DATA,
+      });
+      break;
+    case 'FVER':
+      chunk.parsed = AIFCFormatStruct.parse(chunk.chunkData);
+      break;
+    default:
+      DEBUG && console.error('unknown chunk type', chunk.ckID);
+  }
 }
 
 function parseAIFF(fileContents, options = {}) {
@@ -480,61 +554,7 @@ function parseAIFF(fileContents, options = {}) {
             formChunk.chunkData.slice(pos, pos + 64)
           );
       }
-      switch (chunk.ckID) {
-        case 'COMM':
-          chunk.parsed =
-            formType === 'AIFC'
-              ? AIFCCommonStruct.parse(chunk.chunkData)
-              : AIFFCommonStruct.parse(chunk.chunkData);
-          chunk.parsed.sampleRate = ieeeExtended.ConvertFromIeeeExtended(
-            chunk.parsed.sampleRate
-          );
-
-          output.sampleRate = chunk.parsed.sampleRate;
-          output.sampleSize = chunk.parsed.sampleSize;
-          output.numChannels = chunk.parsed.numChannels;
-          output.compressionType = chunk.parsed.compressionType;
-          output.compressionName = chunk.parsed.compressionName;
-          break;
-        case 'SSND':
-          chunk.parsed = AIFFSoundDataStruct.parse(chunk.chunkData, 0, {
-            soundDataSize:
-              chunk.ckSize - AIFF_SOUND_DATA_CHUNK_SIZE_EXCL_SOUNDDATA,
-          });
-          output.soundData = chunk.parsed.soundData;
-          break;
-        case 'MARK':
-          chunk.parsed = AIFFMarkerChunkStruct.parse(chunk.chunkData, 0);
-          break;
-        case 'COMT':
-          chunk.parsed = AIFFCommentStruct.parse(chunk.chunkData, 0);
-          break;
-        case 'INST':
-          chunk.parsed = AIFFInstrumentStruct.parse(chunk.chunkData, 0);
-          break;
-        case AIFFNameChunkID:
-        case AIFFAuthorChunkID:
-        case AIFFCopyrightChunkID:
-        case AIFFAnnotationChunkID:
-          chunk.parsed = AIFFTextStruct.parse(chunk.chunkData, 0, {
-            dataSize: chunk.ckSize,
-          });
-          break;
-        case 'APPL':
-          chunk.parsed = AIFCApplicationSpecificStruct.parse(
-            chunk.chunkData,
-            0,
-            {
-              dataSize: chunk.ckSize - AIFC_APPL_CHUNK_SIZE_EXCL_DATA,
-            }
-          );
-          break;
-        case 'FVER':
-          chunk.parsed = AIFCFormatStruct.parse(chunk.chunkData);
-          break;
-        default:
-          DEBUG && console.error('unknown chunk type', chunk.ckID);
-      }
+      parseLocalChunk(chunk, formType, output);
 
       DEBUG && console.log('local chunk', chunk);
       parsedFormLocalChunks.push({type: chunk.ckID, value: chunk.parsed});
@@ -552,9 +572,157 @@ function parseAIFF(fileContents, options = {}) {
   return output;
 }
 
+const CHUNK_HEADER_SIZE = 8;
+// metadata chunks are read through a window of this size, so the chunks before
+// and after the sound data take a single read each
+const READ_WINDOW_SIZE = 4096;
+
+function readAt(fd, length, position) {
+  const buffer = Buffer.alloc(length);
+  let read = 0;
+  while (read < length) {
+    const bytesRead = fs.readSync(
+      fd,
+      buffer,
+      read,
+      length - read,
+      position + read
+    );
+    if (bytesRead === 0) {
+      throw new Error(
+        `unexpected end of file reading ${length} bytes at ${position}`
+      );
+    }
+    read += bytesRead;
+  }
+  return buffer;
+}
+
+// reads ranges of a file, serving small reads from a window of the file
+class WindowedReader {
+  constructor(fd, fileSize) {
+    this.fd = fd;
+    this.fileSize = fileSize;
+    this.window = null;
+    this.windowPosition = 0;
+  }
+
+  read(length, position) {
+    const offset = position - this.windowPosition;
+    if (this.window && offset >= 0 && offset + length <= this.window.length) {
+      return this.window.subarray(offset, offset + length);
+    }
+    if (length > READ_WINDOW_SIZE) {
+      return readAt(this.fd, length, position);
+    }
+    this.window = readAt(
+      this.fd,
+      Math.max(length, Math.min(READ_WINDOW_SIZE, this.fileSize - position)),
+      position
+    );
+    this.windowPosition = position;
+    return this.window.subarray(0, length);
+  }
+}
+
+function makeRangeReader(filePath, position, length) {
+  return () => {
+    const fd = fs.openSync(filePath, 'r');
+    try {
+      return readAt(fd, length, position);
+    } finally {
+      fs.closeSync(fd);
+    }
+  };
+}
+
+// parse an AIFF/AIFC file reading only its chunk headers and metadata chunks,
+// skipping over the sound data. the result has the same fields as parseAIFF,
+// except that the sound data is only read from the file if soundData is
+// accessed, and the SSND chunk value omits it. readSoundData() and
+// createSoundDataStream() read it without keeping it around.
+// a FORM chunk claiming to be bigger than the file (like some of the VADPCM
+// samples in the n64 sdk) is read up to the end of the file, and sets truncated
+function parseAIFFFileLazy(filePath) {
+  const output = {};
+  const parsedFormLocalChunks = [];
+  let soundDataPosition = null;
+
+  const fd = fs.openSync(filePath, 'r');
+  try {
+    const fileSize = fs.fstatSync(fd).size;
+    const reader = new WindowedReader(fd, fileSize);
+    const header = reader.read(CHUNK_HEADER_SIZE + 4, 0);
+    if (header.slice(0, 4).toString('utf8') !== 'FORM') {
+      throw new Error(`${filePath} is not an aiff file: no FORM chunk`);
+    }
+    const formEnd = CHUNK_HEADER_SIZE + header.readInt32BE(4);
+    output.truncated = formEnd > fileSize;
+    const formType = header.slice(8, 12).toString('utf8');
+    if (formType === 'AIFF' || formType === 'AIFC') {
+      output.formType = formType;
+    }
+
+    let pos = CHUNK_HEADER_SIZE + 4;
+    const end = Math.min(formEnd, fileSize);
+    while (pos + CHUNK_HEADER_SIZE <= end) {
+      const chunkHeader = reader.read(CHUNK_HEADER_SIZE, pos);
+      const chunk = {
+        ckID: chunkHeader.slice(0, 4).toString('utf8'),
+        ckSize: chunkHeader.readInt32BE(4),
+      };
+      const dataPosition = pos + CHUNK_HEADER_SIZE;
+      if (chunk.ckID === 'SSND') {
+        const soundDataHeader = reader.read(
+          AIFF_SOUND_DATA_CHUNK_SIZE_EXCL_SOUNDDATA,
+          dataPosition
+        );
+        chunk.parsed = {
+          offset: soundDataHeader.readUInt32BE(0),
+          blockSize: soundDataHeader.readUInt32BE(4),
+        };
+        soundDataPosition =
+          dataPosition + AIFF_SOUND_DATA_CHUNK_SIZE_EXCL_SOUNDDATA;
+        output.soundDataSize =
+          chunk.ckSize - AIFF_SOUND_DATA_CHUNK_SIZE_EXCL_SOUNDDATA;
+      } else {
+        chunk.chunkData = reader.read(chunk.ckSize, dataPosition);
+        parseLocalChunk(chunk, formType, output);
+      }
+      parsedFormLocalChunks.push({type: chunk.ckID, value: chunk.parsed});
+      pos = dataPosition + getAlignedSize(chunk.ckSize, 2);
+    }
+  } finally {
+    fs.closeSync(fd);
+  }
+  output.chunks = parsedFormLocalChunks;
+  if (soundDataPosition == null) return output;
+
+  // the reader doesn't hold a reference to output, so the caller can keep it
+  // without keeping soundData alive
+  const readSoundData = makeRangeReader(
+    filePath,
+    soundDataPosition,
+    output.soundDataSize
+  );
+  let soundData = null;
+  Object.defineProperty(output, 'soundData', {
+    get: () => soundData || (soundData = readSoundData()),
+  });
+  output.readSoundData = readSoundData;
+  output.createSoundDataStream = () =>
+    fs.createReadStream(filePath, {
+      start: soundDataPosition,
+      end: soundDataPosition + output.soundDataSize - 1,
+    });
+  return output;
+}
+
 module.exports = {
   serialize: serializeAIFF,
+  serializePieces: serializeAIFFPieces,
   parse: parseAIFF,
+  parseFileLazy: parseAIFFFileLazy,
   PString,
   LoopPlayMode,
 };
@@ -1,29 +1,89 @@
 #!/usr/bin/env node
 
 // eg. bankdec.js ../ultra/usr/lib/PR/soundbanks/GenMidiRaw.ctl -o test/genmidi
+// or to index the banks in a directory of roms:
+// bankdec.js --scan --index banks.json roms/
+// or to extract one instrument, keeping an index to make later queries quick:
+// bankdec.js --cache .bankindex --bank 0 --instrument 5 -o piano rom.z64
 
 const fs = require('fs');
-const arg = require('arg');
-const parser = require('./instparser');
-const {bankToSource, parseCtl, ALBankFileStruct} = require('./soundtools');
-
-const args = arg({
-  // Types
-  '--help': Boolean,
-  '--out': String, // --name <string> or --name=<string>
-  '--gm': Boolean,
-  '--ctlstart': Number, // when reading from rom, offset of ctl
-  '--tblstart': Number, // when reading from rom, offset of tbl
-  '--verbose': Boolean,
-
-  // Aliases
-  '-v': '--verbose',
-  '-o': '--out',
-  '-h': '--help',
-});
-
-if (args['--help']) {
-  console.log(`bankdec [--out outputFilePrefix] inputFile
+const path = require('path');
+const os = require('os');
+const {isMainThread} = require('worker_threads');
+const {
+  bankToSource,
+  bankFileToSource,
+  parseCtl,
+  AL_ADPCM_WAVE,
+} = require('./soundtools');
+const {loadRom, getRomName, findTblStart, scanRom} = require('./romscan');
+const {BankIndex, RomReader, selectFromBankFile} = require('./bankindex');
+const {runWorkerPool, serveWorkerJobs} = require('./workerpool');
+const {findFiles} = require('./findfiles');
+
+const INDEX_VERSION = 1;
+
+// scans a rom on a worker thread when using --scan
+function scanRomFile(file) {
+  const startTime = process.hrtime.bigint();
+  const stat = fs.statSync(file);
+  const romBuffer = loadRom(file);
+  const banks = scanRom(romBuffer).map(
+    ({ctlStart, ctlEnd, tblStart, bankFile}) => ({
+      ctlStart,
+      ctlEnd,
+      tblStart,
+      bankCount: bankFile.bankCount,
+      instruments: Object.keys(bankFile.instruments).length,
+      sounds: Object.keys(bankFile.sounds).length,
+    })
+  );
+  return {
+    file: path.resolve(file),
+    name: getRomName(romBuffer),
+    size: stat.size,
+    mtimeMs: stat.mtimeMs,
+    banks,
+    scanMs: Number(process.hrtime.bigint() - startTime) / 1e6,
+  };
+}
+
+function hex(offset) {
+  return '0x' + offset.toString(16);
+}
+
+if (!isMainThread) {
+  serveWorkerJobs(scanRomFile);
+} else {
+  const arg = require('arg');
+
+  const args = arg({
+    // Types
+    '--help': Boolean,
+    '--out': String, // --name <string> or --name=<string>
+    '--gm': Boolean,
+    '--ctlstart': Number, // when reading from rom, offset of ctl
+    '--tblstart': Number, // when reading from rom, offset of tbl
+    '--verbose': Boolean,
+    '--scan': Boolean, // index the banks in many roms instead of decompiling
+    '--index': String, // where to write the index when scanning
+    '--jobs': Number, // max roms to scan, or samples to extract, in parallel
+    '--decode': Boolean, // also write uncompressed copies of VADPCM samples
+    '--cache': String, // dir of per-rom indexes of the banks found
+    '--list': Boolean, // list the contents of the banks instead of extracting
+    '--bank': Number, // only extract this bank
+    '--instrument': String, // only extract this instrument of --bank
+
+    // Aliases
+    '-v': '--verbose',
+    '-o': '--out',
+    '-j': '--jobs',
+    '-h': '--help',
+  });
+
+  if (args['--help']) {
+    console.log(`bankdec [--out outputFilePrefix] inputFile
+bankdec --scan [--index file] [--jobs n] roms or directories...
 
   -h, --help: print this message
   -o, --out: name prefix to use for output ctl, tbl and samples dir
@@ -31,152 +91,289 @@ if (args['--help']) {
   --ctlstart: when reading from rom, offset of ctl
   --tblstart: when reading from rom, offset of tbl
   --verbose: wordier errors
+  --scan: find the ctl/tbl data in each rom (.z64 or .v64) and write their
+    offsets to a json index, rather than decompiling them
+  --index: file to write the index to (default: bankindex.json)
+  -j, --jobs: with --scan, max roms to scan in parallel (default: number of
+    cpus), otherwise max samples to extract at once (default: 16)
+  --decode: also decode each VADPCM .aifc sample to an uncompressed .aiff
+  --cache: when reading from rom, directory to keep an index of the banks
+    found in each rom, so later runs on the same rom don't have to scan it
+  --list: when reading from rom, list the banks, instruments and sounds in
+    each ctl instead of decompiling them
+  --bank: when reading from rom, only decompile this bank (by index)
+  --instrument: with --bank, only decompile this instrument (by program
+    number, or 'percussion')
 
   inputFile: input file to read, either ctl, tbl, or rom file
 `);
-  process.exit(0);
-}
-
-const sourceFile = args._[0];
+    process.exit(0);
+  }
 
-if (!sourceFile) {
-  throw new Error('no input file specified');
-}
+  const sourceFile = args._[0];
 
-async function decompileFromRom(sourceFile) {
-  const romBuffer = await fs.promises.readFile(sourceFile);
-  if (sourceFile.match(/\.(v64)/)) {
-    romBuffer.swap16();
+  if (!sourceFile) {
+    throw new Error('no input file specified');
   }
 
-  let romName = romBuffer
-    .slice(0x20, 0x20 + 20)
-    .toString('utf8')
-    .trim()
-    .toLowerCase()
-    .replace(/\W/g, '_');
-  if (!romName.length) {
-    romName = 'untitled';
+  function parseInstrumentArg(value) {
+    if (value == null || value === 'percussion') return value;
+    const program = Number(value);
+    if (!Number.isInteger(program) || program < 0) {
+      throw new Error(`invalid instrument '${value}'`);
+    }
+    return program;
   }
-  console.log('rom:', romName);
-
-  let found = 0;
-  let startOffset = 0;
 
-  // only extract one if either of these are specified
-  const decompileOneOnly = args['--ctlstart'] || args['--tblstart'];
-
-  while (true) {
-    let ctlStart;
-    if (args['--ctlstart'] != null) {
-      ctlStart = args['--ctlstart'];
-    } else {
-      ctlStart = romBuffer.indexOf(
-        Buffer.from([0x42, 0x31, 0x00, 0x01]),
-        startOffset
+  function printCtl(ctl) {
+    const {bankFile} = ctl;
+    console.log(
+      `ctl ${hex(ctl.ctlStart)}-${hex(ctl.ctlEnd)}, tbl ${hex(
+        ctl.tblStart
+      )}: ${bankFile.bankCount} bank(s)`
+    );
+    function printInstrument(label, instOffset) {
+      const instrument = bankFile.instruments[instOffset];
+      console.log(
+        `    ${label}: ${instrument.soundCount} sound(s), volume ${instrument.volume}, pan ${instrument.pan}`
       );
+      instrument.soundArray.forEach((soundOffset) => {
+        const sound = bankFile.sounds[soundOffset];
+        const wavetable = bankFile.wavetables[sound.wavetable];
+        const {keyMin, keyMax, keyBase} = bankFile.keyMaps[sound.keyMap];
+        console.log(
+          `      sound ${hex(soundOffset)}: keys ${keyMin}-${keyMax} (base ${keyBase}), ${
+            wavetable.type === AL_ADPCM_WAVE ? 'adpcm' : 'raw16'
+          } wavetable at tbl+${hex(wavetable.base)}, ${wavetable.len} bytes`
+        );
+      });
     }
+    bankFile.bankArray.forEach((bankOffset, i) => {
+      const bank = bankFile.banks[bankOffset];
+      console.log(
+        `  bank ${i}: ${bank.sampleRate}Hz, ${bank.instCount} instrument(s)${
+          bank.percussion ? ' + percussion' : ''
+        }`
+      );
+      bank.instArray.forEach((instOffset, program) => {
+        if (instOffset) printInstrument(`instrument ${program}`, instOffset);
+      });
+      if (bank.percussion) printInstrument('percussion', bank.percussion);
+    });
+  }
 
-    if (ctlStart < 0) {
-      if (found == 0) {
-        throw new Error(`couldn't find ctl magic number`);
-      } else {
-        return;
+  // returns the ctls in the rom, from the index if using --cache, and a
+  // function to read data from the rom
+  function findRomBanks(sourceFile) {
+    if (args['--cache']) {
+      const index = new BankIndex(args['--cache']);
+      const rom = index.getRom(sourceFile);
+      index.save();
+      if (args['--verbose']) {
+        console.log(
+          `index: ${index.stats.romsRead} rom(s) read, ${index.stats.romsScanned} scanned`
+        );
       }
+      const reader = new RomReader(sourceFile);
+      return {
+        name: rom.name,
+        ctls: rom.ctls,
+        readRom: (offset, length) => reader.read(offset, length),
+        loadRomBuffer: () => loadRom(sourceFile),
+        close: () => reader.close(),
+      };
     }
 
-    // console.log(romBuffer.slice(ctlStart, ctlStart + 64));
-    // const bankFileHeader = ALBankFileStruct.parse(romBuffer, ctlStart);
-    // console.log(bankFileHeader);
-    let bankFile;
-    try {
-      bankFile = parseCtl(romBuffer, ctlStart);
-    } catch (err) {
-      if (args['--verbose']) {
-        console.error(err);
-      }
-      if (decompileOneOnly) {
-        throw new Error(`failed to find ctl at 0x${ctlStart.toString(16)}`);
-      } else {
-        // failed to parse bank file, probably not really a bank file
-        // and just coincidentally contained the 4 byte magic string.
-        // move past it and try again
-        startOffset = ctlStart + 4;
-        continue;
+    const romBuffer = loadRom(sourceFile);
+    return {
+      name: getRomName(romBuffer),
+      // candidates which fail to parse probably aren't really bank files and
+      // just coincidentally contained the magic string
+      ctls: scanRom(romBuffer, {
+        onParseError: args['--verbose'] ? (err) => console.error(err) : null,
+      }),
+      readRom: (offset, length) => romBuffer.slice(offset, offset + length),
+      loadRomBuffer: () => romBuffer,
+      close: () => {},
+    };
+  }
+
+  async function decompileFromRom(sourceFile) {
+    const rom = findRomBanks(sourceFile);
+    const romName = rom.name;
+    console.log('rom:', romName);
+
+    // only extract one if either of these are specified
+    const decompileOneOnly =
+      args['--ctlstart'] != null || args['--tblstart'] != null;
+    const query = {
+      bank: args['--bank'] != null ? args['--bank'] : null,
+      instrument: parseInstrumentArg(args['--instrument']),
+    };
+
+    let found = rom.ctls;
+    if (args['--ctlstart'] != null) {
+      const ctlStart = args['--ctlstart'];
+      found = found.filter((ctl) => ctl.ctlStart === ctlStart);
+      if (!found.length) {
+        // not something the scan would find, so try harder
+        const romBuffer = rom.loadRomBuffer();
+        let bankFile;
+        try {
+          bankFile = parseCtl(romBuffer, ctlStart);
+        } catch (err) {
+          if (args['--verbose']) {
+            console.error(err);
+          }
+          throw new Error(`failed to find ctl at ${hex(ctlStart)}`);
+        }
+        const ctlEnd = bankFile.lastOffset;
+        found = [
+          {
+            ctlStart,
+            ctlEnd,
+            tblStart: findTblStart(romBuffer, ctlEnd),
+            bankFile,
+          },
+        ];
       }
+    } else if (decompileOneOnly) {
+      found = found.slice(0, 1);
     }
 
-    console.log('found ctl at 0x' + ctlStart.toString(16));
-    found++;
-    // console.log('bankFile', bankFile);
-    // console.log(
-    //   'next 64 bytes:',
-    //   romBuffer.slice(bankFile.lastOffset, bankFile.lastOffset + 64)
-    // );
-
-    let tblStart;
-    if (args['--tblstart'] != null) {
-      tblStart = args['--tblstart'];
-    } else {
-      // next time we look for a ctl, start here
-      startOffset = bankFile.lastOffset;
-
-      // look for tbl immediate after ctl
-      tblStart = bankFile.lastOffset;
-      // look ahead through null bytes
-      while (
-        romBuffer
-          .slice(tblStart, tblStart + 4)
-          .equals(Buffer.from([0, 0, 0, 0]))
-      ) {
-        tblStart += 4;
-      }
+    if (!found.length) {
+      throw new Error(`couldn't find ctl magic number`);
     }
 
     try {
-      await bankToSource(
-        romBuffer,
-        ctlStart,
-        romBuffer,
-        tblStart,
-        (args['--out'] || romName) +
-          (decompileOneOnly ? '' : '_' + String(ctlStart)),
-        args['--gm']
-      );
-    } catch (err) {
-      throw new Error(
-        `failed to parse, ctl=0x${ctlStart.toString(
-          16
-        )} tbl=0x${tblStart.toString(16)}`
-      );
+      for (const ctl of found) {
+        if (args['--list']) {
+          printCtl(ctl);
+          continue;
+        }
+        const {ctlStart} = ctl;
+        console.log('found ctl at ' + hex(ctlStart));
+        const tblStart =
+          args['--tblstart'] != null ? args['--tblstart'] : ctl.tblStart;
+        try {
+          await bankFileToSource(
+            selectFromBankFile(ctl.bankFile, query),
+            (wavetable) =>
+              rom.readRom(tblStart + wavetable.base, wavetable.len),
+            (args['--out'] || romName) +
+              (decompileOneOnly ? '' : '_' + String(ctlStart)),
+            args['--gm'],
+            extractOptions
+          );
+        } catch (err) {
+          if (args['--verbose']) {
+            console.error(err);
+          }
+          throw new Error(
+            `failed to parse, ctl=${hex(ctlStart)} tbl=${hex(tblStart)}`
+          );
+        }
+      }
+    } finally {
+      rom.close();
     }
+  }
 
-    if (decompileOneOnly) {
-      return;
-    }
+  const extractOptions = {
+    concurrency: args['--jobs'],
+    decodePCM: args['--decode'],
+  };
+
+  // with --verbose, report how long decompiling took and how much memory it
+  // needed
+  function reportUsage(startTime) {
+    if (!args['--verbose']) return;
+    console.log(
+      `decompiled in ${((Date.now() - startTime) / 1000).toFixed(
+        2
+      )}s, peak rss ${(process.resourceUsage().maxRSS / 1024).toFixed(0)}MB`
+    );
   }
-}
 
-if (sourceFile.match(/\.(n64|v64|z64)/)) {
-  if (!sourceFile.match(/\.(v64|z64)/)) {
-    console.error('only .z64 and .v64 roms supported');
-    process.exit(1);
+  async function scanRoms(inputs) {
+    const files = findFiles(inputs, /\.(v64|z64)$/i);
+    const indexFile = args['--index'] || 'bankindex.json';
+    const startTime = Date.now();
+    let totalBytes = 0;
+    let totalBanks = 0;
+    const roms = await runWorkerPool({
+      workerFile: __filename,
+      jobs: files,
+      concurrency: args['--jobs'] || os.cpus().length,
+      onResult: (rom, file) => {
+        totalBytes += rom.size;
+        totalBanks += rom.banks.length;
+        console.log(
+          `${file} (${rom.name}): ${rom.banks.length} bank file(s)${
+            rom.banks.length
+              ? ' at ' + rom.banks.map((bank) => hex(bank.ctlStart)).join(', ')
+              : ''
+          } in ${rom.scanMs.toFixed(0)}ms`
+        );
+      },
+    });
+    fs.writeFileSync(
+      indexFile,
+      JSON.stringify(
+        {
+          version: INDEX_VERSION,
+          roms: roms.map(({scanMs, ...rom}) => rom),
+        },
+        null,
+        2
+      )
+    );
+    const elapsed = (Date.now() - startTime) / 1000;
+    console.log(
+      `found ${totalBanks} bank file(s) in ${files.length} rom(s), ${(
+        totalBytes /
+        1024 /
+        1024
+      ).toFixed(1)}MB in ${elapsed.toFixed(2)}s (${(
+        totalBytes /
+        1024 /
+        1024 /
+        elapsed
+      ).toFixed(1)}MB/s), index written to ${indexFile}`
+    );
   }
 
-  decompileFromRom(sourceFile).catch((err) => {
-    console.error(err);
-    process.exit(1);
-  });
-} else {
-  const inFilePrefix = sourceFile.replace(/\.\w+$/, '');
-  const ctlBuffer = fs.readFileSync(inFilePrefix + '.ctl');
-  const tblBuffer = fs.readFileSync(inFilePrefix + '.tbl');
-  bankToSource(
-    ctlBuffer,
-    0,
-    tblBuffer,
-    0,
-    args['--out'] || 'tst',
-    args['--gm']
-  );
+  if (args['--scan']) {
+    scanRoms(args._).catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+  } else if (sourceFile.match(/\.(n64|v64|z64)/)) {
+    if (!sourceFile.match(/\.(v64|z64)/)) {
+      console.error('only .z64 and .v64 roms supported');
+      process.exit(1);
+    }
+
+    const startTime = Date.now();
+    decompileFromRom(sourceFile)
+      .then(() => reportUsage(startTime))
+      .catch((err) => {
+        console.error(err);
+        process.exit(1);
+      });
+  } else {
+    const startTime = Date.now();
+    const inFilePrefix = sourceFile.replace(/\.\w+$/, '');
+    const ctlBuffer = fs.readFileSync(inFilePrefix + '.ctl');
+    const tblBuffer = fs.readFileSync(inFilePrefix + '.tbl');
+    bankToSource(
+      ctlBuffer,
+      0,
+      tblBuffer,
+      0,
+      args['--out'] || 'tst',
+      args['--gm'],
+      extractOptions
+    ).then(() => reportUsage(startTime));
+  }
 }
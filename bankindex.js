@@ -0,0 +1,254 @@
+// persistent index of the sound banks found in roms, so listing or extracting
+// part of a bank doesn't need the whole rom to be read, scanned and parsed
+// again.
+//
+// the index directory contains roms.json, which maps each rom path to the
+// mtime, size and sha1 of its contents (in .z64 byte order) when it was last
+// indexed, and a <sha1>.json per rom holding the location of each ctl and tbl
+// found and the parsed ctl: the bank/instrument/sound tree and the offset and
+// length of each wavetable in the tbl. queries against an indexed rom only
+// read the wavetable data they need from the rom file
+
+const fs = require('fs');
+const path = require('path');
+const crypto = require('crypto');
+const {loadRom, getRomName, scanRom} = require('./romscan');
+
+// bump this when the format of rom entries or the parsed ctl changes
+const INDEX_VERSION = 1;
+const ROMS_FILE = 'roms.json';
+
+// buffers in the parsed ctl (codebooks and loop state) are stored as base64
+function bufferReplacer(key, value) {
+  const original = this[key];
+  return Buffer.isBuffer(original)
+    ? {base64: original.toString('base64')}
+    : value;
+}
+
+function bufferReviver(key, value) {
+  return value != null &&
+    typeof value === 'object' &&
+    typeof value.base64 === 'string'
+    ? Buffer.from(value.base64, 'base64')
+    : value;
+}
+
+function hashRom(romBuffer) {
+  return crypto.createHash('sha1').update(romBuffer).digest('hex');
+}
+
+// returns {version, hash, name, size, ctls}, where each of ctls is {ctlStart,
+// ctlEnd, tblStart, bankFile}
+function indexRom(romBuffer, hash = hashRom(romBuffer)) {
+  return {
+    version: INDEX_VERSION,
+    hash,
+    name: getRomName(romBuffer),
+    size: romBuffer.length,
+    ctls: scanRom(romBuffer),
+  };
+}
+
+class BankIndex {
+  constructor(dir) {
+    this.dir = dir;
+    this.roms = {};
+    this.dirty = false;
+    this.stats = {romsRead: 0, romsScanned: 0};
+    fs.mkdirSync(dir, {recursive: true});
+
+    const romsPath = path.join(dir, ROMS_FILE);
+    if (fs.existsSync(romsPath)) {
+      try {
+        const roms = JSON.parse(fs.readFileSync(romsPath, 'utf8'));
+        if (roms.version === INDEX_VERSION) {
+          this.roms = roms.roms;
+        }
+      } catch (err) {
+        // a corrupt file just means roms get hashed again
+      }
+    }
+  }
+
+  entryPath(hash) {
+    return path.join(this.dir, `${hash}.json`);
+  }
+
+  loadEntry(hash) {
+    const entryPath = this.entryPath(hash);
+    if (!fs.existsSync(entryPath)) return null;
+    try {
+      const entry = JSON.parse(
+        fs.readFileSync(entryPath, 'utf8'),
+        bufferReviver
+      );
+      return entry.version === INDEX_VERSION ? entry : null;
+    } catch (err) {
+      return null;
+    }
+  }
+
+  // returns the index entry for a rom (as returned by indexRom), scanning it
+  // if it isn't indexed yet. a rom whose mtime and size are unchanged is
+  // assumed to have the same contents without reading it
+  getRom(file) {
+    const romPath = path.resolve(file);
+    const stat = fs.statSync(romPath);
+    const known = this.roms[romPath];
+    let romBuffer = null;
+    let hash;
+    if (known && known.mtimeMs === stat.mtimeMs && known.size === stat.size) {
+      hash = known.hash;
+    } else {
+      romBuffer = loadRom(romPath);
+      this.stats.romsRead++;
+      hash = hashRom(romBuffer);
+      this.roms[romPath] = {mtimeMs: stat.mtimeMs, size: stat.size, hash};
+      this.dirty = true;
+    }
+
+    const existing = this.loadEntry(hash);
+    if (existing) return existing;
+
+    if (!romBuffer) {
+      romBuffer = loadRom(romPath);
+      this.stats.romsRead++;
+    }
+    this.stats.romsScanned++;
+    const entry = indexRom(romBuffer, hash);
+    const entryPath = this.entryPath(hash);
+    const tmpPath = `${entryPath}.${process.pid}.tmp`;
+    fs.writeFileSync(tmpPath, JSON.stringify(entry, bufferReplacer));
+    fs.renameSync(tmpPath, entryPath);
+    return entry;
+  }
+
+  save() {
+    if (!this.dirty) return;
+    const romsPath = path.join(this.dir, ROMS_FILE);
+    const tmpPath = `${romsPath}.${process.pid}.tmp`;
+    fs.writeFileSync(
+      tmpPath,
+      JSON.stringify({version: INDEX_VERSION, roms: this.roms})
+    );
+    fs.renameSync(tmpPath, romsPath);
+    this.dirty = false;
+  }
+}
+
+// random access reads from a rom file, in .z64 byte order
+class RomReader {
+  constructor(file) {
+    this.fd = fs.openSync(file, 'r');
+    this.byteSwapped = Boolean(file.match(/\.v64$/i));
+  }
+
+  read(offset, length) {
+    // a .v64 can only be swapped back a halfword at a time
+    const start = this.byteSwapped ? offset & ~1 : offset;
+    const end = this.byteSwapped
+      ? (offset + length + 1) & ~1
+      : offset + length;
+    const buffer = Buffer.alloc(end - start);
+    let read = 0;
+    while (read < buffer.length) {
+      const bytesRead = fs.readSync(
+        this.fd,
+        buffer,
+        read,
+        buffer.length - read,
+        start + read
+      );
+      if (bytesRead === 0) {
+        throw new Error(
+          `unexpected end of rom reading ${length} bytes at ${offset}`
+        );
+      }
+      read += bytesRead;
+    }
+    if (this.byteSwapped) buffer.swap16();
+    return buffer.subarray(offset - start, offset - start + length);
+  }
+
+  close() {
+    fs.closeSync(this.fd);
+  }
+}
+
+// returns a copy of a bank file as returned by parseCtl, containing only the
+// given bank (an index into bankArray) and the structs reachable from it.
+// instrument can be a program number or 'percussion' to select only that
+// instrument of the bank
+function selectFromBankFile(bankFile, {bank = null, instrument = null}) {
+  if (instrument != null && bank == null) {
+    throw new Error('an instrument can only be selected within a bank');
+  }
+  const bankOffsets =
+    bank == null ? bankFile.bankArray : [bankFile.bankArray[bank]];
+  if (bankOffsets[0] == null) {
+    throw new Error(`no bank ${bank}, bank file has ${bankFile.bankCount}`);
+  }
+
+  const selected = {
+    ...bankFile,
+    bankCount: bankOffsets.length,
+    bankArray: bankOffsets,
+    banks: {},
+    instruments: {},
+    sounds: {},
+    envelopes: {},
+    keyMaps: {},
+    wavetables: {},
+    books: {},
+    loops: {},
+  };
+
+  function select(type, offset) {
+    if (offset && !selected[type][offset]) {
+      selected[type][offset] = bankFile[type][offset];
+    }
+  }
+
+  bankOffsets.forEach((bankOffset) => {
+    const bankStruct = bankFile.banks[bankOffset];
+    let instArray = bankStruct.instArray;
+    let percussion = bankStruct.percussion;
+    if (instrument === 'percussion') {
+      if (!percussion) throw new Error(`bank ${bank} has no percussion`);
+      instArray = [];
+    } else if (instrument != null) {
+      if (!instArray[instrument]) {
+        throw new Error(`no instrument ${instrument} in bank ${bank}`);
+      }
+      // keep the instrument's program number
+      instArray = [];
+      instArray[instrument] = bankStruct.instArray[instrument];
+      percussion = 0;
+    }
+    selected.banks[bankOffset] = {...bankStruct, instArray, percussion};
+
+    instArray.concat(percussion).forEach((instOffset) => {
+      if (!instOffset) return;
+      select('instruments', instOffset);
+      bankFile.instruments[instOffset].soundArray.forEach((soundOffset) => {
+        select('sounds', soundOffset);
+        const sound = bankFile.sounds[soundOffset];
+        select('envelopes', sound.envelope);
+        select('keyMaps', sound.keyMap);
+        select('wavetables', sound.wavetable);
+        const {waveInfo} = bankFile.wavetables[sound.wavetable];
+        select('loops', waveInfo.loop);
+        select('books', waveInfo.book);
+      });
+    });
+  });
+  return selected;
+}
+
+module.exports = {
+  BankIndex,
+  RomReader,
+  indexRom,
+  selectFromBankFile,
+};
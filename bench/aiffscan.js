@@ -0,0 +1,135 @@
+#!/usr/bin/env node
+
+// benchmarks scanning the metadata (loops and codebooks) of a directory of
+// .aiff/.aifc files, reading and parsing each whole file with AIFF.parse vs
+// reading only the chunk headers and metadata chunks with AIFF.parseFileLazy.
+// with no directory, a synthetic one is generated. as the files are scanned
+// repeatedly, the page cache will be warm after the first pass.
+// eg. node bench/aiffscan.js test/genmidi_samples
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+const arg = require('arg');
+const AIFF = require('../aiff');
+const {
+  encodeVADPCMAIFF,
+  getVADPCMChunks,
+  getAIFFLoop,
+  makeAIFFLoopChunks,
+} = require('../soundtools');
+
+const args = arg({
+  '--files': Number, // number of synthetic files
+  '--sample-size': Number, // size of the sound data of each, in kilobytes
+  '--passes': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`aiffscan bench [--files n] [--sample-size kb] [--passes n] [dir]`);
+  process.exit(0);
+}
+
+// alternating looped .aiff and .aifc files with random sound data
+function writeSyntheticFiles(dir, count, soundDataBytes) {
+  const tone = Buffer.alloc(16 * 1024);
+  for (let i = 0; i < tone.length / 2; i++) {
+    tone.writeInt16BE(Math.round(8000 * Math.sin(i / 10)), i * 2);
+  }
+  const loop = {start: 100, end: tone.length / 2 - 100};
+  const aiffTemplate = {
+    numChannels: 1,
+    sampleSize: 16,
+    sampleRate: 22050,
+    chunks: makeAIFFLoopChunks(loop),
+  };
+  // borrow the codebook and loop chunks of a real encoded sample
+  const aifcTemplate = AIFF.parse(
+    encodeVADPCMAIFF(
+      {...aiffTemplate, formType: 'AIFF', soundData: tone},
+      'tone'
+    ).aifc
+  );
+
+  for (let i = 0; i < count; i++) {
+    const soundData = crypto.randomFillSync(Buffer.alloc(soundDataBytes));
+    const isAIFC = i % 2 === 1;
+    fs.writeFileSync(
+      path.join(dir, `s${i}.${isAIFC ? 'aifc' : 'aiff'}`),
+      AIFF.serialize(
+        isAIFC
+          ? {...aifcTemplate, soundData}
+          : {...aiffTemplate, formType: 'AIFF', soundData}
+      )
+    );
+  }
+}
+
+function scan(files, parse) {
+  let loops = 0;
+  files.forEach((file) => {
+    const aiff = parse(file);
+    const loop =
+      aiff.formType === 'AIFC'
+        ? getVADPCMChunks(aiff, file).loop
+        : getAIFFLoop(aiff);
+    if (loop) loops++;
+  });
+  return loops;
+}
+
+const METHODS = {
+  'AIFF.parse': (file) => AIFF.parse(fs.readFileSync(file)),
+  'AIFF.parseFileLazy': (file) => AIFF.parseFileLazy(file),
+};
+
+function run() {
+  let dir = args._[0];
+  let tmpDir = null;
+  if (!dir) {
+    tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'aiffscan-'));
+    dir = tmpDir;
+    writeSyntheticFiles(
+      dir,
+      args['--files'] || 400,
+      (args['--sample-size'] || 256) * 1024
+    );
+  }
+  try {
+    const files = fs
+      .readdirSync(dir)
+      .filter((entry) => entry.match(/\.(aiff?|aifc)$/i))
+      .sort()
+      .map((entry) => path.join(dir, entry));
+    const totalBytes = files.reduce(
+      (sum, file) => sum + fs.statSync(file).size,
+      0
+    );
+    console.log(
+      `${files.length} files, ${(totalBytes / 1024 / 1024).toFixed(1)}MB`
+    );
+
+    const passes = args['--passes'] || 5;
+    Object.entries(METHODS).forEach(([name, parse]) => {
+      scan(files, parse); // warm up
+      const start = process.hrtime.bigint();
+      let loops = 0;
+      for (let pass = 0; pass < passes; pass++) {
+        loops = scan(files, parse);
+      }
+      const seconds = Number(process.hrtime.bigint() - start) / 1e9 / passes;
+      console.log(
+        `${name}: ${(seconds * 1000).toFixed(1)}ms per scan, ${(
+          files.length / seconds
+        ).toFixed(0)} files/s (${loops} loops found)`
+      );
+    });
+  } finally {
+    if (tmpDir) fs.rmSync(tmpDir, {recursive: true, force: true});
+  }
+}
+
+run();
@@ -0,0 +1,132 @@
+#!/usr/bin/env node
+
+// benchmarks extracting the samples of a large bank, building every .aiff in
+// memory at once and writing them all concurrently (as bankToSource used to)
+// vs bankToSource's bounded pipeline which writes each file's headers and
+// sound data without concatenating them. each method runs in its own process
+// so their peak rss can be compared. uses the given .ctl/.tbl, otherwise a
+// synthetic bank.
+// eg. node bench/bankextract.js --concurrency 16 test/genmidi.ctl
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const {execFileSync} = require('child_process');
+const arg = require('arg');
+const AIFF = require('../aiff');
+const {bankToSource, parseCtl} = require('../soundtools');
+const {writeSyntheticCompiledBank} = require('./fixtures');
+
+const args = arg({
+  '--sounds': Number, // number of synthetic samples
+  '--sample-size': Number, // size of each synthetic sample, in kilobytes
+  '--concurrency': Number,
+  '--decode': Boolean,
+  '--method': String, // internal: run one method in this process
+  '--out': String, // internal: where the method should write to
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `bankextract bench [--sounds n] [--sample-size kb] [--concurrency n] [--decode] [ctl file]`
+  );
+  process.exit(0);
+}
+
+// writes just the samples, as the old Promise.all over every wavetable did
+function extractAllAtOnce(ctl, tbl, outDir) {
+  const bankFile = parseCtl(ctl, 0);
+  fs.mkdirSync(outDir, {recursive: true});
+  return Promise.all(
+    Object.values(bankFile.wavetables).map((wavetable) =>
+      fs.promises.writeFile(
+        path.join(outDir, `${wavetable.base}.aifc`),
+        AIFF.serialize({
+          soundData: tbl.slice(wavetable.base, wavetable.base + wavetable.len),
+          numChannels: 1,
+          sampleSize: 16,
+          sampleRate: 22050,
+          formType: 'AIFC',
+          compressionType: 'VAPC',
+          compressionName: 'VADPCM ~4-1',
+          chunks: [],
+        })
+      )
+    )
+  );
+}
+
+const METHODS = {
+  'all at once': (ctl, tbl, outDir) => extractAllAtOnce(ctl, tbl, outDir),
+  pipeline: (ctl, tbl, outDir) =>
+    bankToSource(ctl, 0, tbl, 0, path.join(outDir, 'bench'), false, {
+      concurrency: args['--concurrency'],
+      decodePCM: args['--decode'],
+    }),
+};
+
+async function runMethod(method, ctlPath, outDir) {
+  const start = process.hrtime.bigint();
+  const ctl = fs.readFileSync(ctlPath);
+  const tbl = fs.readFileSync(ctlPath.replace(/\.ctl$/, '.tbl'));
+  await METHODS[method](ctl, tbl, outDir);
+  console.log(
+    JSON.stringify({
+      ms: Number(process.hrtime.bigint() - start) / 1e6,
+      maxRSS: process.resourceUsage().maxRSS * 1024,
+    })
+  );
+}
+
+function run() {
+  const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'bankextract-'));
+  try {
+    let ctlPath = args._[0];
+    if (!ctlPath) {
+      ctlPath = path.join(tmpDir, 'bench.ctl');
+      writeSyntheticCompiledBank(
+        ctlPath.replace(/\.ctl$/, ''),
+        args['--sounds'] || 1000,
+        (args['--sample-size'] || 256) * 1024
+      );
+    }
+    const tblSize = fs.statSync(ctlPath.replace(/\.ctl$/, '.tbl')).size;
+    console.log(`tbl: ${(tblSize / 1024 / 1024).toFixed(1)}MB`);
+
+    Object.keys(METHODS).forEach((method, i) => {
+      const outDir = path.join(tmpDir, `out${i}`);
+      const {ms, maxRSS} = JSON.parse(
+        execFileSync(process.execPath, [
+          __filename,
+          ...process.argv.slice(2).filter((a) => a !== ctlPath),
+          '--method',
+          method,
+          '--out',
+          outDir,
+          ctlPath,
+        ]).toString()
+      );
+      fs.rmSync(outDir, {recursive: true, force: true});
+      console.log(
+        `${method}: ${ms.toFixed(0)}ms, peak rss ${(
+          maxRSS /
+          1024 /
+          1024
+        ).toFixed(0)}MB`
+      );
+    });
+  } finally {
+    fs.rmSync(tmpDir, {recursive: true, force: true});
+  }
+}
+
+if (args['--method']) {
+  runMethod(args['--method'], args._[0], args['--out']).catch((err) => {
+    console.error(err);
+    process.exit(1);
+  });
+} else {
+  run();
+}
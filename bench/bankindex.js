@@ -0,0 +1,145 @@
+#!/usr/bin/env node
+
+// benchmarks answering queries about the banks in a rom by scanning the rom
+// and decompiling everything (as bankdec does without --cache) vs from a
+// BankIndex, which only reads the wavetables it needs. uses the given rom,
+// otherwise a synthetic one containing a large bank.
+// eg. node bench/bankindex.js --bank 0 --instrument 5 rom.z64
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+const arg = require('arg');
+const {bankToSource, bankFileToSource} = require('../soundtools');
+const {loadRom, scanRom} = require('../romscan');
+const {BankIndex, RomReader, selectFromBankFile} = require('../bankindex');
+const {writeSyntheticCompiledBank} = require('./fixtures');
+
+const args = arg({
+  '--instruments': Number, // size of the synthetic bank
+  '--sample-size': Number, // size of each synthetic sample, in kilobytes
+  '--bank': Number, // bank to extract from
+  '--instrument': Number, // instrument to extract
+  '--passes': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `bankindex bench [--instruments n] [--sample-size kb] [--bank n] [--instrument n] [--passes n] [rom]`
+  );
+  process.exit(0);
+}
+
+// a rom of random data with a bank of one sample per instrument in the middle
+function writeSyntheticRom(romPath, instrumentCount, sampleBytes) {
+  const prefix = romPath.replace(/\.z64$/, '');
+  writeSyntheticCompiledBank(prefix, instrumentCount, sampleBytes);
+  const ctl = fs.readFileSync(prefix + '.ctl');
+  const tbl = fs.readFileSync(prefix + '.tbl');
+  const romBuffer = crypto.randomFillSync(
+    Buffer.alloc(Math.max(32 * 1024 * 1024, (ctl.length + tbl.length) * 2))
+  );
+  const ctlStart = romBuffer.length / 4;
+  ctl.copy(romBuffer, ctlStart);
+  tbl.copy(romBuffer, ctlStart + ctl.length);
+  fs.writeFileSync(romPath, romBuffer);
+}
+
+async function time(passes, fn) {
+  await fn(); // warm up
+  const start = process.hrtime.bigint();
+  for (let pass = 0; pass < passes; pass++) await fn();
+  return Number(process.hrtime.bigint() - start) / 1e6 / passes;
+}
+
+async function run() {
+  const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'bankindex-'));
+  try {
+    let romPath = args._[0];
+    if (!romPath) {
+      romPath = path.join(tmpDir, 'bench.z64');
+      writeSyntheticRom(
+        romPath,
+        args['--instruments'] || 128,
+        (args['--sample-size'] || 128) * 1024
+      );
+    }
+    const query = {
+      bank: args['--bank'] || 0,
+      instrument: args['--instrument'] || 0,
+    };
+    const indexDir = path.join(tmpDir, 'index');
+    const outDir = path.join(tmpDir, 'out');
+    const passes = args['--passes'] || 5;
+
+    const fullMs = await time(passes, async () => {
+      const romBuffer = loadRom(romPath);
+      for (const {ctlStart, tblStart} of scanRom(romBuffer)) {
+        await bankToSource(
+          romBuffer,
+          ctlStart,
+          romBuffer,
+          tblStart,
+          path.join(outDir, `full_${ctlStart}`)
+        );
+      }
+    });
+
+    const buildStart = process.hrtime.bigint();
+    const index = new BankIndex(indexDir);
+    index.getRom(romPath);
+    index.save();
+    const buildMs = Number(process.hrtime.bigint() - buildStart) / 1e6;
+
+    let ctlCount = 0;
+    const listMs = await time(passes, () => {
+      ctlCount = new BankIndex(indexDir).getRom(romPath).ctls.length;
+    });
+
+    const extractMs = await time(passes, async () => {
+      const rom = new BankIndex(indexDir).getRom(romPath);
+      const reader = new RomReader(romPath);
+      try {
+        const {ctlStart, tblStart, bankFile} = rom.ctls[0];
+        await bankFileToSource(
+          selectFromBankFile(bankFile, query),
+          (wavetable) =>
+            reader.read(tblStart + wavetable.base, wavetable.len),
+          path.join(outDir, `query_${ctlStart}`)
+        );
+      } finally {
+        reader.close();
+      }
+    });
+
+    console.log(
+      `${(fs.statSync(romPath).size / 1024 / 1024).toFixed(
+        1
+      )}MB rom, ${ctlCount} ctl(s)`
+    );
+    console.log(`scan + full decompile: ${fullMs.toFixed(1)}ms`);
+    console.log(`index build (first query): ${buildMs.toFixed(1)}ms`);
+    console.log(
+      `indexed list: ${listMs.toFixed(1)}ms (${(fullMs / listMs).toFixed(
+        0
+      )}x faster)`
+    );
+    console.log(
+      `indexed extract of bank ${query.bank} instrument ${
+        query.instrument
+      }: ${extractMs.toFixed(1)}ms (${(fullMs / extractMs).toFixed(
+        0
+      )}x faster)`
+    );
+  } finally {
+    fs.rmSync(tmpDir, {recursive: true, force: true});
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
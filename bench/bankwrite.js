@@ -0,0 +1,130 @@
+#!/usr/bin/env node
+
+// benchmarks writing a large bank: building each file in memory with
+// FileTable.build() and fs.writeFileSync (holding every sample at once), vs
+// FileTable.writeFile streaming the chunks with vectored writes (reloading
+// each sample as it's written). each method runs in its own process so peak
+// memory (max rss) can be compared.
+// eg. node bench/bankwrite.js --megabytes 400
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+const util = require('util');
+const execFile = util.promisify(require('child_process').execFile);
+const arg = require('arg');
+const {writeSyntheticBank} = require('./fixtures');
+
+const args = arg({
+  '--megabytes': Number, // total size of the synthetic sample data
+  '--sample-size': Number, // size of each synthetic sample in kilobytes
+  '--method': String, // internal: run one method in this process
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`bankwrite bench [--megabytes n] [--sample-size kb]`);
+  process.exit(0);
+}
+
+const METHODS = ['build', 'stream'];
+
+// runs in a child process
+function runMethod(method, instFile, outPrefix) {
+  const {parseWithNiceErrors} = require('../instparserapi');
+  const {
+    sourceToBank,
+    extractSampleData,
+    loadAIFFData,
+  } = require('../soundtools');
+
+  const parsed = parseWithNiceErrors(
+    fs.readFileSync(instFile, 'utf8'),
+    instFile
+  );
+  const start = process.hrtime.bigint();
+  if (method === 'build') {
+    // the sound data stays referenced by the tbl until it's written
+    const bank = sourceToBank(parsed, instFile, {
+      loadSample: (file) => extractSampleData(loadAIFFData(file), file),
+    });
+    // writeBankFile streams, so substitute the old way of writing the tables
+    bank.ctl.writeFile = (file) => fs.writeFileSync(file, bank.ctl.build());
+    bank.tbl.writeFile = (file) => fs.writeFileSync(file, bank.tbl.build());
+    bank.writeBankFile(outPrefix);
+  } else {
+    sourceToBank(parsed, instFile).writeBankFile(outPrefix);
+  }
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+  console.log(
+    JSON.stringify({
+      seconds,
+      bytes: fs.statSync(outPrefix + '.tbl').size,
+      maxRSS: process.resourceUsage().maxRSS * 1024,
+    })
+  );
+}
+
+async function run() {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'bankwrite-'));
+  try {
+    const totalBytes = (args['--megabytes'] || 300) * 1024 * 1024;
+    const sampleBytes = (args['--sample-size'] || 1024) * 1024;
+    // random sample data (so nothing is deduped), odd lengths so most chunks
+    // need padding
+    const instFile = writeSyntheticBank(
+      dir,
+      Math.ceil(totalBytes / sampleBytes),
+      (s) => crypto.randomFillSync(Buffer.alloc(sampleBytes + s * 2))
+    );
+    console.log(
+      `${Math.ceil(totalBytes / sampleBytes)} samples of ${
+        sampleBytes / 1024
+      }KB+, ${(totalBytes / 1024 / 1024).toFixed(0)}MB total`
+    );
+
+    const outputs = [];
+    for (const method of METHODS) {
+      const outPrefix = path.join(dir, method);
+      const {stdout} = await execFile(process.execPath, [
+        __filename,
+        '--method',
+        method,
+        '--',
+        instFile,
+        outPrefix,
+      ]);
+      const {seconds, bytes, maxRSS} = JSON.parse(stdout);
+      console.log(
+        `${method}: ${seconds.toFixed(3)}s, ${(bytes / seconds / 1e6).toFixed(
+          0
+        )}MB/s, max rss ${(maxRSS / 1024 / 1024).toFixed(0)}MB`
+      );
+      outputs.push(outPrefix);
+    }
+
+    const [reference, ...others] = outputs;
+    others.forEach((outPrefix) => {
+      ['.ctl', '.tbl'].forEach((ext) => {
+        const expected = fs.readFileSync(reference + ext);
+        if (!expected.equals(fs.readFileSync(outPrefix + ext))) {
+          throw new Error(`${outPrefix}${ext} differs from ${reference}${ext}`);
+        }
+      });
+    });
+    console.log('outputs match');
+  } finally {
+    fs.rmSync(dir, {recursive: true, force: true});
+  }
+}
+
+if (args['--method']) {
+  runMethod(args['--method'], args._[0], args._[1]);
+} else {
+  run().catch((err) => {
+    console.error(err);
+    process.exit(1);
+  });
+}
@@ -0,0 +1,200 @@
+#!/usr/bin/env node
+
+// benchmarks building a synthetic project (midicvt for each midi file, sbc of
+// the .seq files, then ic of a bank of uncompressed samples) by running each
+// tool in a new node process, through buildc to a running buildd, and by
+// sending buildd the requests directly (the cost of buildd without buildc's
+// own startup). each is timed for a cold build, a warm rebuild and a rebuild
+// after touching one midi file and one sample.
+// eg. node bench/buildd.js --songs 20 --samples 100
+
+const fs = require('fs');
+const os = require('os');
+const net = require('net');
+const path = require('path');
+const util = require('util');
+const childProcess = require('child_process');
+const execFile = util.promisify(childProcess.execFile);
+const arg = require('arg');
+const {writeMidi} = require('midi-file');
+const {SAMPLE_RATE, makeToneData, writeSyntheticBank} = require('./fixtures');
+const {sendMessage, receiveMessages} = require('../buildprotocol');
+
+const args = arg({
+  '--songs': Number, // number of synthetic midi files
+  '--samples': Number, // number of synthetic samples
+  '--keep': Boolean, // don't delete the temp dir
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`buildd bench [--songs n] [--samples n] [--keep]`);
+  process.exit(0);
+}
+
+const TOOL_DIR = path.join(__dirname, '..');
+
+// a few tracks of notes per song, different for every song
+function writeSyntheticMidi(file, song) {
+  const tracks = [];
+  for (let t = 0; t < 4; t++) {
+    const track = [];
+    for (let i = 0; i < 500; i++) {
+      const noteNumber = 36 + ((song * 7 + t * 5 + i * 3) % 48);
+      track.push(
+        {deltaTime: 0, channel: t, type: 'noteOn', noteNumber, velocity: 100},
+        {deltaTime: 120, channel: t, type: 'noteOff', noteNumber, velocity: 0}
+      );
+    }
+    track.push({deltaTime: 0, meta: true, type: 'endOfTrack'});
+    tracks.push(track);
+  }
+  fs.writeFileSync(
+    file,
+    Buffer.from(
+      writeMidi({
+        header: {format: 1, numTracks: tracks.length, ticksPerBeat: 480},
+        tracks,
+      })
+    )
+  );
+}
+
+// the tool runs making up one build, in order
+function getSteps(songCount) {
+  const steps = [];
+  const seqFiles = [];
+  for (let i = 0; i < songCount; i++) {
+    steps.push(['midicvt', ['-o', `song${i}.seq`, `song${i}.mid`]]);
+    seqFiles.push(`song${i}.seq`);
+  }
+  steps.push(['sbc', ['-o', 'songs.sbk', ...seqFiles]]);
+  steps.push(['ic', ['-o', 'bank', 'bench.inst']]);
+  return steps;
+}
+
+function requestBuildd(socketPath, message) {
+  return new Promise((resolve, reject) => {
+    const socket = net.connect(socketPath);
+    let exitCode = 1;
+    socket.on('connect', () => sendMessage(socket, message));
+    socket.on('error', reject);
+    socket.on('close', () => resolve(exitCode));
+    receiveMessages(socket, (response) => {
+      if (response.exitCode != null) exitCode = response.exitCode;
+    });
+  });
+}
+
+function startBuildd(dir, socketPath) {
+  return new Promise((resolve, reject) => {
+    const buildd = childProcess.spawn(
+      process.execPath,
+      [path.join(TOOL_DIR, 'buildd.js'), '--quiet', '--socket', socketPath],
+      {cwd: dir, stdio: ['ignore', 'pipe', 'inherit']}
+    );
+    buildd.on('error', reject);
+    buildd.stdout.once('data', () => resolve(buildd));
+  });
+}
+
+async function timeBuilds(label, dir, runStep) {
+  const build = async () => {
+    const start = process.hrtime.bigint();
+    for (const [tool, argv] of getSteps(args['--songs'] || 20)) {
+      await runStep(tool, argv);
+    }
+    return Number(process.hrtime.bigint() - start) / 1e9;
+  };
+  const cold = await build();
+  const warm = await build();
+  const now = new Date();
+  fs.utimesSync(path.join(dir, 'song0.mid'), now, now);
+  fs.utimesSync(path.join(dir, 's0.aif'), now, now);
+  // give the watchers a moment to see the change
+  await new Promise((resolve) => setTimeout(resolve, 100));
+  const touched = await build();
+  console.log(
+    `${label}: cold ${cold.toFixed(3)}s, warm ${warm.toFixed(
+      3
+    )}s, after touching ${touched.toFixed(3)}s`
+  );
+  return warm;
+}
+
+async function run() {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'buildd-'));
+  const socketPath = path.join(dir, 'buildd.sock');
+  let buildd = null;
+  try {
+    for (let i = 0; i < (args['--songs'] || 20); i++) {
+      writeSyntheticMidi(path.join(dir, `song${i}.mid`), i);
+    }
+    writeSyntheticBank(dir, args['--samples'] || 100, (s) =>
+      makeToneData(s, SAMPLE_RATE / 2)
+    );
+
+    const checkExit = (tool, exitCode) => {
+      if (exitCode !== 0) throw new Error(`${tool} failed (${exitCode})`);
+    };
+
+    const separate = await timeBuilds(
+      'node per step',
+      dir,
+      async (tool, argv) => {
+        await execFile(
+          process.execPath,
+          [path.join(TOOL_DIR, `${tool}.js`), ...argv],
+          {cwd: dir, maxBuffer: 64 * 1024 * 1024}
+        );
+      }
+    );
+    const reference = fs.readFileSync(path.join(dir, 'songs.sbk'));
+
+    buildd = await startBuildd(dir, socketPath);
+    const client = await timeBuilds(
+      'buildc per step',
+      dir,
+      async (tool, argv) => {
+        await execFile(
+          process.execPath,
+          [path.join(TOOL_DIR, 'buildc.js'), '--socket', socketPath, tool]
+            .concat(argv),
+          {cwd: dir, maxBuffer: 64 * 1024 * 1024}
+        );
+      }
+    );
+    const direct = await timeBuilds(
+      'direct requests',
+      dir,
+      async (tool, argv) => {
+        checkExit(
+          tool,
+          await requestBuildd(socketPath, {tool, argv, cwd: dir})
+        );
+      }
+    );
+    if (!reference.equals(fs.readFileSync(path.join(dir, 'songs.sbk')))) {
+      throw new Error('buildd output differs from separate runs');
+    }
+
+    console.log(
+      `warm build through buildc is ${(separate / client).toFixed(
+        1
+      )}x faster, direct requests ${(separate / direct).toFixed(1)}x faster`
+    );
+  } finally {
+    if (buildd) buildd.kill();
+    if (args['--keep']) {
+      console.log(`output in ${dir}`);
+    } else {
+      fs.rmSync(dir, {recursive: true, force: true});
+    }
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
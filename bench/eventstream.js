@@ -0,0 +1,185 @@
+#!/usr/bin/env node
+
+// compares opening a midi file in n64daw's Player as it was (rendering an
+// object and Buffer per event, then sorting them all) with rendering an
+// EventStream from merged per-track runs, and with loading the EventStream
+// from an EventStreamCache. reports the median time of each and the memory
+// the rendered events keep alive, for a synthetic song (as @tonejs/midi's
+// toJSON() gives it) of about 100k events. a cache hit also skips parsing the
+// file with @tonejs/midi, which isn't measured here.
+// eg. node bench/eventstream.js --events 100000
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const v8 = require('v8');
+const vm = require('vm');
+const arg = require('arg');
+const {midiCCs} = require('../n64daw/src/midicc');
+const renderMidiStream = require('../n64daw/src/renderMidiStream');
+const EventStreamCache = require('../n64daw/eventstreamcache');
+const {makeSyntheticSong} = require('./fixtures');
+
+v8.setFlagsFromString('--expose-gc');
+const gc = vm.runInNewContext('gc');
+
+const args = arg({
+  '--events': Number, // approximate events in the synthetic song
+  '--runs': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`eventstream bench [--events n] [--runs n]`);
+  process.exit(0);
+}
+
+// renderMidiStream as it was before EventStream. the song's ccs are all ones
+// it keeps, so the allowed list is left out
+function renderLegacy(midi) {
+  const events = [];
+  midi.tracks.forEach((track) => {
+    events.push({
+      time: Math.floor(Math.random() * 1000),
+      type: 'programChange',
+      program: track.instrument.number,
+      data: Buffer.from([0xc0 | track.channel, track.instrument.number | 0]),
+    });
+    track.notes.forEach((noteEvent) => {
+      events.push({
+        time: 1000 * noteEvent.time,
+        type: 'noteOn',
+        noteEvent,
+        velocity: (noteEvent.velocity * 0x7f) | 0,
+        data: Buffer.from([
+          0x90 | track.channel,
+          noteEvent.midi,
+          (noteEvent.velocity * 0x7f) | 0,
+        ]),
+      });
+      events.push({
+        time: 1000 * (noteEvent.time + noteEvent.duration),
+        type: 'noteOff',
+        noteEvent,
+        velocity: (noteEvent.noteOffVelocity * 0x7f) | 0,
+        data: Buffer.from([
+          0x80 | track.channel,
+          noteEvent.midi,
+          (noteEvent.noteOffVelocity * 0x7f) | 0,
+        ]),
+      });
+    });
+    Object.values(track.controlChanges).forEach((ccEventArray) => {
+      ccEventArray.forEach((ccEvent) => {
+        events.push({
+          time: 1000 * (isNaN(ccEvent.time) ? 0 : ccEvent.time),
+          type: 'controlChange',
+          ccNumber: ccEvent.number,
+          ccType: midiCCs[ccEvent.number],
+          ccEvent,
+          ccValue: (ccEvent.value * 0x7f) | 0,
+          data: Buffer.from([
+            0xb0 | track.channel,
+            ccEvent.number,
+            (ccEvent.value * 0x7f) | 0,
+          ]),
+        });
+      });
+    });
+  });
+  const sortOrder = {
+    controlChange: 0,
+    noteOff: 1,
+    noteOn: 2,
+  };
+  events.sort((a, b) => {
+    if (a.time === b.time) {
+      return sortOrder[a.type] - sortOrder[b.type];
+    }
+    return a.time - b.time;
+  });
+  return events;
+}
+
+function getUsedMemory() {
+  gc();
+  const {heapUsed, arrayBuffers} = process.memoryUsage();
+  return heapUsed + arrayBuffers;
+}
+
+// median ms per call of fn, and the memory kept alive by what it returns
+function measure(runs, fn) {
+  fn(); // warm up
+  const times = [];
+  for (let i = 0; i < runs; i++) {
+    gc();
+    const start = process.hrtime.bigint();
+    fn();
+    times.push(Number(process.hrtime.bigint() - start) / 1e6);
+  }
+  times.sort((a, b) => a - b);
+
+  const before = getUsedMemory();
+  const result = fn();
+  const retained = getUsedMemory() - before;
+  return {ms: times[times.length >> 1], retained, result};
+}
+
+function run() {
+  const eventCount = args['--events'] || 100000;
+  const runs = args['--runs'] || 10;
+  // each note is 2 events, and there are a few volume and modulation changes
+  const song = makeSyntheticSong(Math.round(eventCount / 2), {
+    maxNoteLength: 8,
+    controllers: [1, 7],
+    tempos: [{ticks: 0, bpm: 120}],
+  });
+  // stands in for the .mid file's contents, which the cache key hashes
+  const midiData = Buffer.from(JSON.stringify(song));
+  const options = {channelFilter: null, generalMIDI: false};
+
+  const cacheDir = fs.mkdtempSync(path.join(os.tmpdir(), 'eventstream-'));
+  try {
+    const cache = new EventStreamCache(cacheDir);
+    const rendered = renderMidiStream(song, null, false);
+    cache.set(cache.getKey(midiData, options), song.header, rendered);
+
+    const results = {
+      'object per event (as before)': measure(runs, () => renderLegacy(song)),
+      'EventStream render': measure(runs, () =>
+        renderMidiStream(song, null, false)
+      ),
+      'EventStream from cache': measure(runs, () =>
+        cache.get(cache.getKey(midiData, options))
+      ),
+    };
+
+    const legacy = results['object per event (as before)'].result;
+    if (legacy.length !== rendered.length) {
+      throw new Error(`${legacy.length} events before, ${rendered.length} now`);
+    }
+    const cached = results['EventStream from cache'].result.events;
+    for (let i = 0; i < rendered.length; i++) {
+      if (
+        rendered.time[i] !== cached.time[i] ||
+        rendered.getMessage(i).join() !== cached.getMessage(i).join()
+      ) {
+        throw new Error(`cached event ${i} differs`);
+      }
+    }
+
+    console.log(`${rendered.length} events`);
+    for (const [name, {ms, retained}] of Object.entries(results)) {
+      console.log(
+        `${name}: ${ms.toFixed(2)}ms, ${(retained / 1024 / 1024).toFixed(
+          2
+        )}MB retained`
+      );
+    }
+  } finally {
+    fs.rmSync(cacheDir, {recursive: true, force: true});
+  }
+}
+
+run();
@@ -0,0 +1,228 @@
+// synthetic inputs shared by the benchmarks
+
+const fs = require('fs');
+const path = require('path');
+const crypto = require('crypto');
+const AIFF = require('../aiff');
+
+const SAMPLE_RATE = 22050;
+
+// returns random(n), an integer in [0, n). xorshift, seeded so runs compare
+// and anything generated from a seed can be generated again
+function makeRandom(seed) {
+  let state = (seed * 2654435761) >>> 0 || 1;
+  return (n) => {
+    state ^= state << 13;
+    state >>>= 0;
+    state ^= state >>> 17;
+    state ^= state << 5;
+    state >>>= 0;
+    return state % n;
+  };
+}
+
+// length 16 bit big endian samples of a decaying pair of tones, a bit
+// different for each index
+function makeToneData(index, length) {
+  const soundData = Buffer.alloc(length * 2);
+  const freq = 55 * Math.pow(2, (index % 60) / 12);
+  for (let i = 0; i < length; i++) {
+    const t = i / SAMPLE_RATE;
+    const value =
+      8000 * Math.sin(2 * Math.PI * freq * t) * Math.exp(-t * 2) +
+      3000 * Math.sin(2 * Math.PI * freq * 3.01 * t + index);
+    soundData.writeInt16BE(Math.round(value), i * 2);
+  }
+  return soundData;
+}
+
+// .inst source for instrumentCount instruments of soundsPerInstrument sounds,
+// in banks of 128. the sounds share sharedDefs envelopes and keymaps, or with
+// sharedDefs 0 each has its own (so nothing is deduped). getSampleFile(s) is
+// the file sound s uses
+function makeSyntheticInst(
+  instrumentCount,
+  {
+    soundsPerInstrument = 1,
+    sharedDefs = 1,
+    getSampleFile = (s) => `./s${s}.aif`,
+  } = {}
+) {
+  const defCount = sharedDefs || instrumentCount * soundsPerInstrument;
+  let inst = '';
+  for (let d = 0; d < defCount; d++) {
+    const keyMin = (d % 8) * 16;
+    inst += `envelope env${d} {
+  attackTime = ${d * 1000};
+  attackVolume = 127;
+  decayTime = ${500000 + d * 10000};
+  decayVolume = ${100 - (d % 32)};
+  releaseTime = 200000;
+}
+
+keymap km${d} {
+  velocityMin = 0;
+  velocityMax = 127;
+  keyMin = ${keyMin};
+  keyMax = ${keyMin + 15};
+  keyBase = ${keyMin + 8};
+  detune = ${d % 100};
+}
+
+`;
+  }
+  for (let i = 0; i < instrumentCount; i++) {
+    const sounds = [];
+    for (let j = 0; j < soundsPerInstrument; j++) {
+      const s = i * soundsPerInstrument + j;
+      inst += `sound snd${s} {
+  use("${getSampleFile(s)}");
+  pan = ${(s * 7) % 128};
+  volume = 127;
+  envelope = env${s % defCount};
+  keymap = km${(sharedDefs ? j : s) % defCount};
+}
+
+`;
+      sounds.push(`  sound = snd${s};\n`);
+    }
+    inst += `instrument inst${i} {
+  volume = 127;
+  pan = 64;
+  priority = 5;
+  bendRange = 200;
+${sounds.join('')}}
+
+`;
+  }
+  return `${inst}${Array.from(
+    {length: Math.ceil(instrumentCount / 128)},
+    (_, b) => `bank B${b} {
+  sampleRate = ${SAMPLE_RATE};
+${Array.from(
+  {length: Math.min(128, instrumentCount - b * 128)},
+  (_, i) => `  instrument [${i}] = inst${b * 128 + i};\n`
+).join('')}}
+`
+  ).join('\n')}`;
+}
+
+// a mono 16 bit AIFF of makeToneData(index, length), looping over its second
+// half with loop
+function makeToneAIFF(index, length, {loop = false} = {}) {
+  const {makeAIFFLoopChunks} = require('../soundtools');
+  return {
+    soundData: makeToneData(index, length),
+    numChannels: 1,
+    sampleRate: SAMPLE_RATE,
+    sampleSize: 16,
+    chunks: loop
+      ? makeAIFFLoopChunks({start: Math.floor(length / 2), end: length - 1})
+      : [],
+  };
+}
+
+// writes count sounds to dir as s<n>.aif, with makeSoundData(s) giving the
+// samples of each, and dir/bench.inst using them. returns the .inst file
+function writeSyntheticBank(dir, count, makeSoundData) {
+  for (let s = 0; s < count; s++) {
+    fs.writeFileSync(
+      path.join(dir, `s${s}.aif`),
+      AIFF.serialize({
+        soundData: makeSoundData(s),
+        numChannels: 1,
+        sampleRate: SAMPLE_RATE,
+        sampleSize: 16,
+        chunks: [],
+      })
+    );
+  }
+  const instFile = path.join(dir, 'bench.inst');
+  fs.writeFileSync(instFile, makeSyntheticInst(count));
+  return instFile;
+}
+
+// compiles makeSyntheticInst(instrumentCount, instOptions) to a bank, with
+// loadSample(file) giving the sample data of each file it uses (see
+// sourceToBank). the sample files are named s<n>.aifc
+function compileSyntheticBank(instrumentCount, loadSample, instOptions = {}) {
+  const {parseWithNiceErrors} = require('../instparserapi');
+  const {sourceToBank} = require('../soundtools');
+  const inst = makeSyntheticInst(instrumentCount, {
+    getSampleFile: (s) => `./s${s}.aifc`,
+    ...instOptions,
+  });
+  const defs = parseWithNiceErrors(inst, 'bench.inst');
+  return sourceToBank(defs, 'bench.inst', {loadSample});
+}
+
+// writes a bank of count instruments as prefix.ctl/.tbl, each sound using a
+// sampleBytes VADPCM wavetable of random data (rounded down to whole frames)
+function writeSyntheticCompiledBank(prefix, count, sampleBytes) {
+  const {AL_ADPCM_WAVE} = require('../soundtools');
+  compileSyntheticBank(count, () => ({
+    type: AL_ADPCM_WAVE,
+    soundData: crypto.randomFillSync(
+      Buffer.alloc(sampleBytes - (sampleBytes % 9))
+    ),
+    book: {order: 2, npredictors: 1, book: Buffer.alloc(2 * 8 * 2)},
+    loop: null,
+  })).writeBankFile(prefix);
+}
+
+// a song of noteCount notes as @tonejs/midi's toJSON() gives it: on each 16th
+// note at 120bpm, chords of up to maxChordSize notes (each up to maxNoteLength
+// 16ths long) on about half of the 16 channels, with a change to one of
+// controllers (cc numbers) after about 1 in 8 chords
+function makeSyntheticSong(
+  noteCount,
+  {maxChordSize = 4, maxNoteLength = 4, controllers = [], tempos = []} = {}
+) {
+  const random = makeRandom(1);
+  const tracks = Array.from({length: 16}, (_, channel) => ({
+    channel,
+    instrument: {number: channel},
+    notes: [],
+    // keyed as @tonejs/midi does, by cc number
+    controlChanges: Object.fromEntries(
+      controllers.map((number) => [number, []])
+    ),
+  }));
+  let notes = 0;
+  for (let time = 0; notes < noteCount; time += 0.125) {
+    for (const track of tracks) {
+      if (random(2)) continue;
+      const chordSize = 1 + random(maxChordSize);
+      for (let i = 0; i < chordSize && notes < noteCount; i++, notes++) {
+        track.notes.push({
+          time,
+          duration: 0.125 * (1 + random(maxNoteLength)),
+          midi: 36 + random(60),
+          velocity: (1 + random(127)) / 127,
+          noteOffVelocity: 0,
+        });
+      }
+      if (controllers.length && !random(8)) {
+        const number = controllers[random(controllers.length)];
+        track.controlChanges[number].push({
+          time,
+          number,
+          value: random(128) / 127,
+        });
+      }
+    }
+  }
+  return {header: {ppq: 480, tempos}, tracks};
+}
+
+module.exports = {
+  SAMPLE_RATE,
+  makeRandom,
+  makeToneData,
+  makeSyntheticInst,
+  makeToneAIFF,
+  writeSyntheticBank,
+  compileSyntheticBank,
+  writeSyntheticCompiledBank,
+  makeSyntheticSong,
+};
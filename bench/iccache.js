@@ -0,0 +1,99 @@
+#!/usr/bin/env node
+
+// benchmarks ic builds with and without the sample cache: a cold build into an
+// empty cache, a warm rebuild, a rebuild after editing an envelope in the
+// .inst, and a rebuild after touching one sample. uses a synthetic bank of
+// uncompressed samples unless a .inst file is given.
+// eg. node bench/iccache.js --samples 400 --compress
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const util = require('util');
+const execFile = util.promisify(require('child_process').execFile);
+const arg = require('arg');
+const {SAMPLE_RATE, makeToneData, writeSyntheticBank} = require('./fixtures');
+
+const args = arg({
+  '--samples': Number, // number of synthetic samples
+  '--seconds': Number, // length of each synthetic sample
+  '--compress': Boolean, // pass --compress to ic
+  '--keep': Boolean, // don't delete the temp dir
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `iccache bench [--samples n] [--seconds s] [--compress] [--keep] [inst file]`
+  );
+  process.exit(0);
+}
+
+async function build(label, instFile, outPrefix, extraArgs) {
+  const start = process.hrtime.bigint();
+  const {stdout} = await execFile(
+    process.execPath,
+    [
+      path.join(__dirname, '../ic.js'),
+      ...(args['--compress'] ? ['--compress'] : []),
+      ...extraArgs,
+      '-o',
+      outPrefix,
+      instFile,
+    ],
+    {maxBuffer: 64 * 1024 * 1024}
+  );
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+  const summary = stdout.trim().split('\n').pop();
+  console.log(`${label}: ${seconds.toFixed(3)}s (${summary})`);
+  return seconds;
+}
+
+async function run() {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'iccache-'));
+  try {
+    const length = Math.round(SAMPLE_RATE * (args['--seconds'] || 1));
+    const instFile = args._[0]
+      ? path.resolve(args._[0])
+      : writeSyntheticBank(dir, args['--samples'] || 400, (s) =>
+          makeToneData(s, length)
+        );
+    const outPrefix = path.join(dir, 'out');
+    const cacheArgs = ['--cache', path.join(dir, 'cache')];
+
+    await build('no cache', instFile, outPrefix, []);
+    const reference = fs.readFileSync(outPrefix + '.ctl');
+    const cold = await build('cold cache', instFile, outPrefix, cacheArgs);
+    const warm = await build('warm cache', instFile, outPrefix, cacheArgs);
+    if (!reference.equals(fs.readFileSync(outPrefix + '.ctl'))) {
+      throw new Error('cached build differs from uncached build');
+    }
+
+    if (!args._[0]) {
+      // the kind of edit that shouldn't need any samples to be reloaded
+      const edited = fs
+        .readFileSync(instFile, 'utf8')
+        .replace('decayTime = 1000000', 'decayTime = 900000');
+      fs.writeFileSync(instFile, edited);
+      await build('after .inst edit', instFile, outPrefix, cacheArgs);
+
+      // same contents, new mtime: the file is rehashed but not reprocessed
+      const now = new Date();
+      fs.utimesSync(path.join(dir, 's0.aif'), now, now);
+      await build('after touching a sample', instFile, outPrefix, cacheArgs);
+    }
+    console.log(`warm build is ${(cold / warm).toFixed(1)}x faster than cold`);
+  } finally {
+    if (args['--keep']) {
+      console.log(`output in ${dir}`);
+    } else {
+      fs.rmSync(dir, {recursive: true, force: true});
+    }
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
@@ -0,0 +1,245 @@
+#!/usr/bin/env node
+
+// checks the hand written .inst parser against the generated one (the
+// reference for the grammar) and benchmarks both. every bank found in the
+// given roms (or directories of roms) is decompiled as bankdec does, then each
+// .inst is parsed by both parsers, as are mutated copies of it (truncated, with
+// characters deleted, inserted or changed), which must give the same defs or
+// the same error. with no roms, a synthetic bank is used.
+// eg. node bench/instparse.js roms/
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const util = require('util');
+const arg = require('arg');
+const pegParser = require('../instparser');
+const fastParser = require('../instparserfast');
+const {parseWithNiceErrors} = require('../instparserapi');
+const {
+  bankToSource,
+  bankFileToSource,
+  AL_RAW16_WAVE,
+} = require('../soundtools');
+const {loadRom, scanRom} = require('../romscan');
+const {findFiles} = require('../findfiles');
+const {makeRandom, compileSyntheticBank} = require('./fixtures');
+
+const args = arg({
+  '--instruments': Number, // size of the synthetic bank
+  '--mutations': Number, // mutated copies of each .inst to check
+  '--passes': Number,
+  '--keep': Boolean, // don't delete the temp dir
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `instparse bench [--instruments n] [--mutations n] [--passes n] [--keep] [roms or dirs...]`
+  );
+  process.exit(0);
+}
+
+async function decompileRoms(romFiles, outDir) {
+  const instFiles = [];
+  for (const romFile of romFiles) {
+    const romBuffer = loadRom(romFile);
+    for (const {ctlStart, tblStart, bankFile} of scanRom(romBuffer)) {
+      const outPath = path.join(
+        outDir,
+        `${path.basename(romFile)}_${ctlStart.toString(16)}`
+      );
+      await bankFileToSource(
+        bankFile,
+        (wavetable) =>
+          romBuffer.slice(
+            tblStart + wavetable.base,
+            tblStart + wavetable.base + wavetable.len
+          ),
+        outPath
+      );
+      instFiles.push(outPath + '.inst');
+    }
+  }
+  return instFiles;
+}
+
+// a bank with a sound, keymap and envelope per instrument, decompiled so the
+// .inst is what bankdec writes
+async function writeSyntheticInst(outDir, instrumentCount) {
+  const bank = compileSyntheticBank(
+    instrumentCount,
+    () => ({
+      type: AL_RAW16_WAVE,
+      soundData: Buffer.alloc(64),
+      book: null,
+      loop: null,
+    }),
+    {sharedDefs: 0}
+  );
+  const prefix = path.join(outDir, 'synthetic');
+  bank.writeBankFile(prefix);
+  await bankToSource(
+    fs.readFileSync(prefix + '.ctl'),
+    0,
+    fs.readFileSync(prefix + '.tbl'),
+    0,
+    path.join(outDir, 'decompiled')
+  );
+  return [path.join(outDir, 'decompiled.inst')];
+}
+
+// what the generated parser gives, as parseWithNiceErrors used it
+function parseReference(contents) {
+  try {
+    return {defs: pegParser.parse(contents)};
+  } catch (err) {
+    if (!(err instanceof pegParser.SyntaxError)) throw err;
+    return {error: err};
+  }
+}
+
+// the hand written parser, falling back to the generated one for syntax errors
+// as parseWithNiceErrors does
+function parseFast(contents) {
+  try {
+    return {defs: fastParser.parse(contents)};
+  } catch (err) {
+    if (err instanceof fastParser.InstSyntaxError) {
+      return {syntaxError: err};
+    }
+    if (!(err instanceof pegParser.SyntaxError)) throw err;
+    return {error: err};
+  }
+}
+
+function describeResult(result) {
+  if (result.defs) return `${result.defs.length} defs`;
+  if (result.syntaxError) return result.syntaxError.message;
+  return result.error.message;
+}
+
+// returns a description of the difference, if any
+function compareParsers(contents) {
+  const reference = parseReference(contents);
+  const fast = parseFast(contents);
+  if (fast.syntaxError) {
+    // the reference parser must fail on the same text (with its own message)
+    if (
+      reference.error &&
+      !reference.error.message.startsWith('Expected Error parsing')
+    ) {
+      return null;
+    }
+  } else if (reference.defs && fast.defs) {
+    if (util.isDeepStrictEqual(reference.defs, fast.defs)) return null;
+  } else if (reference.error && fast.error) {
+    const {message, expected, found, location} = reference.error;
+    if (
+      util.isDeepStrictEqual(
+        {message, expected, found, location},
+        {
+          message: fast.error.message,
+          expected: fast.error.expected,
+          found: fast.error.found,
+          location: fast.error.location,
+        }
+      )
+    ) {
+      return null;
+    }
+  }
+  return `reference: ${describeResult(reference)}\nfast: ${describeResult(
+    fast
+  )}`;
+}
+
+const MUTATION_CHARS = ' \n{}[]();="/*-.e0123456789aZ_\\';
+
+function mutate(contents, random) {
+  const at = random(contents.length + 1);
+  const char = MUTATION_CHARS[random(MUTATION_CHARS.length)];
+  switch (random(4)) {
+    case 0:
+      return contents.slice(0, at);
+    case 1:
+      return contents.slice(0, at) + contents.slice(at + 1);
+    case 2:
+      return contents.slice(0, at) + char + contents.slice(at);
+    default:
+      return contents.slice(0, at) + char + contents.slice(at + 1);
+  }
+}
+
+function time(passes, fn) {
+  fn(); // warm up
+  const start = process.hrtime.bigint();
+  for (let pass = 0; pass < passes; pass++) fn();
+  return Number(process.hrtime.bigint() - start) / 1e6 / passes;
+}
+
+async function run() {
+  const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'instparse-'));
+  try {
+    const instFiles = args._.length
+      ? await decompileRoms(findFiles(args._, /\.(v64|z64)$/i), tmpDir)
+      : await writeSyntheticInst(tmpDir, args['--instruments'] || 128);
+    const mutations = args['--mutations'] != null ? args['--mutations'] : 500;
+    const passes = args['--passes'] || 10;
+
+    let failures = 0;
+    let checked = 0;
+    let totalBytes = 0;
+    let referenceMs = 0;
+    let fastMs = 0;
+    for (const instFile of instFiles) {
+      const contents = fs.readFileSync(instFile, 'utf8');
+      // fixed seed so runs check the same mutations
+      const random = makeRandom(1);
+      const inputs = [contents];
+      for (let i = 0; i < mutations; i++) {
+        inputs.push(mutate(contents, random));
+      }
+      for (const input of inputs) {
+        const difference = compareParsers(input);
+        checked++;
+        if (difference) {
+          failures++;
+          if (failures <= 5) {
+            console.error(`${instFile} (or a mutation of it):\n${difference}`);
+          }
+        }
+      }
+      parseWithNiceErrors(contents, instFile);
+
+      totalBytes += contents.length;
+      referenceMs += time(passes, () => pegParser.parse(contents));
+      fastMs += time(passes, () => fastParser.parse(contents));
+    }
+
+    console.log(
+      `${instFiles.length} .inst file(s), ${(totalBytes / 1024).toFixed(
+        0
+      )}KB, ${checked} inputs checked, ${failures} differences`
+    );
+    console.log(`generated parser: ${referenceMs.toFixed(2)}ms`);
+    console.log(
+      `hand written parser: ${fastMs.toFixed(2)}ms (${(
+        referenceMs / fastMs
+      ).toFixed(1)}x faster)`
+    );
+    if (failures) process.exitCode = 1;
+  } finally {
+    if (args['--keep']) {
+      console.log(`output in ${tmpDir}`);
+    } else {
+      fs.rmSync(tmpDir, {recursive: true, force: true});
+    }
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
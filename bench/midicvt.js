@@ -0,0 +1,174 @@
+#!/usr/bin/env node
+
+// benchmarks converting a type 1 midi file to a type 0 .seq by collecting
+// every kept event, sorting them all by time and writing the result with
+// writeMidi (as midicvt used to) vs merging the already sorted tracks and
+// writing events out as they're merged, checking both give the same events.
+// with no file, a synthetic one with many long tracks is generated.
+// eg. node bench/midicvt.js song.mid
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const arg = require('arg');
+const {parseMidi, writeMidi} = require('midi-file');
+const {SeqWriter, mergeTracks} = require('../seqwriter');
+const {makeRandom} = require('./fixtures');
+
+const args = arg({
+  '--tracks': Number, // synthetic tracks
+  '--events': Number, // events per synthetic track
+  '--passes': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `midicvt bench [--tracks n] [--events n] [--passes n] [midi file]`
+  );
+  process.exit(0);
+}
+
+// notes with occasional controller and program changes, with lots of events
+// at the same time in different tracks. uses a fixed seed so runs compare
+function makeSyntheticMidi(trackCount, eventsPerTrack) {
+  const random = makeRandom(1);
+  const tracks = [];
+  for (let t = 0; t < trackCount; t++) {
+    const channel = t % 16;
+    const track = [
+      {deltaTime: 0, meta: true, type: 'trackName', text: `track ${t}`},
+    ];
+    if (t === 0) {
+      track.push({
+        deltaTime: 0,
+        meta: true,
+        type: 'setTempo',
+        microsecondsPerBeat: 500000,
+      });
+    }
+    for (let i = 0; i < eventsPerTrack; i++) {
+      const deltaTime = random(4) === 0 ? 0 : random(4) * 120;
+      const kind = random(10);
+      if (kind === 0) {
+        track.push({
+          deltaTime,
+          channel,
+          type: 'controller',
+          controllerType: 7,
+          value: random(128),
+        });
+      } else if (kind === 1) {
+        track.push({
+          deltaTime,
+          channel,
+          type: 'pitchBend',
+          value: random(200) - 100,
+        });
+      } else {
+        track.push({
+          deltaTime,
+          channel,
+          type: kind % 2 ? 'noteOn' : 'noteOff',
+          noteNumber: random(128),
+          velocity: kind % 2 ? 1 + random(127) : 0,
+        });
+      }
+    }
+    track.push({deltaTime: 0, meta: true, type: 'endOfTrack'});
+    tracks.push(track);
+  }
+  return Buffer.from(
+    writeMidi({
+      header: {format: 1, numTracks: trackCount, ticksPerBeat: 480},
+      tracks,
+    })
+  );
+}
+
+const keptTypes = new Set([
+  'noteOn',
+  'noteOff',
+  'controller',
+  'programChange',
+  'setTempo',
+  'timeSignature',
+]);
+const keepEvent = (ev) => keptTypes.has(ev.type);
+
+function convertSorted(midiBuffer, outFile) {
+  const midi = parseMidi(midiBuffer);
+  const events = [];
+  midi.tracks.forEach((track) => {
+    let lastEventAbsTime = 0;
+    track.forEach((ev) => {
+      ev.absoluteTime = ev.deltaTime + lastEventAbsTime;
+      lastEventAbsTime = ev.absoluteTime;
+      if (keepEvent(ev)) events.push(ev);
+    });
+  });
+  events.sort((a, b) => a.absoluteTime - b.absoluteTime);
+  let lastEventTime = 0;
+  events.forEach((ev) => {
+    ev.deltaTime = ev.absoluteTime - lastEventTime;
+    lastEventTime = ev.absoluteTime;
+  });
+  events.push({deltaTime: 0, meta: true, type: 'endOfTrack'});
+  midi.header.format = 0;
+  midi.tracks = [events];
+  fs.writeFileSync(outFile, Buffer.from(writeMidi(midi)));
+  return events.length;
+}
+
+function convertMerged(midiBuffer, outFile) {
+  const midi = parseMidi(midiBuffer);
+  const fd = fs.openSync(outFile, 'w');
+  try {
+    const writer = new SeqWriter(fd, midi.header);
+    mergeTracks(midi.tracks, keepEvent, (ev, absoluteTime) =>
+      writer.writeEvent(ev, absoluteTime)
+    );
+    writer.end();
+    return writer.eventCount;
+  } finally {
+    fs.closeSync(fd);
+  }
+}
+
+function run() {
+  const midiBuffer = args._[0]
+    ? fs.readFileSync(args._[0])
+    : makeSyntheticMidi(args['--tracks'] || 32, args['--events'] || 20000);
+  const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'midicvt-'));
+  const passes = args['--passes'] || 5;
+  const outputs = [];
+  try {
+    Object.entries({sort: convertSorted, merge: convertMerged}).forEach(
+      ([name, convert]) => {
+        const outFile = path.join(tmpDir, `${name}.seq`);
+        convert(midiBuffer, outFile); // warm up
+        const start = process.hrtime.bigint();
+        let eventCount = 0;
+        for (let pass = 0; pass < passes; pass++) {
+          eventCount = convert(midiBuffer, outFile);
+        }
+        const seconds = Number(process.hrtime.bigint() - start) / 1e9 / passes;
+        console.log(
+          `${name}: ${(seconds * 1000).toFixed(1)}ms per file, ${Math.round(
+            eventCount / seconds
+          )} events/s`
+        );
+        outputs.push(fs.readFileSync(outFile));
+      }
+    );
+  } finally {
+    fs.rmSync(tmpDir, {recursive: true, force: true});
+  }
+  if (!outputs[0].equals(outputs[1])) {
+    console.error('outputs differ');
+    process.exit(1);
+  }
+}
+
+run();
@@ -0,0 +1,291 @@
+#!/usr/bin/env node
+
+// compares the ed64-soundtool send loop for midi files as it was (gathering
+// events and building a packet every tick) with sending packets from a
+// PacketTimeline encoded up front. a synthetic song (dense chords across 16
+// channels) is played through each to a stub debugger interface:
+// - stepping through the song tick by tick, measuring the memory allocated
+//   per second of playback and the gcs it causes
+// - in real time, with a timer busy-working and allocating in the background
+//   as a ui would, measuring the time spent in each tick and how early (or
+//   late) each event reaches the n64 relative to its time in the song
+// eg. node bench/packettimeline.js --notes 100000 --seconds 10
+
+const {performance, PerformanceObserver} = require('perf_hooks');
+const arg = require('arg');
+const renderMidiStream = require('../n64daw/src/renderMidiStream');
+const {
+  PacketTimeline,
+  PACKET_HEADER_SIZE,
+  MIDI_MESSAGE_SIZE,
+} = require('../n64daw/src/packettimeline');
+const {makeRandom, makeSyntheticSong} = require('./fixtures');
+
+global.performance = performance;
+
+const args = arg({
+  '--notes': Number, // notes in the synthetic song
+  '--seconds': Number, // seconds to play in real time with each sender
+  '--load': Number, // max ms of background work every 10ms
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `packettimeline bench [--notes n] [--seconds s] [--load ms]`
+  );
+  process.exit(0);
+}
+
+const TICK_INTERVAL = 1000 / 60;
+const LOOKAHEAD = 32;
+
+// the send loop as cli.js did it before PacketTimeline, with the time passed
+// in rather than read from a Player. events are objects with a Buffer of
+// their midi bytes, as renderMidiStream used to render them
+function makeLegacySender(events, sendPacket) {
+  let nextEvent = 0;
+  function getPendingEvents(time, timeWindow) {
+    const eventsToSend = [];
+    while (events[nextEvent] && events[nextEvent].time < time + timeWindow) {
+      eventsToSend.push(events[nextEvent]);
+      nextEvent++;
+    }
+    return eventsToSend;
+  }
+
+  function sendPendingEvents(events, time) {
+    const midiMessageSize = 4 + 4;
+    const remainingSpace = 512 - 8;
+    const maxEventsInPacket = Math.floor(remainingSpace / midiMessageSize);
+    const eventMessagesTruncated = events
+      .slice(0, maxEventsInPacket)
+      .map((event) => {
+        const midiMessage = Buffer.alloc(midiMessageSize);
+        midiMessage.writeUInt32BE(event.time * 1000);
+        event.data.copy(midiMessage, /*offset to midi bytes*/ 4);
+        return midiMessage;
+      });
+
+    const headerEventCount = Buffer.alloc(4);
+    headerEventCount.writeUInt32BE(eventMessagesTruncated.length);
+    const packetHeader = Buffer.concat([
+      Buffer.from('MMID', 'utf8'),
+      headerEventCount,
+    ]);
+    const packet = Buffer.concat([packetHeader, ...eventMessagesTruncated]);
+    sendPacket(packet, time);
+    return events.slice(maxEventsInPacket);
+  }
+
+  let eventsToSend = [];
+  return {
+    tick(time) {
+      eventsToSend = eventsToSend.concat(getPendingEvents(time, LOOKAHEAD));
+      if (eventsToSend.length) {
+        eventsToSend = sendPendingEvents(eventsToSend, time);
+      }
+    },
+    get done() {
+      return nextEvent >= events.length && !eventsToSend.length;
+    },
+  };
+}
+
+function makeTimelineSender(timeline, sendPacket) {
+  let nextPacket = 0;
+  return {
+    tick(time) {
+      while (
+        nextPacket < timeline.length &&
+        timeline.sendTimes[nextPacket] <= time
+      ) {
+        sendPacket(timeline.packets[nextPacket++], time);
+      }
+    },
+    get done() {
+      return nextPacket >= timeline.length;
+    },
+  };
+}
+
+function makeNoopSender(stream) {
+  const endTime = stream.time[stream.length - 1];
+  let lastTime = 0;
+  return {
+    tick(time) {
+      lastTime = time;
+    },
+    get done() {
+      return lastTime > endTime;
+    },
+  };
+}
+
+function getAllocatedMemory() {
+  const {heapUsed, arrayBuffers} = process.memoryUsage();
+  return heapUsed + arrayBuffers;
+}
+
+// steps through the whole song a tick at a time, summing the growth in memory
+// used over each tick. a gc during a tick hides that tick's allocation, so
+// this undercounts a little when there are many gcs
+async function measureAllocation(makeSender) {
+  let gcs = 0;
+  const observer = new PerformanceObserver((list) => {
+    gcs += list.getEntries().length;
+  });
+  observer.observe({entryTypes: ['gc']});
+
+  const sender = makeSender(() => {});
+  let allocated = 0;
+  let time = 0;
+  for (; !sender.done; time += TICK_INTERVAL) {
+    const before = getAllocatedMemory();
+    sender.tick(time);
+    const after = getAllocatedMemory();
+    if (after > before) allocated += after - before;
+  }
+  // let the observer see the last gcs
+  await new Promise((resolve) => setTimeout(resolve, 10));
+  observer.disconnect();
+  return {allocated, gcs, seconds: time / 1000};
+}
+
+function percentile(sorted, p) {
+  if (!sorted.length) return 0;
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+// background work on another timer: busy time and garbage, as from rendering
+// and logging
+function startLoad(maxLoadMs) {
+  const random = makeRandom(2);
+  let garbage = [];
+  const interval = setInterval(() => {
+    const until = performance.now() + random(maxLoadMs * 10 + 1) / 10;
+    while (performance.now() < until) {
+      garbage.push({value: random(1000), text: `item ${garbage.length}`});
+      if (garbage.length > 10000) garbage = [];
+    }
+  }, 10);
+  return () => clearInterval(interval);
+}
+
+// plays the start of the song in real time, as cli.js does, recording the
+// time spent in each tick and how far ahead of its time each event was sent
+async function measureTiming(makeSender, seconds, maxLoadMs) {
+  const slack = [];
+  const sender = makeSender((packet, time) => {
+    const count = packet.readUInt32BE(4);
+    for (let i = 0; i < count; i++) {
+      const eventTime =
+        packet.readUInt32BE(PACKET_HEADER_SIZE + i * MIDI_MESSAGE_SIZE) / 1000;
+      slack.push(eventTime - time);
+    }
+  });
+  const tickTimes = [];
+  const stopLoad = startLoad(maxLoadMs);
+  const startTime = performance.now();
+  await new Promise((resolve) => {
+    function tick() {
+      setTimeout(() => {
+        const tickStart = performance.now();
+        sender.tick(tickStart - startTime);
+        tickTimes.push(performance.now() - tickStart);
+        if (sender.done || tickStart - startTime > seconds * 1000) {
+          resolve();
+        } else {
+          tick();
+        }
+      }, TICK_INTERVAL);
+    }
+    sender.tick(0);
+    tick();
+  });
+  stopLoad();
+  tickTimes.sort((a, b) => a - b);
+  slack.sort((a, b) => a - b);
+  return {
+    tickTimes,
+    slack,
+    late: slack.filter((s) => s < 0).length,
+  };
+}
+
+function formatMs(ms) {
+  return ms.toFixed(3) + 'ms';
+}
+
+async function run() {
+  const noteCount = args['--notes'] || 100000;
+  const seconds = args['--seconds'] || 5;
+  const maxLoadMs = args['--load'] != null ? args['--load'] : 8;
+
+  // dense chords of up to 6 notes
+  const events = renderMidiStream(
+    makeSyntheticSong(noteCount, {maxChordSize: 6})
+  );
+  const encodeStart = performance.now();
+  const timeline = new PacketTimeline(events, {
+    lookAhead: LOOKAHEAD,
+    tickInterval: TICK_INTERVAL,
+  });
+  const encodeTime = performance.now() - encodeStart;
+  console.log(
+    `${events.length} events, ${(
+      events.time[events.length - 1] / 1000
+    ).toFixed(0)}s long`
+  );
+  console.log(
+    `timeline: ${timeline.length} packets, ${(
+      timeline.data.length / 1024
+    ).toFixed(0)}KB, encoded in ${formatMs(encodeTime)}`
+  );
+
+  const eventObjects = Array.from({length: events.length}, (_, i) => ({
+    time: events.time[i],
+    data: Buffer.from(events.getMessage(i)),
+  }));
+  const senders = {
+    legacy: (sendPacket) => makeLegacySender(eventObjects, sendPacket),
+    timeline: (sendPacket) => makeTimelineSender(timeline, sendPacket),
+  };
+
+  // the cost of measuring, taken off each sender's allocation
+  const baseline = await measureAllocation(() => makeNoopSender(events));
+  const baselineRate = baseline.allocated / baseline.seconds;
+  for (const [name, makeSender] of Object.entries(senders)) {
+    const {allocated, gcs, seconds} = await measureAllocation(makeSender);
+    console.log(
+      `${name} allocation: ${(
+        Math.max(0, allocated / seconds - baselineRate) / 1024
+      ).toFixed(1)}KB per second of song, ${gcs} gcs (${
+        baseline.gcs
+      } measuring nothing)`
+    );
+  }
+
+  for (const [name, makeSender] of Object.entries(senders)) {
+    const {tickTimes, slack, late} = await measureTiming(
+      makeSender,
+      seconds,
+      maxLoadMs
+    );
+    console.log(
+      `${name} under load: tick p50 ${formatMs(
+        percentile(tickTimes, 0.5)
+      )} p99 ${formatMs(percentile(tickTimes, 0.99))} max ${formatMs(
+        tickTimes[tickTimes.length - 1]
+      )}, events sent ahead p1 ${formatMs(
+        percentile(slack, 0.01)
+      )} min ${formatMs(slack[0])}, ${late}/${slack.length} late`
+    );
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
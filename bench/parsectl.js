@@ -0,0 +1,100 @@
+#!/usr/bin/env node
+
+// benchmarks parseCtl with BufferStruct schemas interpreted on every call vs
+// compiled to generated functions, checking both give the same result. uses
+// a .ctl file (or a rom, with --offset) if given, otherwise a large synthetic
+// bank of VADPCM sounds with loops.
+// eg. node bench/parsectl.js --offset 0x5f2e0 rom.z64
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const util = require('util');
+const arg = require('arg');
+const {BufferStruct} = require('../bufferstruct');
+const {parseCtl, AL_ADPCM_WAVE} = require('../soundtools');
+const {compileSyntheticBank} = require('./fixtures');
+
+const args = arg({
+  '--offset': Number, // offset of the ctl data in the file
+  '--instruments': Number, // size of the synthetic bank
+  '--sounds': Number, // sounds per synthetic instrument
+  '--iterations': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `parsectl bench [--offset n] [--iterations n] [--instruments n] [--sounds n] [ctl or rom file]`
+  );
+  process.exit(0);
+}
+
+// every sound gets its own envelope, keymap, wavetable, book and loop, so
+// nothing is deduped
+function makeSyntheticCtl(instrumentCount, soundsPerInstrument) {
+  const book = Buffer.alloc(2 * 4 * 8 * 2);
+  const bank = compileSyntheticBank(
+    instrumentCount,
+    (file) => {
+      const n = parseInt(file.match(/s(\d+)\.aifc$/)[1], 10);
+      book.writeUInt16BE(n & 0xffff, 0);
+      return {
+        type: AL_ADPCM_WAVE,
+        soundData: Buffer.alloc(9 * 16 + (n % 16) * 9),
+        book: {order: 2, npredictors: 4, book: Buffer.from(book)},
+        loop: {
+          start: n,
+          end: 100 + n,
+          count: 0x7fffffff,
+          state: Buffer.alloc(32),
+        },
+      };
+    },
+    {soundsPerInstrument, sharedDefs: 0}
+  );
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'parsectl-'));
+  bank.writeBankFile(path.join(dir, 'bench'));
+  const ctl = fs.readFileSync(path.join(dir, 'bench.ctl'));
+  fs.rmSync(dir, {recursive: true, force: true});
+  return ctl;
+}
+
+function time(iterations, fn) {
+  fn(); // warm up
+  const start = process.hrtime.bigint();
+  let result;
+  for (let i = 0; i < iterations; i++) result = fn();
+  const ms = Number(process.hrtime.bigint() - start) / 1e6 / iterations;
+  return {result, ms};
+}
+
+const ctl = args._[0]
+  ? fs.readFileSync(args._[0])
+  : makeSyntheticCtl(args['--instruments'] || 256, args['--sounds'] || 8);
+const offset = args['--offset'] || 0;
+const iterations = args['--iterations'] || 50;
+
+const parse = () => parseCtl(ctl, offset);
+BufferStruct.compile = false;
+const interpreted = time(iterations, parse);
+BufferStruct.compile = true;
+const compiled = time(iterations, parse);
+
+const {instruments, sounds} = compiled.result;
+console.log(
+  `${Object.keys(instruments).length} instruments, ${
+    Object.keys(sounds).length
+  } sounds`
+);
+console.log(`interpreted: ${interpreted.ms.toFixed(2)}ms per parse`);
+console.log(
+  `compiled: ${compiled.ms.toFixed(2)}ms per parse (${(
+    interpreted.ms / compiled.ms
+  ).toFixed(1)}x)`
+);
+if (!util.isDeepStrictEqual(interpreted.result, compiled.result)) {
+  console.error('results differ');
+  process.exit(1);
+}
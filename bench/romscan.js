@@ -0,0 +1,89 @@
+#!/usr/bin/env node
+
+// benchmarks finding the ctls in a rom by searching for the 'B1' 0x0001
+// magic and trying parseCtl on every match (as bankdec used to) vs
+// romscan.scanRom, which rejects most matches with cheap header checks. with
+// no rom, a synthetic one is generated from random data containing a bank file
+// and many false matches.
+// eg. node bench/romscan.js rom.z64
+
+const fs = require('fs');
+const crypto = require('crypto');
+const arg = require('arg');
+const {parseCtl} = require('../soundtools');
+const {loadRom, scanRom} = require('../romscan');
+
+const args = arg({
+  '--size': Number, // size of the synthetic rom, in megabytes
+  '--decoys': Number, // false matches in the synthetic rom
+  '--ctl': String, // ctl to embed in the synthetic rom
+  '--passes': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `romscan bench [--size mb] [--decoys n] [--ctl file] [--passes n] [rom]`
+  );
+  process.exit(0);
+}
+
+const MAGIC = Buffer.from([0x42, 0x31, 0x00, 0x01]);
+
+function makeSyntheticRom(size, decoys, ctl) {
+  const romBuffer = crypto.randomFillSync(Buffer.alloc(size));
+  for (let i = 0; i < decoys; i++) {
+    const offset = Math.floor((i * size) / decoys) & ~3;
+    MAGIC.copy(romBuffer, offset);
+  }
+  if (ctl) ctl.copy(romBuffer, Math.floor(size / 2) & ~0xf);
+  return romBuffer;
+}
+
+function scanOld(romBuffer) {
+  const found = [];
+  let startOffset = 0;
+  for (;;) {
+    const ctlStart = romBuffer.indexOf(MAGIC, startOffset);
+    if (ctlStart < 0) return found;
+    try {
+      const bankFile = parseCtl(romBuffer, ctlStart);
+      found.push(ctlStart);
+      startOffset = bankFile.lastOffset;
+    } catch (err) {
+      startOffset = ctlStart + 4;
+    }
+  }
+}
+
+function scanNew(romBuffer) {
+  return scanRom(romBuffer).map(({ctlStart}) => ctlStart);
+}
+
+const romBuffer = args._[0]
+  ? loadRom(args._[0])
+  : makeSyntheticRom(
+      (args['--size'] || 32) * 1024 * 1024,
+      args['--decoys'] || 2000,
+      args['--ctl'] ? fs.readFileSync(args['--ctl']) : null
+    );
+const passes = args['--passes'] || 5;
+const megabytes = romBuffer.length / 1024 / 1024;
+
+const results = {};
+Object.entries({'indexOf + parseCtl': scanOld, scanRom: scanNew}).forEach(
+  ([name, scan]) => {
+    results[name] = scan(romBuffer); // warm up
+    const start = process.hrtime.bigint();
+    for (let pass = 0; pass < passes; pass++) scan(romBuffer);
+    const seconds = Number(process.hrtime.bigint() - start) / 1e9 / passes;
+    console.log(
+      `${name}: ${(seconds * 1000).toFixed(1)}ms per scan, ${(
+        megabytes / seconds
+      ).toFixed(0)}MB/s (found ${results[name]
+        .map((offset) => '0x' + offset.toString(16))
+        .join(', ')})`
+    );
+  }
+);
@@ -0,0 +1,628 @@
+#!/usr/bin/env node
+
+// round trip fuzzing for bank compile/decompile. random valid banks (many
+// sounds sharing envelopes, keymaps and samples, with ADPCM and raw samples,
+// with and without loops) are compiled with sourceToBank, decompiled with
+// bankToSource and compiled again, in parallel. the two compiled banks must
+// have the same structure. when they don't (or a stage throws), the bank is
+// shrunk to a small one which fails the same way, and saved as a reproducer.
+// each stage is timed per bank size, and stages whose time per sound grows
+// with the size of the bank are reported.
+// eg. node bench/roundtrip.js --sizes 100,1000,4000 --banks 4
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const util = require('util');
+const crypto = require('crypto');
+const {isMainThread} = require('worker_threads');
+const {runWorkerPool, serveWorkerJobs} = require('../workerpool');
+const AIFF = require('../aiff');
+const {
+  sourceToBank,
+  bankToSource,
+  parseCtl,
+  makeAIFFLoopChunks,
+  serializeVADPCMApplDataField,
+  VADPCMBookChunkStruct,
+  VADPCMLoopChunkStruct,
+  VADPCM_CODE_NAME,
+  VADPCM_LOOP_NAME,
+  VADPCM_VERSION,
+  AL_ADPCM_WAVE,
+  AL_RAW16_WAVE,
+} = require('../soundtools');
+const {parseWithNiceErrors} = require('../instparserapi');
+const {makeRandom} = require('./fixtures');
+
+const STAGES = ['generate', 'compile', 'decompile', 'recompile', 'compare'];
+
+function randomBytes(random, length) {
+  const buffer = Buffer.alloc(length);
+  for (let i = 0; i < length; i++) buffer[i] = random(256);
+  return buffer;
+}
+
+// a bank as plain data, which can be shrunk and written out as .inst
+function generateSpec(seed, soundCount) {
+  const random = makeRandom(seed);
+  const envelopes = Array.from({length: 1 + random(16)}, () => ({
+    attackTime: random(100000),
+    attackVolume: random(128),
+    decayTime: random(5000000),
+    decayVolume: random(128),
+    releaseTime: random(1000000),
+  }));
+  const keymaps = Array.from({length: 1 + random(16)}, () => {
+    const keyMin = random(128);
+    return {
+      velocityMin: random(64),
+      velocityMax: 64 + random(64),
+      keyMin,
+      keyMax: keyMin + random(128 - keyMin),
+      keyBase: random(128),
+      detune: random(100),
+    };
+  });
+  const samples = Array.from(
+    {length: Math.max(1, Math.ceil(soundCount / 4))},
+    () => {
+      const adpcm = random(3) !== 0;
+      if (adpcm) {
+        const frames = 1 + random(200);
+        const order = 2;
+        const npredictors = 1 + random(4);
+        return {
+          type: AL_ADPCM_WAVE,
+          soundData: randomBytes(random, frames * 9),
+          book: {
+            order,
+            npredictors,
+            book: randomBytes(random, order * npredictors * 8 * 2),
+          },
+          loop: random(2)
+            ? {
+                start: random(frames * 8),
+                end: frames * 16,
+                count: random(2) ? 0xffffffff : random(100),
+                state: randomBytes(random, 32),
+              }
+            : null,
+        };
+      }
+      const length = 1 + random(2000);
+      return {
+        type: AL_RAW16_WAVE,
+        soundData: randomBytes(random, length * 2),
+        book: null,
+        loop: random(2)
+          ? {start: random(length), end: length, count: 0x7fffffff}
+          : null,
+      };
+    }
+  );
+  const sounds = Array.from({length: soundCount}, () => ({
+    envelope: random(envelopes.length),
+    keymap: random(keymaps.length),
+    sample: random(samples.length),
+    pan: random(128),
+    volume: random(128),
+  }));
+  // sounds are split between up to 128 instruments
+  const instrumentCount = Math.max(
+    1,
+    Math.min(128, Math.ceil(soundCount / 8))
+  );
+  const instruments = Array.from({length: instrumentCount}, () => ({
+    volume: random(128),
+    pan: random(128),
+    priority: random(10),
+    bendRange: random(2400),
+    tremType: random(2),
+    tremRate: random(256),
+    tremDepth: random(256),
+    tremDelay: random(256),
+    vibType: random(2),
+    vibRate: random(256),
+    vibDepth: random(256),
+    vibDelay: random(256),
+    sounds: [],
+  }));
+  sounds.forEach((sound, i) =>
+    instruments[i % instrumentCount].sounds.push(i)
+  );
+  return {
+    sampleRate: [22050, 32000, 44100][random(3)],
+    percussion: random(4) === 0 ? random(instrumentCount) : null,
+    instruments,
+    sounds,
+    envelopes,
+    keymaps,
+    samples,
+  };
+}
+
+function sampleFileName(spec, index) {
+  return `s${index}.${
+    spec.samples[index].type === AL_ADPCM_WAVE ? 'aifc' : 'aiff'
+  }`;
+}
+
+function fieldsToInst(fields) {
+  return Object.entries(fields)
+    .map(([name, value]) => `  ${name} = ${value};\n`)
+    .join('');
+}
+
+// only what's used by the instruments is written
+function specToInst(spec) {
+  const used = {sounds: new Set(), envelopes: new Set(), keymaps: new Set()};
+  const instrumentDefs = spec.instruments.map(({sounds, ...fields}, i) => {
+    sounds.forEach((s) => used.sounds.add(s));
+    return `instrument inst${i} {
+${fieldsToInst(fields)}${sounds.map((s) => `  sound = snd${s};\n`).join('')}}
+`;
+  });
+  const soundDefs = [...used.sounds].map((s) => {
+    const sound = spec.sounds[s];
+    used.envelopes.add(sound.envelope);
+    used.keymaps.add(sound.keymap);
+    return `sound snd${s} {
+  use("${sampleFileName(spec, sound.sample)}");
+  pan = ${sound.pan};
+  volume = ${sound.volume};
+  envelope = env${sound.envelope};
+  keymap = km${sound.keymap};
+}
+`;
+  });
+  return [
+    ...[...used.envelopes].map(
+      (e) => `envelope env${e} {\n${fieldsToInst(spec.envelopes[e])}}\n`
+    ),
+    ...[...used.keymaps].map(
+      (k) => `keymap km${k} {\n${fieldsToInst(spec.keymaps[k])}}\n`
+    ),
+    ...soundDefs,
+    ...instrumentDefs,
+    `bank bank {
+  sampleRate = ${spec.sampleRate};
+${
+  spec.percussion != null && spec.percussion < spec.instruments.length
+    ? `  percussionDefault = inst${spec.percussion};\n`
+    : ''
+}${spec.instruments
+      .map((_, i) => `  instrument [${i}] = inst${i};\n`)
+      .join('')}}
+`,
+  ].join('\n');
+}
+
+// the bank's tree with offsets replaced by what they point to, and sample
+// data by its hash, so banks laid out differently can be compared
+function describeBank(ctl, tbl) {
+  const bankFile = parseCtl(ctl, 0);
+  const hex = (buffer) => Buffer.from(buffer).toString('hex');
+  const describeWavetable = (offset) => {
+    const {base, len, type, waveInfo} = bankFile.wavetables[offset];
+    const loop = waveInfo.loop ? {...bankFile.loops[waveInfo.loop]} : null;
+    if (loop && loop.state) loop.state = hex(loop.state);
+    const book =
+      type === AL_ADPCM_WAVE && waveInfo.book
+        ? {...bankFile.books[waveInfo.book]}
+        : null;
+    if (book) book.book = hex(book.book);
+    return {
+      type,
+      len,
+      data: crypto
+        .createHash('sha1')
+        .update(tbl.slice(base, base + len))
+        .digest('hex'),
+      loop,
+      book,
+    };
+  };
+  const describeSound = (offset) => {
+    const sound = bankFile.sounds[offset];
+    return {
+      pan: sound.samplePan,
+      volume: sound.sampleVolume,
+      envelope: bankFile.envelopes[sound.envelope],
+      keymap: bankFile.keyMaps[sound.keyMap],
+      wavetable: describeWavetable(sound.wavetable),
+    };
+  };
+  const describeInstrument = (offset) => {
+    if (!offset) return null;
+    const {soundArray, soundCount, flags, ...fields} = bankFile.instruments[
+      offset
+    ];
+    return {...fields, sounds: soundArray.map(describeSound)};
+  };
+  return bankFile.bankArray.map((offset) => {
+    const bank = bankFile.banks[offset];
+    return {
+      sampleRate: bank.sampleRate,
+      percussion: describeInstrument(bank.percussion),
+      instruments: bank.instArray.map(describeInstrument),
+    };
+  });
+}
+
+// the path to the first difference between a and b
+function findDifference(a, b, where = 'bank') {
+  if (util.isDeepStrictEqual(a, b)) return null;
+  if (a && b && typeof a === 'object' && typeof b === 'object') {
+    const keys = new Set([...Object.keys(a), ...Object.keys(b)]);
+    for (const key of keys) {
+      const difference = findDifference(
+        a[key],
+        b[key],
+        Array.isArray(a) ? `${where}[${key}]` : `${where}.${key}`
+      );
+      if (difference) return difference;
+    }
+  }
+  return `${where}: ${util.inspect(a, {depth: 1})} became ${util.inspect(b, {
+    depth: 1,
+  })}`;
+}
+
+// returns {timings, byteIdentical, failure}, where failure describes the first
+// mismatch or error
+async function roundTrip(spec, dir) {
+  const timings = {};
+  let stageStart = process.hrtime.bigint();
+  const endStage = (stage) => {
+    const now = process.hrtime.bigint();
+    timings[stage] = Number(now - stageStart) / 1e6;
+    stageStart = now;
+  };
+  let stage = 'generate';
+  try {
+    const instFile = path.join(dir, 'bank.inst');
+    const instText = specToInst(spec);
+    fs.writeFileSync(instFile, instText);
+    const samplesByFile = new Map(
+      spec.samples.map((sample, i) => [
+        path.join(dir, sampleFileName(spec, i)),
+        sample,
+      ])
+    );
+    endStage(stage);
+
+    stage = 'compile';
+    sourceToBank(parseWithNiceErrors(instText, instFile), instFile, {
+      loadSample: (file) => samplesByFile.get(file),
+    }).writeBankFile(path.join(dir, 'a'));
+    const ctlA = fs.readFileSync(path.join(dir, 'a.ctl'));
+    const tblA = fs.readFileSync(path.join(dir, 'a.tbl'));
+    endStage(stage);
+
+    stage = 'decompile';
+    await bankToSource(ctlA, 0, tblA, 0, path.join(dir, 'decompiled'));
+    endStage(stage);
+
+    stage = 'recompile';
+    const decompiledFile = path.join(dir, 'decompiled.inst');
+    sourceToBank(
+      parseWithNiceErrors(
+        fs.readFileSync(decompiledFile, 'utf8'),
+        decompiledFile
+      ),
+      decompiledFile
+    ).writeBankFile(path.join(dir, 'b'));
+    const ctlB = fs.readFileSync(path.join(dir, 'b.ctl'));
+    const tblB = fs.readFileSync(path.join(dir, 'b.tbl'));
+    endStage(stage);
+
+    stage = 'compare';
+    const difference = findDifference(
+      describeBank(ctlA, tblA),
+      describeBank(ctlB, tblB)
+    );
+    endStage(stage);
+    return {
+      timings,
+      byteIdentical: ctlA.equals(ctlB) && tblA.equals(tblB),
+      failure: difference ? `mismatch at ${difference}` : null,
+    };
+  } catch (err) {
+    return {
+      timings,
+      byteIdentical: false,
+      failure: `${stage} failed: ${err.message.split('\n')[0]}`,
+    };
+  }
+}
+
+// the kind of failure, so shrinking keeps failing the same way. numbers
+// (offsets, indexes) change as the bank shrinks, and for mismatches only where
+// in the bank they are matters, not the values
+function failureKind(failure) {
+  const kind = failure.replace(/\d+/g, 'N');
+  return kind.startsWith('mismatch') ? kind.split(':')[0] : kind;
+}
+
+// removes parts of the bank while it still fails the same way
+async function minimize(spec, failure, dir) {
+  const kind = failureKind(failure);
+  const stillFails = async (candidate) => {
+    fs.rmSync(dir, {recursive: true, force: true});
+    fs.mkdirSync(dir, {recursive: true});
+    const result = await roundTrip(candidate, dir);
+    return result.failure != null && failureKind(result.failure) === kind;
+  };
+  const withInstruments = (instruments) => ({
+    ...spec,
+    instruments,
+    percussion:
+      spec.percussion != null && spec.percussion < instruments.length
+        ? spec.percussion
+        : null,
+  });
+
+  // drop chunks of instruments, then of each instrument's sounds, halving the
+  // chunk size until single ones are tried
+  for (let chunk = spec.instruments.length >> 1; chunk >= 1; chunk >>= 1) {
+    for (let i = 0; i + chunk <= spec.instruments.length; ) {
+      if (spec.instruments.length <= chunk) break;
+      const instruments = spec.instruments
+        .slice(0, i)
+        .concat(spec.instruments.slice(i + chunk));
+      if (await stillFails(withInstruments(instruments))) {
+        spec = withInstruments(instruments);
+      } else {
+        i += chunk;
+      }
+    }
+  }
+  for (let n = 0; n < spec.instruments.length; n++) {
+    const sounds = spec.instruments[n].sounds;
+    for (let chunk = sounds.length >> 1; chunk >= 1; chunk >>= 1) {
+      for (let i = 0; i + chunk <= spec.instruments[n].sounds.length; ) {
+        const current = spec.instruments[n].sounds;
+        if (current.length <= chunk) break;
+        const instruments = spec.instruments.slice();
+        instruments[n] = {
+          ...instruments[n],
+          sounds: current.slice(0, i).concat(current.slice(i + chunk)),
+        };
+        if (await stillFails(withInstruments(instruments))) {
+          spec = withInstruments(instruments);
+        } else {
+          i += chunk;
+        }
+      }
+    }
+  }
+  if (spec.percussion != null) {
+    const candidate = {...spec, percussion: null};
+    if (await stillFails(candidate)) spec = candidate;
+  }
+  // loops, which are often the interesting part, are kept only if needed
+  for (let i = 0; i < spec.samples.length; i++) {
+    if (!spec.samples[i].loop) continue;
+    const samples = spec.samples.slice();
+    samples[i] = {...samples[i], loop: null};
+    if (await stillFails({...spec, samples})) spec = {...spec, samples};
+  }
+  return spec;
+}
+
+// as an .aiff or .aifc, so the reproducer can be built with ic
+function serializeSample({type, soundData, book, loop}) {
+  if (type === AL_RAW16_WAVE) {
+    return AIFF.serialize({
+      soundData,
+      numChannels: 1,
+      sampleSize: 16,
+      sampleRate: 22050,
+      chunks: loop ? makeAIFFLoopChunks(loop) : [],
+    });
+  }
+  const applChunk = (chunkName, data) => ({
+    type: 'APPL',
+    value: {
+      applicationSignature: 'stoc',
+      data: serializeVADPCMApplDataField({chunkName, data}),
+    },
+  });
+  const chunks = [
+    applChunk(
+      VADPCM_CODE_NAME,
+      VADPCMBookChunkStruct.serialize({version: VADPCM_VERSION, ...book})
+    ),
+  ];
+  if (loop) {
+    chunks.push(
+      applChunk(
+        VADPCM_LOOP_NAME,
+        VADPCMLoopChunkStruct.serialize({
+          version: VADPCM_VERSION,
+          nloops: 1,
+          aloops: [loop],
+        })
+      )
+    );
+  }
+  return AIFF.serialize({
+    soundData,
+    numChannels: 1,
+    sampleSize: 16,
+    sampleRate: 22050,
+    formType: 'AIFC',
+    compressionType: 'VAPC',
+    compressionName: 'VADPCM ~4-1',
+    chunks,
+  });
+}
+
+function writeReproducer(spec, failure, outDir) {
+  fs.mkdirSync(outDir, {recursive: true});
+  fs.writeFileSync(path.join(outDir, 'bank.inst'), specToInst(spec));
+  const used = new Set();
+  spec.instruments.forEach((instrument) =>
+    instrument.sounds.forEach((s) => used.add(spec.sounds[s].sample))
+  );
+  used.forEach((i) =>
+    fs.writeFileSync(
+      path.join(outDir, sampleFileName(spec, i)),
+      serializeSample(spec.samples[i])
+    )
+  );
+  fs.writeFileSync(
+    path.join(outDir, 'failure.txt'),
+    `${failure}\nrebuild with: ic -o bank bank.inst\n`
+  );
+}
+
+// worker: round trips one bank, minimizing it if it fails
+async function runJob({seed, soundCount, outDir}) {
+  const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'roundtrip-'));
+  try {
+    const generateStart = process.hrtime.bigint();
+    let spec = generateSpec(seed, soundCount);
+    const generateMs = Number(process.hrtime.bigint() - generateStart) / 1e6;
+    const result = await roundTrip(spec, dir);
+    result.timings.generate += generateMs;
+    if (result.failure) {
+      spec = await minimize(spec, result.failure, path.join(dir, 'minimize'));
+      const minimized = await roundTrip(spec, path.join(dir, 'minimize'));
+      result.reproducer = path.join(outDir, `seed${seed}_${soundCount}`);
+      writeReproducer(spec, minimized.failure, result.reproducer);
+      result.reproducerSounds = spec.instruments.reduce(
+        (sum, instrument) => sum + instrument.sounds.length,
+        0
+      );
+    }
+    return {seed, soundCount, ...result};
+  } finally {
+    fs.rmSync(dir, {recursive: true, force: true});
+  }
+}
+
+if (!isMainThread) {
+  serveWorkerJobs(runJob);
+} else {
+  const arg = require('arg');
+  const args = arg({
+    '--sizes': String, // comma separated numbers of sounds per bank
+    '--banks': Number, // random banks of each size
+    '--seed': Number, // first seed
+    '--jobs': Number, // banks to round trip in parallel
+    '--out': String, // dir to save reproducers in
+    '--max-growth': Number, // allowed growth in time per sound
+    '--help': Boolean,
+    '-j': '--jobs',
+    '-h': '--help',
+  });
+
+  if (args['--help']) {
+    console.log(
+      `roundtrip bench [--sizes n,n] [--banks n] [--seed n] [-j jobs] [--out dir] [--max-growth x]`
+    );
+    process.exit(0);
+  }
+
+  const sizes = (args['--sizes'] || '100,1000,4000')
+    .split(',')
+    .map((v) => parseInt(v, 10));
+  const bankCount = args['--banks'] || 4;
+  const firstSeed = args['--seed'] || 1;
+  const outDir = path.resolve(args['--out'] || 'roundtrip-failures');
+  const maxGrowth = args['--max-growth'] || 2;
+
+  const jobs = [];
+  sizes.forEach((soundCount) => {
+    for (let i = 0; i < bankCount; i++) {
+      jobs.push({seed: firstSeed + jobs.length, soundCount, outDir});
+    }
+  });
+
+  let problems = 0;
+  runWorkerPool({
+    workerFile: __filename,
+    jobs,
+    concurrency: args['--jobs'] || os.cpus().length,
+    onResult: (result) => {
+      if (result.failure) {
+        problems++;
+        console.log(
+          `seed ${result.seed} (${result.soundCount} sounds): ${result.failure}\n  reproducer with ${result.reproducerSounds} sound(s): ${result.reproducer}`
+        );
+      }
+    },
+  })
+    .then((results) => {
+      // per size: total ms per stage over the banks which round tripped, and
+      // how many came back byte identical
+      const bySize = new Map(
+        sizes.map((size) => [size, {ms: {}, banks: 0, same: 0}])
+      );
+      results.forEach((result) => {
+        if (result.failure) return;
+        const totals = bySize.get(result.soundCount);
+        totals.banks++;
+        if (result.byteIdentical) totals.same++;
+        STAGES.forEach((stage) => {
+          totals.ms[stage] =
+            (totals.ms[stage] || 0) + (result.timings[stage] || 0);
+        });
+      });
+
+      const perSound = (size, stage) => {
+        const totals = bySize.get(size);
+        return (totals.ms[stage] * 1000) / (size * totals.banks);
+      };
+      const timedSizes = sizes.filter((size) => bySize.get(size).banks > 0);
+      if (timedSizes.length) {
+        console.log(`\nus per sound, over the banks which round tripped:`);
+        console.log(
+          ['sounds'.padStart(8), ...STAGES.map((s) => s.padStart(10))].join(
+            ' '
+          )
+        );
+      }
+      timedSizes.forEach((size) => {
+        const totals = bySize.get(size);
+        console.log(
+          [
+            String(size).padStart(8),
+            ...STAGES.map((stage) =>
+              perSound(size, stage).toFixed(1).padStart(10)
+            ),
+            ` ${totals.same}/${totals.banks} byte identical`,
+          ].join(' ')
+        );
+      });
+
+      // scaling problems show up as a growing cost per sound
+      const smallest = Math.min(...timedSizes);
+      const largest = Math.max(...timedSizes);
+      if (largest > smallest) {
+        STAGES.forEach((stage) => {
+          const growth = perSound(largest, stage) / perSound(smallest, stage);
+          if (growth > maxGrowth) {
+            problems++;
+            console.log(
+              `${stage} slows down with bank size: ${growth.toFixed(
+                1
+              )}x the time per sound at ${largest} sounds than at ${smallest}`
+            );
+          }
+        });
+      }
+      console.log(
+        problems
+          ? `${problems} problem(s)`
+          : `${results.length} bank(s) round tripped`
+      );
+      if (problems) process.exitCode = 1;
+    })
+    .catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+}
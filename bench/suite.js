@@ -0,0 +1,415 @@
+#!/usr/bin/env node
+
+// benchmarks each stage of the sound tool pipeline on a fixed synthetic corpus
+// (banks of a few sizes, long midi files and .seqs, VADPCM compressed .aifc
+// samples) generated locally with a fixed seed. each stage runs in its own
+// process so its peak memory can be measured, and reports ops/sec, MB/s and
+// peak rss. results can be saved as json and compared against a baseline
+// saved earlier, flagging stages which got slower or use more memory.
+// eg.
+// node bench/suite.js --out baseline.json
+// (make changes)
+// node bench/suite.js --baseline baseline.json
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const childProcess = require('child_process');
+const arg = require('arg');
+const {
+  SAMPLE_RATE,
+  makeRandom,
+  makeToneAIFF,
+  makeSyntheticInst,
+} = require('./fixtures');
+
+const args = arg({
+  '--corpus': String, // dir to generate the corpus in (or reuse it from)
+  '--stages': String, // comma separated stages to run (default all)
+  '--min-time': Number, // seconds to run each stage for (default 2)
+  '--out': String, // save results as json
+  '--baseline': String, // results to compare against
+  '--threshold': Number, // % slower or bigger to count as a regression
+  '--stage': String, // internal: run one stage in this process
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `bench suite [--corpus dir] [--stages a,b] [--min-time s] [--out results.json] [--baseline results.json] [--threshold %]`
+  );
+  process.exit(0);
+}
+
+// bump when the corpus changes, so results from different corpora aren't
+// compared
+const CORPUS_VERSION = 2;
+
+const BANK_SIZES = {
+  small: {instruments: 16, soundsPerInstrument: 1},
+  medium: {instruments: 128, soundsPerInstrument: 2},
+  large: {instruments: 128, soundsPerInstrument: 8},
+};
+const SAMPLE_COUNT = 32;
+const SONG_COUNT = 8;
+
+// a VADPCM compressed tone, with a loop in every other sample
+function writeSample(file, index) {
+  const {encodeVADPCMAIFF} = require('../soundtools');
+  const length = Math.round(SAMPLE_RATE * (0.5 + (index % 4) * 0.25));
+  const aiff = makeToneAIFF(index, length, {loop: index % 2 === 1});
+  fs.writeFileSync(file, encodeVADPCMAIFF(aiff, file).aifc);
+}
+
+function writeMidiFile(file, song, random) {
+  const {writeMidi} = require('midi-file');
+  const tracks = [
+    [
+      {
+        deltaTime: 0,
+        meta: true,
+        type: 'setTempo',
+        microsecondsPerBeat: 500000,
+      },
+      {deltaTime: 0, meta: true, type: 'endOfTrack'},
+    ],
+  ];
+  for (let t = 0; t < 12; t++) {
+    const channel = t;
+    const track = [
+      {deltaTime: 0, channel, type: 'programChange', programNumber: t},
+    ];
+    for (let i = 0; i < 2000 + song * 500; i++) {
+      const noteNumber = 36 + random(48);
+      if (random(8) === 0) {
+        track.push({
+          deltaTime: 0,
+          channel,
+          type: 'controller',
+          controllerType: 7,
+          value: random(128),
+        });
+      }
+      track.push(
+        {
+          deltaTime: random(3) * 60,
+          channel,
+          type: 'noteOn',
+          noteNumber,
+          velocity: 1 + random(127),
+        },
+        {
+          deltaTime: 60 + random(4) * 60,
+          channel,
+          type: 'noteOff',
+          noteNumber,
+          velocity: 0,
+        }
+      );
+    }
+    track.push({deltaTime: 0, meta: true, type: 'endOfTrack'});
+    tracks.push(track);
+  }
+  fs.writeFileSync(
+    file,
+    Buffer.from(
+      writeMidi({
+        header: {format: 1, numTracks: tracks.length, ticksPerBeat: 480},
+        tracks,
+      })
+    )
+  );
+}
+
+// the corpus is only generated if it isn't already there (with the same
+// version), as generating it takes a while
+async function ensureCorpus(dir) {
+  const versionFile = path.join(dir, 'version.json');
+  if (
+    fs.existsSync(versionFile) &&
+    JSON.parse(fs.readFileSync(versionFile, 'utf8')).version === CORPUS_VERSION
+  ) {
+    return;
+  }
+  console.log(`generating corpus in ${dir}`);
+  const {parseWithNiceErrors} = require('../instparserapi');
+  const {sourceToBank} = require('../soundtools');
+  const midicvt = require('../midicvt');
+  const random = makeRandom(1);
+
+  fs.mkdirSync(path.join(dir, 'samples'), {recursive: true});
+  for (let i = 0; i < SAMPLE_COUNT; i++) {
+    writeSample(path.join(dir, 'samples', `s${i}.aifc`), i);
+  }
+  for (const [name, size] of Object.entries(BANK_SIZES)) {
+    const instFile = path.join(dir, `${name}.inst`);
+    // a few envelopes and keymaps shared between all the sounds
+    fs.writeFileSync(
+      instFile,
+      makeSyntheticInst(size.instruments, {
+        soundsPerInstrument: size.soundsPerInstrument,
+        sharedDefs: 8,
+        getSampleFile: (s) => `./samples/s${s % SAMPLE_COUNT}.aifc`,
+      })
+    );
+    const defs = parseWithNiceErrors(
+      fs.readFileSync(instFile, 'utf8'),
+      instFile
+    );
+    sourceToBank(defs, instFile).writeBankFile(path.join(dir, name));
+  }
+  fs.mkdirSync(path.join(dir, 'songs'), {recursive: true});
+  for (let i = 0; i < SONG_COUNT; i++) {
+    const midiFile = path.join(dir, 'songs', `song${i}.mid`);
+    writeMidiFile(midiFile, i, random);
+    const exitCode = await midicvt.run(
+      ['-o', path.join(dir, 'songs', `song${i}.seq`), midiFile],
+      {log: () => {}}
+    );
+    if (exitCode !== 0) throw new Error(`midicvt failed on ${midiFile}`);
+  }
+  fs.writeFileSync(versionFile, JSON.stringify({version: CORPUS_VERSION}));
+}
+
+function listFiles(dir, ext) {
+  return fs
+    .readdirSync(dir)
+    .filter((entry) => entry.endsWith(ext))
+    .sort()
+    .map((entry) => path.join(dir, entry));
+}
+
+// each stage's setup loads its inputs and returns {bytes, op}, where bytes is
+// the input size handled by each call of op
+const STAGES = {
+  'AIFF.parse': (corpus) => {
+    const AIFF = require('../aiff');
+    const inputs = listFiles(path.join(corpus, 'samples'), '.aifc').map(
+      (file) => fs.readFileSync(file)
+    );
+    return {
+      bytes: inputs.reduce((sum, input) => sum + input.length, 0),
+      op: () => inputs.forEach((input) => AIFF.parse(input)),
+    };
+  },
+  parseCtl: (corpus) => {
+    const {parseCtl} = require('../soundtools');
+    const inputs = Object.keys(BANK_SIZES).map((name) =>
+      fs.readFileSync(path.join(corpus, `${name}.ctl`))
+    );
+    return {
+      bytes: inputs.reduce((sum, input) => sum + input.length, 0),
+      op: () => inputs.forEach((input) => parseCtl(input, 0)),
+    };
+  },
+  sourceToBank: (corpus) => {
+    const {parseWithNiceErrors} = require('../instparserapi');
+    const {sourceToBank} = require('../soundtools');
+    const outDir = fs.mkdtempSync(path.join(os.tmpdir(), 'bench-'));
+    const instFile = path.join(corpus, 'large.inst');
+    const contents = fs.readFileSync(instFile, 'utf8');
+    return {
+      bytes:
+        contents.length +
+        fs.statSync(path.join(corpus, 'large.tbl')).size,
+      op: () => {
+        const defs = parseWithNiceErrors(contents, instFile);
+        sourceToBank(defs, instFile).writeBankFile(path.join(outDir, 'out'));
+      },
+      cleanup: () => fs.rmSync(outDir, {recursive: true, force: true}),
+    };
+  },
+  bankToSource: (corpus) => {
+    const {bankToSource} = require('../soundtools');
+    const outDir = fs.mkdtempSync(path.join(os.tmpdir(), 'bench-'));
+    const ctl = fs.readFileSync(path.join(corpus, 'large.ctl'));
+    const tbl = fs.readFileSync(path.join(corpus, 'large.tbl'));
+    return {
+      bytes: ctl.length + tbl.length,
+      op: () => bankToSource(ctl, 0, tbl, 0, path.join(outDir, 'out')),
+      cleanup: () => fs.rmSync(outDir, {recursive: true, force: true}),
+    };
+  },
+  serializeSBK: (corpus) => {
+    const {serializeSBK} = require('../sequencebank');
+    const inputs = listFiles(path.join(corpus, 'songs'), '.seq').map((file) =>
+      fs.readFileSync(file)
+    );
+    return {
+      bytes: inputs.reduce((sum, input) => sum + input.length, 0),
+      op: () => serializeSBK(inputs),
+    };
+  },
+  midicvt: (corpus) => {
+    const midicvt = require('../midicvt');
+    const outDir = fs.mkdtempSync(path.join(os.tmpdir(), 'bench-'));
+    const midiFile = path.join(corpus, 'songs', `song${SONG_COUNT - 1}.mid`);
+    return {
+      bytes: fs.statSync(midiFile).size,
+      op: () =>
+        midicvt.run(['-o', path.join(outDir, 'out.seq'), midiFile], {
+          log: () => {},
+        }),
+      cleanup: () => fs.rmSync(outDir, {recursive: true, force: true}),
+    };
+  },
+};
+
+const SAMPLES = 10;
+
+// runs in a child process, so maxRSS is the stage's own. the time is split
+// into samples, and the median sample's rate is used, so a few slow ops (gc,
+// other processes) don't skew the result
+async function runStage(name, corpus, minTime) {
+  const {bytes, op, cleanup} = STAGES[name](corpus);
+  try {
+    await op(); // warm up
+    let ops = 0;
+    const rates = [];
+    for (let sample = 0; sample < SAMPLES; sample++) {
+      let sampleOps = 0;
+      let elapsed = 0;
+      const start = process.hrtime.bigint();
+      do {
+        await op();
+        sampleOps++;
+        elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+      } while (elapsed < minTime / SAMPLES);
+      ops += sampleOps;
+      rates.push(sampleOps / elapsed);
+    }
+    rates.sort((a, b) => a - b);
+    const opsPerSec = (rates[(SAMPLES - 1) >> 1] + rates[SAMPLES >> 1]) / 2;
+    return {
+      ops,
+      opsPerSec,
+      mbPerSec: (bytes * opsPerSec) / 1024 / 1024,
+      // maxRSS is in kilobytes
+      peakRssMB: process.resourceUsage().maxRSS / 1024,
+    };
+  } finally {
+    if (cleanup) cleanup();
+  }
+}
+
+function runStageProcess(name, corpus, minTime) {
+  return new Promise((resolve, reject) => {
+    const child = childProcess.fork(
+      __filename,
+      ['--stage', name, '--corpus', corpus, '--min-time', String(minTime)],
+      {stdio: ['ignore', 'inherit', 'inherit', 'ipc']}
+    );
+    let result = null;
+    child.on('message', (message) => {
+      result = message;
+    });
+    child.on('error', reject);
+    child.on('exit', (code) => {
+      if (code !== 0 || !result) {
+        reject(new Error(`stage ${name} failed (${code})`));
+      } else {
+        resolve(result);
+      }
+    });
+  });
+}
+
+function formatChange(percent) {
+  return `${percent >= 0 ? '+' : ''}${percent.toFixed(1)}%`;
+}
+
+function compareWithBaseline(results, baseline, threshold) {
+  if (baseline.corpusVersion !== results.corpusVersion) {
+    console.log(
+      `baseline is from corpus version ${baseline.corpusVersion}, not ${results.corpusVersion}. not comparing`
+    );
+    return [];
+  }
+  const regressions = [];
+  console.log(`\ncompared with baseline (${threshold}% threshold):`);
+  for (const [name, stage] of Object.entries(results.stages)) {
+    const base = baseline.stages[name];
+    if (!base) continue;
+    const speedChange = (stage.opsPerSec / base.opsPerSec - 1) * 100;
+    const memoryChange = (stage.peakRssMB / base.peakRssMB - 1) * 100;
+    const problems = [];
+    if (speedChange < -threshold) problems.push('slower');
+    if (memoryChange > threshold) problems.push('more memory');
+    if (problems.length) regressions.push(name);
+    console.log(
+      `${name.padEnd(14)} ops/sec ${formatChange(
+        speedChange
+      )}, peak rss ${formatChange(memoryChange)}${
+        problems.length ? `  REGRESSION (${problems.join(', ')})` : ''
+      }`
+    );
+  }
+  return regressions;
+}
+
+async function run() {
+  const minTime = args['--min-time'] || 2;
+  if (args['--stage']) {
+    process.send(await runStage(args['--stage'], args['--corpus'], minTime));
+    return;
+  }
+
+  const corpus =
+    args['--corpus'] || path.join(os.tmpdir(), 'n64soundtools-bench-corpus');
+  await ensureCorpus(corpus);
+
+  const stageNames = args['--stages']
+    ? args['--stages'].split(',')
+    : Object.keys(STAGES);
+  const unknown = stageNames.filter((name) => !STAGES[name]);
+  if (unknown.length) {
+    throw new Error(
+      `unknown stage(s) ${unknown.join(', ')}, stages are ${Object.keys(
+        STAGES
+      ).join(', ')}`
+    );
+  }
+
+  const results = {
+    corpusVersion: CORPUS_VERSION,
+    date: new Date().toISOString(),
+    node: process.version,
+    platform: `${process.platform} ${process.arch}`,
+    cpu: os.cpus()[0].model,
+    stages: {},
+  };
+  for (const name of stageNames) {
+    const stage = await runStageProcess(name, corpus, minTime);
+    results.stages[name] = stage;
+    console.log(
+      [
+        name.padEnd(14),
+        `${stage.opsPerSec.toFixed(2).padStart(10)} ops/sec`,
+        `${stage.mbPerSec.toFixed(1).padStart(8)} MB/s`,
+        `${stage.peakRssMB.toFixed(0).padStart(6)}MB peak rss`,
+      ].join(' ')
+    );
+  }
+
+  if (args['--out']) {
+    fs.writeFileSync(args['--out'], JSON.stringify(results, null, 2) + '\n');
+  }
+  if (args['--baseline']) {
+    const baseline = JSON.parse(fs.readFileSync(args['--baseline'], 'utf8'));
+    const regressions = compareWithBaseline(
+      results,
+      baseline,
+      args['--threshold'] != null ? args['--threshold'] : 10
+    );
+    if (regressions.length) {
+      console.log(`regressions in ${regressions.join(', ')}`);
+      process.exitCode = 1;
+    }
+  }
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
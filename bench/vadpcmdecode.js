@@ -0,0 +1,114 @@
+#!/usr/bin/env node
+
+// benchmarks VADPCM decoding of a directory of .aifc files (eg. the samples dir
+// written by bankdec) in-process on one thread, with vadpcmdecode.js on the
+// worker pool, and optionally with the sdk's vadpcm_dec for comparison. when
+// vadpcm_dec is given, its output is also compared sample for sample.
+// eg. node bench/vadpcmdecode.js --bin vadpcm_dec test/genmidi_samples
+
+const fs = require('fs');
+const path = require('path');
+const util = require('util');
+const execFile = util.promisify(require('child_process').execFile);
+const arg = require('arg');
+const AIFF = require('../aiff');
+const {getVADPCMChunks} = require('../soundtools');
+const {decodeVADPCM, bigEndianBufferToSamples} = require('../vadpcm');
+const {findFiles} = require('../findfiles');
+
+const args = arg({
+  '--bin': String, // path to the sdk's vadpcm_dec
+  '--jobs': Number,
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help'] || !args._.length) {
+  console.log(`vadpcmdecode bench [--bin vadpcm_dec] [--jobs n] dir or files`);
+  process.exit(0);
+}
+
+function elapsedSeconds(start) {
+  return Number(process.hrtime.bigint() - start) / 1e9;
+}
+
+async function run() {
+  const files = findFiles(args._, /\.aifc$/i);
+  const aiffs = files.map((file) => AIFF.parse(fs.readFileSync(file)));
+  const totalBytes = aiffs.reduce(
+    (sum, aiff) => sum + aiff.soundData.length,
+    0
+  );
+  console.log(`${files.length} files, ${totalBytes} bytes of VADPCM data`);
+
+  // in-process, single thread, excluding file io
+  let totalSamples = 0;
+  const decoded = [];
+  let start = process.hrtime.bigint();
+  aiffs.forEach((aiff, i) => {
+    const {book} = getVADPCMChunks(aiff, files[i]);
+    const samples = decodeVADPCM(aiff.soundData, book);
+    totalSamples += samples.length;
+    decoded.push(samples);
+  });
+  let seconds = elapsedSeconds(start);
+  console.log(
+    `in-process: ${seconds.toFixed(3)}s, ${(totalSamples / seconds / 1e6).toFixed(
+      2
+    )}M samples/s`
+  );
+
+  // the vadpcmdecode cli, including process startup and file io
+  start = process.hrtime.bigint();
+  await execFile(process.execPath, [
+    path.join(__dirname, '../vadpcmdecode.js'),
+    '--jobs',
+    String(args['--jobs'] || require('os').cpus().length),
+    ...files,
+  ]);
+  seconds = elapsedSeconds(start);
+  console.log(`vadpcmdecode.js: ${seconds.toFixed(3)}s (${files.length} files)`);
+
+  if (!args['--bin']) return;
+
+  // the old approach: one vadpcm_dec process per file
+  start = process.hrtime.bigint();
+  const outputs = await Promise.all(
+    files.map((file) =>
+      execFile(args['--bin'], [file], {
+        encoding: 'buffer',
+        maxBuffer: 64 * 1024 * 1024,
+      })
+    )
+  );
+  seconds = elapsedSeconds(start);
+  console.log(`${args['--bin']}: ${seconds.toFixed(3)}s (${files.length} files)`);
+
+  let mismatched = 0;
+  outputs.forEach(({stdout}, i) => {
+    const reference = bigEndianBufferToSamples(stdout);
+    const ours = decoded[i];
+    const length = Math.min(reference.length, ours.length);
+    for (let j = 0; j < length; j++) {
+      if (reference[j] !== ours[j]) {
+        console.log(
+          `${files[i]}: differs at sample ${j}: expected ${reference[j]}, got ${ours[j]}`
+        );
+        mismatched++;
+        return;
+      }
+    }
+    if (reference.length !== ours.length) {
+      console.log(
+        `${files[i]}: length ${ours.length} samples, expected ${reference.length}`
+      );
+      mismatched++;
+    }
+  });
+  console.log(`${files.length - mismatched} of ${files.length} files match`);
+}
+
+run().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
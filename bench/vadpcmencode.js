@@ -0,0 +1,167 @@
+#!/usr/bin/env node
+
+// reports encode throughput and SNR of the VADPCM encoder for a set of
+// uncompressed .aiff files, for each encoder search mode. given --sdk <dir>
+// containing the same samples encoded with the sdk's tabledesign/vadpcm_enc
+// (as <name>.aifc), their SNR is reported alongside for comparison.
+// with no files, a few synthetic test tones are used. also checks that
+// decoding from the loop state the encoder returns gives the same samples as
+// decoding straight through, as the sample is heard when it loops
+// eg. node bench/vadpcmencode.js --sdk sdk_encoded/ samples/*.aiff
+
+const fs = require('fs');
+const path = require('path');
+const arg = require('arg');
+const AIFF = require('../aiff');
+const {getVADPCMChunks} = require('../soundtools');
+const {designCodebook} = require('../tabledesign');
+const {
+  ENCODE_MODES,
+  FRAME_SIZE,
+  FRAME_SAMPLES,
+  decodeVADPCM,
+  encodeVADPCM,
+  bigEndianBufferToSamples,
+  samplesToBigEndianBuffer,
+  computeSNR,
+} = require('../vadpcm');
+const {makeRandom} = require('./fixtures');
+
+const args = arg({
+  '--sdk': String, // dir of sdk encoded .aifc files
+  '--modes': String, // comma separated encoder modes to run
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`vadpcmencode bench [--sdk dir] [--modes fast,normal,max] aiff files`);
+  process.exit(0);
+}
+
+const modes = args['--modes'] ? args['--modes'].split(',') : ENCODE_MODES;
+
+function makeTestTones() {
+  const sampleRate = 22050;
+  const length = sampleRate * 2;
+  const random = makeRandom(7);
+  const noise = () => random(0x7fffffff) / 0x7fffffff - 0.5;
+  const tones = {
+    sine: (i) => 20000 * Math.sin((2 * Math.PI * 440 * i) / sampleRate),
+    decaying_chord: (i) =>
+      Math.exp(-i / sampleRate) *
+      [262, 330, 392].reduce(
+        (sum, f) => sum + 8000 * Math.sin((2 * Math.PI * f * i) / sampleRate),
+        0
+      ),
+    noisy_bass: (i) =>
+      12000 * Math.sin((2 * Math.PI * 55 * i) / sampleRate) + noise() * 4000,
+  };
+  return Object.entries(tones).map(([name, fn]) => {
+    const samples = new Int16Array(length);
+    for (let i = 0; i < length; i++) {
+      samples[i] = Math.max(-32768, Math.min(32767, Math.round(fn(i))));
+    }
+    return {
+      file: name,
+      aiff: {
+        soundData: samplesToBigEndianBuffer(samples),
+        numChannels: 1,
+        sampleSize: 16,
+        sampleRate,
+        chunks: [],
+      },
+    };
+  });
+}
+
+function sdkResult(file, original) {
+  const name = path.basename(file).replace(/\.aiff?$/i, '') + '.aifc';
+  const sdkFile = path.join(args['--sdk'], name);
+  if (!fs.existsSync(sdkFile)) return null;
+  const aifc = AIFF.parse(fs.readFileSync(sdkFile));
+  const {book} = getVADPCMChunks(aifc, sdkFile);
+  return {
+    snr: computeSNR(original, decodeVADPCM(aifc.soundData, book)),
+    bytes: aifc.soundData.length,
+  };
+}
+
+// loops from the middle of the sample, and compares decoding from where the
+// microcode resumes (the frame after the one containing the loop start) with
+// the loop state against decoding the whole sample
+function checkLoopState(samples, book, mode) {
+  const loopStart = samples.length >> 1;
+  const {data, loopState} = encodeVADPCM(samples, book, {loopStart, mode});
+  const resumeFrame = Math.floor(loopStart / FRAME_SAMPLES) + 1;
+  const straight = decodeVADPCM(data, book).subarray(
+    resumeFrame * FRAME_SAMPLES
+  );
+  const looped = decodeVADPCM(
+    data.subarray(resumeFrame * FRAME_SIZE),
+    book,
+    loopState
+  );
+  return (
+    looped.length === straight.length &&
+    looped.every((sample, i) => sample === straight[i])
+  );
+}
+
+const inputs = args._.length
+  ? args._.map((file) => ({file, aiff: AIFF.parse(fs.readFileSync(file))}))
+  : makeTestTones();
+
+// the codebook is trained once per sample and shared by every mode, so the
+// timings below are of the frame search alone
+inputs.forEach((input) => {
+  input.samples = bigEndianBufferToSamples(input.aiff.soundData);
+  const start = process.hrtime.bigint();
+  input.book = designCodebook(input.samples);
+  input.designSeconds = Number(process.hrtime.bigint() - start) / 1e9;
+});
+// warm up the jit so the first mode isn't penalised
+encodeVADPCM(inputs[0].samples, inputs[0].book, {mode: modes[0]});
+
+const rows = {};
+const summary = [];
+modes.forEach((mode) => {
+  let totalFrames = 0;
+  let totalSeconds = 0;
+  let totalSNR = 0;
+  let minSNR = Infinity;
+  inputs.forEach(({file, samples, book}) => {
+    const start = process.hrtime.bigint();
+    const {data} = encodeVADPCM(samples, book, {mode});
+    totalSeconds += Number(process.hrtime.bigint() - start) / 1e9;
+    totalFrames += Math.ceil(samples.length / FRAME_SAMPLES);
+    const snr = computeSNR(samples, decodeVADPCM(data, book));
+    totalSNR += snr;
+    minSNR = Math.min(minSNR, snr);
+    const row = (rows[file] = rows[file] || {file: path.basename(file)});
+    row[`${mode} SNR`] = snr.toFixed(2);
+    if (!checkLoopState(samples, book, mode)) {
+      console.error(`${file} (${mode}): decoding from the loop state differs`);
+      process.exitCode = 1;
+    }
+  });
+  summary.push({
+    mode,
+    'frames/s': Math.round(totalFrames / totalSeconds),
+    'mean SNR': (totalSNR / inputs.length).toFixed(2),
+    'min SNR': minSNR.toFixed(2),
+  });
+});
+
+if (args['--sdk']) {
+  inputs.forEach(({file, aiff}) => {
+    const sdk = sdkResult(file, bigEndianBufferToSamples(aiff.soundData));
+    rows[file]['sdk SNR'] = sdk ? sdk.snr.toFixed(2) : '-';
+    rows[file]['sdk bytes'] = sdk ? sdk.bytes : '-';
+  });
+}
+
+const designSeconds = inputs.reduce((sum, input) => sum + input.designSeconds, 0);
+console.table(Object.values(rows));
+console.table(summary);
+console.log(`codebook training: ${designSeconds.toFixed(3)}s total`);
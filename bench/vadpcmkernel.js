@@ -0,0 +1,138 @@
+#!/usr/bin/env node
+
+// microbenchmark of the unrolled VADPCM frame kernel against the reference
+// decoder, checking that both give identical output.
+// reads every ADPCM wavetable of a ctl/tbl bank (eg. the sdk's GenMidi bank),
+// or .aifc files, or if given nothing, random frames with a random codebook
+// eg. node bench/vadpcmkernel.js --bank ../ultra/usr/lib/PR/soundbanks/GenMidi
+
+const fs = require('fs');
+const path = require('path');
+const arg = require('arg');
+const AIFF = require('../aiff');
+const {parseCtl, getVADPCMChunks, AL_ADPCM_WAVE} = require('../soundtools');
+const {
+  expandCodebook,
+  decodeVADPCM,
+  decodeVADPCMReference,
+  FRAME_SIZE,
+} = require('../vadpcm');
+const {makeRandom} = require('./fixtures');
+
+const args = arg({
+  '--bank': String, // ctl/tbl path prefix
+  '--seconds': Number, // min time to spend on each decoder
+  '--help': Boolean,
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(
+    `vadpcmkernel bench [--bank ctl/tbl prefix] [--seconds n] [aifc files]`
+  );
+  process.exit(0);
+}
+
+function loadBankSamples(bankPath) {
+  const ctl = fs.readFileSync(bankPath + '.ctl');
+  const tbl = fs.readFileSync(bankPath + '.tbl');
+  const bankFile = parseCtl(ctl, 0);
+  return Object.values(bankFile.wavetables)
+    .filter((wavetable) => wavetable.type === AL_ADPCM_WAVE)
+    .map((wavetable) => ({
+      name: `wavetable ${wavetable.base}`,
+      data: tbl.slice(wavetable.base, wavetable.base + wavetable.len),
+      book: bankFile.books[wavetable.waveInfo.book],
+    }));
+}
+
+function loadAIFCSamples(files) {
+  return files.map((file) => {
+    const aiff = AIFF.parse(fs.readFileSync(file));
+    return {
+      name: file,
+      data: aiff.soundData,
+      book: getVADPCMChunks(aiff, file).book,
+    };
+  });
+}
+
+function makeRandomSamples() {
+  const random = makeRandom(1);
+  const order = 2;
+  const npredictors = 4;
+  const book = Buffer.alloc(npredictors * order * 8 * 2);
+  for (let i = 0; i < book.length; i += 2) {
+    book.writeInt16BE(random(8000) - 4000, i);
+  }
+  const data = Buffer.alloc(FRAME_SIZE * 200000);
+  for (let i = 0; i < data.length; i++) {
+    data[i] =
+      i % FRAME_SIZE === 0
+        ? (random(12) << 4) | random(npredictors)
+        : random(256);
+  }
+  return [{name: 'random', data, book: {order, npredictors, book}}];
+}
+
+function bench(name, decode, samples) {
+  const minSeconds = args['--seconds'] || 2;
+  let decodedSamples = 0;
+  let iterations = 0;
+  const start = process.hrtime.bigint();
+  let elapsed = 0;
+  while (elapsed < minSeconds) {
+    samples.forEach((sample) => {
+      decodedSamples += decode(sample.data, sample.codebook).length;
+    });
+    iterations++;
+    elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+  }
+  const rate = decodedSamples / elapsed;
+  console.log(
+    `${name}: ${(rate / 1e6).toFixed(2)}M samples/s (${iterations} iterations)`
+  );
+  return rate;
+}
+
+let samples;
+if (args['--bank']) {
+  samples = loadBankSamples(args['--bank'].replace(/\.(ctl|tbl)$/, ''));
+} else if (args._.length) {
+  samples = loadAIFCSamples(args._);
+} else {
+  samples = makeRandomSamples();
+}
+samples.forEach((sample) => {
+  sample.codebook = expandCodebook(sample.book);
+});
+
+const totalFrames = samples.reduce(
+  (sum, sample) => sum + Math.floor(sample.data.length / FRAME_SIZE),
+  0
+);
+console.log(`${samples.length} samples, ${totalFrames} frames`);
+
+let mismatched = 0;
+samples.forEach((sample) => {
+  const fast = decodeVADPCM(sample.data, sample.codebook);
+  const reference = decodeVADPCMReference(sample.data, sample.codebook);
+  for (let i = 0; i < reference.length; i++) {
+    if (fast[i] !== reference[i]) {
+      console.log(
+        `${sample.name}: differs at sample ${i}: reference ${reference[i]}, kernel ${fast[i]}`
+      );
+      mismatched++;
+      break;
+    }
+  }
+});
+if (mismatched) {
+  console.log(`${mismatched} samples differ from the reference`);
+  process.exit(1);
+}
+console.log('kernel output matches reference');
+
+const referenceRate = bench('reference', decodeVADPCMReference, samples);
+const kernelRate = bench('kernel', decodeVADPCM, samples);
+console.log(`speedup: ${(kernelRate / referenceRate).toFixed(2)}x`);
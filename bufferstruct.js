@@ -90,133 +90,181 @@ class BufferStructBase {
 }
 
 class BufferStruct extends BufferStructBase {
+  // when false, schemas are interpreted on every call rather than compiled
+  static compile = true;
+
   parse(buffer, startOffset, contextData = null) {
+    if (!BufferStruct.compile) {
+      return this.parseInterpreted(buffer, startOffset, contextData);
+    }
+    if (!this._compiledParse) {
+      this._compiledParse = this._compileParse();
+    }
+    return this._compiledParse(buffer, startOffset || 0, contextData);
+  }
+
+  serialize(data, contextData = null) {
+    if (!data) {
+      throw new Error(
+        `missing argument 'data' when serializing ${this.getName()}`
+      );
+    }
+    if (!BufferStruct.compile) {
+      return this.serializeInterpreted(data, contextData);
+    }
+    if (!this._compiledSerialize) {
+      this._compiledSerialize = this._compileSerialize();
+    }
+    return this._compiledSerialize(data, contextData);
+  }
+
+  parseInterpreted(buffer, startOffset, contextData = null) {
     const partialResult = {};
     let offset = startOffset || 0;
     Object.keys(this.schema.fields).forEach((fieldName) => {
-      const {field, endian, size, type} = this._getFieldConfig(
+      offset = this._parseField(
         fieldName,
+        buffer,
+        offset,
         partialResult,
         contextData
       );
+    });
+    if (isNaN(offset)) {
+      throw new Error(`invalid offset while parsing ${this.getName()}`);
+    }
+    this.lastOffset = offset;
+    return partialResult;
+  }
 
-      const parse = BytesTypes.has(type)
-        ? (buffer, startOffset) => {
-            if (size == null) {
-              throw new Error(
-                `can't parse field of type 'bytes' without predetermined size`
-              );
-            }
-            if (buffer.length < startOffset + size) {
-              throw new Error(
-                `tried to read ${size} bytes but only ${
-                  buffer.length - startOffset
-                } remaining for field ${fieldName} on ${this.getName()}`
-              );
-            }
-            const valueAsBuffer = buffer.slice(startOffset, startOffset + size);
-            let value = valueAsBuffer;
-            if (type === 'utf8') {
-              value = valueAsBuffer.toString('utf8');
-            }
-            return {value, parsedSize: size};
-          }
-        : type instanceof BufferStructBase
-        ? (buffer, startOffset) => {
-            // console.log('parsing', type.getName(), 'at', startOffset);
-            const value = type.parse(buffer, startOffset, contextData);
-            // use static size where determined (eg. in case of union)
-            const parsedSize =
-              size != null ? size : type.lastOffset - startOffset; // change in offset after parsing
-            // console.log({value, parsedSize});
-
-            return {value, parsedSize};
-          }
-        : (buffer, startOffset) => {
-            const methodName = `read${getBufferMethodName(type, size, endian)}`;
-
-            const value = buffer[methodName](startOffset);
-            if (this.schema.traceReads) {
-              console.log(methodName, {
-                fieldName,
-                type,
-                size,
-                endian,
-                startOffset,
-                value,
-              });
-            }
-
-            return {value, parsedSize: size};
-          };
-
-      // the ability to provide predetermined size, as well as define alignment, means we need to account for either of these
-      // sources of padding when advancing the point we are reading in the buffer
-      const parseWithAlignment = (buffer, startOffset) => {
-        const {value, parsedSize} = parse(buffer, nanthrows(startOffset));
-
-        if (size != null && parsedSize > size) {
-          throw new Error(
-            `parsed size ${parsedSize} larger than predetermined size ${size} for field ${fieldName} on ${this.getName()}`
-          );
-        }
-
-        // when field is aligned we must make sure to advance by aligned size
-        // additionally, if a predetermined size is set, we should use that size instead (in case of padding)
-        // we have already asserted above that the parsed size is not larger than the predetermined size
-        let parsedSizeWithAlignment = getAlignedSizeForField(
-          field,
-          size != null ? size : parsedSize
-        );
+  serializeInterpreted(data, contextData = null) {
+    const parts = [];
+    Object.keys(this.schema.fields).forEach((fieldName) => {
+      parts.push(...this._serializeField(fieldName, data, contextData));
+    });
+    return Buffer.concat(parts);
+  }
 
-        if (size != null) {
-          const alignedExpectedSize = getAlignedSizeForField(field, size);
+  // parses one field into partialResult, returning the offset after it
+  _parseField(fieldName, buffer, offset, partialResult, contextData) {
+    const {field, endian, size, type} = this._getFieldConfig(
+      fieldName,
+      partialResult,
+      contextData
+    );
 
-          if (parsedSizeWithAlignment > alignedExpectedSize) {
+    const parse = BytesTypes.has(type)
+      ? (buffer, startOffset) => {
+          if (size == null) {
             throw new Error(
-              `aligned parsed size ${parsedSizeWithAlignment} larger than aligned predetermined size ${alignedExpectedSize} for field ${fieldName} on ${this.getName()}`
+              `can't parse field of type 'bytes' without predetermined size`
             );
           }
+          if (buffer.length < startOffset + size) {
+            throw new Error(
+              `tried to read ${size} bytes but only ${
+                buffer.length - startOffset
+              } remaining for field ${fieldName} on ${this.getName()}`
+            );
+          }
+          const valueAsBuffer = buffer.slice(startOffset, startOffset + size);
+          let value = valueAsBuffer;
+          if (type === 'utf8') {
+            value = valueAsBuffer.toString('utf8');
+          }
+          return {value, parsedSize: size};
         }
+      : type instanceof BufferStructBase
+      ? (buffer, startOffset) => {
+          // console.log('parsing', type.getName(), 'at', startOffset);
+          const value = type.parse(buffer, startOffset, contextData);
+          // use static size where determined (eg. in case of union)
+          const parsedSize =
+            size != null ? size : type.lastOffset - startOffset; // change in offset after parsing
+          // console.log({value, parsedSize});
+
+          return {value, parsedSize};
+        }
+      : (buffer, startOffset) => {
+          const methodName = `read${getBufferMethodName(type, size, endian)}`;
 
-        return {value, consumedSize: nanthrows(parsedSizeWithAlignment)};
-      };
+          const value = buffer[methodName](startOffset);
+          if (this.schema.traceReads) {
+            console.log(methodName, {
+              fieldName,
+              type,
+              size,
+              endian,
+              startOffset,
+              value,
+            });
+          }
 
-      // try {
-      if (field.arrayElements) {
-        // array field
-        const count =
-          typeof field.arrayElements === 'function'
-            ? field.arrayElements(partialResult, contextData)
-            : field.arrayElements;
-        const array = new Array(count);
+          return {value, parsedSize: size};
+        };
 
-        for (var i = 0; i < count; ++i) {
-          // console.log('getting array el', i, 'of', count, 'at', offset);
-          const {value, consumedSize} = parseWithAlignment(buffer, offset);
+    // the ability to provide predetermined size, as well as define alignment, means we need to account for either of these
+    // sources of padding when advancing the point we are reading in the buffer
+    const parseWithAlignment = (buffer, startOffset) => {
+      const {value, parsedSize} = parse(buffer, nanthrows(startOffset));
 
-          offset += nanthrows(consumedSize);
-          array[i] = value;
+      if (size != null && parsedSize > size) {
+        throw new Error(
+          `parsed size ${parsedSize} larger than predetermined size ${size} for field ${fieldName} on ${this.getName()}`
+        );
+      }
+
+      // when field is aligned we must make sure to advance by aligned size
+      // additionally, if a predetermined size is set, we should use that size instead (in case of padding)
+      // we have already asserted above that the parsed size is not larger than the predetermined size
+      let parsedSizeWithAlignment = getAlignedSizeForField(
+        field,
+        size != null ? size : parsedSize
+      );
+
+      if (size != null) {
+        const alignedExpectedSize = getAlignedSizeForField(field, size);
+
+        if (parsedSizeWithAlignment > alignedExpectedSize) {
+          throw new Error(
+            `aligned parsed size ${parsedSizeWithAlignment} larger than aligned predetermined size ${alignedExpectedSize} for field ${fieldName} on ${this.getName()}`
+          );
         }
+      }
 
-        partialResult[fieldName] = array;
-      } else {
-        // non-array field
+      return {value, consumedSize: nanthrows(parsedSizeWithAlignment)};
+    };
+
+    // try {
+    if (field.arrayElements) {
+      // array field
+      const count =
+        typeof field.arrayElements === 'function'
+          ? field.arrayElements(partialResult, contextData)
+          : field.arrayElements;
+      const array = new Array(count);
+
+      for (var i = 0; i < count; ++i) {
+        // console.log('getting array el', i, 'of', count, 'at', offset);
         const {value, consumedSize} = parseWithAlignment(buffer, offset);
+
         offset += nanthrows(consumedSize);
-        partialResult[fieldName] = value;
+        array[i] = value;
       }
-      // } catch (error) {
-      //   throw new Error(
-      //     `failed parsing field ${fieldName} on ${this.getName()}: ${error}`
-      //   );
-      // }
-    });
-    if (isNaN(offset)) {
-      throw new Error(`invalid offset while parsing ${this.getName()}`);
+
+      partialResult[fieldName] = array;
+    } else {
+      // non-array field
+      const {value, consumedSize} = parseWithAlignment(buffer, offset);
+      offset += nanthrows(consumedSize);
+      partialResult[fieldName] = value;
     }
-    this.lastOffset = offset;
-    return partialResult;
+    // } catch (error) {
+    //   throw new Error(
+    //     `failed parsing field ${fieldName} on ${this.getName()}: ${error}`
+    //   );
+    // }
+    return offset;
   }
 
   _getFieldConfig(fieldName, partialFieldData, contextData) {
@@ -274,122 +322,270 @@ class BufferStruct extends BufferStructBase {
     return {field, endian, size, type: actualType};
   }
 
-  serialize(data, contextData = null) {
-    if (!data) {
-      throw new Error(
-        `missing argument 'data' when serializing ${this.getName()}`
-      );
-    }
+  // returns the buffers the field serializes to
+  _serializeField(fieldName, data, contextData) {
     const parts = [];
-    Object.keys(this.schema.fields).forEach((fieldName) => {
-      const {field, endian, size, type} = this._getFieldConfig(
-        fieldName,
-        data,
-        contextData
-      );
+    const {field, endian, size, type} = this._getFieldConfig(
+      fieldName,
+      data,
+      contextData
+    );
 
-      let value;
-      if (!(fieldName in data)) {
-        if ('default' in field) {
-          value =
-            typeof field.default === 'function'
-              ? field.default(data, contextData)
-              : field.default;
-        } else {
-          throw new Error(
-            `missing field ${fieldName} when serializing ${this.getName()}`
-          );
-        }
+    let value;
+    if (!(fieldName in data)) {
+      if ('default' in field) {
+        value =
+          typeof field.default === 'function'
+            ? field.default(data, contextData)
+            : field.default;
+      } else {
+        throw new Error(
+          `missing field ${fieldName} when serializing ${this.getName()}`
+        );
       }
+    } else {
       value = data[fieldName];
+    }
 
-      const serialize = BytesTypes.has(type)
-        ? (value) => {
-            let valueAsBuffer = value;
-            if (type === 'utf8') {
-              valueAsBuffer = Buffer.from(value, 'utf8');
-            }
+    const serialize = BytesTypes.has(type)
+      ? (value) => {
+          let valueAsBuffer = value;
+          if (type === 'utf8') {
+            valueAsBuffer = Buffer.from(value, 'utf8');
+          }
 
-            const dynSize = size == null ? valueAsBuffer.length : size;
-            const partBuffer = Buffer.alloc(dynSize);
-            valueAsBuffer.copy(partBuffer, 0, 0, dynSize);
+          const dynSize = size == null ? valueAsBuffer.length : size;
+          const partBuffer = Buffer.alloc(dynSize);
+          valueAsBuffer.copy(partBuffer, 0, 0, dynSize);
 
-            return partBuffer;
-          }
-        : type instanceof BufferStructBase
-        ? (value) => type.serialize(value, contextData)
-        : (value) => {
-            const methodName = `write${getBufferMethodName(
+          return partBuffer;
+        }
+      : type instanceof BufferStructBase
+      ? (value) => type.serialize(value, contextData)
+      : (value) => {
+          const methodName = `write${getBufferMethodName(
+            type,
+            size,
+            endian
+          )}`;
+
+          const partBuffer = Buffer.alloc(size);
+          partBuffer[methodName](value);
+          if (this.schema.traceWrites) {
+            console.log(methodName, {
+              fieldName,
               type,
               size,
-              endian
-            )}`;
-
-            const partBuffer = Buffer.alloc(size);
-            partBuffer[methodName](value);
-            if (this.schema.traceWrites) {
-              console.log(methodName, {
-                fieldName,
-                type,
-                size,
-                endian,
-                value,
-              });
-            }
-
-            return partBuffer;
-          };
-
-      const serializeWithAlignment = (value) => {
-        const partBuffer = serialize(value);
-        const serializedSize = partBuffer.length;
-        if (size != null && serializedSize > size) {
+              endian,
+              value,
+            });
+          }
+
+          return partBuffer;
+        };
+
+    const serializeWithAlignment = (value) => {
+      const partBuffer = serialize(value);
+      const serializedSize = partBuffer.length;
+      if (size != null && serializedSize > size) {
+        throw new Error(
+          `serialized size ${serializedSize} larger than predetermined size ${size} for field ${fieldName} on ${this.getName()}`
+        );
+      }
+
+      let maybeAlignedPartBuffer = partBuffer;
+      if (field.align != null) {
+        const alignedSerializedSize = getAlignedSize(
+          serializedSize,
+          field.align
+        );
+        const alignedExpectedSize = getAlignedSize(size, field.align);
+        if (alignedSerializedSize > alignedExpectedSize)
           throw new Error(
-            `serialized size ${serializedSize} larger than predetermined size ${size} for field ${fieldName} on ${this.getName()}`
+            `serialized aligned size ${
+              maybeAlignedPartBuffer.length
+            } larger than predetermined size (aligned) ${alignedExpectedSize} for field ${fieldName} on ${this.getName()}`
           );
-        }
 
-        let maybeAlignedPartBuffer = partBuffer;
-        if (field.align != null) {
-          const alignedSerializedSize = getAlignedSize(
-            serializedSize,
-            field.align
-          );
-          const alignedExpectedSize = getAlignedSize(size, field.align);
-          if (alignedSerializedSize > alignedExpectedSize)
-            throw new Error(
-              `serialized aligned size ${
-                maybeAlignedPartBuffer.length
-              } larger than predetermined size (aligned) ${alignedExpectedSize} for field ${fieldName} on ${this.getName()}`
-            );
+        const partBufferAligned = Buffer.alloc(alignedSerializedSize);
+        partBuffer.copy(partBufferAligned);
+        maybeAlignedPartBuffer = partBufferAligned;
+      }
 
-          const partBufferAligned = Buffer.alloc(alignedSerializedSize);
-          partBuffer.copy(partBufferAligned);
-          maybeAlignedPartBuffer = partBufferAligned;
-        }
+      return maybeAlignedPartBuffer;
+    };
+
+    // try {
+    if (field.arrayElements) {
+      for (var i = 0; i < value.length; ++i) {
+        const part = serializeWithAlignment(value[i]);
+        parts.push(part);
+      }
+    } else {
+      const part = serializeWithAlignment(value);
+      parts.push(part);
+    }
+    // } catch (error) {
+    //   const extra = DEBUG ? `${error.stack} \nrethrown stack:` : '';
+    //   throw new Error(
+    //     `failed serializing field ${fieldName}: ${error} ${extra}`
+    //   );
+    // }
+    return parts;
+  }
 
-        return maybeAlignedPartBuffer;
-      };
+  // if the field is a number, or bytes/string of fixed size, with no
+  // dependencies on other fields, returns its method name suffix and the size
+  // it occupies including alignment
+  _getStaticFieldLayout(fieldName) {
+    const field = this.schema.fields[fieldName];
+    const {type, size} = field;
+    if (typeof size !== 'number' || size < 0 || field.arrayElements) {
+      return null;
+    }
+    let method = null;
+    if (BytesTypes.has(type)) {
+      method = type;
+    } else if (type in FieldTypesToBufferMethods) {
+      const endian = field.endian || this.schema.endian || 'little';
+      method = getBufferMethodName(type, size, endian);
+      if (!(`read${method}` in Buffer.prototype)) return null;
+    } else {
+      return null;
+    }
+    return {method, size, alignedSize: getAlignedSizeForField(field, size)};
+  }
 
-      // try {
-      if (field.arrayElements) {
-        for (var i = 0; i < value.length; ++i) {
-          const part = serializeWithAlignment(value[i]);
-          parts.push(part);
-        }
+  // generates a parse function with the schema unrolled. runs of fixed size
+  // fields are read at constant offsets from the last dynamically sized field,
+  // and any other fields are parsed by _parseField
+  _compileParse() {
+    if (this.schema.traceReads) {
+      return (buffer, startOffset, contextData) =>
+        this.parseInterpreted(buffer, startOffset, contextData);
+    }
+    const lines = ['let offset = startOffset;', 'const result = {};'];
+    let pending = 0; // size of the fixed size fields since offset was updated
+    const flush = () => {
+      if (pending) lines.push(`offset += ${pending};`);
+      pending = 0;
+    };
+    Object.keys(this.schema.fields).forEach((fieldName) => {
+      const key = JSON.stringify(fieldName);
+      const layout = this._getStaticFieldLayout(fieldName);
+      if (!layout) {
+        flush();
+        lines.push(
+          `offset = self._parseField(${key}, buffer, offset, result, contextData);`
+        );
+        return;
+      }
+      const start = `offset + ${pending}`;
+      if (BytesTypes.has(layout.method)) {
+        const end = `offset + ${pending + layout.size}`;
+        lines.push(
+          `if (buffer.length < ${end}) throw self._bytesRangeError(${key}, ${layout.size}, buffer.length - (${start}));`,
+          `result[${key}] = buffer.slice(${start}, ${end})${
+            layout.method === 'utf8' ? ".toString('utf8')" : ''
+          };`
+        );
       } else {
-        const part = serializeWithAlignment(value);
-        parts.push(part);
+        lines.push(`result[${key}] = buffer.read${layout.method}(${start});`);
+      }
+      pending += layout.alignedSize;
+    });
+    flush();
+    lines.push(
+      `if (isNaN(offset)) throw new Error('invalid offset while parsing ' + self.getName());`,
+      'self.lastOffset = offset;',
+      'return result;'
+    );
+    DEBUG && console.log(this.getName(), lines.join('\n'));
+    return new Function(
+      'self',
+      `return function parse${this._getIdentifier()}(buffer, startOffset, contextData) {
+${lines.join('\n')}
+};`
+    )(this);
+  }
+
+  // generates a serialize function with the schema unrolled. each run of fixed
+  // size fields is written into one buffer at constant offsets, and any other
+  // fields are serialized by _serializeField
+  _compileSerialize() {
+    if (this.schema.traceWrites) {
+      return (data, contextData) =>
+        this.serializeInterpreted(data, contextData);
+    }
+    const fields = this.schema.fields;
+    const lines = ['const parts = [];', 'let value;'];
+    let run = []; // lines writing the current run of fixed size fields
+    let runSize = 0;
+    const flush = () => {
+      if (!run.length) return;
+      lines.push(
+        '{',
+        `const part = Buffer.alloc(${runSize});`,
+        ...run,
+        'parts.push(part);',
+        '}'
+      );
+      run = [];
+      runSize = 0;
+    };
+    Object.keys(fields).forEach((fieldName) => {
+      const key = JSON.stringify(fieldName);
+      const layout = this._getStaticFieldLayout(fieldName);
+      if (!layout) {
+        flush();
+        lines.push(
+          `parts.push(...self._serializeField(${key}, data, contextData));`
+        );
+        return;
       }
-      // } catch (error) {
-      //   const extra = DEBUG ? `${error.stack} \nrethrown stack:` : '';
-      //   throw new Error(
-      //     `failed serializing field ${fieldName}: ${error} ${extra}`
-      //   );
-      // }
+      const field = `self.schema.fields[${key}]`;
+      run.push(
+        `value = data[${key}];`,
+        `if (value === undefined && !(${key} in data)) ${
+          !('default' in fields[fieldName])
+            ? `throw new Error('missing field ' + ${key} + ' when serializing ' + self.getName());`
+            : typeof fields[fieldName].default === 'function'
+            ? `value = ${field}.default(data, contextData);`
+            : `value = ${field}.default;`
+        }`
+      );
+      if (layout.method === 'utf8') {
+        run.push(
+          `Buffer.from(value, 'utf8').copy(part, ${runSize}, 0, ${layout.size});`
+        );
+      } else if (layout.method === 'bytes') {
+        run.push(`value.copy(part, ${runSize}, 0, ${layout.size});`);
+      } else {
+        run.push(`part.write${layout.method}(value, ${runSize});`);
+      }
+      runSize += layout.alignedSize;
     });
+    flush();
+    lines.push(
+      'return parts.length === 1 ? parts[0] : Buffer.concat(parts);'
+    );
+    DEBUG && console.log(this.getName(), lines.join('\n'));
+    return new Function(
+      'self',
+      `return function serialize${this._getIdentifier()}(data, contextData) {
+${lines.join('\n')}
+};`
+    )(this);
+  }
 
-    return Buffer.concat(parts);
+  _getIdentifier() {
+    return this.getName().replace(/[^A-Za-z0-9_$]/g, '_');
+  }
+
+  _bytesRangeError(fieldName, size, remaining) {
+    return new Error(
+      `tried to read ${size} bytes but only ${remaining} remaining for field ${fieldName} on ${this.getName()}`
+    );
   }
 
   _staticSize = null;
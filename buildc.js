@@ -0,0 +1,122 @@
+#!/usr/bin/env node
+
+// buildc runs ic, sbc or midicvt on the buildd started in the current
+// directory, so the tools don't have to be loaded (or their inputs read again)
+// for each run. if there's no buildd, the tool runs in this process instead.
+// eg. buildc midicvt -o song.seq song.mid
+
+// only what's needed to talk to buildd is loaded up front
+const net = require('net');
+const {
+  getSocketPath,
+  sendMessage,
+  receiveMessages,
+} = require('./buildprotocol');
+
+const TOOLS = ['ic', 'sbc', 'midicvt'];
+
+const USAGE = `buildc [--socket path] <${TOOLS.join('|')}> [tool arguments...]
+buildc [--socket path] --status|--stop
+
+  --socket: buildd's socket, if it wasn't started with the default
+  --status: print buildd's stats
+  --stop: stop buildd`;
+
+// buildc's own options come before the tool, so they can't be confused with
+// the tool's
+function parseArgs(argv) {
+  const options = {socket: null, command: null, tool: null, toolArgv: []};
+  for (let i = 0; i < argv.length; i++) {
+    switch (argv[i]) {
+      case '--socket':
+        options.socket = argv[++i];
+        break;
+      case '--status':
+      case '--stop':
+        options.command = argv[i].slice(2);
+        break;
+      case '--help':
+      case '-h':
+        options.command = 'help';
+        break;
+      default:
+        options.tool = argv[i];
+        options.toolArgv = argv.slice(i + 1);
+        return options;
+    }
+  }
+  return options;
+}
+
+// resolves to the exit code
+function runOnDaemon(socketPath, message) {
+  return new Promise((resolve, reject) => {
+    const socket = net.connect(socketPath);
+    let exitCode = null;
+    let connected = false;
+    socket.on('connect', () => {
+      connected = true;
+      sendMessage(socket, message);
+    });
+    // once connected, the tool may have started, so it isn't run again here
+    socket.on('error', (err) => {
+      if (!connected) reject(err);
+    });
+    socket.on('close', () => {
+      if (!connected) return;
+      if (exitCode == null) {
+        console.error(`buildd closed the connection`);
+        exitCode = 1;
+      }
+      resolve(exitCode);
+    });
+    receiveMessages(socket, (response) => {
+      if (response.log != null) {
+        console.log(response.log);
+      } else if (response.error != null) {
+        console.error(response.error);
+      } else if (response.status != null) {
+        console.log(JSON.stringify(response.status, null, 2));
+        exitCode = 0;
+      } else if (response.exitCode != null) {
+        exitCode = response.exitCode;
+      }
+    });
+  });
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  if (options.command === 'help' || (!options.command && !options.tool)) {
+    console.log(USAGE);
+    return options.command === 'help' ? 0 : 1;
+  }
+  if (options.tool && !TOOLS.includes(options.tool)) {
+    console.error(`unknown tool ${options.tool}\n${USAGE}`);
+    return 1;
+  }
+
+  const socketPath = options.socket || getSocketPath();
+  const message = options.command
+    ? {command: options.command}
+    : {tool: options.tool, argv: options.toolArgv, cwd: process.cwd()};
+  try {
+    return await runOnDaemon(socketPath, message);
+  } catch (err) {
+    if (err.code !== 'ENOENT' && err.code !== 'ECONNREFUSED') throw err;
+    if (options.command) {
+      console.error(`buildd isn't running on ${socketPath}`);
+      return 1;
+    }
+    return require(`./${options.tool}`).run(options.toolArgv);
+  }
+}
+
+main()
+  .then((code) => {
+    process.exitCode = code;
+  })
+  .catch((err) => {
+    console.error(err);
+    process.exit(1);
+  });
@@ -0,0 +1,202 @@
+#!/usr/bin/env node
+
+// buildd is a long running build server for ic, sbc and midicvt. it keeps the
+// tools (including the generated .inst parser and the midi parser) loaded,
+// and keeps what they read from their inputs (parsed .inst and midi files,
+// samples, .seq files) in memory, watching the files so changed ones are read
+// again. run buildd in the directory the build runs in, then run the tools
+// through buildc:
+// buildd &
+// buildc midicvt -o song.seq song.mid
+// buildc ic -o bank bank.inst
+
+const fs = require('fs');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+const util = require('util');
+const arg = require('arg');
+
+const {FileCache} = require('./filecache');
+const SampleCache = require('./samplecache');
+const {
+  getSocketPath,
+  sendMessage,
+  receiveMessages,
+} = require('./buildprotocol');
+
+const TOOLS = {
+  ic: require('./ic'),
+  sbc: require('./sbc'),
+  midicvt: require('./midicvt'),
+};
+
+const args = arg({
+  // Types
+  '--help': Boolean,
+  '--socket': String, // where to listen, instead of the default for the cwd
+  '--jobs': Number, // max tool runs at once
+  '--quiet': Boolean, // don't print each job
+
+  // Aliases
+  '-j': '--jobs',
+  '-q': '--quiet',
+  '-h': '--help',
+});
+
+if (args['--help']) {
+  console.log(`buildd [--socket path] [--jobs n] [--quiet]
+
+runs ic, sbc and midicvt for buildc, keeping the tools loaded and their inputs
+cached between runs. tools run in the directory buildd was started in
+
+  --socket: unix socket (or windows named pipe) to listen on. by default this
+    is derived from the working directory, which buildc does too
+  -j, --jobs: max tool runs at once (default: number of cpus). more are queued.
+    runs are interleaved on one thread, apart from the parts of ic and
+    midicvt --batch which use worker threads
+  -q, --quiet: don't print each run
+`);
+  process.exit(0);
+}
+
+const socketPath = args['--socket'] || getSocketPath();
+const maxJobs = args['--jobs'] || os.cpus().length;
+const startTime = Date.now();
+
+const files = new FileCache();
+const stats = {jobs: 0, failed: 0, running: 0, queued: 0};
+
+// sample cache directories are opened once, so their index stays loaded.
+// their hit/miss stats are reset for each run using them
+const sampleCaches = new Map();
+function openSampleCache(dir) {
+  const fullPath = path.resolve(dir);
+  if (!sampleCaches.has(fullPath)) {
+    sampleCaches.set(fullPath, new SampleCache(fullPath));
+  }
+  const cache = sampleCaches.get(fullPath);
+  cache.stats = {hits: 0, misses: 0, filesRead: 0};
+  return cache;
+}
+
+// resolves when a job can run
+const waiting = [];
+function startJob() {
+  if (stats.running < maxJobs) {
+    stats.running++;
+    return Promise.resolve();
+  }
+  stats.queued++;
+  return new Promise((resolve) => waiting.push(resolve));
+}
+
+function finishJob() {
+  const next = waiting.shift();
+  if (next) {
+    stats.queued--;
+    next();
+  } else {
+    stats.running--;
+  }
+}
+
+async function runTool(socket, {tool, argv, cwd}) {
+  if (path.resolve(cwd) !== process.cwd()) {
+    sendMessage(socket, {
+      error: `buildd is running in ${process.cwd()}, not ${cwd}`,
+    });
+    sendMessage(socket, {exitCode: 1});
+    return;
+  }
+  if (!TOOLS[tool]) {
+    sendMessage(socket, {error: `unknown tool ${tool}`});
+    sendMessage(socket, {exitCode: 1});
+    return;
+  }
+
+  await startJob();
+  const jobStart = Date.now();
+  let exitCode = 1;
+  try {
+    exitCode = await TOOLS[tool].run(argv, {
+      log: (...message) => sendMessage(socket, {log: util.format(...message)}),
+      error: (...message) =>
+        sendMessage(socket, {error: util.format(...message)}),
+      files,
+      openSampleCache,
+    });
+  } catch (err) {
+    sendMessage(socket, {error: err.stack || String(err)});
+  } finally {
+    finishJob();
+  }
+  stats.jobs++;
+  if (exitCode !== 0) stats.failed++;
+  sendMessage(socket, {exitCode});
+  if (!args['--quiet']) {
+    console.log(
+      `${tool} ${argv.join(' ')}: ${
+        exitCode === 0 ? 'ok' : `failed (${exitCode})`
+      } in ${Date.now() - jobStart}ms`
+    );
+  }
+}
+
+function getStatus() {
+  return {
+    pid: process.pid,
+    cwd: process.cwd(),
+    uptimeSeconds: Math.round((Date.now() - startTime) / 1000),
+    jobs: {...stats},
+    files: {watched: files.size, ...files.stats},
+  };
+}
+
+const server = net.createServer((socket) => {
+  socket.on('error', () => {
+    // the client went away. its job still finishes
+  });
+  receiveMessages(socket, (message) => {
+    if (message.command === 'status') {
+      sendMessage(socket, {status: getStatus()});
+      socket.end();
+    } else if (message.command === 'stop') {
+      sendMessage(socket, {status: getStatus()});
+      socket.end(() => shutdown());
+    } else {
+      runTool(socket, message).then(() => socket.end());
+    }
+  });
+});
+
+function shutdown() {
+  files.close();
+  server.close(() => process.exit(0));
+}
+
+function listen() {
+  server.listen(socketPath, () => {
+    console.log(`buildd listening on ${socketPath} in ${process.cwd()}`);
+  });
+}
+
+process.on('SIGINT', shutdown);
+process.on('SIGTERM', shutdown);
+
+// a socket file left by a daemon which didn't shut down cleanly is removed,
+// but not one which is still in use
+server.on('error', (err) => {
+  if (err.code !== 'EADDRINUSE' || process.platform === 'win32') throw err;
+  const probe = net.connect(socketPath);
+  probe.on('connect', () => {
+    console.error(`buildd is already running on ${socketPath}`);
+    process.exit(1);
+  });
+  probe.on('error', () => {
+    fs.unlinkSync(socketPath);
+    listen();
+  });
+});
+
+listen();
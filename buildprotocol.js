@@ -0,0 +1,50 @@
+// what buildd and buildc share: where the daemon for a directory listens, and
+// how messages are sent. messages are json, one per line.
+//
+// client -> daemon:
+//   {tool, argv, cwd}  run a tool (ic, sbc or midicvt) with argv
+//   {command}          'status' or 'stop'
+// daemon -> client, for a tool:
+//   {log} and {error}  lines of output while the tool runs
+//   {exitCode}         when it's done
+// or for a command:
+//   {status}           stats about the daemon
+
+const os = require('os');
+const path = require('path');
+const crypto = require('crypto');
+
+// tools run in the daemon's working directory, so there's one daemon per
+// directory
+function getSocketPath(dir = process.cwd()) {
+  const id = crypto
+    .createHash('sha1')
+    .update(path.resolve(dir))
+    .digest('hex')
+    .slice(0, 12);
+  if (process.platform === 'win32') {
+    return `\\\\.\\pipe\\n64soundtools-${id}`;
+  }
+  return path.join(os.tmpdir(), `n64soundtools-${id}.sock`);
+}
+
+function sendMessage(socket, message) {
+  if (!socket.destroyed) socket.write(JSON.stringify(message) + '\n');
+}
+
+// calls onMessage with each message received on the socket
+function receiveMessages(socket, onMessage) {
+  let pending = '';
+  socket.setEncoding('utf8');
+  socket.on('data', (data) => {
+    pending += data;
+    let end;
+    while ((end = pending.indexOf('\n')) !== -1) {
+      const line = pending.slice(0, end);
+      pending = pending.slice(end + 1);
+      if (line) onMessage(JSON.parse(line));
+    }
+  });
+}
+
+module.exports = {getSocketPath, sendMessage, receiveMessages};
@@ -3,28 +3,37 @@ const path = require('path');
 const AIFF = require('./aiff');
 const soundtools = require('./soundtools');
 
-const dir = '../ultra/usr/lib/PR/sounds/';
+// checks that the VADPCM samples in a directory (the sdk's sounds by default)
+// can be parsed and have a codebook. only the metadata of each file is read
+const dir = process.argv[2] || '../ultra/usr/lib/PR/sounds/';
 const files = fs
   .readdirSync(dir)
   .map((file) => path.resolve(dir, file))
   .filter((f) => f.endsWith('.aifc'));
 
+let truncatedCount = 0;
+let failedCount = 0;
 files.forEach((filepath) => {
-  const aiffFile = fs.readFileSync(filepath);
-  const valid = !soundtools.isInvalidAIFFFromN64SDK(aiffFile);
-  if (!valid) {
-    soundtools.fixInvalidAIFFFromN64SDK(aiffFile);
-  }
+  let valid = true;
   let parsed = false;
   let error;
   try {
-    AIFF.parse(aiffFile);
+    const aiff = AIFF.parseFileLazy(filepath);
+    // the FORM chunk of the sdk's broken files is bigger than the file
+    valid = !aiff.truncated;
+    soundtools.getVADPCMChunks(aiff, filepath);
     parsed = true;
   } catch (err) {
     error = err;
   }
 
+  if (!valid) truncatedCount++;
   if (!parsed) {
+    failedCount++;
     console.log(filepath, {valid, parsed, error});
   }
 });
+
+console.log(
+  `${files.length} files, ${truncatedCount} with invalid FORM size, ${failedCount} failed`
+);
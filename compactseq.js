@@ -0,0 +1,803 @@
+// converts type 0 midi (.seq) files to compact sequences, the format played by
+// ALCSPlayer, and decodes compact sequences on the host so a conversion can be
+// checked against the events it was made from.
+//
+// a compact sequence starts with an ALCMidiHdr:
+//   u32 trackOffset[16]  offset of each track from the start, or 0 if unused
+//   u32 division         ticks per beat
+// each channel's events go in their own track. like a midi track, a track is
+// a delta time followed by an event, repeated until the end of track, except:
+// - note ons are followed by the note's duration (a varint), and there are no
+//   note offs
+// - meta events have no length. tempo is ff 51 <3 bytes>, end of track ff 2f
+// - loop start is ff 2e <loop number> ff. loop end is ff 2d <loop count>
+//   <loops left> <u32 offset from the end of the loop end back to the end of
+//   the loop start>. the player counts down loops left in place, and a loop
+//   count of ff loops forever
+// - meta events cancel running status
+// - fe <u16 distance> <length> plays <length> bytes starting <distance> bytes
+//   before the fe again, and fe fe is a literal fe. so repeated patterns in a
+//   track (drum loops, repeated phrases) are only stored once
+
+const {parseMidi} = require('midi-file');
+const {mergeTracks} = require('./seqwriter');
+
+const TRACK_COUNT = 16;
+const HEADER_SIZE = TRACK_COUNT * 4 + 4;
+
+const BLOCK_CODE = 0xfe;
+const META = 0xff;
+const META_TEMPO = 0x51;
+const META_EOT = 0x2f;
+const META_LOOPSTART = 0x2e;
+const META_LOOPEND = 0x2d;
+const LOOP_FOREVER = 0xff;
+
+// controllers in the source sequence which become loop markers, as with the
+// sdk's midicomp: 102 starts loop <value>, 103 ends loop <value>, and 104 and
+// 105 set the loop count of the channel's following loop ends to <value> and
+// 128 + <value>. a count of 0 (the default) loops forever
+const CNTRL_LOOPSTART = 102;
+const CNTRL_LOOPEND = 103;
+const CNTRL_LOOPCOUNT_SM = 104;
+const CNTRL_LOOPCOUNT_BIG = 105;
+const LOOP_CONTROLLERS = new Set([
+  CNTRL_LOOPSTART,
+  CNTRL_LOOPEND,
+  CNTRL_LOOPCOUNT_SM,
+  CNTRL_LOOPCOUNT_BIG,
+]);
+
+// back references must be long enough to be smaller than the bytes they
+// replace, their length is a byte, and the distance's high byte can't be fe or
+// it would read as a literal fe
+const MIN_MATCH = 5;
+const MAX_MATCH = 255;
+const MAX_DISTANCE = 0xfdff;
+// how many earlier occurrences of each 4 bytes to try matching against
+const MAX_CHAIN = 64;
+
+// returns the loop count a loop end on the event's channel gets, updating it
+// for loop count controllers
+function updateLoopCount(loopCounts, event) {
+  if (event.controllerType === CNTRL_LOOPCOUNT_SM) {
+    loopCounts[event.channel] = event.value;
+  } else if (event.controllerType === CNTRL_LOOPCOUNT_BIG) {
+    loopCounts[event.channel] = Math.min(128 + event.value, LOOP_FOREVER - 1);
+  }
+  return loopCounts[event.channel] || LOOP_FOREVER;
+}
+
+// the events of all of a midi file's tracks in time order, with the duration
+// of each note on (until its note off, or the end of the sequence) in place of
+// note offs. note ons for the same note are matched to note offs in order
+function getTimedEvents(midi) {
+  const events = [];
+  let endTime = 0;
+  let noteOffCount = 0;
+  const playing = new Map();
+  mergeTracks(
+    midi.tracks,
+    () => true,
+    (event, absoluteTime) => {
+      endTime = Math.max(endTime, absoluteTime);
+      const timed = {event, absoluteTime, duration: 0};
+      if (event.type === 'noteOn' && event.velocity > 0) {
+        const note = event.channel * 128 + event.noteNumber;
+        if (!playing.has(note)) playing.set(note, []);
+        playing.get(note).push(timed);
+      } else if (event.type === 'noteOff' || event.type === 'noteOn') {
+        noteOffCount++;
+        const noteOns = playing.get(event.channel * 128 + event.noteNumber);
+        if (noteOns && noteOns.length) {
+          const noteOn = noteOns.shift();
+          noteOn.duration = absoluteTime - noteOn.absoluteTime;
+        }
+        return;
+      }
+      events.push(timed);
+    }
+  );
+  playing.forEach((noteOns) =>
+    noteOns.forEach((noteOn) => {
+      noteOn.duration = endTime - noteOn.absoluteTime;
+    })
+  );
+  return {events, endTime, noteOffCount};
+}
+
+// the bytes of a track before compression. loop markers are kept out of back
+// references, as the player reads loop ends directly and writes to them
+class TrackBuilder {
+  constructor() {
+    this.bytes = [];
+    this.loops = [];
+    this.lastTime = 0;
+    this.lastStatus = null;
+    this.eventCount = 0;
+  }
+
+  writeVarInt(value) {
+    if (value > 0x0fffffff) {
+      throw new Error(`time ${value} too large`);
+    }
+    let shift = 21;
+    while (shift > 0 && value >> shift === 0) shift -= 7;
+    for (; shift > 0; shift -= 7) {
+      this.bytes.push(((value >> shift) & 0x7f) | 0x80);
+    }
+    this.bytes.push(value & 0x7f);
+  }
+
+  writeDelta(absoluteTime) {
+    this.writeVarInt(absoluteTime - this.lastTime);
+    this.lastTime = absoluteTime;
+    this.eventCount++;
+  }
+
+  writeChannelEvent(status, data) {
+    if (status !== this.lastStatus) this.bytes.push(status);
+    this.lastStatus = status;
+    this.bytes.push(...data);
+  }
+
+  writeMeta(type, data) {
+    this.lastStatus = null;
+    this.bytes.push(META, type, ...data);
+  }
+
+  writeLoopStart(loopNumber) {
+    const start = this.bytes.length;
+    this.writeMeta(META_LOOPSTART, [loopNumber, 0xff]);
+    this.loops.push({start, end: this.bytes.length, loopNumber});
+  }
+
+  // the offset back to the loop start is filled in by compressTrack
+  writeLoopEnd(loopNumber, count) {
+    const start = this.bytes.length;
+    this.writeMeta(META_LOOPEND, [count, count, 0, 0, 0, 0]);
+    this.loops.push({start, end: this.bytes.length, loopNumber, isEnd: true});
+  }
+}
+
+// replaces repeats of earlier bytes in a track with back references, escapes
+// literal fe bytes and fills in the offsets of loop ends. back references copy
+// the compressed bytes as they are, so they can match anything already written
+// except loop markers
+function compressTrack(track, channel, stats) {
+  const input = Buffer.from(track.bytes);
+  const out = Buffer.alloc(input.length * 2);
+  const noCopy = new Uint8Array(out.length);
+  const chains = new Map();
+  const loopStarts = new Map();
+  let pos = 0;
+  let indexed = 0;
+  let nextLoop = 0;
+
+  let i = 0;
+  while (i < input.length) {
+    const loop = track.loops[nextLoop];
+    if (loop && i === loop.start) {
+      const size = loop.end - loop.start;
+      input.copy(out, pos, loop.start, loop.end);
+      noCopy.fill(1, pos, pos + size);
+      pos += size;
+      if (!loop.isEnd) {
+        loopStarts.set(loop.loopNumber, pos);
+      } else if (loopStarts.has(loop.loopNumber)) {
+        out.writeUInt32BE(pos - loopStarts.get(loop.loopNumber), pos - 4);
+      } else {
+        throw new Error(
+          `loop ${loop.loopNumber} on channel ${channel} ends without starting`
+        );
+      }
+      i = loop.end;
+      nextLoop++;
+      continue;
+    }
+
+    const limit = Math.min(MAX_MATCH, (loop ? loop.start : input.length) - i);
+    let bestLength = 0;
+    let bestStart = 0;
+    const candidates =
+      limit >= MIN_MATCH ? chains.get(input.readUInt32BE(i)) : null;
+    if (candidates) {
+      const first = Math.max(0, candidates.length - MAX_CHAIN);
+      for (let c = candidates.length - 1; c >= first; c--) {
+        const start = candidates[c];
+        if (pos - start > MAX_DISTANCE) break;
+        let length = 0;
+        while (
+          length < limit &&
+          start + length < pos &&
+          !noCopy[start + length] &&
+          out[start + length] === input[i + length]
+        ) {
+          length++;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestStart = start;
+          if (length === limit) break;
+        }
+      }
+    }
+
+    if (bestLength >= MIN_MATCH) {
+      out[pos] = BLOCK_CODE;
+      out.writeUInt16BE(pos - bestStart, pos + 1);
+      out[pos + 3] = bestLength;
+      pos += 4;
+      i += bestLength;
+      stats.patterns++;
+      stats.patternBytes += bestLength;
+    } else {
+      out[pos++] = input[i];
+      if (input[i] === BLOCK_CODE) out[pos++] = BLOCK_CODE;
+      i++;
+    }
+
+    for (; indexed + 4 <= pos; indexed++) {
+      if (noCopy[indexed]) continue;
+      const key = out.readUInt32BE(indexed);
+      if (!chains.has(key)) chains.set(key, []);
+      chains.get(key).push(indexed);
+    }
+  }
+  return out.slice(0, pos);
+}
+
+// the status and data bytes of a channel event (other than a note off), or
+// null for other events
+function getChannelEventBytes(event) {
+  const ch = event.channel;
+  switch (event.type) {
+    case 'noteOn':
+      return [0x90 | ch, event.noteNumber, event.velocity];
+    case 'noteAftertouch':
+      return [0xa0 | ch, event.noteNumber, event.amount];
+    case 'controller':
+      return [0xb0 | ch, event.controllerType, event.value];
+    case 'programChange':
+      return [0xc0 | ch, event.programNumber];
+    case 'channelAftertouch':
+      return [0xd0 | ch, event.amount];
+    case 'pitchBend': {
+      const value = event.value + 0x2000;
+      return [0xe0 | ch, value & 0x7f, value >> 7];
+    }
+    default:
+      return null;
+  }
+}
+
+// encodes a parsed midi file (any format, but usually a type 0 .seq) as a
+// compact sequence. meta events other than tempo changes (eg. time
+// signatures) have no equivalent and are left out. returns the sequence and
+// stats about the conversion
+function encodeCompactSeq(midi) {
+  if (midi.header.ticksPerBeat == null) {
+    throw new Error(`compact sequences need a ticks per beat time division`);
+  }
+  const stats = {
+    tracks: 0,
+    events: 0,
+    noteOffs: 0,
+    loops: 0,
+    dropped: 0,
+    patterns: 0,
+    patternBytes: 0,
+  };
+  const {events, endTime, noteOffCount} = getTimedEvents(midi);
+  stats.noteOffs = noteOffCount;
+  const tracks = new Array(TRACK_COUNT).fill(null);
+  const getTrack = (channel) => {
+    if (!tracks[channel]) tracks[channel] = new TrackBuilder();
+    return tracks[channel];
+  };
+  const loopCounts = new Array(TRACK_COUNT).fill(0);
+
+  // tempo changes go in the track of the lowest channel used
+  const channels = events
+    .map(({event}) => event.channel)
+    .filter((channel) => channel != null);
+  const tempoTrack = getTrack(channels.length ? Math.min(...channels) : 0);
+
+  events.forEach(({event, absoluteTime, duration}) => {
+    if (event.type === 'setTempo') {
+      tempoTrack.writeDelta(absoluteTime);
+      tempoTrack.writeMeta(META_TEMPO, [
+        (event.microsecondsPerBeat >> 16) & 0xff,
+        (event.microsecondsPerBeat >> 8) & 0xff,
+        event.microsecondsPerBeat & 0xff,
+      ]);
+      return;
+    }
+    if (
+      event.type === 'controller' &&
+      LOOP_CONTROLLERS.has(event.controllerType)
+    ) {
+      const count = updateLoopCount(loopCounts, event);
+      const track = getTrack(event.channel);
+      if (event.controllerType === CNTRL_LOOPSTART) {
+        track.writeDelta(absoluteTime);
+        track.writeLoopStart(event.value);
+      } else if (event.controllerType === CNTRL_LOOPEND) {
+        track.writeDelta(absoluteTime);
+        track.writeLoopEnd(event.value, count);
+        stats.loops++;
+      }
+      return;
+    }
+    const bytes = getChannelEventBytes(event);
+    if (!bytes) {
+      if (event.type !== 'endOfTrack') stats.dropped++;
+      return;
+    }
+    const track = getTrack(event.channel);
+    track.writeDelta(absoluteTime);
+    track.writeChannelEvent(bytes[0], bytes.slice(1));
+    if (event.type === 'noteOn') track.writeVarInt(duration);
+  });
+
+  // every track ends at the end of the sequence, so it doesn't get shorter
+  const trackData = tracks.map((track, channel) => {
+    if (!track) return null;
+    stats.tracks++;
+    stats.events += track.eventCount;
+    track.writeDelta(endTime);
+    track.writeMeta(META_EOT, []);
+    return compressTrack(track, channel, stats);
+  });
+
+  const header = Buffer.alloc(HEADER_SIZE);
+  let offset = HEADER_SIZE;
+  trackData.forEach((data, channel) => {
+    if (!data) return;
+    header.writeUInt32BE(offset, channel * 4);
+    offset += data.length;
+  });
+  header.writeUInt32BE(midi.header.ticksPerBeat, TRACK_COUNT * 4);
+  return {
+    buffer: Buffer.concat([header, ...trackData.filter(Boolean)]),
+    stats,
+  };
+}
+
+// makes a midi-file style event from a channel message
+function makeChannelEvent(status, byte1, byte2) {
+  const channel = status & 0x0f;
+  switch (status & 0xf0) {
+    case 0x80:
+      return {type: 'noteOff', channel, noteNumber: byte1, velocity: byte2};
+    case 0x90:
+      return {type: 'noteOn', channel, noteNumber: byte1, velocity: byte2};
+    case 0xa0:
+      return {
+        type: 'noteAftertouch',
+        channel,
+        noteNumber: byte1,
+        amount: byte2,
+      };
+    case 0xb0:
+      return {type: 'controller', channel, controllerType: byte1, value: byte2};
+    case 0xc0:
+      return {type: 'programChange', channel, programNumber: byte1};
+    case 0xd0:
+      return {type: 'channelAftertouch', channel, amount: byte1};
+    default:
+      return {
+        type: 'pitchBend',
+        channel,
+        value: ((byte2 << 7) | byte1) - 0x2000,
+      };
+  }
+}
+
+// reads a track of a compact sequence the way alCSeq does
+class CompactTrackReader {
+  constructor(buffer, track, offset) {
+    this.buffer = buffer;
+    this.track = track;
+    this.pos = offset;
+    this.backupPos = 0;
+    this.backupLength = 0;
+    // whether the last byte read came from a back reference
+    this.fromBackup = false;
+    this.lastStatus = 0;
+    this.absoluteTime = 0;
+    // loop numbers by the offset after their loop start event
+    this.loopStarts = new Map();
+  }
+
+  readRawByte() {
+    if (this.pos >= this.buffer.length) {
+      throw new Error(`track ${this.track} runs past the end of the sequence`);
+    }
+    return this.buffer[this.pos++];
+  }
+
+  readByte() {
+    this.fromBackup = this.backupLength > 0;
+    if (this.fromBackup) {
+      this.backupLength--;
+      return this.buffer[this.backupPos++];
+    }
+    const byte = this.readRawByte();
+    if (byte !== BLOCK_CODE) return byte;
+    const next = this.readRawByte();
+    if (next === BLOCK_CODE) return byte;
+    const distance = (next << 8) | this.readRawByte();
+    const length = this.readRawByte();
+    this.backupPos = this.pos - 4 - distance;
+    // the player only checks for the end of a back reference after its
+    // second byte
+    if (length < 2 || this.backupPos < HEADER_SIZE) {
+      throw new Error(
+        `invalid back reference in track ${this.track} at ${this.pos - 4}`
+      );
+    }
+    this.backupLength = length - 1;
+    this.fromBackup = true;
+    return this.buffer[this.backupPos++];
+  }
+
+  readVarInt() {
+    let value = 0;
+    for (let i = 0; i < 4; i++) {
+      const byte = this.readByte();
+      value = (value << 7) | (byte & 0x7f);
+      if (!(byte & 0x80)) return value;
+    }
+    throw new Error(`invalid varint in track ${this.track}`);
+  }
+
+  // returns null at the end of the track
+  readMetaEvent() {
+    const type = this.readByte();
+    switch (type) {
+      case META_TEMPO: {
+        this.lastStatus = 0;
+        const bytes = [this.readByte(), this.readByte(), this.readByte()];
+        return {
+          type: 'setTempo',
+          microsecondsPerBeat: (bytes[0] << 16) | (bytes[1] << 8) | bytes[2],
+        };
+      }
+      case META_EOT:
+        return null;
+      case META_LOOPSTART: {
+        this.lastStatus = 0;
+        const loopNumber = this.readByte();
+        this.readByte();
+        if (!this.fromBackup) this.loopStarts.set(this.pos, loopNumber);
+        return {type: 'loopStart', loopNumber};
+      }
+      case META_LOOPEND: {
+        this.lastStatus = 0;
+        // the player reads the rest of a loop end straight from the track
+        if (this.fromBackup) {
+          throw new Error(`loop end in back reference in track ${this.track}`);
+        }
+        if (this.pos + 6 > this.buffer.length) this.readRawByte();
+        const count = this.buffer[this.pos];
+        if (this.buffer[this.pos + 1] !== count) {
+          throw new Error(`loop end in track ${this.track} has loops left`);
+        }
+        const offset = this.buffer.readUInt32BE(this.pos + 2);
+        this.pos += 6;
+        const loopNumber = this.loopStarts.get(this.pos - offset);
+        if (loopNumber == null) {
+          throw new Error(
+            `loop end in track ${this.track} doesn't jump back to a loop start`
+          );
+        }
+        return {type: 'loopEnd', loopNumber, count};
+      }
+      default:
+        throw new Error(`unknown meta event ${type} in track ${this.track}`);
+    }
+  }
+
+  readEvent() {
+    let status = this.readByte();
+    if (status === META) return this.readMetaEvent();
+    let byte1;
+    if (status & 0x80) {
+      byte1 = this.readByte();
+      this.lastStatus = status;
+    } else if (this.lastStatus) {
+      byte1 = status;
+      status = this.lastStatus;
+    } else {
+      throw new Error(`running status with no status in track ${this.track}`);
+    }
+    const type = status & 0xf0;
+    const byte2 = type === 0xc0 || type === 0xd0 ? 0 : this.readByte();
+    const event = makeChannelEvent(status, byte1, byte2);
+    if (type === 0x90) event.duration = this.readVarInt();
+    return event;
+  }
+}
+
+// calls onEvent(event, absoluteTime, track) for the events of a compact
+// sequence in time order (events at the same time in track order, as the
+// player reads them). loops are played once: loop ends are passed on as
+// events after checking they jump back to a loop start. note ons have the
+// note's duration
+function decodeCompactSeq(buffer, onEvent) {
+  if (buffer.length < HEADER_SIZE) {
+    throw new Error(`compact sequence too short`);
+  }
+  const readers = [];
+  for (let track = 0; track < TRACK_COUNT; track++) {
+    const offset = buffer.readUInt32BE(track * 4);
+    if (!offset) continue;
+    if (offset < HEADER_SIZE || offset >= buffer.length) {
+      throw new Error(`invalid offset ${offset} for track ${track}`);
+    }
+    const reader = new CompactTrackReader(buffer, track, offset);
+    reader.absoluteTime = reader.readVarInt();
+    readers.push(reader);
+  }
+
+  let endTime = 0;
+  let eventCount = 0;
+  while (readers.length) {
+    let next = 0;
+    for (let i = 1; i < readers.length; i++) {
+      if (readers[i].absoluteTime < readers[next].absoluteTime) next = i;
+    }
+    const reader = readers[next];
+    const event = reader.readEvent();
+    if (!event) {
+      endTime = Math.max(endTime, reader.absoluteTime);
+      readers.splice(next, 1);
+      continue;
+    }
+    eventCount++;
+    onEvent(event, reader.absoluteTime, reader.track);
+    reader.absoluteTime += reader.readVarInt();
+  }
+  return {
+    division: buffer.readUInt32BE(TRACK_COUNT * 4),
+    endTime,
+    eventCount,
+  };
+}
+
+// reads the events of a type 0 midi (.seq) file the way alSeq does, for
+// comparing how long it takes to read a sequence in each format
+function readSeqEvents(buffer, onEvent) {
+  let pos = 14 + 8;
+  const end = Math.min(buffer.length, pos + buffer.readUInt32BE(18));
+  const readVarInt = () => {
+    let value = 0;
+    let byte;
+    do {
+      byte = buffer[pos++];
+      value = (value << 7) | (byte & 0x7f);
+    } while (byte & 0x80);
+    return value;
+  };
+  let absoluteTime = 0;
+  let lastStatus = 0;
+  let eventCount = 0;
+  while (pos < end) {
+    absoluteTime += readVarInt();
+    let status = buffer[pos++];
+    if (status === META || status === 0xf0 || status === 0xf7) {
+      const type = status === META ? buffer[pos++] : status;
+      const length = readVarInt();
+      pos += length;
+      lastStatus = 0;
+      if (type === META_EOT) break;
+      eventCount++;
+      onEvent({type: 'meta', metaType: type}, absoluteTime);
+      continue;
+    }
+    let byte1;
+    if (status & 0x80) {
+      byte1 = buffer[pos++];
+      lastStatus = status;
+    } else {
+      byte1 = status;
+      status = lastStatus;
+    }
+    const type = status & 0xf0;
+    const byte2 = type === 0xc0 || type === 0xd0 ? 0 : buffer[pos++];
+    eventCount++;
+    onEvent(makeChannelEvent(status, byte1, byte2), absoluteTime);
+  }
+  return {endTime: absoluteTime, eventCount};
+}
+
+// what a sequence does, in a form which can be compared between a sequence
+// and the compact sequence made from it: the messages of each channel in
+// order, except that note offs (the end of each note) are compared by time,
+// the tempo changes and the end time
+class EventListing {
+  constructor() {
+    this.channels = Array.from({length: TRACK_COUNT}, () => ({
+      events: [],
+      noteOffs: [],
+    }));
+    this.tempos = [];
+    this.endTime = 0;
+  }
+
+  // note ons need the note's duration
+  addEvent(event, t, duration) {
+    const channel = event.channel != null ? this.channels[event.channel] : null;
+    const events = channel && channel.events;
+    switch (event.type) {
+      case 'noteOn':
+        events.push(`${t} noteOn ${event.noteNumber} ${event.velocity}`);
+        channel.noteOffs.push([t + duration, event.noteNumber]);
+        break;
+      case 'noteAftertouch':
+        events.push(`${t} aftertouch ${event.noteNumber} ${event.amount}`);
+        break;
+      case 'controller':
+        events.push(`${t} controller ${event.controllerType} ${event.value}`);
+        break;
+      case 'programChange':
+        events.push(`${t} program ${event.programNumber}`);
+        break;
+      case 'channelAftertouch':
+        events.push(`${t} pressure ${event.amount}`);
+        break;
+      case 'pitchBend':
+        events.push(`${t} pitchBend ${event.value}`);
+        break;
+      case 'loopStart':
+        events.push(`${t} loopStart ${event.loopNumber}`);
+        break;
+      case 'loopEnd':
+        events.push(`${t} loopEnd ${event.loopNumber} ${event.count}`);
+        break;
+      case 'setTempo':
+        this.tempos.push(`${t} tempo ${event.microsecondsPerBeat}`);
+        break;
+    }
+  }
+
+  // returns a description of the first difference from another listing, or
+  // null if they're the same
+  compare(other) {
+    if (this.endTime !== other.endTime) {
+      return `ends at ${other.endTime} instead of ${this.endTime}`;
+    }
+    const lists = [['tempo changes', this.tempos, other.tempos]];
+    this.channels.forEach((channel, i) => {
+      const byTime = (a, b) => a[0] - b[0] || a[1] - b[1];
+      const noteOffs = (ch) =>
+        ch.noteOffs.sort(byTime).map(([t, note]) => `${t} noteOff ${note}`);
+      lists.push([`channel ${i}`, channel.events, other.channels[i].events]);
+      lists.push([
+        `channel ${i}`,
+        noteOffs(channel),
+        noteOffs(other.channels[i]),
+      ]);
+    });
+    for (const [name, expected, actual] of lists) {
+      for (let i = 0; i < Math.max(expected.length, actual.length); i++) {
+        if (expected[i] !== actual[i]) {
+          return `${name}: got ${actual[i] || 'nothing'}, expected ${
+            expected[i] || 'nothing'
+          }`;
+        }
+      }
+    }
+    return null;
+  }
+}
+
+// lists a parsed midi file's events as a compact sequence should play them:
+// loop controllers become loop markers, notes still playing at the end stop at
+// the end, and note offs for notes which aren't playing are left out
+function listMidiEvents(midi) {
+  const listing = new EventListing();
+  const {events, endTime} = getTimedEvents(midi);
+  const loopCounts = new Array(TRACK_COUNT).fill(0);
+  listing.endTime = endTime;
+  events.forEach(({event, absoluteTime, duration}) => {
+    const {type, channel, controllerType, value} = event;
+    if (type === 'controller' && LOOP_CONTROLLERS.has(controllerType)) {
+      const count = updateLoopCount(loopCounts, event);
+      if (controllerType === CNTRL_LOOPSTART) {
+        event = {type: 'loopStart', channel, loopNumber: value};
+      } else if (controllerType === CNTRL_LOOPEND) {
+        event = {type: 'loopEnd', channel, loopNumber: value, count};
+      } else {
+        return;
+      }
+    }
+    listing.addEvent(event, absoluteTime, duration);
+  });
+  return listing;
+}
+
+function listCompactSeqEvents(buffer) {
+  const listing = new EventListing();
+  const {endTime} = decodeCompactSeq(buffer, (event, absoluteTime, track) => {
+    // loop markers apply to the track they're in
+    if (event.channel == null) event.channel = track;
+    listing.addEvent(event, absoluteTime, event.duration);
+  });
+  listing.endTime = endTime;
+  return listing;
+}
+
+// average time in ms to run fn, after warming up, repeating it for at least
+// minMs
+function timeRuns(fn, minMs = 50) {
+  for (let i = 0; i < 3; i++) fn();
+  const start = process.hrtime.bigint();
+  let runs = 0;
+  let elapsed = 0;
+  do {
+    fn();
+    runs++;
+    elapsed = Number(process.hrtime.bigint() - start) / 1e6;
+  } while (elapsed < minMs);
+  return elapsed / runs;
+}
+
+// converts a .seq to a compact sequence, checking it decodes to the same
+// events, and compares the size of each and how long each takes to read.
+// throws if the check fails
+function convertSeqToCompact(seqBuffer, name = 'sequence') {
+  const midi = parseMidi(seqBuffer);
+  const {buffer, stats} = encodeCompactSeq(midi);
+  const difference = listMidiEvents(midi).compare(listCompactSeqEvents(buffer));
+  if (difference) {
+    throw new Error(
+      `compact sequence made from ${name} doesn't play the same: ${difference}`
+    );
+  }
+
+  const noop = () => {};
+  return {
+    buffer,
+    stats,
+    seq: {
+      size: seqBuffer.length,
+      eventCount: readSeqEvents(seqBuffer, noop).eventCount,
+      readMs: timeRuns(() => readSeqEvents(seqBuffer, noop)),
+    },
+    compact: {
+      size: buffer.length,
+      eventCount: decodeCompactSeq(buffer, noop).eventCount,
+      readMs: timeRuns(() => decodeCompactSeq(buffer, noop)),
+    },
+  };
+}
+
+function formatCompactReport({stats, seq, compact}) {
+  const percent = (a, b) => `${(((b - a) / a) * 100).toFixed(1)}%`;
+  return `compact: ${seq.size} -> ${compact.size} bytes (${percent(
+    seq.size,
+    compact.size
+  )}), ${seq.eventCount} -> ${compact.eventCount} events, read in ${(
+    seq.readMs * 1000
+  ).toFixed(0)}us -> ${(compact.readMs * 1000).toFixed(0)}us (${percent(
+    seq.readMs,
+    compact.readMs
+  )}). ${stats.tracks} tracks, ${stats.noteOffs} note offs removed, ${
+    stats.patterns
+  } repeated patterns (${stats.patternBytes} bytes), ${stats.loops} loops${
+    stats.dropped ? `, ${stats.dropped} unsupported meta events left out` : ''
+  }`;
+}
+
+module.exports = {
+  encodeCompactSeq,
+  decodeCompactSeq,
+  readSeqEvents,
+  listMidiEvents,
+  listCompactSeqEvents,
+  convertSeqToCompact,
+  formatCompactReport,
+  LOOP_CONTROLLERS,
+};
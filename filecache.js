@@ -0,0 +1,89 @@
+// in-memory cache of what's read from input files, for long running processes
+// (buildd) which build from the same inputs many times. each file is watched
+// once something from it is cached, and everything cached for it is dropped
+// when it changes.
+//
+// tools take their inputs through a `files` object with this interface. when
+// run from the command line they get uncachedFiles, which just reads them
+
+const fs = require('fs');
+const path = require('path');
+
+class FileCache {
+  constructor() {
+    // absolute path -> {watcher, values: Map of key -> value}
+    this.entries = new Map();
+    this.stats = {hits: 0, misses: 0, invalidations: 0};
+  }
+
+  // returns null for files which can't be watched (eg. missing files)
+  getEntry(file) {
+    const fullPath = path.resolve(file);
+    let entry = this.entries.get(fullPath);
+    if (!entry) {
+      // watch before reading, so a change made while it's being read isn't
+      // missed
+      let watcher;
+      try {
+        watcher = fs.watch(fullPath, {persistent: false}, () =>
+          this.invalidate(fullPath)
+        );
+      } catch (err) {
+        return null;
+      }
+      watcher.on('error', () => this.invalidate(fullPath));
+      entry = {watcher, values: new Map()};
+      this.entries.set(fullPath, entry);
+    }
+    return entry;
+  }
+
+  // returns compute(), which should read the file, cached as `key` until the
+  // file changes. the value is shared between callers, so it must not be
+  // modified. files which can't be watched aren't cached, so compute() can
+  // report why they can't be read
+  memo(file, key, compute) {
+    const entry = this.getEntry(file);
+    if (!entry) return compute();
+    if (entry.values.has(key)) {
+      this.stats.hits++;
+      return entry.values.get(key);
+    }
+    this.stats.misses++;
+    const value = compute();
+    // the file may have changed (and the entry been dropped) while computing
+    if (this.entries.get(path.resolve(file)) === entry) {
+      entry.values.set(key, value);
+    }
+    return value;
+  }
+
+  read(file) {
+    return this.memo(file, 'contents', () => fs.readFileSync(file));
+  }
+
+  invalidate(fullPath) {
+    const entry = this.entries.get(fullPath);
+    if (!entry) return;
+    // a file replaced by renaming over it needs a new watcher anyway
+    entry.watcher.close();
+    this.entries.delete(fullPath);
+    this.stats.invalidations++;
+  }
+
+  get size() {
+    return this.entries.size;
+  }
+
+  close() {
+    this.entries.forEach((entry) => entry.watcher.close());
+    this.entries.clear();
+  }
+}
+
+const uncachedFiles = {
+  memo: (file, key, compute) => compute(),
+  read: (file) => fs.readFileSync(file),
+};
+
+module.exports = {FileCache, uncachedFiles};
@@ -0,0 +1,23 @@
+// expands the inputs given to a tool on the command line into a list of files.
+// directories are replaced by the files in them whose names match pattern, in
+// sorted order, and files are passed through whatever their names
+
+const fs = require('fs');
+const path = require('path');
+
+function findFiles(inputs, pattern) {
+  const files = [];
+  inputs.forEach((input) => {
+    if (fs.statSync(input).isDirectory()) {
+      fs.readdirSync(input)
+        .filter((entry) => pattern.test(entry))
+        .sort()
+        .forEach((entry) => files.push(path.join(input, entry)));
+    } else {
+      files.push(input);
+    }
+  });
+  return files;
+}
+
+module.exports = {findFiles};
@@ -5,33 +5,245 @@
 // or ./ic.js test/test.inst -o test/test
 
 const fs = require('fs');
-const arg = require('arg');
-const {sourceToBank} = require('./soundtools');
-const {parseWithNiceErrors} = require('./instparserapi');
-
-const args = arg({
-  // Types
-  '--help': Boolean,
-  '--out': String, // --name <string> or --name=<string>
-
-  // Aliases
-  '-o': '--out',
-  '-h': '--help',
-});
-
-if (args['--help']) {
-  console.log(`ic -o <output file prefix> <source file>`);
-  process.exit(0);
+const os = require('os');
+const {isMainThread} = require('worker_threads');
+const AIFF = require('./aiff');
+const {
+  sourceToBank,
+  encodeVADPCMAIFF,
+  extractSampleData,
+  loadAIFFData,
+  loadAIFFMetadata,
+  loadSampleData,
+} = require('./soundtools');
+const SampleCache = require('./samplecache');
+const {uncachedFiles} = require('./filecache');
+const {runWorkerPool, serveWorkerJobs} = require('./workerpool');
+const {ENCODE_MODES} = require('./vadpcm');
+
+// compresses a sample on a worker thread when using --compress
+function compressSample(file, {mode}) {
+  const startTime = process.hrtime.bigint();
+  const {aifc, stats} = encodeVADPCMAIFF(loadAIFFData(file), file, {mode});
+  return {
+    aifc,
+    stats: {
+      ...stats,
+      encodeMs: Number(process.hrtime.bigint() - startTime) / 1e6,
+    },
+  };
 }
 
-const sourceFile = args._[0];
+// prepare every sample used by the bank, returning a map of file path ->
+// function loading the sample as extracted by extractSampleData, to build the
+// bank from. samples are taken from the cache when possible. with compress,
+// uncompressed samples which aren't cached are VADPCM encoded in parallel.
+// cached and uncompressed samples are loaded again when the bank is written,
+// rather than keeping them all in memory (unless files keeps them)
+async function loadSamples(bank, {cache, compress, jobs, mode, files, log}) {
+  const sampleFiles = bank
+    .getSampleFiles()
+    .filter((file, index, all) => all.indexOf(file) === index);
+  const compressedVariant = `vadpcm-${mode}`;
+
+  const samples = new Map();
+  const hashes = new Map();
+  const rawFiles = [];
+  sampleFiles.forEach((file) => {
+    let {hash, formType, contents} = cache
+      ? cache.identify(file)
+      : {hash: null, formType: null, contents: null};
+    let aiffData = null;
+    function parse() {
+      if (!aiffData) {
+        if (contents) {
+          aiffData = AIFF.parse(contents);
+          if (!aiffData.soundData) {
+            throw new Error(`file ${file} does not contain SSND chunk`);
+          }
+        } else {
+          // only the sound data of samples which need extracting is read
+          aiffData = files.memo(file, 'aiff', () => loadAIFFMetadata(file));
+        }
+        formType = aiffData.formType;
+        if (cache) cache.setFormType(file, formType);
+      }
+      return aiffData;
+    }
+    if (!formType) parse();
+
+    const variant =
+      compress && formType === 'AIFF' ? compressedVariant : 'extract';
+    if (cache && cache.has(hash, variant)) {
+      samples.set(file, () => cache.get(hash, variant));
+    } else if (variant === compressedVariant) {
+      hashes.set(file, hash);
+      rawFiles.push(file);
+    } else if (cache) {
+      cache.set(hash, variant, extractSampleData(parse(), file));
+      samples.set(file, () => cache.get(hash, variant));
+    } else {
+      samples.set(file, () =>
+        files.memo(file, 'sample', () => loadSampleData(file))
+      );
+    }
+  });
+
+  const startTime = Date.now();
+  let totalSamples = 0;
+  let rawBytes = 0;
+  let compressedBytes = 0;
+  let encodeMs = 0;
+  await runWorkerPool({
+    workerFile: __filename,
+    workerData: {mode},
+    jobs: rawFiles,
+    concurrency: jobs,
+    onResult: ({aifc, stats}, file) => {
+      const sample = extractSampleData(AIFF.parse(Buffer.from(aifc)), file);
+      if (cache) cache.set(hashes.get(file), compressedVariant, sample);
+      samples.set(file, () => sample);
+      totalSamples += stats.samples;
+      rawBytes += stats.rawBytes;
+      compressedBytes += stats.compressedBytes;
+      encodeMs += stats.encodeMs;
+      log(
+        `${file}: ${stats.rawBytes} -> ${
+          stats.compressedBytes
+        } bytes, SNR ${stats.snr.toFixed(1)}dB`
+      );
+    },
+  });
+  const elapsed = (Date.now() - startTime) / 1000;
+  if (rawFiles.length) {
+    log(
+      `compressed ${rawFiles.length} sample(s): ${rawBytes} -> ${compressedBytes} bytes (${(
+        (compressedBytes / rawBytes) *
+        100
+      ).toFixed(1)}%) in ${elapsed.toFixed(2)}s, ${(
+        totalSamples /
+        (encodeMs / 1000) /
+        1e6
+      ).toFixed(2)}M samples/s per thread`
+    );
+  }
+  if (cache) cache.save();
+  return samples;
+}
 
-if (!sourceFile) {
-  throw new Error('no input file specified');
+function writeBank(bank, outPrefix, log) {
+  bank.writeBankFile(outPrefix);
+  const {ctl, tbl, bytes} = bank.getDedupStats();
+  if (bytes) {
+    log(
+      `shared ${ctl.chunks + tbl.chunks} duplicate chunk(s), saving ${bytes} bytes (ctl: ${ctl.bytes}, tbl: ${tbl.bytes})`
+    );
+  }
 }
 
-const contents = fs.readFileSync(sourceFile, 'utf8');
+// runs ic with the given command line arguments. context can replace console
+// output (log, error), how inputs are read (files, see filecache.js) and how
+// sample cache directories are opened (openSampleCache), for buildd. resolves
+// to the exit code
+async function run(
+  argv,
+  {
+    log = console.log,
+    error = console.error,
+    files = uncachedFiles,
+    openSampleCache = (dir) => new SampleCache(dir),
+  } = {}
+) {
+  const arg = require('arg');
+  const {parseWithNiceErrors} = require('./instparserapi');
+
+  const args = arg(
+    {
+      // Types
+      '--help': Boolean,
+      '--out': String, // --name <string> or --name=<string>
+      '--compress': Boolean, // VADPCM encode uncompressed samples
+      '--jobs': Number, // max samples to compress in parallel
+      '--quality': String, // VADPCM encoder search mode
+      '--no-dedup': Boolean, // store identical data as many times as it's used
+      '--cache': String, // directory to keep extracted sample data in
+
+      // Aliases
+      '-o': '--out',
+      '-c': '--compress',
+      '-j': '--jobs',
+      '-h': '--help',
+    },
+    {argv}
+  );
+
+  if (args['--help']) {
+    log(`ic [--compress] [--jobs n] [--cache dir] -o <output file prefix> <source file>
 
-const parsed = parseWithNiceErrors(contents, sourceFile);
+  -c, --compress: VADPCM encode uncompressed .aiff samples, instead of storing
+    them as raw 16 bit
+  -j, --jobs: max samples to compress in parallel (default: number of cpus)
+  --quality: encoder search, one of ${ENCODE_MODES.join(', ')} (default: normal)
+    max tries every predictor at every scale for each frame, which is slower
+  --no-dedup: don't share identical sample data and structs in the ctl/tbl
+  --cache: directory to cache the data extracted from each sample in (and the
+    compressed version, with --compress), so rebuilds only read changed samples
+`);
+    return 0;
+  }
+
+  const sourceFile = args._[0];
+
+  if (!sourceFile) {
+    throw new Error('no input file specified');
+  }
+
+  const parsed = files.memo(sourceFile, 'inst', () =>
+    parseWithNiceErrors(fs.readFileSync(sourceFile, 'utf8'), sourceFile)
+  );
+
+  const dedup = !args['--no-dedup'];
+  const outPrefix = args['--out'] || 'tst';
+  const cache = args['--cache'] ? openSampleCache(args['--cache']) : null;
+
+  const startTime = Date.now();
+  const samples = await loadSamples(sourceToBank(parsed, sourceFile), {
+    cache,
+    compress: args['--compress'],
+    jobs: args['--jobs'] || os.cpus().length,
+    mode: args['--quality'] || 'normal',
+    files,
+    log,
+  });
+  const bank = sourceToBank(parsed, sourceFile, {
+    loadSample: (file) => samples.get(file)(),
+    dedup,
+  });
+  writeBank(bank, outPrefix, log);
+  const elapsed = (Date.now() - startTime) / 1000;
+  log(
+    `built ${outPrefix} from ${samples.size} sample(s) in ${elapsed.toFixed(
+      3
+    )}s${
+      cache
+        ? ` (${cache.stats.hits} cached, ${cache.stats.misses} not cached, ${cache.stats.filesRead} file(s) read)`
+        : ''
+    }`
+  );
+  return 0;
+}
+
+if (!isMainThread) {
+  serveWorkerJobs(compressSample);
+} else if (require.main === module) {
+  run(process.argv.slice(2))
+    .then((code) => {
+      process.exitCode = code;
+    })
+    .catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+}
 
-sourceToBank(parsed, sourceFile).writeBankFile(args['--out'] || 'tst');
+module.exports = {run};
@@ -1,9 +1,17 @@
 const parser = require('./instparser');
+const fastParser = require('./instparserfast');
 
 function parseWithNiceErrors(contents, filename) {
   let parsed;
   try {
-    parsed = parser.parse(contents);
+    try {
+      parsed = fastParser.parse(contents);
+    } catch (err) {
+      if (!(err instanceof fastParser.InstSyntaxError)) throw err;
+      // the generated parser describes what was expected where. it's the
+      // reference for the grammar, so if it does parse the file, use that
+      parsed = parser.parse(contents);
+    }
     // console.log(parsed);
   } catch (err) {
     const loc = err.location;
@@ -0,0 +1,320 @@
+// hand written parser for ic's .inst file format, giving the same defs as the
+// pegjs parser generated from instparser.pegjs (which remains the reference
+// for the grammar) in a single pass over the text, without backtracking.
+//
+// errors from checking objects' members (eg. unknown properties) are thrown
+// as the same SyntaxError the generated parser throws. for syntax errors it
+// throws InstSyntaxError, which only has an offset. parseWithNiceErrors runs
+// the generated parser on those files to get its description of the error
+
+const utils = require('./instparserutils');
+const {SyntaxError: PegSyntaxError} = require('./instparser');
+
+class InstSyntaxError extends Error {
+  constructor(offset) {
+    super(`syntax error at offset ${offset}`);
+    this.offset = offset;
+  }
+}
+
+const CHAR_TAB = 9;
+const CHAR_LF = 10;
+const CHAR_CR = 13;
+const CHAR_SPACE = 32;
+const CHAR_QUOTE = 34;
+const CHAR_OPEN_PAREN = 40;
+const CHAR_CLOSE_PAREN = 41;
+const CHAR_STAR = 42;
+const CHAR_PLUS = 43;
+const CHAR_MINUS = 45;
+const CHAR_DOT = 46;
+const CHAR_SLASH = 47;
+const CHAR_0 = 48;
+const CHAR_9 = 57;
+const CHAR_SEMICOLON = 59;
+const CHAR_EQUALS = 61;
+const CHAR_OPEN_BRACKET = 91;
+const CHAR_BACKSLASH = 92;
+const CHAR_CLOSE_BRACKET = 93;
+const CHAR_OPEN_BRACE = 123;
+const CHAR_CLOSE_BRACE = 125;
+
+const ESCAPES = {
+  '"': '"',
+  '\\': '\\',
+  '/': '/',
+  b: '\b',
+  f: '\f',
+  n: '\n',
+  r: '\r',
+  t: '\t',
+};
+
+function isDigit(c) {
+  return c >= CHAR_0 && c <= CHAR_9;
+}
+
+function isSymbolChar(c) {
+  return (
+    (c >= CHAR_0 && c <= CHAR_9) ||
+    (c >= 65 && c <= 90) || // A-Z
+    (c >= 97 && c <= 122) || // a-z
+    c === 95 // _
+  );
+}
+
+function isHexDigit(c) {
+  return isDigit(c) || (c >= 65 && c <= 70) || (c >= 97 && c <= 102);
+}
+
+// line and column as the generated parser reports them
+function getPosDetails(input, offset) {
+  let line = 1;
+  let column = 1;
+  for (let i = 0; i < offset; i++) {
+    if (input.charCodeAt(i) === CHAR_LF) {
+      line++;
+      column = 1;
+    } else {
+      column++;
+    }
+  }
+  return {offset, line, column};
+}
+
+function parse(input) {
+  const length = input.length;
+  let pos = 0;
+
+  function fail() {
+    throw new InstSyntaxError(pos);
+  }
+
+  function expectChar(c) {
+    if (input.charCodeAt(pos) !== c) fail();
+    pos++;
+  }
+
+  function skipWs() {
+    for (;;) {
+      const c = input.charCodeAt(pos);
+      if (
+        c !== CHAR_SPACE &&
+        c !== CHAR_LF &&
+        c !== CHAR_TAB &&
+        c !== CHAR_CR
+      ) {
+        return;
+      }
+      pos++;
+    }
+  }
+
+  function parseSymbol() {
+    const start = pos;
+    while (isSymbolChar(input.charCodeAt(pos))) pos++;
+    if (pos === start) fail();
+    return input.slice(start, pos);
+  }
+
+  function skipDigits() {
+    const start = pos;
+    while (isDigit(input.charCodeAt(pos))) pos++;
+    return pos > start;
+  }
+
+  function parseNumber() {
+    const start = pos;
+    if (input.charCodeAt(pos) === CHAR_MINUS) pos++;
+    const c = input.charCodeAt(pos);
+    if (c === CHAR_0) {
+      pos++;
+    } else if (isDigit(c)) {
+      skipDigits();
+    } else {
+      fail();
+    }
+    // the fraction and exponent are optional, so are left unconsumed if
+    // they're incomplete
+    if (
+      input.charCodeAt(pos) === CHAR_DOT &&
+      isDigit(input.charCodeAt(pos + 1))
+    ) {
+      pos++;
+      skipDigits();
+    }
+    if ((input.charCodeAt(pos) | 0x20) === 101) {
+      // e or E
+      const expStart = pos;
+      pos++;
+      const sign = input.charCodeAt(pos);
+      if (sign === CHAR_MINUS || sign === CHAR_PLUS) pos++;
+      if (!skipDigits()) pos = expStart;
+    }
+    return parseFloat(input.slice(start, pos));
+  }
+
+  function parseString() {
+    expectChar(CHAR_QUOTE);
+    let value = '';
+    let chunkStart = pos;
+    for (;;) {
+      const c = input.charCodeAt(pos);
+      if (c === CHAR_QUOTE) {
+        value += input.slice(chunkStart, pos);
+        pos++;
+        return value;
+      } else if (c === CHAR_BACKSLASH) {
+        value += input.slice(chunkStart, pos);
+        const escaped = input[pos + 1];
+        if (escaped === 'u') {
+          for (let i = 2; i < 6; i++) {
+            if (!isHexDigit(input.charCodeAt(pos + i))) {
+              pos += i;
+              fail();
+            }
+          }
+          value += String.fromCharCode(
+            parseInt(input.slice(pos + 2, pos + 6), 16)
+          );
+          pos += 6;
+        } else if (escaped in ESCAPES) {
+          value += ESCAPES[escaped];
+          pos += 2;
+        } else {
+          pos++;
+          fail();
+        }
+        chunkStart = pos;
+      } else if (c >= 0x20) {
+        pos++;
+      } else {
+        // control characters and the end of the input
+        fail();
+      }
+    }
+  }
+
+  // comments start with a slash, which is checked by the caller
+  function skipComment() {
+    pos++;
+    const c = input.charCodeAt(pos);
+    if (c === CHAR_SLASH) {
+      while (pos < length) {
+        const c = input.charCodeAt(pos);
+        if (c === CHAR_LF || c === CHAR_CR) break;
+        pos++;
+      }
+    } else if (c === CHAR_STAR) {
+      const end = input.indexOf('*/', pos + 1);
+      if (end === -1) {
+        pos = length;
+        fail();
+      }
+      pos = end + 2;
+    } else {
+      fail();
+    }
+  }
+
+  // returns null for comments
+  function parseMember() {
+    const start = pos;
+    if (input.charCodeAt(pos) === CHAR_SLASH) {
+      skipComment();
+      return null;
+    }
+    const name = parseSymbol();
+    skipWs();
+    const c = input.charCodeAt(pos);
+    let member;
+    if (c === CHAR_EQUALS || c === CHAR_OPEN_BRACKET) {
+      let index;
+      if (c === CHAR_OPEN_BRACKET) {
+        // no whitespace inside the brackets
+        pos++;
+        index = parseNumber();
+        expectChar(CHAR_CLOSE_BRACKET);
+        skipWs();
+        expectChar(CHAR_EQUALS);
+      } else {
+        pos++;
+      }
+      skipWs();
+      const v = input.charCodeAt(pos);
+      // a value starting like a number must be one
+      const value =
+        v === CHAR_MINUS || isDigit(v)
+          ? parseNumber()
+          : {type: 'symbol', value: parseSymbol()};
+      skipWs();
+      expectChar(CHAR_SEMICOLON);
+      member =
+        index === undefined
+          ? {type: 'assignment', name, value}
+          : {type: 'assignmentIndexed', name, index, value};
+    } else if (c === CHAR_OPEN_PAREN && name === 'use') {
+      pos++;
+      const value = parseString();
+      expectChar(CHAR_CLOSE_PAREN);
+      skipWs();
+      expectChar(CHAR_SEMICOLON);
+      member = {type: 'use', value};
+    } else {
+      fail();
+    }
+    // offsets, turned into line and column only if there's an error
+    member.location = {start, end: pos};
+    return member;
+  }
+
+  function parseObject() {
+    const start = pos;
+    const objectType = parseSymbol();
+    skipWs();
+    const name = parseSymbol();
+    skipWs();
+    expectChar(CHAR_OPEN_BRACE);
+    skipWs();
+    const members = [];
+    while (input.charCodeAt(pos) !== CHAR_CLOSE_BRACE) {
+      const member = parseMember();
+      if (member) members.push(member);
+      skipWs();
+    }
+    pos++;
+    skipWs();
+
+    // as with the generated parser's expected()
+    const expected = (description, location) => {
+      const found = input.slice(start, pos);
+      const expectation = [{type: 'other', description}];
+      throw new PegSyntaxError(
+        PegSyntaxError.buildMessage(expectation, found),
+        expectation,
+        found,
+        {
+          start: getPosDetails(input, location ? location.start : start),
+          end: getPosDetails(input, location ? location.end : pos),
+        }
+      );
+    };
+    const value = utils.collectMembers(objectType, name, members, expected);
+    return {type: objectType, name, value};
+  }
+
+  const defs = [];
+  skipWs();
+  // at least one def (or comment) is required
+  do {
+    if (input.charCodeAt(pos) === CHAR_SLASH) {
+      skipComment();
+    } else {
+      defs.push(parseObject());
+    }
+    skipWs();
+  } while (pos < length);
+  return defs;
+}
+
+module.exports = {parse, InstSyntaxError};
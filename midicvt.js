@@ -2,45 +2,27 @@
 
 // midicvt takes an input midi file and filters out a bunch of unneeded event types,
 // saving the output as a (Type 0 MIDI) .seq file
-// TODO: finish implementing deltaTime calculation for track
+// or to convert directories of midi files in parallel:
+// midicvt --batch -o seqs/ music/
+// with --compact, a compact sequence (.cseq) is also saved next to each .seq
 
 var parseMidi = require('midi-file').parseMidi;
 var writeMidi = require('midi-file').writeMidi;
 
 const fs = require('fs');
-
-const arg = require('arg');
-
-const args = arg({
-  // Types
-  '--help': Boolean,
-  '--out': String, // --name <string> or --name=<string>
-  '--blank': Boolean, // output file with no events
-  '--gm': Boolean, // format file to correctly play as general midi
-  '--channelfilter': String, // --channelfilter 2 or --channelfilter="1, 3, 4"
-
-  // Aliases
-  '-o': '--out',
-  '-h': '--help',
-});
-
-if (args['--help']) {
-  console.log(`midicvt [-v] [-s] <input file> <output file>`);
-  process.exit(0);
-}
-
-const midiBuffer = fs.readFileSync(args._[0]);
-
-let channelFilter = null;
-
-if (args['--channelfilter']) {
-  channelFilter = new Set(
-    args['--channelfilter'].split(',').map((v) => parseInt(v, 10))
-  );
-}
-
-const midi = parseMidi(midiBuffer);
-// console.log(midi.tracks[0]);
+const path = require('path');
+const os = require('os');
+const {isMainThread} = require('worker_threads');
+const {SeqWriter, mergeTracks} = require('./seqwriter');
+const {SeqOptimizer, PlaybackDigest} = require('./seqoptimizer');
+const {
+  convertSeqToCompact,
+  formatCompactReport,
+  LOOP_CONTROLLERS,
+} = require('./compactseq');
+const {runWorkerPool, serveWorkerJobs} = require('./workerpool');
+const {uncachedFiles} = require('./filecache');
+const {findFiles} = require('./findfiles');
 
 const allowedCCs = new Set([
   0,
@@ -93,54 +75,290 @@ const acceptableEvents = new Set([
   'timeSignature',
 ]);
 
-if (args['--blank']) {
-  midi.tracks = [];
-} else {
-  const events = [];
-  midi.tracks.map((track) => {
-    let lastEventAbsTime = 0;
-    track.forEach((ev) => {
-      const absoluteTime = ev.deltaTime + lastEventAbsTime;
-      ev.absoluteTime = absoluteTime;
-      lastEventAbsTime = absoluteTime;
-      if (!acceptableEvents.has(ev.type)) {
-        return;
-      }
+function makeEventFilter({gm, channelFilter, compact}) {
+  const filteredChannels = channelFilter ? new Set(channelFilter) : null;
+  return (ev) => {
+    if (!acceptableEvents.has(ev.type)) {
+      return false;
+    }
 
-      if (args['--gm'] && ev.channel === 9) {
-        return;
-      }
+    if (gm && ev.channel === 9) {
+      return false;
+    }
 
-      if (
-        channelFilter &&
-        ev.channel != null &&
-        channelFilter.has(ev.channel)
-      ) {
-        return;
-      }
+    if (
+      filteredChannels &&
+      ev.channel != null &&
+      filteredChannels.has(ev.channel)
+    ) {
+      return false;
+    }
 
-      if (ev.type === 'controller' && !allowedCCs.has(ev.controllerType)) {
-        return;
-      }
+    if (
+      ev.type === 'controller' &&
+      !allowedCCs.has(ev.controllerType) &&
+      // loop markers for the compact sequence
+      !(compact && LOOP_CONTROLLERS.has(ev.controllerType))
+    ) {
+      return false;
+    }
 
-      events.push(ev);
+    return true;
+  };
+}
+
+// converts a midi file to a type 0 .seq, writing it out as the tracks are
+// merged. returns the number of events read and written, and the size of the
+// output. with optimize, events which don't change playback are left out and
+// running status is used, and the result is checked against the unoptimized
+// sequence. the parsed midi file may be shared through files, so isn't
+// modified
+function convertMidiToSeq(
+  inFile,
+  outFile,
+  {blank = false, gm = false, channelFilter, optimize = false, compact = false},
+  files
+) {
+  const midi = files.memo(inFile, 'midi', () =>
+    parseMidi(fs.readFileSync(inFile))
+  );
+  const eventsIn = midi.tracks.reduce((sum, track) => sum + track.length, 0);
+
+  if (blank) {
+    const output = Buffer.from(
+      writeMidi({header: {...midi.header, format: 0}, tracks: []})
+    );
+    fs.writeFileSync(outFile, output);
+    return {eventsIn, eventsOut: 0, size: output.length};
+  }
+
+  const keepEvent = makeEventFilter({gm, channelFilter, compact});
+  const fd = fs.openSync(outFile, 'w');
+  let result;
+  let expectedPlayback;
+  try {
+    if (!optimize) {
+      const writer = new SeqWriter(fd, midi.header);
+      mergeTracks(midi.tracks, keepEvent, (ev, absoluteTime) =>
+        writer.writeEvent(ev, absoluteTime)
+      );
+      writer.end();
+      return {eventsIn, eventsOut: writer.eventCount, size: writer.size};
+    }
+
+    // the unoptimized sequence is only measured, and digested to check the
+    // optimized one against
+    const unoptimized = new SeqWriter(null, midi.header);
+    const unoptimizedPlayback = new PlaybackDigest();
+    const writer = new SeqWriter(fd, midi.header, {runningStatus: true});
+    const optimizer = new SeqOptimizer(writer);
+    mergeTracks(midi.tracks, keepEvent, (ev, absoluteTime) => {
+      unoptimized.writeEvent(ev, absoluteTime);
+      unoptimizedPlayback.addEvent(ev, absoluteTime);
+      optimizer.writeEvent(ev, absoluteTime);
     });
-  });
+    unoptimized.end();
+    unoptimizedPlayback.addEvent({type: 'endOfTrack'}, unoptimized.lastTime);
+    optimizer.end(unoptimized.lastTime);
+    expectedPlayback = unoptimizedPlayback.digest();
+    result = {
+      eventsIn,
+      eventsOut: writer.eventCount,
+      size: writer.size,
+      unoptimizedSize: unoptimized.size,
+      dropped: optimizer.stats,
+      statusBytesSaved: writer.statusBytesSaved,
+    };
+  } finally {
+    fs.closeSync(fd);
+  }
 
-  // fix delta times based on track-merged events absolute times
-  events.sort((a, b) => a.absoluteTime - b.absoluteTime);
-  let lastEventTime = 0;
-  events.forEach((ev) => {
-    const deltaTime = ev.absoluteTime - lastEventTime;
-    lastEventTime = ev.absoluteTime;
-    ev.deltaTime = deltaTime;
-  });
+  const playback = new PlaybackDigest();
+  parseMidi(fs.readFileSync(outFile)).tracks.forEach((track) =>
+    playback.addTrack(track)
+  );
+  if (playback.digest() !== expectedPlayback) {
+    throw new Error(
+      `optimized ${outFile} doesn't play the same as the unoptimized sequence`
+    );
+  }
+  return result;
+}
+
+function getCompactFile(outFile) {
+  return outFile.replace(/\.seq$/i, '') + '.cseq';
+}
+
+// converts a midi file to a .seq, and with compact, also to a compact
+// sequence, which is checked to decode to the same events as the .seq
+function convertMidi(inFile, outFile, options, files = uncachedFiles) {
+  const result = convertMidiToSeq(inFile, outFile, options, files);
+  if (options.compact) {
+    const {buffer, ...compact} = convertSeqToCompact(
+      fs.readFileSync(outFile),
+      outFile
+    );
+    fs.writeFileSync(getCompactFile(outFile), buffer);
+    result.compact = compact;
+  }
+  return result;
+}
+
+function formatSavings({size, unoptimizedSize, dropped, statusBytesSaved}) {
+  const saved = unoptimizedSize - size;
+  return `${unoptimizedSize} -> ${size} bytes, saved ${saved} (${(
+    (saved / unoptimizedSize) *
+    100
+  ).toFixed(1)}%): dropped ${dropped.controllers} controller, ${
+    dropped.tempos
+  } tempo and ${
+    dropped.metaEvents
+  } other meta events, ${statusBytesSaved} status bytes left out`;
+}
+
+// runs midicvt with the given command line arguments. context can replace
+// console output (log, error) and how inputs are read (files, see
+// filecache.js), for buildd. with --batch, files are converted on worker
+// threads, which read them directly. resolves to the exit code
+async function run(
+  argv,
+  {log = console.log, error = console.error, files = uncachedFiles} = {}
+) {
+  const arg = require('arg');
+
+  const args = arg(
+    {
+      // Types
+      '--help': Boolean,
+      '--out': String, // --name <string> or --name=<string>
+      '--blank': Boolean, // output file with no events
+      '--gm': Boolean, // format file to correctly play as general midi
+      '--channelfilter': String, // --channelfilter 2 or --channelfilter="1, 3, 4"
+      '--batch': Boolean, // convert many files, --out is a directory
+      '--jobs': Number, // max files to convert in parallel with --batch
+      '--optimize': Boolean, // make the output as small as possible
+      '--compact': Boolean, // also output compact sequences
+
+      // Aliases
+      '-o': '--out',
+      '-j': '--jobs',
+      '-h': '--help',
+    },
+    {argv}
+  );
+
+  if (args['--help']) {
+    log(`midicvt [--gm] [--channelfilter channels] [-o output file] <input file>
+midicvt --batch [-o output dir] [-j jobs] <input files or directories...>
+
+  -o, --out: output .seq file (default tst.seq), or directory with --batch
+  --blank: output a sequence with no events
+  --gm: leave out channel 10 (general midi percussion)
+  --channelfilter: comma separated channels to leave out
+  --batch: convert each .mid file given (or in the directories given) to a
+    .seq in the output directory, in parallel
+  -j, --jobs: max files to convert in parallel (default: number of cpus)
+  --optimize: make the .seq smaller by leaving out controller and tempo
+    changes which don't change anything, merging meta events at the same
+    time and using running status. the result is checked to play the same.
+    assumes the sequence plays straight through, without loops
+  --compact: also save a compact sequence (for ALCSPlayer) as a .cseq next
+    to the .seq, and compare their size and how long they take to read.
+    controllers 102 and 103 mark the start and end of loop <value>, and 104
+    and 105 set the loop count to <value> and 128 + <value> (0 or unset loops
+    forever)
+`);
+    return 0;
+  }
 
-  events.push({deltaTime: 0, meta: true, type: 'endOfTrack'});
-  midi.tracks = [events];
+  const options = {
+    blank: args['--blank'],
+    gm: args['--gm'],
+    channelFilter: args['--channelfilter']
+      ? args['--channelfilter'].split(',').map((v) => parseInt(v, 10))
+      : null,
+    optimize: args['--optimize'],
+    compact: args['--compact'],
+  };
+
+  if (!args['--batch']) {
+    const result = convertMidi(
+      args._[0],
+      args['--out'] || 'tst.seq',
+      options,
+      files
+    );
+    if (options.optimize) {
+      log(formatSavings(result));
+    }
+    if (options.compact) {
+      log(formatCompactReport(result.compact));
+    }
+    return 0;
+  }
+
+  const outDir = args['--out'] || '.';
+  fs.mkdirSync(outDir, {recursive: true});
+  const jobs = findFiles(args._, /\.midi?$/i).map((inFile) => ({
+    inFile,
+    outFile: path.join(
+      outDir,
+      path.basename(inFile).replace(/\.midi?$/i, '') + '.seq'
+    ),
+  }));
+  const startTime = Date.now();
+  let eventsIn = 0;
+  let totalSize = 0;
+  let totalUnoptimizedSize = 0;
+  let totalCompactSize = 0;
+  await runWorkerPool({
+    workerFile: __filename,
+    workerData: options,
+    jobs,
+    concurrency: args['--jobs'] || os.cpus().length,
+    onResult: (result, job) => {
+      eventsIn += result.eventsIn;
+      totalSize += result.size;
+      totalUnoptimizedSize += result.unoptimizedSize || result.size;
+      log(
+        `${job.inFile} -> ${job.outFile}: ${result.eventsOut} of ${
+          result.eventsIn
+        } events kept${options.optimize ? ', ' + formatSavings(result) : ''}`
+      );
+      if (options.compact) {
+        totalCompactSize += result.compact.compact.size;
+        log(`  ${formatCompactReport(result.compact)}`);
+      }
+    },
+  });
+  const elapsed = (Date.now() - startTime) / 1000;
+  log(
+    `converted ${jobs.length} file(s), ${eventsIn} events in ${elapsed.toFixed(
+      2
+    )}s (${Math.round(eventsIn / elapsed)} events/s)`
+  );
+  if (options.optimize) {
+    log(`optimized ${totalUnoptimizedSize} -> ${totalSize} bytes in total`);
+  }
+  if (options.compact) {
+    log(`compact sequences: ${totalSize} -> ${totalCompactSize} bytes in total`);
+  }
+  return 0;
 }
 
-const outputBuffer = Buffer.from(writeMidi(midi));
-// console.log('output', parseMidi(outputBuffer));
+if (!isMainThread) {
+  serveWorkerJobs(({inFile, outFile}, options) =>
+    convertMidi(inFile, outFile, options)
+  );
+} else if (require.main === module) {
+  run(process.argv.slice(2))
+    .then((code) => {
+      process.exitCode = code;
+    })
+    .catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+}
 
-fs.writeFileSync(args['--out'] || 'tst.seq', outputBuffer);
+module.exports = {run};
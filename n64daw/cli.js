@@ -1,5 +1,11 @@
 const fs = require('fs');
 const {performance} = require('perf_hooks');
+const {
+  isMainThread,
+  Worker,
+  parentPort,
+  workerData,
+} = require('worker_threads');
 const {Midi} = require('@tonejs/midi');
 
 global.performance = performance;
@@ -7,6 +13,22 @@ global.performance = performance;
 const DEV = process.env.NODE_ENV === 'development';
 
 const arg = require('arg');
+const {
+  PacketTimeline,
+  encodePacket,
+  PACKET_HEADER_SIZE,
+  MIDI_MESSAGE_SIZE,
+  MAX_EVENTS_IN_PACKET,
+} = require('./src/packettimeline');
+const EventStream = require('./src/eventstream');
+const renderMidiStream = require('./src/renderMidiStream');
+const EventStreamCache = require('./eventstreamcache');
+const {
+  SendScheduler,
+  playTimeline,
+  playEvents,
+  runPeriodic,
+} = require('./src/sendscheduler');
 
 const args = arg({
   // Types
@@ -16,11 +38,20 @@ const args = arg({
   '--midiin': String, // --midiin <string> or --midiin=<string>
   '--midiout': String, // --midiout <string> or --midiout=<string>
   '--channelfilter': String, // --channelfilter 2 or --channelfilter="1, 3, 4"
+  '--record': String, // --record <file> saves packets sent to the n64
+  '--worker': Boolean, // send from a worker thread
+  '--guard': Number, // ms before each send to stop sleeping and busy wait
+  '--cache': String, // --cache <dir> keeps rendered midi to load next time
 });
 
 let player;
 let realtime = false;
 let channelFilter = null;
+let scheduler = null;
+let sendWorker = null;
+
+const tickInterval = 1000 / 60;
+const lookAhead = 32;
 
 if (args['--channelfilter']) {
   channelFilter = new Set(
@@ -29,35 +60,100 @@ if (args['--channelfilter']) {
 }
 async function run() {
   if (args._[0]) {
-    const Player = require('./soundtool-ui/src/player');
+    const Player = require('./src/player');
     const midiData = await fs.promises.readFile(args._[0]);
-    player = new Player(
-      new Midi(midiData).toJSON(),
-      channelFilter,
-      args['--gm']
-    );
+    const {midi, events} = loadMidi(midiData);
+    player = new Player(midi, channelFilter, args['--gm'], events);
   } else if (args['--midiin']) {
     if (args['--channelfilter']) {
       throw new Error('--channelfilter not supported with --midiout');
     }
+    if (args['--worker']) {
+      throw new Error('--worker not supported with --midiin');
+    }
     realtime = true;
-    const Player = require('./soundtool-ui/src/rtplayer');
+    const Player = require('./src/rtplayer');
     const inPort = await getMidiPort(args['--midiin'], 'in');
     player = new Player(inPort);
   } else {
     throw new Error('--midiin or positional arg required');
   }
 
-  if (args['--midiout']) {
-    runWithMidiOut(args['--midiout']);
-  } else {
-    runWithEverdriveOut();
+  if (args['--worker']) {
+    return runOnWorker(player.events);
+  }
+  return play(player.events);
+}
+
+// parses and renders the midi file, or loads what was rendered last time
+// from the --cache dir
+function loadMidi(midiData) {
+  const cache = args['--cache'] ? new EventStreamCache(args['--cache']) : null;
+  const key =
+    cache && cache.getKey(midiData, {channelFilter, generalMIDI: args['--gm']});
+  const cached = cache && cache.get(key);
+  if (cached) {
+    return {midi: {header: cached.header, tracks: []}, events: cached.events};
   }
+
+  const midi = new Midi(midiData).toJSON();
+  const events = renderMidiStream(midi, channelFilter, args['--gm']);
+  if (cache) {
+    const {ppq, tempos} = midi.header;
+    cache.set(key, {ppq, tempos}, events);
+  }
+  return {midi, events};
+}
+
+function play(events) {
+  const guard = args['--guard'] != null ? args['--guard'] : 1;
+  // realtime input is polled, so busy waiting wouldn't make it any sooner
+  scheduler = new SendScheduler({guard: realtime ? 0 : guard});
+  const done = args['--midiout']
+    ? runWithMidiOut(args['--midiout'], events)
+    : runWithEverdriveOut(events);
+  return done.then(() => {
+    console.log(scheduler.lateness.format());
+  });
+}
+
+// the output is opened and sent to from a worker thread, so work on the main
+// thread (eg. logging) can't delay sends. resolves when the worker is done
+function runOnWorker(events) {
+  sendWorker = new Worker(__filename, {
+    argv: process.argv.slice(2),
+    workerData: {events},
+  });
+  sendWorker.on('message', (message) => {
+    console.log(message);
+  });
+  return new Promise((resolve, reject) => {
+    sendWorker.on('error', reject);
+    sendWorker.on('exit', (code) => {
+      if (code !== 0) {
+        reject(new Error(`send worker exited with code ${code}`));
+      } else {
+        resolve();
+      }
+    });
+  });
+}
+
+function serveWorker() {
+  parentPort.on('message', (message) => {
+    if (message === 'report') {
+      parentPort.postMessage(scheduler.lateness.format());
+    }
+  });
+  play(EventStream.from(workerData.events)).catch((err) => {
+    console.error(err);
+    process.exit(1);
+  });
 }
 
 const eventLog = [];
 
-async function runWithEverdriveOut() {
+async function runWithEverdriveOut(events) {
   const DebuggerInterface = DEV
     ? require('../../ed64log/ed64logjs/dbgif')
     : require('ed64logjs/dbgif');
@@ -79,84 +175,69 @@ async function runWithEverdriveOut() {
     );
   }
 
-  function sendPendingEvents(events) {
-    // play to n64
-    const midiMessageSize = 4 + 4;
-    const remainingSpace = 512 - 8;
-    const maxEventsInPacket = Math.floor(remainingSpace / midiMessageSize);
-    const eventMessagesTruncated = events
-      .slice(0, maxEventsInPacket)
-      .map((event) => {
-        const midiMessage = Buffer.alloc(midiMessageSize);
-        midiMessage.writeUInt32BE(event.time * 1000);
-        event.data.copy(midiMessage, /*offset to midi bytes*/ 4);
-        return midiMessage;
-      });
-
-    const headerEventCount = Buffer.alloc(4);
-    headerEventCount.writeUInt32BE(eventMessagesTruncated.length);
-    const packetHeader = Buffer.concat([
-      Buffer.from('MMID', 'utf8'),
-      headerEventCount,
-    ]);
-    const packet = Buffer.concat([packetHeader, ...eventMessagesTruncated]);
-    if (packet.length > 512) {
-      throw new Error(`invalid packet size ${packet.length}`);
-    }
+  // recording of the packets sent, for replaying on the host, eg. with
+  // sgisoundtest/chanstate.c
+  const recording = args['--record']
+    ? fs.createWriteStream(args['--record'])
+    : null;
+  function sendPacket(packet) {
     if (args['--verbose']) {
-      console.log('messages', eventMessagesTruncated);
       console.log('sendPacket', packet);
     }
+    if (recording) {
+      recording.write(packet);
+    }
     dbgif.sendPacket(packet);
+  }
+
+  function sendPendingEvents(events) {
+    // play to n64
+    const count = Math.min(events.length, MAX_EVENTS_IN_PACKET);
+    const packet = Buffer.alloc(PACKET_HEADER_SIZE + count * MIDI_MESSAGE_SIZE);
+    encodePacket(packet, 0, events, 0, count);
+    sendPacket(packet);
 
     // return any leftover events which didn't fit in this packet
-    return events.slice(maxEventsInPacket);
+    return events.slice(count);
   }
 
-  let eventsToSend = [];
-  function tick() {
-    const lookAhead = 32;
-    setTimeout(() => {
+  console.log('playing to n64');
+  sendPacket(Buffer.from('MSTA', 'utf8'));
+  if (realtime) {
+    let eventsToSend = [];
+    player.play();
+    await runPeriodic(scheduler, tickInterval, () => {
       eventsToSend = eventsToSend.concat(player.getPendingEvents(lookAhead));
-      if (eventsToSend.length) {
+      const pending = eventsToSend.length;
+      if (pending) {
         eventsToSend = sendPendingEvents(eventsToSend);
       }
-      if (player.playing) {
-        tick();
-      }
-    }, 1000 / 60);
+      return pending - eventsToSend.length;
+    });
+  } else {
+    // files are encoded into packets up front, so playing just sends each
+    // one when it's due
+    const timeline = new PacketTimeline(events, {lookAhead, tickInterval});
+    await playTimeline(scheduler, timeline, sendPacket);
   }
-
-  console.log('playing to n64');
-  dbgif.sendPacket(Buffer.from('MSTA', 'utf8'));
-  player.play();
-  tick();
 }
 
-async function runWithMidiOut(portName) {
-  const outPort = await getMidiPort(args['--midiout'], 'out');
-
-  function playPendingEvents(events) {
-    events.forEach((event) => {
-      const midiMessage = Array.from(event.data);
-
-      outPort.send(midiMessage);
-    });
-  }
+async function runWithMidiOut(portName, events) {
+  const outPort = await getMidiPort(portName, 'out');
 
-  function tick() {
-    const start = performance.now();
-    setTimeout(() => {
-      // eventLog.push({time: performance.now() - start});
+  console.log('playing to midi out');
+  if (realtime) {
+    player.play();
+    await runPeriodic(scheduler, 1, () => {
       const events = player.getPendingEvents(0);
-      playPendingEvents(events);
-      tick();
+      events.forEach((event) => {
+        outPort.send(Array.from(event.data));
+      });
+      return events.length;
     });
+  } else {
+    await playEvents(scheduler, events, outPort);
   }
-  tick();
-
-  console.log('playing to midi out');
-  player.play();
 }
 
 async function getMidiPort(name, direction) {
@@ -179,14 +260,26 @@ async function getMidiPort(name, direction) {
   return port;
 }
 
-process.on('SIGINT', function () {
-  eventLog.forEach((event, index) => {
-    console.log(event);
+if (!isMainThread) {
+  serveWorker();
+} else {
+  process.on('SIGINT', function () {
+    eventLog.forEach((event, index) => {
+      console.log(event);
+    });
+    if (sendWorker) {
+      sendWorker.once('message', () => process.exit(0));
+      sendWorker.postMessage('report');
+      return;
+    }
+    if (scheduler) {
+      console.log(scheduler.lateness.format());
+    }
+    process.exit(0);
   });
-  process.exit(0);
-});
 
-run().catch((err) => {
-  console.error(err);
-  process.exit(1);
-});
+  run().catch((err) => {
+    console.error(err);
+    process.exit(1);
+  });
+}
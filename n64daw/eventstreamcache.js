@@ -0,0 +1,116 @@
+// cache of the EventStreams rendered from midi files, so opening a large file
+// again doesn't have to parse and render it. entries are keyed by the sha1 of
+// the file's contents and the render options, and store the midi header
+// (which Player needs for tempo changes) and the stream's columns, which are
+// loaded as views of the file's contents rather than parsed.
+//
+// an entry is <key>.events: the magic, the version, the event count and the
+// length of the header json (u32 LE), the header json, padding to a multiple
+// of 8 bytes, then the time, status, data1 and data2 columns
+
+const fs = require('fs');
+const path = require('path');
+const crypto = require('crypto');
+const EventStream = require('./src/eventstream');
+
+// bump this when the entry format or what renderMidiStream produces changes
+const CACHE_VERSION = 1;
+const MAGIC = 'N64DAWEV';
+const PREFIX_SIZE = MAGIC.length + 4 * 3;
+
+class EventStreamCache {
+  constructor(dir) {
+    this.dir = dir;
+    fs.mkdirSync(dir, {recursive: true});
+  }
+
+  getKey(midiData, {channelFilter, generalMIDI}) {
+    return crypto
+      .createHash('sha1')
+      .update(midiData)
+      .update(
+        JSON.stringify({
+          version: CACHE_VERSION,
+          channelFilter: channelFilter
+            ? [...channelFilter].sort((a, b) => a - b)
+            : null,
+          generalMIDI: Boolean(generalMIDI),
+        })
+      )
+      .digest('hex');
+  }
+
+  entryPath(key) {
+    return path.join(this.dir, `${key}.events`);
+  }
+
+  // returns {header, events}, or null if there's no (valid) entry
+  get(key) {
+    let contents;
+    try {
+      contents = fs.readFileSync(this.entryPath(key));
+    } catch (err) {
+      if (err.code === 'ENOENT') return null;
+      throw err;
+    }
+    if (
+      contents.length < PREFIX_SIZE ||
+      contents.toString('latin1', 0, MAGIC.length) !== MAGIC ||
+      contents.readUInt32LE(MAGIC.length) !== CACHE_VERSION
+    ) {
+      return null;
+    }
+    const count = contents.readUInt32LE(MAGIC.length + 4);
+    const headerSize = contents.readUInt32LE(MAGIC.length + 8);
+    const columnsStart = align8(PREFIX_SIZE + headerSize);
+    if (contents.length !== columnsStart + count * (8 + 3)) return null;
+
+    const header = JSON.parse(
+      contents.toString('utf8', PREFIX_SIZE, PREFIX_SIZE + headerSize)
+    );
+    // Float64Array views need to be 8 byte aligned
+    if ((contents.byteOffset + columnsStart) % 8 !== 0) {
+      contents = Buffer.from(contents);
+    }
+    const {buffer, byteOffset} = contents;
+    let offset = byteOffset + columnsStart;
+    const time = new Float64Array(buffer, offset, count);
+    offset += count * 8;
+    const status = new Uint8Array(buffer, offset, count);
+    offset += count;
+    const data1 = new Uint8Array(buffer, offset, count);
+    offset += count;
+    const data2 = new Uint8Array(buffer, offset, count);
+    return {header, events: new EventStream(time, status, data1, data2)};
+  }
+
+  set(key, header, events) {
+    const headerJSON = Buffer.from(JSON.stringify(header), 'utf8');
+    const prefix = Buffer.alloc(align8(PREFIX_SIZE + headerJSON.length));
+    prefix.write(MAGIC, 0, 'latin1');
+    prefix.writeUInt32LE(CACHE_VERSION, MAGIC.length);
+    prefix.writeUInt32LE(events.length, MAGIC.length + 4);
+    prefix.writeUInt32LE(headerJSON.length, MAGIC.length + 8);
+    headerJSON.copy(prefix, PREFIX_SIZE);
+
+    const columns = [events.time, events.status, events.data1, events.data2];
+    const entryPath = this.entryPath(key);
+    const tmpPath = `${entryPath}.${process.pid}.tmp`;
+    fs.writeFileSync(
+      tmpPath,
+      Buffer.concat([
+        prefix,
+        ...columns.map((column) =>
+          Buffer.from(column.buffer, column.byteOffset, column.byteLength)
+        ),
+      ])
+    );
+    fs.renameSync(tmpPath, entryPath);
+  }
+}
+
+function align8(size) {
+  return (size + 7) & ~7;
+}
+
+module.exports = EventStreamCache;
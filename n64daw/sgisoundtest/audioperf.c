@@ -0,0 +1,188 @@
+#include "audioperf.h"
+
+void audioPerfInit(AudioPerfRing* ring) {
+  int i;
+  for (i = 0; i < AUDIOPERF_RING_SIZE; i++) {
+    ring->frames[i].cmdListUs = 0;
+    ring->frames[i].rspUs = 0;
+    ring->frames[i].voices = 0;
+    ring->frames[i].events = 0;
+  }
+  ring->next = 0;
+  ring->count = 0;
+  ring->totalFrames = 0;
+}
+
+void audioPerfPush(AudioPerfRing* ring, const AudioPerfFrame* frame) {
+  ring->frames[ring->next] = *frame;
+  ring->next++;
+  if (ring->next >= AUDIOPERF_RING_SIZE) ring->next = 0;
+  if (ring->count < AUDIOPERF_RING_SIZE) ring->count++;
+  ring->totalFrames++;
+}
+
+static void statInit(AudioPerfStat* stat) {
+  stat->min = 0xffffffff;
+  stat->avg = 0;
+  stat->max = 0;
+}
+
+// accumulates the sum into avg, which is divided down in statFinish
+static void statAdd(AudioPerfStat* stat, u32 value) {
+  if (value < stat->min) stat->min = value;
+  if (value > stat->max) stat->max = value;
+  stat->avg += value;
+}
+
+static void statFinish(AudioPerfStat* stat, u32 count) {
+  if (count == 0) {
+    stat->min = 0;
+    return;
+  }
+  // round to nearest
+  stat->avg = (stat->avg + count / 2) / count;
+}
+
+void audioPerfSummarize(const AudioPerfRing* ring, AudioPerfSummary* out) {
+  u32 i;
+  const AudioPerfFrame* frame;
+
+  statInit(&out->cmdListUs);
+  statInit(&out->rspUs);
+  statInit(&out->voices);
+  statInit(&out->events);
+
+  // order doesn't matter for min/avg/max so just walk the valid slots
+  for (i = 0; i < ring->count; i++) {
+    frame = &ring->frames[i];
+    statAdd(&out->cmdListUs, frame->cmdListUs);
+    statAdd(&out->rspUs, frame->rspUs);
+    statAdd(&out->voices, frame->voices);
+    statAdd(&out->events, frame->events);
+  }
+
+  statFinish(&out->cmdListUs, ring->count);
+  statFinish(&out->rspUs, ring->count);
+  statFinish(&out->voices, ring->count);
+  statFinish(&out->events, ring->count);
+  out->frames = ring->count;
+}
+
+static const u8* skipVarLen(const u8* data, const u8* end, u32* value) {
+  *value = 0;
+  while (data < end) {
+    u8 byte = *data++;
+    *value = (*value << 7) | (byte & 0x7f);
+    if (!(byte & 0x80)) break;
+  }
+  return data;
+}
+
+u32 audioPerfCountSeqEvents(const u8* data, const u8* end, u8 runningStatus) {
+  u32 events = 0;
+  u32 length;
+
+  while (data < end) {
+    u8 status;
+    data = skipVarLen(data, end, &length); /* delta time */
+    if (data >= end) break;
+    status = *data;
+    if (status & 0x80) {
+      data++;
+    } else {
+      status = runningStatus;
+    }
+
+    if (status == 0xff) {
+      data = skipVarLen(data + 1, end, &length) + length; /* meta */
+    } else if (status == 0xf0 || status == 0xf7) {
+      data = skipVarLen(data, end, &length) + length; /* sysex */
+    } else {
+      runningStatus = status;
+      // program change and channel pressure have one data byte
+      data += (status & 0xe0) == 0xc0 ? 1 : 2;
+      events++;
+    }
+  }
+  return events;
+}
+
+#ifdef AUDIOPERF_HOST_MAIN
+#include <stdio.h>
+
+// host check: feeds a known sequence of frames through the ring and verifies
+// the aggregates, including after the ring has wrapped around
+static int failures = 0;
+
+static void expect(const char* what, u32 actual, u32 expected) {
+  if (actual != expected) {
+    printf("FAIL %s: expected %lu, got %lu\n", what, (unsigned long)expected,
+           (unsigned long)actual);
+    failures++;
+  }
+}
+
+int main() {
+  AudioPerfRing ring;
+  AudioPerfSummary summary;
+  AudioPerfFrame frame;
+  u32 i;
+
+  audioPerfInit(&ring);
+  audioPerfSummarize(&ring, &summary);
+  expect("empty frames", summary.frames, 0);
+  expect("empty min", summary.cmdListUs.min, 0);
+  expect("empty avg", summary.cmdListUs.avg, 0);
+
+  for (i = 1; i <= 4; i++) {
+    frame.cmdListUs = i * 100;
+    frame.rspUs = 1000 + i;
+    frame.voices = i;
+    frame.events = i % 2;
+    audioPerfPush(&ring, &frame);
+  }
+  audioPerfSummarize(&ring, &summary);
+  expect("partial frames", summary.frames, 4);
+  expect("partial cmd min", summary.cmdListUs.min, 100);
+  expect("partial cmd avg", summary.cmdListUs.avg, 250);
+  expect("partial cmd max", summary.cmdListUs.max, 400);
+  expect("partial rsp avg", summary.rspUs.avg, 1003); /* 1002.5 rounded */
+  expect("partial voices max", summary.voices.max, 4);
+  expect("partial events min", summary.events.min, 0);
+
+  // wrap: only the last AUDIOPERF_RING_SIZE frames should count
+  for (i = 0; i < AUDIOPERF_RING_SIZE * 2 + 3; i++) {
+    frame.cmdListUs = i;
+    frame.rspUs = 0;
+    frame.voices = 24;
+    frame.events = 0;
+    audioPerfPush(&ring, &frame);
+  }
+  audioPerfSummarize(&ring, &summary);
+  expect("wrapped frames", summary.frames, AUDIOPERF_RING_SIZE);
+  expect("wrapped cmd min", summary.cmdListUs.min, AUDIOPERF_RING_SIZE + 3);
+  expect("wrapped cmd max", summary.cmdListUs.max, AUDIOPERF_RING_SIZE * 2 + 2);
+  expect("wrapped voices avg", summary.voices.avg, 24);
+  expect("total frames", ring.totalFrames, AUDIOPERF_RING_SIZE * 2 + 7);
+
+  {
+    // note on, note on with running status, tempo, program change, note off
+    // after a two byte delta, sysex, end of track
+    static const u8 track[] = {
+        0x00, 0x90, 0x3c, 0x64, 0x00, 0x3e, 0x64, 0x00, 0xff, 0x51,
+        0x03, 0x07, 0xa1, 0x20, 0x00, 0xc0, 0x05, 0x81, 0x00, 0x80,
+        0x3c, 0x00, 0x00, 0xf0, 0x02, 0x7e, 0xf7, 0x00, 0xff, 0x2f,
+        0x00,
+    };
+    expect("seq events", audioPerfCountSeqEvents(track, track + sizeof(track), 0),
+           4);
+    // starting at the running status note on
+    expect("seq events running status",
+           audioPerfCountSeqEvents(track + 4, track + 7, 0x90), 1);
+    expect("seq events none", audioPerfCountSeqEvents(track, track, 0x90), 0);
+  }
+
+  if (failures == 0) printf("audioperf ok\n");
+  return failures ? 1 : 0;
+}
+#endif /* AUDIOPERF_HOST_MAIN */
@@ -0,0 +1,60 @@
+#ifndef AUDIOPERF_H
+#define AUDIOPERF_H
+
+/*
+  per audio frame cost counters, aggregated over a ring of recent frames.
+
+  this file and audioperf.c don't depend on libultra, so the aggregation can
+  be built and checked on the host, eg:
+  cc -o audioperf_host -DAUDIOPERF_HOST_MAIN audioperf.c
+*/
+
+#include "ed64io_types.h"
+
+// number of recent audio frames aggregated into min/avg/max
+#define AUDIOPERF_RING_SIZE 64
+
+// packet type used when streaming a summary over usb with ed64SendBinaryData
+#define AUDIOPERF_USB_PACKET_TYPE 0x4150 /* 'AP' */
+
+typedef struct AudioPerfFrame {
+  u32 cmdListUs; /* CPU time spent building the audio command list */
+  u32 rspUs;     /* RSP time spent running the audio task */
+  u32 voices;    /* physical voices allocated by the synthesizer */
+  u32 events;    /* midi events dispatched to the seq player */
+} AudioPerfFrame;
+
+typedef struct AudioPerfStat {
+  u32 min;
+  u32 avg;
+  u32 max;
+} AudioPerfStat;
+
+// layout is also the usb packet payload: 13 big endian u32 values
+typedef struct AudioPerfSummary {
+  u32 frames; /* number of frames aggregated (at most AUDIOPERF_RING_SIZE) */
+  AudioPerfStat cmdListUs;
+  AudioPerfStat rspUs;
+  AudioPerfStat voices;
+  AudioPerfStat events;
+} AudioPerfSummary;
+
+typedef struct AudioPerfRing {
+  AudioPerfFrame frames[AUDIOPERF_RING_SIZE];
+  u32 next;        /* index the next frame will be written to */
+  u32 count;       /* number of valid frames in the ring */
+  u32 totalFrames; /* frames pushed since init */
+} AudioPerfRing;
+
+void audioPerfInit(AudioPerfRing* ring);
+
+void audioPerfPush(AudioPerfRing* ring, const AudioPerfFrame* frame);
+
+void audioPerfSummarize(const AudioPerfRing* ring, AudioPerfSummary* out);
+
+// count the midi events in part of a (type 0) midi track, from data up to end,
+// where runningStatus is the status in effect at data. meta and sysex events
+// aren't counted
+u32 audioPerfCountSeqEvents(const u8* data, const u8* end, u8 runningStatus);
+
+#endif /* AUDIOPERF_H */
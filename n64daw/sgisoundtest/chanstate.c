@@ -0,0 +1,216 @@
+#include "chanstate.h"
+
+#define MIDI_CONTROL_CHANGE 0xb
+#define MIDI_PROGRAM_CHANGE 0xc
+#define MIDI_CC_VOLUME 7
+
+void chanStateInit(ChannelStateTable* table, u32 nowUs) {
+  int i;
+  for (i = 0; i < CHANSTATE_CHANNELS; i++) {
+    table->channels[i].volume = 0;
+    table->channels[i].program = 0;
+    table->channels[i].eventCount = 0;
+    table->channels[i].eventRate = 0;
+  }
+  table->rateStartUs = nowUs;
+}
+
+void chanStateSeed(ChannelStateTable* table, int channel, u8 volume,
+                   u8 program) {
+  table->channels[channel].volume = volume;
+  table->channels[channel].program = program;
+}
+
+int chanStateApply(ChannelStateTable* table, u8 status, u8 data1, u8 data2) {
+  ChannelState* ch = &table->channels[status & 0xf];
+
+  ch->eventCount++;
+
+  switch (status >> 4) {
+    case MIDI_CONTROL_CHANGE:
+      if (data1 == MIDI_CC_VOLUME) {
+        ch->volume = data2;
+      }
+      return 0;
+    case MIDI_PROGRAM_CHANGE:
+      // the seq player resets the channel volume to the instrument's volume on
+      // program change. we keep the previous volume, which the caller restores
+      ch->program = data1;
+      return 1;
+  }
+  return 0;
+}
+
+void chanStateUpdateRates(ChannelStateTable* table, u32 nowUs) {
+  int i;
+  u32 elapsedUs = nowUs - table->rateStartUs;
+
+  if (elapsedUs < CHANSTATE_RATE_INTERVAL_US) return;
+
+  for (i = 0; i < CHANSTATE_CHANNELS; i++) {
+    ChannelState* ch = &table->channels[i];
+    // events per second, scaled by the actual elapsed time
+    ch->eventRate =
+        (u32)(((u64)ch->eventCount * 1000000 + elapsedUs / 2) / elapsedUs);
+    ch->eventCount = 0;
+  }
+  table->rateStartUs = nowUs;
+}
+
+#ifdef CHANSTATE_HOST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// host check: replays a recording of MMID packets (as sent by cli.js, eg.
+// chanstate.mmid) through the same dispatch logic as playMidi, to a model of
+// the seq player. the channel state the recording sets is tracked separately,
+// from the recorded messages alone, and both the seq player model and the
+// shadow table are checked against it after every message.
+
+// volume the modelled seq player starts each channel at, and resets a channel
+// to on program change. different so a missing restore shows up
+#define MODEL_INITIAL_VOLUME 127
+#define MODEL_INST_VOLUME 100
+
+typedef struct SeqpModel {
+  u8 volume[CHANSTATE_CHANNELS];
+  u8 program[CHANSTATE_CHANNELS];
+} SeqpModel;
+
+// as the seq player handles the messages alSeqpSendMidi gives it
+static void modelSendMidi(SeqpModel* model, u8 status, u8 data1, u8 data2) {
+  int channel = status & 0xf;
+  switch (status >> 4) {
+    case MIDI_CONTROL_CHANGE:
+      if (data1 == MIDI_CC_VOLUME) model->volume[channel] = data2;
+      break;
+    case MIDI_PROGRAM_CHANGE:
+      model->program[channel] = data1;
+      model->volume[channel] = MODEL_INST_VOLUME;
+      break;
+  }
+}
+
+static u32 readU32BE(const u8* p) {
+  return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+int main(int argc, char** argv) {
+  FILE* file;
+  u8* data;
+  long size;
+  long pos = 0;
+  u32 packets = 0;
+  u32 messages = 0;
+  u32 counted = 0;
+  int failures = 0;
+  int i;
+  ChannelStateTable table;
+  SeqpModel model;
+  // the last volume and program the recording sent each channel, which is
+  // what it expects the channel to have
+  u8 songVolume[CHANSTATE_CHANNELS];
+  u8 songProgram[CHANSTATE_CHANNELS];
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s recording.mmid\n", argv[0]);
+    return 2;
+  }
+
+  file = fopen(argv[1], "rb");
+  if (!file) {
+    perror(argv[1]);
+    return 2;
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data = malloc(size);
+  if (fread(data, 1, size, file) != (size_t)size) {
+    perror(argv[1]);
+    return 2;
+  }
+  fclose(file);
+
+  chanStateInit(&table, 0);
+  for (i = 0; i < CHANSTATE_CHANNELS; i++) {
+    model.volume[i] = MODEL_INITIAL_VOLUME;
+    model.program[i] = 0;
+    songVolume[i] = MODEL_INITIAL_VOLUME;
+    songProgram[i] = 0;
+    // as stage00.c seeds the table from the seq player
+    chanStateSeed(&table, i, model.volume[i], model.program[i]);
+  }
+
+  while (pos + 4 <= size) {
+    u32 count;
+    u32 j;
+    if (memcmp(data + pos, "MSTA", 4) == 0) {
+      pos += 4;
+      continue;
+    }
+    if (memcmp(data + pos, "MMID", 4) != 0 || pos + 8 > size) {
+      fprintf(stderr, "invalid packet at offset %ld\n", pos);
+      return 2;
+    }
+    count = readU32BE(data + pos + 4);
+    pos += 8;
+    if (pos + (long)count * 8 > size) {
+      fprintf(stderr, "truncated packet at offset %ld\n", pos);
+      return 2;
+    }
+    for (j = 0; j < count; j++, pos += 8) {
+      u8 status = data[pos + 4];
+      u8 data1 = data[pos + 5];
+      u8 data2 = data[pos + 6];
+      int channel = status & 0xf;
+
+      if ((status & 0xf0) == 0xb0 && data1 == 7) {
+        songVolume[channel] = data2;
+      } else if ((status & 0xf0) == 0xc0) {
+        songProgram[channel] = data1;
+      }
+
+      // same sequence of sends as playMidi
+      modelSendMidi(&model, status, data1, data2);
+      if (chanStateApply(&table, status, data1, data2)) {
+        modelSendMidi(&model, 0xb0 | channel, MIDI_CC_VOLUME,
+                      table.channels[channel].volume);
+      }
+
+      if (model.volume[channel] != songVolume[channel] ||
+          model.program[channel] != songProgram[channel] ||
+          table.channels[channel].volume != songVolume[channel] ||
+          table.channels[channel].program != songProgram[channel]) {
+        printf("FAIL message %lu (%02x %02x %02x): recording v%u p%u, "
+               "seq player v%u p%u, shadow v%u p%u\n",
+               (unsigned long)messages, status, data1, data2,
+               songVolume[channel], songProgram[channel],
+               model.volume[channel], model.program[channel],
+               table.channels[channel].volume, table.channels[channel].program);
+        failures++;
+      }
+      messages++;
+    }
+    packets++;
+  }
+
+  for (i = 0; i < CHANSTATE_CHANNELS; i++) {
+    counted += table.channels[i].eventCount;
+    printf("ch%2d v%3u p%3u events %lu\n", i, table.channels[i].volume,
+           table.channels[i].program,
+           (unsigned long)table.channels[i].eventCount);
+  }
+  if (counted != messages) {
+    printf("FAIL counted %lu events, expected %lu\n", (unsigned long)counted,
+           (unsigned long)messages);
+    failures++;
+  }
+
+  printf("%lu packets, %lu messages, %d failures\n", (unsigned long)packets,
+         (unsigned long)messages, failures);
+  free(data);
+  return failures ? 1 : 0;
+}
+#endif /* CHANSTATE_HOST_MAIN */
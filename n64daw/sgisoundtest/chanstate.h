@@ -0,0 +1,50 @@
+#ifndef CHANSTATE_H
+#define CHANSTATE_H
+
+/*
+  shadow copy of seq player channel state, kept up to date from the midi
+  messages we send to the seq player, so we don't need to query the seq player
+  with alSeqpGetChlVol/alSeqpGetChlProgram.
+
+  this file and chanstate.c don't depend on libultra, so they can be built and
+  checked on the host against a recorded stream of MMID packets (see
+  `cli.js --record`), eg. chanstate.mmid, which has program changes before,
+  after and between volume changes on every channel:
+  cc -o chanstate_host -DCHANSTATE_HOST_MAIN chanstate.c
+  ./chanstate_host chanstate.mmid
+*/
+
+#include "ed64io_types.h"
+
+#define CHANSTATE_CHANNELS 16
+
+// how often event rates are recomputed
+#define CHANSTATE_RATE_INTERVAL_US 1000000
+
+typedef struct ChannelState {
+  u8 volume;
+  u8 program;
+  u32 eventCount; /* events since the last rate update */
+  u32 eventRate;  /* events per second over the last rate interval */
+} ChannelState;
+
+typedef struct ChannelStateTable {
+  ChannelState channels[CHANSTATE_CHANNELS];
+  u32 rateStartUs; /* start of the current rate interval */
+} ChannelStateTable;
+
+void chanStateInit(ChannelStateTable* table, u32 nowUs);
+
+// set the known state of a channel, eg. from the seq player at startup
+void chanStateSeed(ChannelStateTable* table, int channel, u8 volume,
+                   u8 program);
+
+// update the shadow state for a midi message being sent to the seq player.
+// returns TRUE if the message resets the channel volume (program change), in
+// which case the caller should follow it with a cc7 of the channel's volume
+// in the same tick to restore it.
+int chanStateApply(ChannelStateTable* table, u8 status, u8 data1, u8 data2);
+
+void chanStateUpdateRates(ChannelStateTable* table, u32 nowUs);
+
+#endif /* CHANSTATE_H */
@@ -3,6 +3,8 @@
 #include "main.h"
 #include "graphic.h"
 #include "segment.h"
+#include "audioperf.h"
+#include "chanstate.h"
 
 #ifdef ED64
 #include "ed64io.h"
@@ -69,8 +71,8 @@ ALSeqpConfig  seqpConfig = {
 
 static u32 seqStartTime = 0;
 
-static u8 chVolumes[NUM_CHANNELS];
-static u8 chPrograms[NUM_CHANNELS];
+// shadow of the seq player's channel state, updated from the midi we send it
+static ChannelStateTable chState;
 
 
 int getMaxSeqNo() { 
@@ -80,16 +82,41 @@ int getMaxSeqNo() {
 // debug window enum
 #define DBG_CHANNELS 0
 #define DBG_EVENTS 1
+#define DBG_PERF 2
 static int debugMidiEvents = TRUE;
 static int debugMidiChannels = TRUE;
 static int debugMidiEventsParsed = TRUE;
+static int debugAudioPerf = TRUE;
+static int debugAudioPerfUsb = TRUE;
 
-#define DEBUG_SCREENS 2
+#define DEBUG_SCREENS 3
 #define CH_SCREEN 0
 #define EV_SCREEN 1
+#define PERF_SCREEN 2
 static int debugScreen = EV_SCREEN;
 
 
+// audio frame performance counters
+// the probe player is serviced first in each alAudioFrame, marking the start of
+// command list building. the audio manager callback runs once the frame's
+// command list has been built, closing out the frame.
+// events are counted in the audio thread: midi we've sent since the last
+// frame (from a count only the game thread writes), and the events the seq
+// player has read from the seq file since the last frame
+#define AUDIO_PERF_PROBE_INTERVAL_US 1000
+// how often (in game frames) to stream a summary over usb
+#define AUDIO_PERF_USB_INTERVAL 60
+
+static AudioPerfRing audioPerfRing;
+static ALPlayer audioPerfProbe;
+static OSTime audioFrameStartTime;
+static int audioFrameStarted = FALSE;
+static volatile u32 midiEventsSent = 0;
+static u32 midiEventsCounted = 0;
+static u8* seqEventsCountedTo = NULL;
+static volatile u32 audioFrameCount = 0;
+static int audioPerfUsbCounter = 0;
+
 char* ALMsgTypeStrings[] = {
     "AL_SEQ_REF_EVT", /* Reference to a pending event in the sequence. */
     "AL_SEQ_MIDI_EVT",
@@ -118,6 +145,84 @@ char* ALMsgTypeStrings[] = {
 };
 
 
+static ALMicroTime audioPerfProbeHandler(void* node) {
+  // may be called more than once per frame, keep the earliest time
+  if (!audioFrameStarted) {
+    audioFrameStartTime = osGetTime();
+    audioFrameStarted = TRUE;
+  }
+  return AUDIO_PERF_PROBE_INTERVAL_US;
+}
+
+static u32 audioPerfCountVoices() {
+  ALLink* node;
+  u32 voices = 0;
+  for (node = alGlobals->drvr.pAllocList.next; node != 0; node = node->next) {
+    voices++;
+  }
+  return voices;
+}
+
+static u32 audioPerfRspTimeUs() {
+#ifdef NU_DEBUG
+  // task times are recorded by the nusys debug library's performance meter
+  int i;
+  u64 rspCycles = 0;
+  NUDebTaskPerf* perf = nuDebTaskPerfPtr;
+  for (i = 0; i < perf->auTaskCnt; i++) {
+    rspCycles += perf->auTaskTime[i].rspEnd - perf->auTaskTime[i].rspStart;
+  }
+  return OS_CYCLES_TO_USEC(rspCycles);
+#else
+  return 0;
+#endif
+}
+
+static u32 audioPerfCountEvents() {
+  u32 sent = midiEventsSent;
+  u32 events = sent - midiEventsCounted;
+  u8* seqPtr = seqState->curPtr;
+
+  midiEventsCounted = sent;
+  // the seq player reads each event from the seq as it posts it, one ahead
+  // of dispatching it. it moves back on looping or loading another seq,
+  // which we don't count across
+  if (seqEventsCountedTo && seqPtr > seqEventsCountedTo) {
+    events += audioPerfCountSeqEvents(seqEventsCountedTo, seqPtr,
+                                      seqState->lastStatus);
+  }
+  seqEventsCountedTo = seqPtr;
+  return events;
+}
+
+// called by the audio manager every audio frame
+static void audioPerfFrameCallback(void* arg) {
+  AudioPerfFrame frame;
+
+  frame.cmdListUs = audioFrameStarted
+                        ? OS_CYCLES_TO_USEC(osGetTime() - audioFrameStartTime)
+                        : 0;
+  frame.rspUs = audioPerfRspTimeUs();
+  frame.voices = audioPerfCountVoices();
+  frame.events = audioPerfCountEvents();
+  audioPerfPush(&audioPerfRing, &frame);
+
+  audioFrameStarted = FALSE;
+  audioFrameCount++;
+}
+
+void audioPerfInstall() {
+  audioPerfInit(&audioPerfRing);
+
+  audioPerfProbe.next = NULL;
+  audioPerfProbe.handler = audioPerfProbeHandler;
+  audioPerfProbe.clientData = NULL;
+  // added after the seq player so it's at the head of the client list
+  alSynAddPlayer(&alGlobals->drvr, &audioPerfProbe);
+
+  nuAuMgrFuncSet((NUAuMgrFunc)audioPerfFrameCallback);
+}
+
 // load a sample bank file for a seq into the audio heap, then assign it to the seq player
 // bank_addr: bank (.ctl) addr in rom
 // bank_size: bank length in bytes
@@ -239,6 +344,8 @@ void initSeqPlayerData() {
 
   seqPlayerSetNo(0); // load the seq data and attach to seqPlayer
   alSeqpPlay(seqPlayer);
+
+  audioPerfInstall();
 }
 
 #define USB_BUFFER_SIZE 128
@@ -303,11 +410,7 @@ void playMidi(u8 midiMsgStart[], u32 seqTimeOffset) {
   u32 ticks = alSeqSecToTicks(seqState, seqTimeOffsetUSRel/1000000.0f, tempo);
   MidiEventType eventType = getMidiEventType(midiMsgStatus);
   u32 channel = midiMsgStatus & 0xf;
-  u8 volBeforeEvent = 0;
-
-  if (eventType == ProgramChangeMidiEvent)  {
-    volBeforeEvent = alSeqpGetChlVol(seqPlayer, channel);
-  }
+  int restoreVolume;
 
   DBGPRINT("midimsg tempo=%d seqTimeOffsetUSRel=%d midi=%x %x %x\n",tempo,seqTimeOffsetUSRel, midiMsgStatus, midiMsgData1, midiMsgData2);
   if (debugMidiEvents && debugScreen == EV_SCREEN) {
@@ -319,11 +422,14 @@ void playMidi(u8 midiMsgStart[], u32 seqTimeOffset) {
     }
   }
 
+  restoreVolume = chanStateApply(&chState, midiMsgStatus, midiMsgData1, midiMsgData2);
+
   alSeqpSendMidi(seqPlayer, ticks, midiMsgStatus, midiMsgData1, midiMsgData2);
+  midiEventsSent++;
 
-  if (eventType == ProgramChangeMidiEvent)  {
-    // fix volume after program change 
-    alSeqpSendMidi(seqPlayer, ticks, (0xb<<4) + channel, 7, volBeforeEvent);
+  if (restoreVolume)  {
+    // fix volume after program change, in the same tick
+    alSeqpSendMidi(seqPlayer, ticks, (0xb<<4) + channel, 7, chState.channels[channel].volume);
   }
           
 }
@@ -378,10 +484,41 @@ int ed64SoundtestUsbListener() {
   return FALSE;
 }
 
+// copy the seq player's channel volumes and programs to the shadow table
+static void chanStateCopyFromSeqPlayer() {
+  int i;
+  for (i = 0; i < NUM_CHANNELS; i++) {
+    chanStateSeed(&chState, i, alSeqpGetChlVol(seqPlayer, i),
+                  alSeqpGetChlProgram(seqPlayer, i));
+  }
+}
+
+// the seq player is only queried when its state may have changed without us
+// sending it midi, eg. at startup or after loading a new seq. alSeqpPlay and
+// alSeqpStop only post messages, which the seq player handles in the audio
+// thread, so seeding waits until a couple of audio frames have passed (so
+// they've been handled) and the player is playing
+static int chanStateSeedPending = FALSE;
+static u32 chanStateSeedFrame;
+
+void chanStateSeedAfterPlay() {
+  chanStateSeedPending = TRUE;
+  chanStateSeedFrame = audioFrameCount;
+}
+
+static void chanStateSeedIfPlaying() {
+  if (!chanStateSeedPending || audioFrameCount - chanStateSeedFrame < 2 ||
+      alSeqpGetState(seqPlayer) != AL_PLAYING) {
+    return;
+  }
+  chanStateSeedPending = FALSE;
+  chanStateInit(&chState, OS_CYCLES_TO_USEC(osGetTime()));
+  chanStateCopyFromSeqPlayer();
+}
+
 /* The initialization of stage 0 */
 void initStage00(void)
 {
-  int i = 0;
   triPos_x = 0.0;
   triPos_y = 0.0;
   theta = 0.0;
@@ -396,11 +533,11 @@ void initStage00(void)
   nuDebConClear(DBG_CHANNELS);
   nuDebConWindowPos(DBG_CHANNELS, 3, 3);
   // nuDebConWindowSize(DBG_CHANNELS, 20-4, 30-4);
+  nuDebConClear(DBG_PERF);
+  nuDebConWindowPos(DBG_PERF, 3, 3);
   
-  for (i = 0 ; i < NUM_CHANNELS; i++) {
-    chVolumes[i] = 0;
-    chPrograms[i] = 0;
-  }
+  chanStateInit(&chState, OS_CYCLES_TO_USEC(osGetTime()));
+  chanStateSeedAfterPlay();
 }
 
 static int initialized = FALSE;
@@ -479,7 +616,9 @@ void makeDL00(void)
   if (debugMidiChannels && debugScreen == CH_SCREEN) {
     for (i = 0; i < NUM_CHANNELS; i++){ 
       nuDebConTextPos(DBG_CHANNELS, 21, 2 + i);
-      nuDebConPrintf(DBG_CHANNELS, "ch%2d v%3d p%3d\n", i, chVolumes[i], chPrograms[i]);
+      nuDebConPrintf(DBG_CHANNELS, "ch%2d v%3d p%3d %3u/s\n", i,
+        chState.channels[i].volume, chState.channels[i].program,
+        chState.channels[i].eventRate);
     }
   }
 
@@ -512,6 +651,30 @@ void makeDL00(void)
     nuDebConTextPos(DBG_EVENTS,  3,  3 + 20);
     nuDebConPrintf(DBG_EVENTS, "queue=%d\n", i); 
   }
+
+  if (debugAudioPerf && debugScreen == PERF_SCREEN) {
+    AudioPerfSummary summary;
+    audioPerfSummarize(&audioPerfRing, &summary);
+    nuDebConClear(DBG_PERF);
+    nuDebConTextPos(DBG_PERF, 3, 3);
+    nuDebConPrintf(DBG_PERF, "audio frames %u\n", summary.frames);
+    nuDebConTextPos(DBG_PERF, 3, 5);
+    nuDebConPrintf(DBG_PERF, "         min   avg   max\n");
+    nuDebConTextPos(DBG_PERF, 3, 6);
+    nuDebConPrintf(DBG_PERF, "cmd us %5u %5u %5u\n", summary.cmdListUs.min,
+                   summary.cmdListUs.avg, summary.cmdListUs.max);
+    nuDebConTextPos(DBG_PERF, 3, 7);
+    nuDebConPrintf(DBG_PERF, "rsp us %5u %5u %5u\n", summary.rspUs.min,
+                   summary.rspUs.avg, summary.rspUs.max);
+    nuDebConTextPos(DBG_PERF, 3, 8);
+    nuDebConPrintf(DBG_PERF, "voices %5u %5u %5u\n", summary.voices.min,
+                   summary.voices.avg, summary.voices.max);
+    nuDebConTextPos(DBG_PERF, 3, 9);
+    nuDebConPrintf(DBG_PERF, "events %5u %5u %5u\n", summary.events.min,
+                   summary.events.avg, summary.events.max);
+    nuDebConTextPos(DBG_PERF, 3, 11);
+    nuDebConPrintf(DBG_PERF, "voice limit %d\n", NU_AU_SYN_PVOICE_MAX);
+  }
     
   /* Draw characters on the frame buffer */
   nuDebConDisp(NU_SC_SWAPBUFFER);
@@ -525,7 +688,6 @@ void makeDL00(void)
 void updateGame00(void)
 {  
   static float vel = 1.0;
-  int i;
 
   /* The game progressing process for stage 0 */
   nuContDataGetEx(contdata,0);
@@ -543,6 +705,7 @@ void updateGame00(void)
       alSeqpStop(seqPlayer);
       osSyncPrintf("MIDI panic\n");
       alSeqpPlay(seqPlayer);
+      chanStateSeedAfterPlay();
     }
 
   if(contdata[0].trigger & U_CBUTTONS)
@@ -563,12 +726,23 @@ void updateGame00(void)
   else
     theta += vel;
 
-  for(i = 0; i < NUM_CHANNELS; i++) {
-    chVolumes[i] = alSeqpGetChlVol(seqPlayer, i);
-    chPrograms[i] = alSeqpGetChlProgram(seqPlayer, i);
-  }
+  chanStateUpdateRates(&chState, OS_CYCLES_TO_USEC(osGetTime()));
 #ifdef REMOTE_MIDI
+  chanStateSeedIfPlaying();
   ed64SoundtestUsbListener();
+#else
+  // the seq file drives the seq player rather than midi we send it, so the
+  // shadow table only knows what the seq player says
+  chanStateCopyFromSeqPlayer();
+#endif
+#if defined(ED64) && !defined(REMOTE_MIDI)
+  // not while receiving midi over usb, which the summary would compete with
+  if (debugAudioPerfUsb && ++audioPerfUsbCounter >= AUDIO_PERF_USB_INTERVAL) {
+    AudioPerfSummary summary;
+    audioPerfUsbCounter = 0;
+    audioPerfSummarize(&audioPerfRing, &summary);
+    ed64SendBinaryData(&summary, AUDIOPERF_USB_PACKET_TYPE, sizeof(summary));
+  }
 #endif
 }
 
@@ -623,6 +797,7 @@ void soundCheck(void)
       alSeqpStop(seqPlayer);
       seqPlayerSetNo(seq_no); // load the seq data and attach to seqPlayer
       alSeqpPlay(seqPlayer);
+      chanStateSeedAfterPlay();
     }
 
   /* Possible to play audio in order by right and left of the cross key */
@@ -0,0 +1,65 @@
+// program change and channel pressure messages have one data byte, the
+// others used here two
+function getMessageLength(status) {
+  return (status & 0xe0) === 0xc0 ? 2 : 3;
+}
+
+// midi events stored as columns: the time of each event (in ms) and its
+// midi bytes (data2 is 0 for messages without it), in time order. much
+// smaller than an object and Buffer per event, and can be saved and loaded
+// without any parsing
+class EventStream {
+  constructor(time, status, data1, data2) {
+    this.length = time.length;
+    this.time = time;
+    this.status = status;
+    this.data1 = data1;
+    this.data2 = data2;
+  }
+
+  static alloc(length) {
+    return new EventStream(
+      new Float64Array(length),
+      new Uint8Array(length),
+      new Uint8Array(length),
+      new Uint8Array(length)
+    );
+  }
+
+  // eg. an EventStream passed to a worker, which arrives as a plain object
+  static from({time, status, data1, data2}) {
+    return new EventStream(time, status, data1, data2);
+  }
+
+  // the midi message for event i
+  getMessage(i) {
+    const status = this.status[i];
+    return getMessageLength(status) === 2
+      ? [status, this.data1[i]]
+      : [status, this.data1[i], this.data2[i]];
+  }
+
+  // event i as an object, as players pass them around
+  getEvent(i) {
+    return {time: this.time[i], data: Uint8Array.from(this.getMessage(i))};
+  }
+
+  // index of the first event at or after time
+  findEvent(time) {
+    let low = 0;
+    let high = this.length;
+    while (low < high) {
+      const mid = (low + high) >>> 1;
+      if (this.time[mid] < time) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+}
+
+EventStream.getMessageLength = getMessageLength;
+
+module.exports = EventStream;
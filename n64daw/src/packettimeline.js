@@ -0,0 +1,131 @@
+// MMID packets as read by sgisoundtest's usb listener: 'MMID', a u32 count of
+// messages, then that many 8 byte messages of u32 time (in microseconds) and
+// the midi bytes. the n64 reads the usb fifo in 512 byte blocks
+const PACKET_MAX_SIZE = 512;
+const PACKET_HEADER_SIZE = 8;
+const MIDI_MESSAGE_SIZE = 4 + 4;
+const MAX_EVENTS_IN_PACKET = Math.floor(
+  (PACKET_MAX_SIZE - PACKET_HEADER_SIZE) / MIDI_MESSAGE_SIZE
+);
+
+function writeHeader(buffer, offset, count) {
+  if (count > MAX_EVENTS_IN_PACKET) {
+    throw new Error(`too many events for a packet: ${count}`);
+  }
+  buffer.write('MMID', offset, 'latin1');
+  buffer.writeUInt32BE(count, offset + 4);
+  return offset + PACKET_HEADER_SIZE;
+}
+
+// writes an MMID packet for events[start] to events[end - 1] into buffer at
+// offset, returning the packet size
+function encodePacket(buffer, offset, events, start, end) {
+  let pos = writeHeader(buffer, offset, end - start);
+  for (let i = start; i < end; i++) {
+    const event = events[i];
+    buffer.writeUInt32BE(event.time * 1000, pos);
+    buffer.set(event.data, pos + 4);
+    pos += MIDI_MESSAGE_SIZE;
+  }
+  return pos - offset;
+}
+
+// as encodePacket, for events in an EventStream
+function encodeStreamPacket(buffer, offset, stream, start, end) {
+  let pos = writeHeader(buffer, offset, end - start);
+  for (let i = start; i < end; i++) {
+    buffer.writeUInt32BE(stream.time[i] * 1000, pos);
+    buffer[pos + 4] = stream.status[i];
+    buffer[pos + 5] = stream.data1[i];
+    buffer[pos + 6] = stream.data2[i];
+    pos += MIDI_MESSAGE_SIZE;
+  }
+  return pos - offset;
+}
+
+// the whole song encoded ahead of time as the packets to send and when to send
+// them (in ms from the start of playback), so playback just sends each packet
+// when its time comes without building anything.
+//
+// events due within a tick of the first event in a packet are sent in the
+// same packet, so with one packet per tick each event is sent about lookAhead
+// ms before it's due, as when events were gathered every tick. where there are
+// more events than fit in a tick's packet, packets are sent a tick apart,
+// earlier than that, so the n64 has them all in time
+class PacketTimeline {
+  constructor(stream, {lookAhead = 32, tickInterval = 1000 / 60} = {}) {
+    this.lookAhead = lookAhead;
+    this.tickInterval = tickInterval;
+
+    // find where each packet starts
+    const packetStarts = [];
+    let start = 0;
+    while (start < stream.length) {
+      packetStarts.push(start);
+      const endTime = stream.time[start] + tickInterval;
+      let end = start + 1;
+      while (
+        end < stream.length &&
+        end - start < MAX_EVENTS_IN_PACKET &&
+        stream.time[end] < endTime
+      ) {
+        end++;
+      }
+      start = end;
+    }
+    packetStarts.push(stream.length);
+
+    this.length = packetStarts.length - 1;
+    this.data = Buffer.alloc(
+      this.length * PACKET_HEADER_SIZE + stream.length * MIDI_MESSAGE_SIZE
+    );
+    this.sendTimes = new Float64Array(this.length);
+    this.packets = new Array(this.length);
+
+    let offset = 0;
+    for (let i = 0; i < this.length; i++) {
+      const size = encodeStreamPacket(
+        this.data,
+        offset,
+        stream,
+        packetStarts[i],
+        packetStarts[i + 1]
+      );
+      this.packets[i] = this.data.subarray(offset, offset + size);
+      offset += size;
+      this.sendTimes[i] = stream.time[packetStarts[i]] - lookAhead;
+    }
+    // pull packets earlier where they'd be sent less than a tick apart
+    for (let i = this.length - 2; i >= 0; i--) {
+      this.sendTimes[i] = Math.min(
+        this.sendTimes[i],
+        this.sendTimes[i + 1] - tickInterval
+      );
+    }
+  }
+
+  // index of the first packet to be sent at or after time
+  findPacket(time) {
+    let low = 0;
+    let high = this.length;
+    while (low < high) {
+      const mid = (low + high) >>> 1;
+      if (this.sendTimes[mid] < time) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+}
+
+module.exports = {
+  PacketTimeline,
+  encodePacket,
+  encodeStreamPacket,
+  PACKET_MAX_SIZE,
+  PACKET_HEADER_SIZE,
+  MIDI_MESSAGE_SIZE,
+  MAX_EVENTS_IN_PACKET,
+};
@@ -9,7 +9,9 @@ class Player {
   _nextEvent = 0;
   _subscribers = [];
 
-  constructor(midi, channelFilter, generalMIDI) {
+  // events is the EventStream rendered from midi, if it's already been
+  // rendered (eg. loaded from a cache)
+  constructor(midi, channelFilter, generalMIDI, events = null) {
     if (midi.header.tempos && midi.header.tempos.length) {
       let lastTempo = 120;
       let lastTime = 0;
@@ -37,25 +39,28 @@ class Player {
         tempo: 120,
       });
     }
-    this.events = renderMidiStream(midi, channelFilter, generalMIDI);
+    this.events =
+      events || renderMidiStream(midi, channelFilter, generalMIDI);
     console.log(module.id, {channelFilter, events: this.events});
   }
 
   getPendingEvents(timeWindow) {
     const time = performance.now() - this.startTime;
 
-    const eventsToSend = [];
-
+    const endTime = time + (timeWindow + this.timeWindowLookahead);
+    const start = this._nextEvent;
     while (
-      this.events[this._nextEvent] &&
-      this.events[this._nextEvent].time <
-        time + (timeWindow + this.timeWindowLookahead)
+      this._nextEvent < this.events.length &&
+      this.events.time[this._nextEvent] < endTime
     ) {
-      eventsToSend.push(this.events[this._nextEvent]);
       this._nextEvent++;
     }
+    const eventsToSend = [];
+    for (let i = start; i < this._nextEvent; i++) {
+      eventsToSend.push(this.events.getEvent(i));
+    }
 
-    if (this.events[this._nextEvent] == null) {
+    if (this._nextEvent >= this.events.length) {
       console.log('stopping');
       this.stop();
     }
@@ -81,13 +86,7 @@ class Player {
   setPlayOffset(offset) {
     if (this.playing) {
       this.startTime = performance.now() - offset;
-      this._nextEvent = 0;
-      while (
-        this.events[this._nextEvent] &&
-        this.events[this._nextEvent].time < offset
-      ) {
-        this._nextEvent++;
-      }
+      this._nextEvent = this.events.findEvent(offset);
     } else {
       this.stoppedAt = offset;
     }
@@ -1,4 +1,5 @@
 const {midiCCs, midiCCsByName} = require('./midicc');
+const EventStream = require('./eventstream');
 
 const allowedCCs = new Set([
   'bankselectcoarse',
@@ -42,80 +43,153 @@ const allowedCCs = new Set([
   'phaserlevel',
 ]);
 
+// events at the same time are sent in this order
+const RANK_PROGRAM_CHANGE = 0;
+const RANK_CONTROL_CHANGE = 1;
+const RANK_NOTE_OFF = 2;
+const RANK_NOTE_ON = 3;
+
+// a run of events of one type on one channel, to be sorted by time then
+// merged with the others
+function makeRun(rank, status, length) {
+  return {
+    rank,
+    status,
+    length,
+    time: new Float64Array(length),
+    data1: new Uint8Array(length),
+    data2: new Uint8Array(length),
+  };
+}
+
+// notes and ccs usually come in time order already, but note offs don't
+function sortRun(run) {
+  let sorted = true;
+  for (let i = 1; i < run.length; i++) {
+    if (run.time[i] < run.time[i - 1]) {
+      sorted = false;
+      break;
+    }
+  }
+  if (sorted) return run;
+
+  const order = Array.from({length: run.length}, (_, i) => i);
+  order.sort((a, b) => run.time[a] - run.time[b] || a - b);
+  const sortedRun = makeRun(run.rank, run.status, run.length);
+  order.forEach((from, to) => {
+    sortedRun.time[to] = run.time[from];
+    sortedRun.data1[to] = run.data1[from];
+    sortedRun.data2[to] = run.data2[from];
+  });
+  return sortedRun;
+}
+
+// merges the sorted runs into one EventStream, with a heap of the runs
+// ordered by their next event. events at the same time are ordered by type,
+// then by the order of the runs (ie. by track)
+function mergeRuns(runs) {
+  runs = runs.filter((run) => run.length);
+  const positions = new Uint32Array(runs.length);
+  function before(a, b) {
+    const runA = runs[a];
+    const runB = runs[b];
+    const timeA = runA.time[positions[a]];
+    const timeB = runB.time[positions[b]];
+    if (timeA !== timeB) return timeA < timeB;
+    if (runA.rank !== runB.rank) return runA.rank < runB.rank;
+    return a < b;
+  }
+
+  const heap = runs.map((_, i) => i);
+  let heapSize = heap.length;
+  function siftDown(i) {
+    for (;;) {
+      const left = 2 * i + 1;
+      const right = left + 1;
+      let first = i;
+      if (left < heapSize && before(heap[left], heap[first])) first = left;
+      if (right < heapSize && before(heap[right], heap[first])) first = right;
+      if (first === i) return;
+      const swap = heap[i];
+      heap[i] = heap[first];
+      heap[first] = swap;
+      i = first;
+    }
+  }
+  for (let i = (heapSize >> 1) - 1; i >= 0; i--) siftDown(i);
+
+  const length = runs.reduce((sum, run) => sum + run.length, 0);
+  const stream = EventStream.alloc(length);
+  for (let i = 0; i < length; i++) {
+    const runIndex = heap[0];
+    const run = runs[runIndex];
+    const position = positions[runIndex]++;
+    stream.time[i] = run.time[position];
+    stream.status[i] = run.status;
+    stream.data1[i] = run.data1[position];
+    stream.data2[i] = run.data2[position];
+    if (positions[runIndex] === run.length) {
+      heap[0] = heap[--heapSize];
+    }
+    siftDown(0);
+  }
+  return stream;
+}
+
+// renders a midi file (as @tonejs/midi's toJSON() gives it) to an
+// EventStream of the midi messages to send
 function renderMIDIStream(midi, channelFilter, generalMIDI) {
-  const events = [];
+  const runs = [];
   midi.tracks.forEach((track) => {
     if (channelFilter && !channelFilter.has(track.channel)) return;
     if (!(generalMIDI && track.channel === 9)) {
-      events.push({
-        time: Math.floor(Math.random() * 1000),
-        type: 'programChange',
-        program: track.instrument.number,
-        data: Buffer.from([0xc0 | track.channel, track.instrument.number | 0]),
-      });
+      const programChange = makeRun(
+        RANK_PROGRAM_CHANGE,
+        0xc0 | track.channel,
+        1
+      );
+      programChange.time[0] = Math.floor(Math.random() * 1000);
+      programChange.data1[0] = track.instrument.number | 0;
+      runs.push(programChange);
     }
 
-    track.notes.forEach((noteEvent) => {
-      events.push({
-        time: 1000 * noteEvent.time,
-        type: 'noteOn',
-        noteEvent,
-        velocity: (noteEvent.velocity * 0x7f) | 0,
-        data: Buffer.from([
-          0x90 | track.channel,
-          noteEvent.midi,
-          (noteEvent.velocity * 0x7f) | 0,
-        ]),
-      });
-      events.push({
-        time: 1000 * (noteEvent.time + noteEvent.duration),
-        type: 'noteOff',
-        noteEvent,
-        velocity: (noteEvent.noteOffVelocity * 0x7f) | 0,
-        data: Buffer.from([
-          0x80 | track.channel,
-          noteEvent.midi,
-          (noteEvent.noteOffVelocity * 0x7f) | 0,
-        ]),
-      });
+    const {notes} = track;
+    const noteOns = makeRun(RANK_NOTE_ON, 0x90 | track.channel, notes.length);
+    const noteOffs = makeRun(
+      RANK_NOTE_OFF,
+      0x80 | track.channel,
+      notes.length
+    );
+    notes.forEach((noteEvent, i) => {
+      noteOns.time[i] = 1000 * noteEvent.time;
+      noteOns.data1[i] = noteEvent.midi;
+      noteOns.data2[i] = (noteEvent.velocity * 0x7f) | 0;
+      noteOffs.time[i] = 1000 * (noteEvent.time + noteEvent.duration);
+      noteOffs.data1[i] = noteEvent.midi;
+      noteOffs.data2[i] = (noteEvent.noteOffVelocity * 0x7f) | 0;
     });
+    runs.push(sortRun(noteOns), sortRun(noteOffs));
 
     Object.values(track.controlChanges).forEach((ccEventArray, key) => {
       if (!allowedCCs.has(midiCCs[key])) {
         return;
       }
-      ccEventArray.forEach((ccEvent) => {
-        events.push({
-          time: 1000 * (isNaN(ccEvent.time) ? 0 : ccEvent.time),
-          type: 'controlChange',
-          ccNumber: ccEvent.number,
-          ccType: midiCCs[ccEvent.number],
-          ccEvent,
-          ccValue: (ccEvent.value * 0x7f) | 0,
-          data: Buffer.from([
-            0xb0 | track.channel,
-            ccEvent.number,
-            (ccEvent.value * 0x7f) | 0,
-          ]),
-        });
+      const controlChanges = makeRun(
+        RANK_CONTROL_CHANGE,
+        0xb0 | track.channel,
+        ccEventArray.length
+      );
+      ccEventArray.forEach((ccEvent, i) => {
+        controlChanges.time[i] =
+          1000 * (isNaN(ccEvent.time) ? 0 : ccEvent.time);
+        controlChanges.data1[i] = ccEvent.number;
+        controlChanges.data2[i] = (ccEvent.value * 0x7f) | 0;
       });
+      runs.push(sortRun(controlChanges));
     });
   });
 
-  const sortOrder = {
-    controlChange: 0,
-    noteOff: 1,
-    noteOn: 2,
-  };
-  events.sort((a, b) => {
-    if (a.time === b.time) {
-      return sortOrder[a.type] - sortOrder[b.type];
-    }
-
-    return a.time - b.time;
-  });
-
-  return events;
+  return mergeRuns(runs);
 }
 
 module.exports = renderMIDIStream;
@@ -0,0 +1,131 @@
+// the clock the scheduler sleeps on. performance.now() is monotonic, so
+// deadlines don't move if the system time changes
+const monotonicClock = {
+  now: () => performance.now(),
+  sleep: (ms) => new Promise((resolve) => setTimeout(resolve, ms)),
+  // timers can wake up a little late, so the last bit of the wait is spent
+  // busy waiting
+  spinUntil(time) {
+    while (performance.now() < time) {}
+  },
+};
+
+function percentile(sorted, p) {
+  if (!sorted.length) return 0;
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+// how late things were sent relative to their deadlines, in ms
+class LatenessStats {
+  values = [];
+
+  add(lateness, count = 1) {
+    for (let i = 0; i < count; i++) this.values.push(lateness);
+  }
+
+  summary() {
+    const sorted = this.values.slice().sort((a, b) => a - b);
+    return {
+      count: sorted.length,
+      p50: percentile(sorted, 0.5),
+      p90: percentile(sorted, 0.9),
+      p99: percentile(sorted, 0.99),
+      max: percentile(sorted, 1),
+    };
+  }
+
+  format() {
+    const {count, p50, p90, p99, max} = this.summary();
+    const ms = (v) => v.toFixed(3) + 'ms';
+    return `lateness over ${count} events: p50 ${ms(p50)} p90 ${ms(
+      p90
+    )} p99 ${ms(p99)} max ${ms(max)}`;
+  }
+}
+
+// sends things at deadlines measured from a start time on a monotonic clock.
+// each deadline is computed from the start time rather than from when the
+// previous thing was sent, so timer delays don't accumulate into drift. it
+// sleeps until `guard` ms before each deadline then busy waits the rest.
+class SendScheduler {
+  running = false;
+  startTime = 0;
+
+  constructor({clock = monotonicClock, guard = 1} = {}) {
+    this.clock = clock;
+    this.guard = guard;
+    this.lateness = new LatenessStats();
+  }
+
+  // getDeadline(index) returns the time to call send(index, time) at, in ms
+  // from the start, or null when there's nothing more to send. deadlines
+  // must not decrease. send returns how many events it sent, for the
+  // lateness stats. resolves when everything has been sent or stop() is
+  // called
+  async run(getDeadline, send, startTime = this.clock.now()) {
+    const {clock, guard} = this;
+    this.startTime = startTime;
+    this.running = true;
+    for (let index = 0; this.running; index++) {
+      const deadline = getDeadline(index);
+      if (deadline == null) break;
+      // things due before the start are sent at the start, and aren't late
+      const target = startTime + Math.max(0, deadline);
+      const wait = target - clock.now() - guard;
+      if (wait > 0) {
+        await clock.sleep(wait);
+        if (!this.running) break;
+      }
+      clock.spinUntil(target);
+      const now = clock.now();
+      const sent = send(index, now - startTime);
+      this.lateness.add(now - target, sent == null ? 1 : sent);
+    }
+    this.running = false;
+  }
+
+  stop() {
+    this.running = false;
+  }
+}
+
+// sends each packet of a PacketTimeline at its send time
+function playTimeline(scheduler, timeline, sendPacket, startTime) {
+  return scheduler.run(
+    (index) => (index < timeline.length ? timeline.sendTimes[index] : null),
+    (index) => {
+      const packet = timeline.packets[index];
+      sendPacket(packet);
+      return packet.readUInt32BE(4);
+    },
+    startTime
+  );
+}
+
+// sends each event of an EventStream to a midi output port at its time.
+// events at the same time are sent together
+function playEvents(scheduler, stream, port, startTime) {
+  return scheduler.run(
+    (index) => (index < stream.length ? stream.time[index] : null),
+    (index) => {
+      port.send(stream.getMessage(index));
+      return 1;
+    },
+    startTime
+  );
+}
+
+// calls send every `interval` ms, eg. to pass on realtime input, which can't
+// be scheduled ahead of time
+function runPeriodic(scheduler, interval, send, startTime) {
+  return scheduler.run((index) => index * interval, send, startTime);
+}
+
+module.exports = {
+  SendScheduler,
+  LatenessStats,
+  monotonicClock,
+  playTimeline,
+  playEvents,
+  runPeriodic,
+};
@@ -0,0 +1,214 @@
+import {
+  SendScheduler,
+  LatenessStats,
+  playEvents,
+  playTimeline,
+  runPeriodic,
+} from './sendscheduler';
+import {PacketTimeline} from './packettimeline';
+import EventStream from './eventstream';
+
+// time only moves when the scheduler sleeps or busy waits. oversleep(ms)
+// returns how much longer than asked a sleep takes, to simulate a busy
+// event loop
+class VirtualClock {
+  time = 0;
+  sleeps = [];
+
+  constructor(oversleep = () => 0) {
+    this.oversleep = oversleep;
+  }
+
+  now() {
+    return this.time;
+  }
+
+  sleep(ms) {
+    this.sleeps.push(ms);
+    this.time += ms + this.oversleep(ms);
+    return Promise.resolve();
+  }
+
+  spinUntil(time) {
+    this.time = Math.max(this.time, time);
+  }
+}
+
+// stands in for a midi output port connected back to an input: everything
+// sent is received straight away, stamped with the time it arrived
+class LoopbackPort {
+  received = [];
+  onmidimessage = null;
+
+  constructor(clock) {
+    this.clock = clock;
+  }
+
+  send(data) {
+    const message = {
+      data: Uint8Array.from(data),
+      receivedTime: this.clock.now(),
+    };
+    this.received.push(message);
+    if (this.onmidimessage) this.onmidimessage(message);
+  }
+}
+
+function makeEvents(times) {
+  const events = EventStream.alloc(times.length);
+  times.forEach((time, i) => {
+    events.time[i] = time;
+    events.status[i] = 0x90;
+    events.data1[i] = 60 + i;
+    events.data2[i] = 100;
+  });
+  return events;
+}
+
+test('sends each event at its time', async () => {
+  const clock = new VirtualClock();
+  const port = new LoopbackPort(clock);
+  const scheduler = new SendScheduler({clock, guard: 2});
+  const events = makeEvents([0, 10, 10, 25.5, 100]);
+
+  await playEvents(scheduler, events, port, 1000);
+
+  expect(port.received.map((m) => m.receivedTime)).toEqual([
+    1000,
+    1010,
+    1010,
+    1025.5,
+    1100,
+  ]);
+  expect(port.received.map((m) => Array.from(m.data))).toEqual(
+    Array.from({length: events.length}, (_, i) => events.getMessage(i))
+  );
+  // it sleeps until the guard before each new time (the first being 1000ms
+  // away), and not for events at the same time
+  expect(clock.sleeps).toEqual([998, 8, 13.5, 72.5]);
+  expect(scheduler.lateness.summary()).toEqual({
+    count: 5,
+    p50: 0,
+    p90: 0,
+    p99: 0,
+    max: 0,
+  });
+});
+
+test('is on time when timers wake up late by less than the guard', async () => {
+  let seed = 1;
+  const clock = new VirtualClock(() => {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return (seed % 900) / 1000;
+  });
+  const port = new LoopbackPort(clock);
+  const scheduler = new SendScheduler({clock, guard: 1});
+  const events = makeEvents(Array.from({length: 200}, (_, i) => i * 7.3));
+
+  await playEvents(scheduler, events, port, 0);
+
+  port.received.forEach((message, i) => {
+    expect(message.receivedTime).toBe(events.time[i]);
+  });
+  expect(scheduler.lateness.summary().max).toBe(0);
+});
+
+test("doesn't drift when every sleep overruns", async () => {
+  const clock = new VirtualClock(() => 5);
+  const scheduler = new SendScheduler({clock, guard: 1});
+  const interval = 1000 / 60;
+  const sendTimes = [];
+
+  await runPeriodic(scheduler, interval, (index, time) => {
+    sendTimes.push(time);
+    if (index === 600) scheduler.stop();
+    return 1;
+  });
+
+  // each tick is 4ms late, but that doesn't add up over the ticks as it
+  // would rescheduling relative to the last tick
+  expect(sendTimes.length).toBe(601);
+  expect(sendTimes[600] - 600 * interval).toBeCloseTo(4);
+  expect(scheduler.lateness.summary().max).toBeCloseTo(4);
+});
+
+test('reports how late events were sent after a stall', async () => {
+  let sleeps = 0;
+  // the third sleep takes 50ms longer than asked
+  const clock = new VirtualClock(() => (++sleeps === 3 ? 50 : 0));
+  const port = new LoopbackPort(clock);
+  const scheduler = new SendScheduler({clock, guard: 1});
+  const events = makeEvents(Array.from({length: 20}, (_, i) => i * 10));
+
+  await playEvents(scheduler, events, port, 0);
+
+  // the event after the stall is sent 49ms late (it was to wake up 1ms
+  // early), and the events which came due during it are sent right after
+  const late = port.received.map((m, i) => m.receivedTime - events.time[i]);
+  expect(late.slice(0, 3)).toEqual([0, 0, 0]);
+  expect(late.slice(3, 8)).toEqual([49, 39, 29, 19, 9]);
+  expect(late.slice(8).every((lateness) => lateness === 0)).toBe(true);
+  expect(scheduler.lateness.summary()).toMatchObject({
+    count: 20,
+    p50: 0,
+    max: 49,
+  });
+});
+
+test('sends timeline packets at their send times', async () => {
+  const clock = new VirtualClock();
+  const scheduler = new SendScheduler({clock, guard: 1});
+  // a burst bigger than a packet, then sparse events
+  const events = makeEvents([
+    ...Array.from({length: 100}, () => 500),
+    600,
+    1000,
+  ]);
+  const timeline = new PacketTimeline(events, {
+    lookAhead: 32,
+    tickInterval: 1000 / 60,
+  });
+  const sent = [];
+
+  await playTimeline(
+    scheduler,
+    timeline,
+    (packet) => sent.push({time: clock.now(), packet}),
+    0
+  );
+
+  expect(sent.map(({packet}) => packet)).toEqual(timeline.packets);
+  // packets due before the start are sent at the start
+  expect(sent.map(({time}) => time)).toEqual(
+    Array.from(timeline.sendTimes, (time) => Math.max(0, time))
+  );
+  // lateness is counted per event rather than per packet
+  expect(scheduler.lateness.summary().count).toBe(events.length);
+});
+
+test('stop ends the run', async () => {
+  const clock = new VirtualClock();
+  const scheduler = new SendScheduler({clock});
+  let sends = 0;
+
+  await runPeriodic(scheduler, 10, () => {
+    if (++sends === 5) scheduler.stop();
+  });
+
+  expect(sends).toBe(5);
+  expect(scheduler.running).toBe(false);
+});
+
+test('lateness percentiles', () => {
+  const stats = new LatenessStats();
+  for (let i = 0; i < 100; i++) stats.add(i / 10);
+  stats.add(50, 2);
+
+  expect(stats.summary()).toEqual({
+    count: 102,
+    p50: 5.1,
+    p90: 9.1,
+    p99: 50,
+    max: 50,
+  });
+});
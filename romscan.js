@@ -0,0 +1,169 @@
+// finds .ctl/.tbl sound banks in n64 rom images.
+//
+// a ctl starts with an ALBankFile header: the revision 'B1' followed by a s16
+// bank count and the offsets of the banks. candidates are found by searching
+// for the 'B1' 0x00 prefix shared by every plausible bank count (rather than
+// searching separately for each count), then rejected with cheap checks on the
+// header and the ALBank structs it points to before trying a full parseCtl
+
+const fs = require('fs');
+const {parseCtl} = require('./soundtools');
+
+// 'B1' and the high byte of bankCount
+const CTL_PREFIX = Buffer.from([0x42, 0x31, 0x00]);
+const MAX_BANKS = 64;
+const MAX_INSTRUMENTS = 1024;
+const MAX_SAMPLE_RATE = 192000;
+const BANK_FILE_HEADER_SIZE = 4;
+const BANK_HEADER_SIZE = 12; // ALBank without instArray
+
+function loadRom(file) {
+  const romBuffer = fs.readFileSync(file);
+  if (file.match(/\.v64$/i)) {
+    romBuffer.swap16();
+  }
+  return romBuffer;
+}
+
+function getRomName(romBuffer) {
+  const romName = romBuffer
+    .slice(0x20, 0x20 + 20)
+    .toString('utf8')
+    .trim()
+    .toLowerCase()
+    .replace(/\W/g, '_');
+  return romName.length ? romName : 'untitled';
+}
+
+// ctl offsets point to structs containing s32s, so must be word aligned, and
+// are relative to the start of the ctl
+function isValidOffset(romBuffer, ctlStart, offset, minOffset, structSize) {
+  return (
+    offset >= minOffset &&
+    offset % 4 === 0 &&
+    ctlStart + offset + structSize <= romBuffer.length
+  );
+}
+
+// returns null if the data at ctlStart looks like the start of a ctl, or the
+// reason it doesn't
+function checkCtlHeader(romBuffer, ctlStart) {
+  if (ctlStart + BANK_FILE_HEADER_SIZE > romBuffer.length) {
+    return 'truncated header';
+  }
+  const bankCount = romBuffer.readInt16BE(ctlStart + 2);
+  if (bankCount < 1 || bankCount > MAX_BANKS) {
+    return `bad bank count ${bankCount}`;
+  }
+  const headerSize = BANK_FILE_HEADER_SIZE + bankCount * 4;
+  if (ctlStart + headerSize > romBuffer.length) {
+    return 'truncated header';
+  }
+  for (let i = 0; i < bankCount; i++) {
+    const bankOffset = romBuffer.readInt32BE(ctlStart + 4 + i * 4);
+    if (
+      !isValidOffset(
+        romBuffer,
+        ctlStart,
+        bankOffset,
+        headerSize,
+        BANK_HEADER_SIZE
+      )
+    ) {
+      return `bad bank offset 0x${bankOffset.toString(16)}`;
+    }
+    const bankStart = ctlStart + bankOffset;
+    const instCount = romBuffer.readInt16BE(bankStart);
+    const sampleRate = romBuffer.readInt32BE(bankStart + 4);
+    const percussion = romBuffer.readInt32BE(bankStart + 8);
+    if (instCount < 0 || instCount > MAX_INSTRUMENTS) {
+      return `bad instrument count ${instCount}`;
+    }
+    if (sampleRate <= 0 || sampleRate > MAX_SAMPLE_RATE) {
+      return `bad sample rate ${sampleRate}`;
+    }
+    if (
+      percussion !== 0 &&
+      !isValidOffset(romBuffer, ctlStart, percussion, headerSize, 0)
+    ) {
+      return `bad percussion offset 0x${percussion.toString(16)}`;
+    }
+    const instArrayStart = bankStart + BANK_HEADER_SIZE;
+    if (instArrayStart + instCount * 4 > romBuffer.length) {
+      return 'truncated bank';
+    }
+    for (let j = 0; j < instCount; j++) {
+      const instOffset = romBuffer.readInt32BE(instArrayStart + j * 4);
+      if (
+        instOffset !== 0 &&
+        !isValidOffset(romBuffer, ctlStart, instOffset, headerSize, 0)
+      ) {
+        return `bad instrument offset 0x${instOffset.toString(16)}`;
+      }
+    }
+  }
+  return null;
+}
+
+// offsets of everything which passes checkCtlHeader
+function* findCtlCandidates(romBuffer, startOffset = 0) {
+  let pos = romBuffer.indexOf(CTL_PREFIX, startOffset);
+  while (pos >= 0) {
+    // the n64 can only dma from even rom addresses
+    if (pos % 2 === 0 && checkCtlHeader(romBuffer, pos) == null) {
+      yield pos;
+    }
+    pos = romBuffer.indexOf(CTL_PREFIX, pos + 1);
+  }
+}
+
+// the tbl is assumed to follow the ctl, after any zero padding
+function findTblStart(romBuffer, ctlEnd) {
+  let tblStart = ctlEnd;
+  while (
+    tblStart + 4 <= romBuffer.length &&
+    romBuffer.readUInt32BE(tblStart) === 0
+  ) {
+    tblStart += 4;
+  }
+  return tblStart;
+}
+
+// returns {ctlStart, ctlEnd, tblStart, bankFile} for each ctl found. a
+// candidate which fails to parse is assumed to be a coincidental match and
+// skipped, and parsed ctls are skipped over
+function scanRom(romBuffer, {onParseError = null} = {}) {
+  const found = [];
+  let searchFrom = 0;
+  for (;;) {
+    const next = findCtlCandidates(romBuffer, searchFrom).next();
+    if (next.done) break;
+    const ctlStart = next.value;
+    let bankFile;
+    try {
+      bankFile = parseCtl(romBuffer, ctlStart);
+    } catch (err) {
+      if (onParseError) onParseError(err, ctlStart);
+      searchFrom = ctlStart + 1;
+      continue;
+    }
+    const ctlEnd = bankFile.lastOffset;
+    found.push({
+      ctlStart,
+      ctlEnd,
+      tblStart: findTblStart(romBuffer, ctlEnd),
+      bankFile,
+    });
+    searchFrom = Math.max(ctlEnd, ctlStart + 1);
+  }
+  return found;
+}
+
+module.exports = {
+  loadRom,
+  getRomName,
+  checkCtlHeader,
+  findCtlCandidates,
+  findTblStart,
+  scanRom,
+};
@@ -0,0 +1,137 @@
+// persistent cache of the sample data ic extracts from .aiff/.aifc files, so
+// rebuilding a bank after editing the .inst doesn't have to re-read, re-parse
+// (or re-compress) every sample.
+//
+// the cache directory contains index.json, which maps each sample path to the
+// mtime, size and sha1 of its contents when it was last read, and a
+// <sha1>.<variant>.json/.bin pair per extracted sample (the .bin holding the
+// sound data). a file whose mtime and size are unchanged is assumed to have the
+// same contents without reading it. entries are keyed by content, so renaming
+// or copying a sample doesn't invalidate them
+
+const fs = require('fs');
+const path = require('path');
+const crypto = require('crypto');
+
+// bump this when the format of cache entries or the extracted data changes
+const CACHE_VERSION = 1;
+const INDEX_FILE = 'index.json';
+
+class SampleCache {
+  constructor(dir) {
+    this.dir = dir;
+    this.files = {};
+    this.dirty = false;
+    this.stats = {hits: 0, misses: 0, filesRead: 0};
+    fs.mkdirSync(dir, {recursive: true});
+
+    const indexPath = path.join(dir, INDEX_FILE);
+    if (fs.existsSync(indexPath)) {
+      try {
+        const index = JSON.parse(fs.readFileSync(indexPath, 'utf8'));
+        if (index.version === CACHE_VERSION) {
+          this.files = index.files;
+        }
+      } catch (err) {
+        // a corrupt index just means everything gets hashed again
+      }
+    }
+  }
+
+  // returns {hash, formType, contents}. contents is only set if the file had to
+  // be read, and formType is only known if it was recorded with setFormType
+  identify(file) {
+    const stat = fs.statSync(file);
+    const known = this.files[file];
+    if (known && known.mtimeMs === stat.mtimeMs && known.size === stat.size) {
+      return {hash: known.hash, formType: known.formType, contents: null};
+    }
+
+    const contents = fs.readFileSync(file);
+    this.stats.filesRead++;
+    const hash = crypto.createHash('sha1').update(contents).digest('hex');
+    this.files[file] = {mtimeMs: stat.mtimeMs, size: stat.size, hash};
+    this.dirty = true;
+    return {hash, formType: null, contents};
+  }
+
+  setFormType(file, formType) {
+    if (this.files[file] && this.files[file].formType !== formType) {
+      this.files[file].formType = formType;
+      this.dirty = true;
+    }
+  }
+
+  entryPath(hash, variant, ext) {
+    return path.join(this.dir, `${hash}.${variant}.${ext}`);
+  }
+
+  has(hash, variant) {
+    const found = fs.existsSync(this.entryPath(hash, variant, 'json'));
+    if (found) {
+      this.stats.hits++;
+    } else {
+      this.stats.misses++;
+    }
+    return found;
+  }
+
+  // returns the sample stored by set(). its sound data can be dropped and read
+  // again with reloadSoundData
+  get(hash, variant) {
+    const dataPath = this.entryPath(hash, variant, 'bin');
+    const entry = JSON.parse(
+      fs.readFileSync(this.entryPath(hash, variant, 'json'), 'utf8')
+    );
+    const soundData = fs.readFileSync(dataPath);
+    return {
+      type: entry.type,
+      soundData,
+      book: entry.book && {
+        ...entry.book,
+        book: Buffer.from(entry.book.book, 'base64'),
+      },
+      loop: entry.loop && {
+        ...entry.loop,
+        ...(entry.loop.state != null
+          ? {state: Buffer.from(entry.loop.state, 'base64')}
+          : {}),
+      },
+      reloadSoundData: () => fs.readFileSync(dataPath),
+    };
+  }
+
+  // store a sample as returned by extractSampleData
+  set(hash, variant, {type, soundData, book, loop}) {
+    const entry = {
+      type,
+      book: book && {...book, book: Buffer.from(book.book).toString('base64')},
+      loop: loop && {
+        ...loop,
+        ...(loop.state != null
+          ? {state: Buffer.from(loop.state).toString('base64')}
+          : {}),
+      },
+    };
+    // the .bin is written first, so a .json always has its data
+    fs.writeFileSync(this.entryPath(hash, variant, 'bin'), soundData);
+    fs.writeFileSync(
+      this.entryPath(hash, variant, 'json'),
+      JSON.stringify(entry)
+    );
+  }
+
+  save() {
+    if (!this.dirty) return;
+    const indexPath = path.join(this.dir, INDEX_FILE);
+    const tmpPath = `${indexPath}.${process.pid}.tmp`;
+    fs.writeFileSync(
+      tmpPath,
+      JSON.stringify({version: CACHE_VERSION, files: this.files})
+    );
+    fs.renameSync(tmpPath, indexPath);
+    this.dirty = false;
+  }
+}
+
+module.exports = SampleCache;
@@ -2,33 +2,72 @@
 const fs = require('fs');
 
 const {serializeSBK} = require('./sequencebank');
+const {convertSeqToCompact, formatCompactReport} = require('./compactseq');
+const {uncachedFiles} = require('./filecache');
 
-const arg = require('arg');
+// runs sbc with the given command line arguments. context can replace console
+// output (log, error) and how inputs are read (files, see filecache.js), for
+// buildd. resolves to the exit code
+async function run(
+  argv,
+  {log = console.log, error = console.error, files = uncachedFiles} = {}
+) {
+  const arg = require('arg');
 
-const args = arg({
-  // Types
-  '--help': Boolean,
-  '--out': String, // --name <string> or --name=<string>
+  const args = arg(
+    {
+      // Types
+      '--help': Boolean,
+      '--out': String, // --name <string> or --name=<string>
+      '--compact': Boolean, // convert .seq files to compact sequences
 
-  // Aliases
-  '-o': '--out',
-  '-h': '--help',
-});
+      // Aliases
+      '-o': '--out',
+      '-h': '--help',
+    },
+    {argv}
+  );
 
-if (args['--help']) {
-  console.log(`sbc -o <output file> file0 [file1 file2 file3 ....]`);
-  process.exit(0);
-}
+  if (args['--help']) {
+    log(`sbc [--compact] -o <output file> file0 [file1 file2 file3 ....]
 
-if (args._.length === 0) {
-  console.error(`error: at least one input file must be specified`);
-  process.exit(1);
-}
+  --compact: convert each (type 0 midi) .seq to a compact sequence for
+    ALCSPlayer before adding it to the bank. each is checked to decode to the
+    same events as the .seq, and the sizes are printed`);
+    return 0;
+  }
+
+  if (args._.length === 0) {
+    error(`error: at least one input file must be specified`);
+    return 1;
+  }
+
+  const inFiles = args._.map((f) => {
+    if (!args['--compact']) return files.read(f);
+    const result = files.memo(f, 'compact', () =>
+      convertSeqToCompact(fs.readFileSync(f), f)
+    );
+    log(`${f}: ${formatCompactReport(result)}`);
+    return result.buffer;
+  });
 
-const inFiles = args._.map((f) => fs.readFileSync(f));
+  const output = serializeSBK(inFiles);
 
-const output = serializeSBK(inFiles);
+  // console.log(output.length, output);
 
-// console.log(output.length, output);
+  fs.writeFileSync(args['--out'] || 'tst.sbk', output);
+  return 0;
+}
+
+if (require.main === module) {
+  run(process.argv.slice(2))
+    .then((code) => {
+      process.exitCode = code;
+    })
+    .catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+}
 
-fs.writeFileSync(args['--out'] || 'tst.sbk', output);
+module.exports = {run};
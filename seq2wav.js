@@ -0,0 +1,175 @@
+#!/usr/bin/env node
+
+// seq2wav renders .seq (Type 0 midi) or .sbk sequence bank files to .wav using
+// a .ctl/.tbl sound bank, for previewing and regression testing music without
+// running it on an n64. files are rendered in parallel, one per worker thread
+// eg. seq2wav.js --bank test/test -o out song1.seq song2.seq music.sbk
+
+const fs = require('fs');
+const path = require('path');
+const os = require('os');
+const {isMainThread} = require('worker_threads');
+const {runWorkerPool, serveWorkerJobs} = require('./workerpool');
+const {
+  SynthBank,
+  renderSeq,
+  floatToS16LEBuffer,
+  DEFAULT_SAMPLE_RATE,
+  DEFAULT_MAX_VOICES,
+} = require('./synthesizer');
+const {parseSBK} = require('./sequencebank');
+const Wave = require('./wave');
+
+function renderJob(job, {bankPath, bankOptions, renderOptions}) {
+  if (!renderJob.bank) {
+    // each worker decodes the bank once and reuses it for every song
+    renderJob.bank = new SynthBank(
+      fs.readFileSync(bankPath + '.ctl'),
+      fs.readFileSync(bankPath + '.tbl'),
+      bankOptions
+    );
+  }
+  const startTime = process.hrtime.bigint();
+  const file = fs.readFileSync(job.file);
+  let seqBuffer = file;
+  if (job.seqIndex != null) {
+    const seq = parseSBK(file).seqArray[job.seqIndex];
+    seqBuffer = file.slice(seq.offset, seq.offset + seq.len);
+  }
+
+  const rendered = renderSeq(seqBuffer, renderJob.bank, renderOptions);
+  fs.writeFileSync(
+    job.outFile,
+    Wave.serialize({
+      audioFormat: 1,
+      numChannels: rendered.numChannels,
+      sampleRate: rendered.sampleRate,
+      sampleSize: 16,
+      soundData: floatToS16LEBuffer(rendered.samples),
+    })
+  );
+  return {
+    outFile: job.outFile,
+    seconds: rendered.samples.length / 2 / rendered.sampleRate,
+    renderMs: Number(process.hrtime.bigint() - startTime) / 1e6,
+    stats: rendered.stats,
+  };
+}
+
+if (!isMainThread) {
+  serveWorkerJobs(renderJob);
+} else {
+  const arg = require('arg');
+
+  const args = arg({
+    // Types
+    '--help': Boolean,
+    '--bank': String, // ctl/tbl path prefix
+    '--out': String, // output directory
+    '--rate': Number,
+    '--voices': Number,
+    '--jobs': Number,
+    '--ctlstart': Number,
+    '--tblstart': Number,
+    '--bankindex': Number,
+
+    // Aliases
+    '-b': '--bank',
+    '-o': '--out',
+    '-j': '--jobs',
+    '-h': '--help',
+  });
+
+  if (args['--help']) {
+    console.log(`seq2wav --bank <ctl/tbl file prefix> [--out dir] files...
+
+  -b, --bank: ctl/tbl to play with, eg. 'test/test' for test/test.ctl and test/test.tbl
+  -o, --out: directory to write .wav files to (default: next to each input file)
+  --rate: output sample rate (default: ${DEFAULT_SAMPLE_RATE})
+  --voices: max simultaneous voices (default: ${DEFAULT_MAX_VOICES})
+  -j, --jobs: number of songs to render in parallel (default: number of cpus)
+  --ctlstart, --tblstart: offsets of the ctl/tbl data in their files
+  --bankindex: which bank of the ctl to use (default: 0)
+
+  files: .seq files, or .sbk files (every sequence in the bank is rendered)
+`);
+    process.exit(0);
+  }
+
+  if (!args['--bank']) {
+    throw new Error('no bank specified');
+  }
+  const files = args._;
+  if (!files.length) {
+    throw new Error('no input files specified');
+  }
+
+  const jobs = [];
+  files.forEach((file) => {
+    const outDir = args['--out'] || path.dirname(file);
+    const name = path.basename(file).replace(/\.(seq|sbk|mid)$/, '');
+    if (file.match(/\.sbk$/)) {
+      const seqBank = parseSBK(fs.readFileSync(file));
+      for (let i = 0; i < seqBank.seqCount; i++) {
+        jobs.push({
+          file,
+          seqIndex: i,
+          outFile: path.join(outDir, `${name}_${i}.wav`),
+        });
+      }
+    } else {
+      jobs.push({
+        file,
+        seqIndex: null,
+        outFile: path.join(outDir, `${name}.wav`),
+      });
+    }
+  });
+
+  if (args['--out']) {
+    fs.mkdirSync(args['--out'], {recursive: true});
+  }
+
+  const startTime = Date.now();
+  let totalSeconds = 0;
+  runWorkerPool({
+    workerFile: __filename,
+    workerData: {
+      bankPath: args['--bank'].replace(/\.(ctl|tbl)$/, ''),
+      bankOptions: {
+        ctlStart: args['--ctlstart'] || 0,
+        tblStart: args['--tblstart'] || 0,
+        bank: args['--bankindex'] || 0,
+      },
+      renderOptions: {
+        sampleRate: args['--rate'] || DEFAULT_SAMPLE_RATE,
+        maxVoices: args['--voices'] || DEFAULT_MAX_VOICES,
+      },
+    },
+    jobs,
+    concurrency: args['--jobs'] || os.cpus().length,
+    onResult: (result) => {
+      totalSeconds += result.seconds;
+      const {notes, stolen, dropped, maxVoices} = result.stats;
+      console.log(
+        `${result.outFile}: ${result.seconds.toFixed(1)}s of audio in ${(
+          result.renderMs / 1000
+        ).toFixed(2)}s (${notes} notes, max ${maxVoices} voices, ${stolen} stolen, ${dropped} dropped)`
+      );
+    },
+  })
+    .then(() => {
+      const elapsed = (Date.now() - startTime) / 1000;
+      console.log(
+        `rendered ${jobs.length} song(s), ${totalSeconds.toFixed(
+          1
+        )}s of audio in ${elapsed.toFixed(2)}s (${(
+          totalSeconds / elapsed
+        ).toFixed(0)}x real time)`
+      );
+    })
+    .catch((err) => {
+      console.error(err);
+      process.exit(1);
+    });
+}
@@ -0,0 +1,309 @@
+// shrinks .seq files by leaving out events which don't change what the
+// sequence player does, and checks the result plays the same as the original.
+//
+// events are assumed to play straight through, apart from loop start markers
+// (controller 102, made into loops in compact sequences): the player can reach
+// a loop start from its loop end, so no state is assumed to carry over them.
+// a loop point set with alSeqpLoop isn't known about, and a controller value
+// set before it isn't resent when the player jumps back
+
+const crypto = require('crypto');
+
+// data entry and increment/decrement act on the currently selected parameter,
+// so repeating them isn't a no-op. the loop controllers (made into loop
+// markers for compact sequences) act where they are
+const NON_IDEMPOTENT_CONTROLLERS = new Set([6, 38, 96, 97, 102, 103, 104, 105]);
+const LOOP_START_CONTROLLER = 102;
+
+const CHANNEL_COUNT = 16;
+const CONTROLLER_COUNT = 128;
+
+// the controller values last sent on each channel, or -1 where unknown
+function makeControllerState() {
+  return Array.from({length: CHANNEL_COUNT}, () =>
+    new Int16Array(CONTROLLER_COUNT).fill(-1)
+  );
+}
+
+// returns true if a controller event changes the state, updating it
+function updateController(controllers, event) {
+  const values = controllers[event.channel];
+  if (
+    values[event.controllerType] === event.value &&
+    !NON_IDEMPOTENT_CONTROLLERS.has(event.controllerType)
+  ) {
+    return false;
+  }
+  values[event.controllerType] = event.value;
+  return true;
+}
+
+function isLoopStart(event) {
+  return (
+    event.type === 'controller' &&
+    event.controllerType === LOOP_START_CONTROLLER
+  );
+}
+
+// a program change sets the channel's volume, pan etc. from the instrument, so
+// the controller values sent before it aren't in effect any more
+function resetControllers(controllers, channel) {
+  controllers[channel].fill(-1);
+}
+
+// passes events on to a SeqWriter, leaving out:
+// - controller changes which set the value the controller already has
+// - tempo and time signature changes to the values already in effect
+// - meta events followed by another of the same type at the same time
+// nothing is assumed to be in effect after a loop start, and meta events
+// either side of one aren't merged
+// note offs are written as note ons with zero velocity, which the player
+// treats the same, so they can share running status with the note ons
+class SeqOptimizer {
+  constructor(writer) {
+    this.writer = writer;
+    this.controllers = makeControllerState();
+    this.tempo = null;
+    this.timeSignature = null;
+    // the events at the current time, so meta events can be merged
+    this.pending = [];
+    this.pendingTime = 0;
+    this.stats = {controllers: 0, tempos: 0, metaEvents: 0};
+  }
+
+  writeEvent(event, absoluteTime) {
+    if (absoluteTime !== this.pendingTime || isLoopStart(event)) {
+      this.flushPending();
+    }
+    this.pendingTime = absoluteTime;
+    this.pending.push(event);
+  }
+
+  flushPending() {
+    const lastOfType = {};
+    this.pending.forEach((event, i) => {
+      if (event.meta) lastOfType[event.type] = i;
+    });
+
+    this.pending.forEach((event, i) => {
+      if (event.meta && lastOfType[event.type] !== i) {
+        this.stats.metaEvents++;
+        return;
+      }
+      switch (event.type) {
+        case 'setTempo':
+          if (event.microsecondsPerBeat === this.tempo) {
+            this.stats.tempos++;
+            return;
+          }
+          this.tempo = event.microsecondsPerBeat;
+          break;
+        case 'timeSignature': {
+          const timeSignature = [
+            event.numerator,
+            event.denominator,
+            event.metronome,
+            event.thirtyseconds,
+          ].join();
+          if (timeSignature === this.timeSignature) {
+            this.stats.metaEvents++;
+            return;
+          }
+          this.timeSignature = timeSignature;
+          break;
+        }
+        case 'controller':
+          if (!updateController(this.controllers, event)) {
+            this.stats.controllers++;
+            return;
+          }
+          if (isLoopStart(event)) {
+            this.controllers = makeControllerState();
+            this.tempo = null;
+            this.timeSignature = null;
+          }
+          break;
+        case 'programChange':
+          resetControllers(this.controllers, event.channel);
+          break;
+        case 'noteOff':
+          event = {
+            type: 'noteOff',
+            channel: event.channel,
+            noteNumber: event.noteNumber,
+            velocity: 0,
+            byte9: true,
+          };
+          break;
+      }
+      this.writer.writeEvent(event, this.pendingTime);
+    });
+    this.pending = [];
+  }
+
+  // endTime should be the end of the unoptimized sequence, so leaving out
+  // events at the end doesn't make it shorter
+  end(endTime) {
+    this.flushPending();
+    this.writer.end(Math.max(endTime, this.writer.lastTime));
+  }
+}
+
+// the controllers a program change loads from the instrument (volume, pan and
+// priority), and the ones which act each time they're sent rather than set a
+// value: data entry and increment/decrement (on the selected parameter) and
+// the loop controllers. kept apart from SeqOptimizer's rules so the digest
+// checks them rather than repeating them
+const INSTRUMENT_CONTROLLERS = [7, 10, 16];
+const ACTION_CONTROLLERS = new Set([6, 38, 96, 97, 102, 103, 104, 105]);
+
+// digests what a sequence player does for a stream of events, so an optimized
+// sequence can be checked against the original. every message is applied to a
+// model of the player's channels (program, controllers, pitch bend and
+// aftertouch), and the digest records the notes and action controllers along
+// with the channel state each is played with, so messages which don't change
+// the state don't count. note offs and zero velocity note ons are the same
+// message, and only the tempo in effect after all the events at a time
+// counts. time signatures are ignored as the player doesn't use them. at a
+// loop start the state is forgotten, as the player can also get there from the
+// loop end, so the state the loop is played with has to be set inside it
+class PlaybackDigest {
+  constructor() {
+    this.hash = crypto.createHash('sha1');
+    // the state of each channel, and that last recorded in the digest
+    this.channels = Array.from({length: CHANNEL_COUNT}, () => new Map());
+    this.recorded = Array.from({length: CHANNEL_COUNT}, () => new Map());
+    this.changedChannels = new Set();
+    this.tempo = null;
+    this.pendingTempo = null;
+    this.time = 0;
+    this.messageCount = 0;
+  }
+
+  emit(message) {
+    this.hash.update(message + '\n');
+    this.messageCount++;
+  }
+
+  flushTempo() {
+    if (this.pendingTempo != null && this.pendingTempo !== this.tempo) {
+      this.tempo = this.pendingTempo;
+      this.emit(`${this.time} tempo ${this.tempo}`);
+    }
+    this.pendingTempo = null;
+  }
+
+  // records how each channel's state differs from when it was last recorded
+  flushChannels() {
+    [...this.changedChannels]
+      .sort((a, b) => a - b)
+      .forEach((channel) => {
+        const recorded = this.recorded[channel];
+        [...this.channels[channel]]
+          .filter(([key, value]) => recorded.get(key) !== value)
+          .sort(([a], [b]) => (a < b ? -1 : 1))
+          .forEach(([key, value]) => {
+            this.emit(`${this.time} ${channel} ${key} ${value}`);
+            recorded.set(key, value);
+          });
+      });
+    this.changedChannels.clear();
+  }
+
+  // the tempo set before the loop start at the same time still counts
+  forget() {
+    this.flushTempo();
+    this.channels.forEach((state) => state.clear());
+    this.recorded.forEach((state) => state.clear());
+    this.tempo = null;
+  }
+
+  setState(channel, key, value) {
+    this.channels[channel].set(key, value);
+    this.changedChannels.add(channel);
+  }
+
+  addEvent(event, absoluteTime) {
+    if (absoluteTime !== this.time) {
+      this.flushChannels();
+      this.flushTempo();
+      this.time = absoluteTime;
+    }
+    const t = absoluteTime;
+    switch (event.type) {
+      case 'noteOn':
+        this.flushChannels();
+        if (event.velocity > 0) {
+          this.emit(
+            `${t} noteOn ${event.channel} ${event.noteNumber} ${event.velocity}`
+          );
+        } else {
+          this.emit(`${t} noteOff ${event.channel} ${event.noteNumber}`);
+        }
+        break;
+      case 'noteOff':
+        this.flushChannels();
+        this.emit(`${t} noteOff ${event.channel} ${event.noteNumber}`);
+        break;
+      case 'controller':
+        if (ACTION_CONTROLLERS.has(event.controllerType)) {
+          this.flushChannels();
+          this.emit(
+            `${t} action ${event.channel} ${event.controllerType} ${event.value}`
+          );
+          if (isLoopStart(event)) this.forget();
+        } else {
+          this.setState(
+            event.channel,
+            `controller ${event.controllerType}`,
+            event.value
+          );
+        }
+        break;
+      case 'programChange':
+        this.setState(event.channel, 'program', event.programNumber);
+        INSTRUMENT_CONTROLLERS.forEach((type) => {
+          this.setState(event.channel, `controller ${type}`, 'instrument');
+        });
+        break;
+      case 'pitchBend':
+        this.setState(event.channel, 'pitchBend', event.value);
+        break;
+      case 'channelAftertouch':
+        this.setState(event.channel, 'aftertouch', event.amount);
+        break;
+      case 'noteAftertouch':
+        this.setState(
+          event.channel,
+          `noteAftertouch ${event.noteNumber}`,
+          event.amount
+        );
+        break;
+      case 'setTempo':
+        this.pendingTempo = event.microsecondsPerBeat;
+        break;
+      case 'endOfTrack':
+        this.flushChannels();
+        this.flushTempo();
+        this.emit(`${t} end`);
+        break;
+    }
+  }
+
+  // adds the events of a parsed midi track
+  addTrack(track) {
+    let absoluteTime = 0;
+    track.forEach((event) => {
+      absoluteTime += event.deltaTime;
+      this.addEvent(event, absoluteTime);
+    });
+  }
+
+  digest() {
+    this.flushChannels();
+    this.flushTempo();
+    return `${this.messageCount}:${this.hash.digest('hex')}`;
+  }
+}
+
+module.exports = {SeqOptimizer, PlaybackDigest};
@@ -0,0 +1,245 @@
+// incremental writer for type 0 midi (.seq) files, so a sequence can be
+// written out as its events are generated in time order rather than built up
+// in memory first. encodes events the same way as midi-file's writeMidi, for
+// the event types midicvt keeps. mergeTracks generates those events from the
+// tracks of a type 1 midi file
+
+const fs = require('fs');
+
+const HEADER_SIZE = 14; // MThd chunk
+const TRACK_HEADER_SIZE = 8; // MTrk id and length
+const MAX_EVENT_SIZE = 16;
+const FLUSH_SIZE = 64 * 1024;
+
+class SeqWriter {
+  // header is a midi-file header ({ticksPerBeat} or {framesPerSecond,
+  // ticksPerFrame}). if fd is null nothing is written, but the size of the
+  // file is still counted.
+  // options:
+  //   runningStatus: leave out the status byte of channel events which have
+  //     the same status as the previous event
+  constructor(fd, header, {runningStatus = false} = {}) {
+    this.fd = fd;
+    this.runningStatus = runningStatus;
+    this.buffer = Buffer.alloc(FLUSH_SIZE + MAX_EVENT_SIZE);
+    this.pos = 0;
+    this.trackSize = 0;
+    this.lastTime = 0;
+    this.lastStatus = null;
+    this.eventCount = 0;
+    this.statusBytesSaved = 0;
+
+    this.buffer.write('MThd', 0, 'latin1');
+    this.buffer.writeUInt32BE(6, 4);
+    this.buffer.writeUInt16BE(0, 8); // format
+    this.buffer.writeUInt16BE(1, 10); // track count
+    if (header.ticksPerBeat != null) {
+      this.buffer.writeUInt16BE(header.ticksPerBeat, 12);
+    } else {
+      this.buffer.writeInt8(-header.framesPerSecond, 12);
+      this.buffer.writeUInt8(header.ticksPerFrame, 13);
+    }
+    this.buffer.write('MTrk', HEADER_SIZE, 'latin1');
+    // the track length is filled in by end()
+    this.pos = HEADER_SIZE + TRACK_HEADER_SIZE;
+  }
+
+  writeByte(value) {
+    this.buffer[this.pos++] = value;
+  }
+
+  writeVarInt(value) {
+    if (value > 0x0fffffff) {
+      throw new Error(`delta time ${value} too large`);
+    }
+    let shift = 21;
+    while (shift > 0 && value >> shift === 0) shift -= 7;
+    for (; shift > 0; shift -= 7) {
+      this.writeByte(((value >> shift) & 0x7f) | 0x80);
+    }
+    this.writeByte(value & 0x7f);
+  }
+
+  get size() {
+    return HEADER_SIZE + TRACK_HEADER_SIZE + this.trackSize;
+  }
+
+  writeStatus(status) {
+    if (this.runningStatus && status === this.lastStatus) {
+      this.statusBytesSaved++;
+      return;
+    }
+    this.writeByte(status);
+    this.lastStatus = status;
+  }
+
+  writeMeta(type, bytes) {
+    // meta events cancel running status
+    this.lastStatus = null;
+    this.writeByte(0xff);
+    this.writeByte(type);
+    this.writeVarInt(bytes.length);
+    bytes.forEach((byte) => this.writeByte(byte));
+  }
+
+  // events must be written in time order
+  writeEvent(event, absoluteTime) {
+    if (absoluteTime < this.lastTime) {
+      throw new Error(
+        `event at ${absoluteTime} written after event at ${this.lastTime}`
+      );
+    }
+    const start = this.pos;
+    this.writeVarInt(absoluteTime - this.lastTime);
+    this.lastTime = absoluteTime;
+    switch (event.type) {
+      case 'noteOff':
+        this.writeStatus((event.byte9 ? 0x90 : 0x80) | event.channel);
+        this.writeByte(event.noteNumber);
+        this.writeByte(event.velocity);
+        break;
+      case 'noteOn':
+        this.writeStatus(0x90 | event.channel);
+        this.writeByte(event.noteNumber);
+        this.writeByte(event.velocity);
+        break;
+      case 'controller':
+        this.writeStatus(0xb0 | event.channel);
+        this.writeByte(event.controllerType);
+        this.writeByte(event.value);
+        break;
+      case 'programChange':
+        this.writeStatus(0xc0 | event.channel);
+        this.writeByte(event.programNumber);
+        break;
+      case 'setTempo':
+        this.writeMeta(0x51, [
+          (event.microsecondsPerBeat >> 16) & 0xff,
+          (event.microsecondsPerBeat >> 8) & 0xff,
+          event.microsecondsPerBeat & 0xff,
+        ]);
+        break;
+      case 'timeSignature':
+        this.writeMeta(0x58, [
+          event.numerator,
+          Math.log2(event.denominator),
+          event.metronome,
+          event.thirtyseconds,
+        ]);
+        break;
+      case 'endOfTrack':
+        this.writeMeta(0x2f, []);
+        break;
+      default:
+        throw new Error(`unsupported event type ${event.type}`);
+    }
+    this.trackSize += this.pos - start;
+    this.eventCount++;
+    if (this.pos >= FLUSH_SIZE) this.flush();
+  }
+
+  flush() {
+    if (this.fd == null) {
+      this.pos = 0;
+      return;
+    }
+    let written = 0;
+    while (written < this.pos) {
+      written += fs.writeSync(
+        this.fd,
+        this.buffer,
+        written,
+        this.pos - written
+      );
+    }
+    this.pos = 0;
+  }
+
+  // writes the end of track event, by default at the time of the last event,
+  // and fills in the track length. the file must have been opened for writing
+  // at the start, not appending
+  end(endTime = this.lastTime) {
+    this.writeEvent({type: 'endOfTrack'}, endTime);
+    this.flush();
+    if (this.fd == null) return;
+    const trackSize = Buffer.alloc(4);
+    trackSize.writeUInt32BE(this.trackSize);
+    fs.writeSync(this.fd, trackSize, 0, 4, HEADER_SIZE + 4);
+  }
+}
+
+// position in a track, at the next event to be kept
+class TrackCursor {
+  constructor(track, trackIndex, keepEvent) {
+    this.track = track;
+    this.trackIndex = trackIndex;
+    this.keepEvent = keepEvent;
+    this.position = -1;
+    this.absoluteTime = 0;
+  }
+
+  // returns false at the end of the track
+  advance() {
+    while (++this.position < this.track.length) {
+      const ev = this.track[this.position];
+      this.absoluteTime += ev.deltaTime;
+      if (this.keepEvent(ev)) return true;
+    }
+    return false;
+  }
+
+  get event() {
+    return this.track[this.position];
+  }
+}
+
+// orders by time, then by track, so events at the same time keep the order of
+// the tracks they came from
+function cursorBefore(a, b) {
+  return (
+    a.absoluteTime < b.absoluteTime ||
+    (a.absoluteTime === b.absoluteTime && a.trackIndex < b.trackIndex)
+  );
+}
+
+function siftDown(heap, i) {
+  for (;;) {
+    const left = i * 2 + 1;
+    const right = left + 1;
+    let first = i;
+    if (left < heap.length && cursorBefore(heap[left], heap[first])) {
+      first = left;
+    }
+    if (right < heap.length && cursorBefore(heap[right], heap[first])) {
+      first = right;
+    }
+    if (first === i) return;
+    [heap[i], heap[first]] = [heap[first], heap[i]];
+    i = first;
+  }
+}
+
+// calls onEvent(event, absoluteTime) for each kept event of the tracks in time
+// order. the events of each track are already in time order, so rather than
+// sorting everything, the tracks are merged with a min-heap of the next event
+// of each. the merge is stable: events at the same time stay in track order
+function mergeTracks(tracks, keepEvent, onEvent) {
+  const heap = tracks
+    .map((track, trackIndex) => new TrackCursor(track, trackIndex, keepEvent))
+    .filter((cursor) => cursor.advance());
+  for (let i = Math.floor(heap.length / 2) - 1; i >= 0; i--) {
+    siftDown(heap, i);
+  }
+  while (heap.length) {
+    const cursor = heap[0];
+    onEvent(cursor.event, cursor.absoluteTime);
+    if (!cursor.advance()) {
+      const last = heap.pop();
+      if (!heap.length) break;
+      heap[0] = last;
+    }
+    siftDown(heap, 0);
+  }
+}
+
+module.exports = {SeqWriter, mergeTracks};
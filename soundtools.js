@@ -1,9 +1,13 @@
+const crypto = require('crypto');
 const fs = require('fs');
 const path = require('path');
 
 const AIFF = require('./aiff');
 const {BufferStruct, BufferStructUnion} = require('./bufferstruct');
 const InstParserUtils = require('./instparserutils');
+const VADPCM = require('./vadpcm');
+const {asyncPool} = require('./workerpool');
+const {designCodebook} = require('./tabledesign');
 
 const DEBUG = false;
 
@@ -403,6 +407,215 @@ function serializeVADPCMApplDataField({chunkName, data}) {
   );
 }
 
+// extract the codebook and loop from the APPL chunks of a parsed VADPCM AIFC.
+// book has the fields expected by ALADPCMBook, loop those of ALADPCMloop
+function getVADPCMChunks(aiffData, fileName = 'aifc') {
+  let loop = null;
+  let book = null;
+
+  aiffData.chunks.forEach((chunk) => {
+    if (chunk.type !== 'APPL') return;
+    let result = parseVADPCMApplDataField(chunk.value);
+    if (result) {
+      if (result.chunkName === VADPCM_CODE_NAME) {
+        const {version, ...rest} = result.parsed;
+        // the remaining properties of VADPCMBookChunkStruct are the
+        // fields expected by ALADPCMBook
+        book = rest;
+      }
+      if (result.chunkName === VADPCM_LOOP_NAME) {
+        // only nloops===1 supported
+        const vadpcmLoopChunkStruct = result.parsed;
+        if (vadpcmLoopChunkStruct.nloops === 1) {
+          loop = vadpcmLoopChunkStruct.aloops[0];
+        } else if (vadpcmLoopChunkStruct.nloops > 1) {
+          throw new Error(
+            `VADPCMLoopChunkStruct nloops has invalid value: ${vadpcmLoopChunkStruct.nloops}`
+          );
+        }
+      }
+    }
+  });
+
+  if (!book)
+    throw new Error(`could not extract VADPCM codebook from ${fileName}`);
+
+  return {book, loop};
+}
+
+// MARK and INST chunks defining a forward sustain loop, as used for
+// uncompressed samples
+function makeAIFFLoopChunks(loop) {
+  return [
+    {
+      type: 'MARK',
+      value: {
+        numMarkers: 2,
+        markers: [
+          {
+            id: 1,
+            position: loop.start,
+            markerName: 'beg loop',
+          },
+          {
+            id: 2,
+            position: loop.end,
+            markerName: 'end loop',
+          },
+        ],
+      },
+    },
+    {
+      type: 'INST',
+      value: {
+        sustainLoop: {
+          playMode: 1,
+          beginLoop: 1,
+          endLoop: 2,
+        },
+        releaseLoop: {
+          playMode: 0,
+          beginLoop: 0,
+          endLoop: 0,
+        },
+      },
+    },
+  ];
+}
+
+// decode a parsed VADPCM AIFC to an uncompressed AIFF file buffer, keeping its
+// sample rate and loop
+function decodeVADPCMAIFF(aiffData, fileName = 'aifc') {
+  return AIFF.serialize(decodeVADPCMAIFFData(aiffData, fileName));
+}
+
+// as decodeVADPCMAIFF, but returns the fields to pass to AIFF.serialize
+function decodeVADPCMAIFFData(aiffData, fileName = 'aifc') {
+  const {book, loop} = getVADPCMChunks(aiffData, fileName);
+  const samples = VADPCM.decodeVADPCM(aiffData.soundData, book);
+  return {
+    soundData: VADPCM.samplesToBigEndianBuffer(samples),
+    numChannels: 1,
+    sampleSize: 16,
+    sampleRate: aiffData.sampleRate,
+    chunks: loop ? makeAIFFLoopChunks(loop) : [],
+  };
+}
+
+// extract a forward sustain loop from the MARK and INST chunks of a parsed
+// uncompressed AIFF, as {start, end, count} for ALRawLoop
+function getAIFFLoop(aiffData) {
+  const markersChunk = aiffData.chunks.find((chunk) => chunk.type == 'MARK');
+  const instrumentChunk = aiffData.chunks.find(
+    (chunk) => chunk.type == 'INST'
+  );
+
+  if (
+    markersChunk &&
+    instrumentChunk &&
+    instrumentChunk.value.sustainLoop.playMode ==
+      AIFF.LoopPlayMode.ForwardLooping
+  ) {
+    const loopStartMarkerID = instrumentChunk.value.sustainLoop.beginLoop;
+    const loopEndMarkerID = instrumentChunk.value.sustainLoop.endLoop;
+
+    const loopStartMarker = markersChunk.value.markers.find(
+      (marker) => marker.id === loopStartMarkerID
+    );
+    const loopEndMarker = markersChunk.value.markers.find(
+      (marker) => marker.id === loopEndMarkerID
+    );
+    if (loopStartMarker && loopEndMarker) {
+      return {
+        start: loopStartMarker.position,
+        end: loopEndMarker.position,
+        count: 0x7fffffff, // infinite, should be -1 but BufferStruct doesn't support underflow
+      };
+    }
+  }
+  return null;
+}
+
+// encode a parsed uncompressed AIFF to a VADPCM AIFC file buffer, training a
+// codebook for it, as tabledesign and vadpcm_enc would. returns the file and
+// some stats about the encoding.
+// options: mode (see VADPCM.ENCODE_MODES) and the options of designCodebook
+function encodeVADPCMAIFF(
+  aiffData,
+  fileName = 'aiff',
+  {mode = 'normal', ...codebookOptions} = {}
+) {
+  if (aiffData.numChannels !== 1 || aiffData.sampleSize !== 16) {
+    throw new Error(
+      `${fileName}: only 16 bit mono samples can be compressed, got ${aiffData.numChannels} channel(s) of ${aiffData.sampleSize} bit`
+    );
+  }
+  const samples = VADPCM.bigEndianBufferToSamples(aiffData.soundData);
+  const book = designCodebook(samples, codebookOptions);
+  const rawLoop = getAIFFLoop(aiffData);
+  const encoded = VADPCM.encodeVADPCM(samples, book, {
+    loopStart: rawLoop ? rawLoop.start : null,
+    mode,
+  });
+
+  const chunks = [
+    {
+      type: 'APPL',
+      value: {
+        applicationSignature: 'stoc',
+        data: serializeVADPCMApplDataField({
+          chunkName: VADPCM_CODE_NAME,
+          data: VADPCMBookChunkStruct.serialize({
+            version: VADPCM_VERSION,
+            ...book,
+          }),
+        }),
+      },
+    },
+  ];
+  if (rawLoop) {
+    chunks.push({
+      type: 'APPL',
+      value: {
+        applicationSignature: 'stoc',
+        data: serializeVADPCMApplDataField({
+          chunkName: VADPCM_LOOP_NAME,
+          data: VADPCMLoopChunkStruct.serialize({
+            version: VADPCM_VERSION,
+            nloops: 1,
+            aloops: [
+              {
+                ...rawLoop,
+                state: VADPCM.writeLoopState(encoded.loopState),
+              },
+            ],
+          }),
+        }),
+      },
+    });
+  }
+
+  const decoded = VADPCM.decodeVADPCM(encoded.data, book);
+  return {
+    aifc: AIFF.serialize({
+      soundData: encoded.data,
+      numChannels: 1,
+      sampleSize: 16,
+      sampleRate: aiffData.sampleRate,
+      formType: 'AIFC',
+      compressionType: 'VAPC',
+      compressionName: 'VADPCM ~4-1',
+      chunks,
+    }),
+    stats: {
+      samples: samples.length,
+      rawBytes: aiffData.soundData.length,
+      compressedBytes: encoded.data.length,
+      snr: VADPCM.computeSNR(samples, decoded),
+    },
+  };
+}
+
 function isInvalidAIFFFromN64SDK(aiffFile) {
   const firstChunkId = aiffFile.slice(0, 4).toString('utf8');
   const firstChunkSize = aiffFile.readInt32BE(4);
@@ -642,13 +855,45 @@ function parseCtl(ctlBuffer, startOffset) {
   return bankFile;
 }
 
+// samples extracted at once by bankToSource. each one in progress holds its
+// sound data and an open file
+const DEFAULT_EXTRACT_CONCURRENCY = 16;
+
 async function bankToSource(
   ctlBuffer,
   ctlStartOffset,
   tblBuffer,
   tblStartOffset,
   outPath,
-  generalMidi
+  generalMidi,
+  options
+) {
+  const bankFile = parseCtl(ctlBuffer, ctlStartOffset);
+  await bankFileToSource(
+    bankFile,
+    (wavetable) =>
+      tblBuffer.slice(
+        tblStartOffset + wavetable.base,
+        tblStartOffset + wavetable.base + wavetable.len
+      ),
+    outPath,
+    generalMidi,
+    options
+  );
+}
+
+// writes the .inst and samples for a bank file as returned by parseCtl, or a
+// subset of one. readWaveData(wavetable) returns the wavetable's sound data
+// from the tbl, or a promise of it.
+// options:
+//   concurrency: max samples read and written at once
+//   decodePCM: also write an uncompressed .aiff of each VADPCM .aifc
+async function bankFileToSource(
+  bankFile,
+  readWaveData,
+  outPath,
+  generalMidi,
+  {concurrency = DEFAULT_EXTRACT_CONCURRENCY, decodePCM = false} = {}
 ) {
   const outFilePrefix = outPath.replace(/\.inst$/, '');
   const outFileName = path.basename(outFilePrefix);
@@ -658,8 +903,6 @@ async function bankToSource(
 
   await fs.promises.mkdir(outSamplesDir, {recursive: true});
 
-  const bankFile = parseCtl(ctlBuffer, ctlStartOffset);
-
   function formatRef(type, ref) {
     return `${type}_${ref}`;
   }
@@ -710,6 +953,9 @@ async function bankToSource(
               type: 'symbol',
               value: formatRef(referencedType, String(refArrayItemAsOffset)),
             }));
+          } else if (fieldValue === 0) {
+            // a null reference, eg. a bank with no percussion instrument
+            return;
           } else {
             value[outFieldName] = {
               type: 'symbol',
@@ -771,13 +1017,12 @@ async function bankToSource(
       )
     )
   );
-  await Promise.all(
-    Object.keys(bankFile.wavetables).map((offset) => {
+  await asyncPool(
+    concurrency,
+    Object.keys(bankFile.wavetables),
+    async (offset) => {
       const wavetable = bankFile.wavetables[offset];
-      const soundWaveData = tblBuffer.slice(
-        tblStartOffset + wavetable.base,
-        tblStartOffset + wavetable.base + wavetable.len
-      );
+      const soundWaveData = await readWaveData(wavetable);
       const chunks = [];
       let aifcFields = null;
       if (wavetable.type === AL_ADPCM_WAVE) {
@@ -835,58 +1080,30 @@ async function bankToSource(
           const loop = bankFile.loops[wavetable.waveInfo.loop];
           if (!loop)
             throw new Error('missing loop data for wavetable at ' + offset);
-          chunks.push({
-            type: 'MARK',
-            value: {
-              numMarkers: 2,
-              markers: [
-                {
-                  id: 1,
-                  position: loop.start,
-                  markerName: 'beg loop',
-                },
-                {
-                  id: 2,
-                  position: loop.end,
-                  markerName: 'end loop',
-                },
-              ],
-            },
-          });
-          chunks.push({
-            type: 'INST',
-            value: {
-              sustainLoop: {
-                playMode: 1,
-                beginLoop: 1,
-                endLoop: 2,
-              },
-              releaseLoop: {
-                playMode: 0,
-                beginLoop: 0,
-                endLoop: 0,
-              },
-            },
-          });
+          chunks.push(...makeAIFFLoopChunks(loop));
         }
       } else {
         throw new Error(`unsupported compression type: ${wavetable.type}`);
       }
 
-      const aiffFileContents = AIFF.serialize({
+      const aiffData = {
         soundData: soundWaveData,
         numChannels: 1,
         sampleSize: 16,
         sampleRate: defaultSampleRate,
         ...aifcFields,
         chunks,
-      });
+      };
+      const filePath = path.join(outFileDir, makeWavetableFilePath(wavetable));
+      await writeFileBuffers(filePath, AIFF.serializePieces(aiffData));
 
-      return fs.promises.writeFile(
-        path.join(outFileDir, makeWavetableFilePath(wavetable)),
-        aiffFileContents
-      );
-    })
+      if (decodePCM && wavetable.type === AL_ADPCM_WAVE) {
+        await writeFileBuffers(
+          filePath.replace(/\.aifc$/, '.aiff'),
+          AIFF.serializePieces(decodeVADPCMAIFFData(aiffData, filePath))
+        );
+      }
+    }
   );
 }
 
@@ -899,6 +1116,41 @@ function loadAIFFData(file) {
   return aiff;
 }
 
+// the parts of a parsed AIFF/AIFC that end up in the ctl/tbl:
+// {type, soundData, book, loop}, where book and loop are null or have the
+// fields of ALADPCMBook and ALADPCMloop/ALRawLoop
+function extractSampleData(aiffData, fileName) {
+  if (aiffData.formType === 'AIFC') {
+    const {book, loop} = getVADPCMChunks(aiffData, fileName);
+    return {type: AL_ADPCM_WAVE, soundData: aiffData.soundData, book, loop};
+  }
+  return {
+    type: AL_RAW16_WAVE,
+    soundData: aiffData.soundData,
+    book: null,
+    loop: getAIFFLoop(aiffData),
+  };
+}
+
+// the sound data is read when it's used, rather than with the metadata
+function loadAIFFMetadata(file) {
+  const aiff = AIFF.parseFileLazy(file);
+
+  if (aiff.soundDataSize == null) {
+    throw new Error(`file ${file} does not contain SSND chunk`);
+  }
+  return aiff;
+}
+
+// reloadSoundData lets the bank writer drop the sound data until it's written
+function loadSampleData(file) {
+  const aiff = loadAIFFMetadata(file);
+  return {
+    ...extractSampleData(aiff, file),
+    reloadSoundData: aiff.readSoundData,
+  };
+}
+
 function getSymbolField(obj, fieldName) {
   if (!InstParserUtils.isSymbol(obj.value[fieldName])) {
     throw new Error(
@@ -913,20 +1165,114 @@ function getAlignedSize(size, alignment) {
   return Math.ceil(size / alignment) * alignment;
 }
 
+// max buffers per writev call (IOV_MAX on linux) and max bytes to gather before
+// writing them
+const MAX_WRITE_BUFFERS = 1024;
+const WRITE_BATCH_BYTES = 1024 * 1024;
+
+// the buffers still to be written after a writev which wrote some of them
+function skipWritten(buffers, written) {
+  let i = 0;
+  while (i < buffers.length && written >= buffers[i].length) {
+    written -= buffers[i].length;
+    i++;
+  }
+  const remaining = buffers.slice(i);
+  if (written) remaining[0] = remaining[0].subarray(written);
+  return remaining;
+}
+
+// write all of buffers to fd, continuing after any partial writes
+function writevAll(fd, buffers) {
+  let remaining = buffers;
+  while (remaining.length) {
+    remaining = skipWritten(remaining, fs.writevSync(fd, remaining));
+  }
+}
+
+// writes a file from a (short) list of buffers without concatenating them
+async function writeFileBuffers(filePath, buffers) {
+  const handle = await fs.promises.open(filePath, 'w');
+  try {
+    let remaining = buffers;
+    while (remaining.length) {
+      const {bytesWritten} = await handle.writev(remaining);
+      remaining = skipWritten(remaining, bytesWritten);
+    }
+  } finally {
+    await handle.close();
+  }
+}
+
+// chunks are stored as buffers, or as {length, load} for data inserted with a
+// reload function, which is only read back in when the file is written. this
+// way the sample data of a bank doesn't all have to be held in memory at once
 class FileTable {
   chunks = new Map();
   size = 0;
-  constructor(alignment = null) {
+  // content hash -> locations of chunks with that hash, for dedup
+  chunksByHash = new Map();
+  dedupStats = {chunks: 0, bytes: 0};
+  constructor(alignment = null, {dedup = false} = {}) {
     this.alignment = alignment;
+    this.dedup = dedup;
+    // padding is written as a view of this, rather than copying chunks
+    this.zeroes = Buffer.alloc(alignment || 0);
+  }
+
+  getChunkData(location) {
+    const chunk = this.chunks.get(location);
+    if (Buffer.isBuffer(chunk)) return chunk;
+    const data = chunk.load();
+    if (data.length !== chunk.length) {
+      throw new Error(
+        `chunk at ${location} reloaded with length ${data.length}, expected ${chunk.length}`
+      );
+    }
+    return data;
   }
-  insertBuffer(buffer) {
+
+  // returns the location of a chunk with identical content to buffer, if any
+  findDuplicate(buffer, hash) {
+    const candidates = this.chunksByHash.get(hash);
+    if (!candidates) return null;
+    const location = candidates.find((location) =>
+      this.getChunkData(location).equals(buffer)
+    );
+    return location == null ? null : location;
+  }
+
+  // dedup: if true and a chunk with the same content has already been inserted,
+  // return its location instead of inserting another copy. chunks which will
+  // later be replaced with replaceBuffer should not be deduped
+  // reload: function returning the same data as buffer, to call when writing
+  // the file instead of keeping buffer around
+  insertBuffer(buffer, {dedup = this.dedup, reload = null} = {}) {
+    let hash = null;
+    if (dedup) {
+      hash = crypto.createHash('sha1').update(buffer).digest('hex');
+      const existing = this.findDuplicate(buffer, hash);
+      if (existing != null) {
+        this.dedupStats.chunks++;
+        this.dedupStats.bytes += buffer.length;
+        return existing;
+      }
+    }
     if (this.alignment != null) {
       // advance position of next insertion to be aligned as required
       this.size = getAlignedSize(this.size, this.alignment);
     }
     const location = this.size;
-    this.chunks.set(location, buffer);
+    this.chunks.set(
+      location,
+      reload ? {length: buffer.length, load: reload} : buffer
+    );
     this.size += buffer.length;
+    if (hash) {
+      const locations = this.chunksByHash.get(hash) || [];
+      locations.push(location);
+      this.chunksByHash.set(hash, locations);
+    }
     return location;
   }
 
@@ -945,22 +1291,47 @@ class FileTable {
     this.chunks.set(offset, buffer);
   }
 
+  // the file contents as a sequence of buffers, loading deferred chunks as
+  // they're reached
+  *pieces() {
+    for (const location of this.chunks.keys()) {
+      const data = this.getChunkData(location);
+      yield data;
+      if (this.alignment == null) continue;
+      // pad any chunks to match alignment
+      // assumes we also aligned their start pos correctly when inserting them
+      const padding = getAlignedSize(data.length, this.alignment) - data.length;
+      if (padding) yield this.zeroes.subarray(0, padding);
+    }
+  }
+
   build() {
-    return Buffer.concat(
-      Array.from(this.chunks.entries()).map(([offset, chunk]) => {
-        if (this.alignment == null) return chunk;
-        // pad any chunks to match alignment
-        // assumes we also aligned their start pos correctly when inserting them
-        const alignedSize = getAlignedSize(chunk.length, this.alignment);
-        if (alignedSize == chunk.length) {
-          return chunk;
-        } else {
-          const padded = Buffer.alloc(alignedSize);
-          chunk.copy(padded);
-          return padded;
+    return Buffer.concat(Array.from(this.pieces()));
+  }
+
+  // stream the file contents to filePath with vectored writes. only one
+  // deferred chunk (plus a batch of small ones) is in memory at a time
+  writeFile(filePath) {
+    const fd = fs.openSync(filePath, 'w');
+    try {
+      let batch = [];
+      let batchBytes = 0;
+      for (const piece of this.pieces()) {
+        batch.push(piece);
+        batchBytes += piece.length;
+        if (
+          batch.length >= MAX_WRITE_BUFFERS ||
+          batchBytes >= WRITE_BATCH_BYTES
+        ) {
+          writevAll(fd, batch);
+          batch = [];
+          batchBytes = 0;
         }
-      })
-    );
+      }
+      writevAll(fd, batch);
+    } finally {
+      fs.closeSync(fd);
+    }
   }
 }
 
@@ -976,11 +1347,20 @@ class ALBankFileWriter {
     ].map((key) => [key, new Map()])
   );
 
-  ctl = new FileTable(/* 8-byte alignment */ 8);
-  tbl = new FileTable(/* 16-byte alignment */ 8);
-
-  constructor(defs, sourceFileLocation) {
+  constructor(
+    defs,
+    sourceFileLocation,
+    {loadSample = loadSampleData, dedup = true} = {}
+  ) {
+    // identical structs and sample data are only stored once, whatever they're
+    // named. the bank loader patches each struct's offsets at most once, so
+    // sharing them is safe
+    this.ctl = new FileTable(/* 8-byte alignment */ 8, {dedup});
+    this.tbl = new FileTable(/* 16-byte alignment */ 8, {dedup});
     this.sourceFileLocation = sourceFileLocation;
+    // loads a sample file given its resolved path, returning the result of
+    // extractSampleData, optionally with a reloadSoundData function
+    this.loadSample = loadSample;
     defs.forEach((obj) => {
       this.insertObject(obj);
       if (obj.type === 'sound') {
@@ -1022,6 +1402,17 @@ class ALBankFileWriter {
     objectsForType.set(obj.name, {obj, offset: null});
   }
 
+  resolveSamplePath(file) {
+    return path.resolve(path.dirname(this.sourceFileLocation), file);
+  }
+
+  // resolved paths of all the sample files used by the bank
+  getSampleFiles() {
+    return Array.from(this.getObjectsOfType('wavetable').values()).map(
+      ({obj}) => this.resolveSamplePath(obj.value.file)
+    );
+  }
+
   dependOnFieldReferencedObject({type, field, source}) {
     const referencedSymbolName = getSymbolField(source, field);
     if (!this.hasObject(type, referencedSymbolName)) {
@@ -1134,49 +1525,17 @@ class ALBankFileWriter {
         return ALEnvelopeStruct.serialize(obj.value);
       }
       case 'wavetable': {
-        const resolvedLocation = path.resolve(
-          path.dirname(this.sourceFileLocation),
-          obj.value.file
+        const sample = this.loadSample(
+          this.resolveSamplePath(obj.value.file)
         );
-        const aiffData = loadAIFFData(resolvedLocation);
 
-        const isVADPCM = aiffData.formType === 'AIFC';
-
-        const waveData = aiffData.soundData;
-        const waveTblOffset = this.tbl.insertBuffer(waveData);
+        const waveData = sample.soundData;
+        const waveTblOffset = this.tbl.insertBuffer(waveData, {
+          reload: sample.reloadSoundData,
+        });
         let wavetableStructData;
-        if (isVADPCM) {
-          let loop = null;
-          let book = null;
-
-          aiffData.chunks.forEach((chunk) => {
-            if (chunk.type !== 'APPL') return;
-            let result = parseVADPCMApplDataField(chunk.value);
-            if (result) {
-              if (result.chunkName === VADPCM_CODE_NAME) {
-                const {version, ...rest} = result.parsed;
-                // the remaining properties of VADPCMBookChunkStruct are the
-                // fields expected by ALADPCMBook
-                book = rest;
-              }
-              if (result.chunkName === VADPCM_LOOP_NAME) {
-                // only nloops===1 supported
-                const vadpcmLoopChunkStruct = result.parsed;
-                if (vadpcmLoopChunkStruct.nloops === 1) {
-                  loop = vadpcmLoopChunkStruct.aloops[0];
-                } else if (vadpcmLoopChunkStruct.nloops > 1) {
-                  throw new Error(
-                    `VADPCMLoopChunkStruct nloops has invalid value: ${vadpcmLoopChunkStruct.nloops}`
-                  );
-                }
-              }
-            }
-          });
-
-          if (!book)
-            throw new Error(
-              `could not extract VADPCM codebook from ${obj.value.file}`
-            );
+        if (sample.type === AL_ADPCM_WAVE) {
+          const {book, loop} = sample;
 
           wavetableStructData = {
             base: waveTblOffset,
@@ -1191,39 +1550,7 @@ class ALBankFileWriter {
             },
           };
         } else {
-          let loop = null;
-          // extract loop definition from AIFF chunks
-          const markersChunk = aiffData.chunks.find(
-            (chunk) => chunk.type == 'MARK'
-          );
-          const instrumentChunk = aiffData.chunks.find(
-            (chunk) => chunk.type == 'INST'
-          );
-
-          if (
-            markersChunk &&
-            instrumentChunk &&
-            instrumentChunk.value.sustainLoop.playMode ==
-              AIFF.LoopPlayMode.ForwardLooping
-          ) {
-            const loopStartMarkerID =
-              instrumentChunk.value.sustainLoop.beginLoop;
-            const loopEndMarkerID = instrumentChunk.value.sustainLoop.endLoop;
-
-            const loopStartMarker = markersChunk.value.markers.find(
-              (marker) => marker.id === loopStartMarkerID
-            );
-            const loopEndMarker = markersChunk.value.markers.find(
-              (marker) => marker.id === loopEndMarkerID
-            );
-            if (loopStartMarker && loopEndMarker) {
-              loop = {
-                start: loopStartMarker.position,
-                end: loopEndMarker.position,
-                count: 0x7fffffff, // infinite, should be -1 but BufferStruct doesn't support underflow
-              };
-            }
-          }
+          const {loop} = sample;
           wavetableStructData = {
             base: waveTblOffset,
             len: waveData.length,
@@ -1282,7 +1609,7 @@ class ALBankFileWriter {
     // make header with placeholders for bank offsets
     // insert as placeholder
     let bankFileHeader = makeHeader(banks.map((_) => 0));
-    this.ctl.insertBuffer(bankFileHeader);
+    this.ctl.insertBuffer(bankFileHeader, {dedup: false});
     // insert all the referenced file parts
     const banksOffsets = banks.map((bank) => this.dependOnObject(bank.obj));
     // replace header with corrected offsets
@@ -1293,20 +1620,44 @@ class ALBankFileWriter {
       });
     this.ctl.replaceBuffer(0, bankFileHeader);
 
-    fs.writeFileSync(filePrefix + '.ctl', this.ctl.build());
-    fs.writeFileSync(filePrefix + '.tbl', this.tbl.build());
+    this.ctl.writeFile(filePrefix + '.ctl');
+    this.tbl.writeFile(filePrefix + '.tbl');
+  }
+
+  // bytes not written to the ctl and tbl because identical data was shared
+  getDedupStats() {
+    return {
+      ctl: {...this.ctl.dedupStats},
+      tbl: {...this.tbl.dedupStats},
+      bytes: this.ctl.dedupStats.bytes + this.tbl.dedupStats.bytes,
+    };
   }
 }
 
-function sourceToBank(defs, sourceFileLocation) {
-  const fileWriter = new ALBankFileWriter(defs, sourceFileLocation);
+function sourceToBank(defs, sourceFileLocation, options) {
+  const fileWriter = new ALBankFileWriter(defs, sourceFileLocation, options);
   return fileWriter;
 }
 
 module.exports = {
   bankToSource,
+  bankFileToSource,
   sourceToBank,
   parseCtl,
+  parseVADPCMApplDataField,
+  serializeVADPCMApplDataField,
+  getVADPCMChunks,
+  decodeVADPCMAIFF,
+  decodeVADPCMAIFFData,
+  encodeVADPCMAIFF,
+  getAIFFLoop,
+  makeAIFFLoopChunks,
+  loadAIFFData,
+  loadAIFFMetadata,
+  extractSampleData,
+  loadSampleData,
+  AL_ADPCM_WAVE,
+  AL_RAW16_WAVE,
   ALBankFileStruct,
   VADPCMApplDataFieldStruct,
   VADPCMBookChunkStruct,
@@ -0,0 +1,562 @@
+// offline software model of the n64 synthesizer and sequence player, for
+// rendering .seq files with an ic-compiled ctl/tbl bank to PCM on the host
+//
+// this models the parts of libultra's alSeqp/alSyn which affect what you hear:
+// keymap lookup, ADSR envelopes, sample loops, volume/pan/pitch and voice
+// allocation. the resampler is linear rather than the microcode's 4 tap
+// polyphase filter and there is no reverb, so output won't be bit exact with
+// hardware, but is close enough for previews and regression tests.
+
+const {parseMidi} = require('midi-file');
+const {parseCtl, AL_ADPCM_WAVE, AL_RAW16_WAVE} = require('./soundtools');
+const {decodeVADPCM} = require('./vadpcm');
+
+const DEFAULT_SAMPLE_RATE = 44100;
+const DEFAULT_MAX_VOICES = 24; // NU_AU_SYN_PVOICE_MAX
+const DEFAULT_TEMPO = 500000; // microseconds per quarter note
+const DEFAULT_TAIL_SECONDS = 10; // max time to let voices ring after the last event
+const AL_PAN_CENTER = 64;
+const AL_VOL_FULL = 127;
+const MAX_PITCH_RATIO = 1.99996; // the resampler can't go more than an octave up
+const ENV_BLOCK_SIZE = 32; // samples between envelope/gain updates
+const MIDI_CC_VOLUME = 7;
+const MIDI_CC_PAN = 10;
+const MIDI_CC_SUSTAIN = 64;
+const MIDI_CC_ALL_SOUND_OFF = 120;
+const MIDI_CC_ALL_NOTES_OFF = 123;
+const MIDI_PITCH_BEND_RANGE = 8192;
+
+const ENV_ATTACK = 0;
+const ENV_DECAY = 1;
+const ENV_SUSTAIN = 2;
+const ENV_RELEASE = 3;
+const ENV_DONE = 4;
+
+// a bank ready to play: the parsed ctl with each wavetable decoded to float
+// samples once up front, so voices only need to resample
+class SynthBank {
+  constructor(
+    ctlBuffer,
+    tblBuffer,
+    {ctlStart = 0, tblStart = 0, bank = 0} = {}
+  ) {
+    this.bankFile = parseCtl(ctlBuffer, ctlStart);
+    const bankOffset = this.bankFile.bankArray[bank];
+    if (bankOffset == null) {
+      throw new Error(
+        `bank ${bank} not found, ctl has ${this.bankFile.bankCount} bank(s)`
+      );
+    }
+    this.bank = this.bankFile.banks[bankOffset];
+    this.sampleRate = this.bank.sampleRate;
+    this.tblBuffer = tblBuffer;
+    this.tblStart = tblStart;
+    this.waves = new Map();
+  }
+
+  getInstrument(program) {
+    const offset = this.bank.instArray[program];
+    return offset ? this.bankFile.instruments[offset] : null;
+  }
+
+  // find the sound of an instrument whose keymap contains the key/velocity.
+  // like the seq player, the first match wins
+  findSound(instrument, key, velocity) {
+    for (const soundOffset of instrument.soundArray) {
+      const sound = this.bankFile.sounds[soundOffset];
+      const keyMap = this.bankFile.keyMaps[sound.keyMap];
+      if (
+        key >= keyMap.keyMin &&
+        key <= keyMap.keyMax &&
+        velocity >= keyMap.velocityMin &&
+        velocity <= keyMap.velocityMax
+      ) {
+        return sound;
+      }
+    }
+    return null;
+  }
+
+  getWave(wavetableOffset) {
+    let wave = this.waves.get(wavetableOffset);
+    if (!wave) {
+      wave = this.decodeWave(this.bankFile.wavetables[wavetableOffset]);
+      this.waves.set(wavetableOffset, wave);
+    }
+    return wave;
+  }
+
+  decodeWave(wavetable) {
+    const data = this.tblBuffer.slice(
+      this.tblStart + wavetable.base,
+      this.tblStart + wavetable.base + wavetable.len
+    );
+    let pcm;
+    let loop = null;
+    if (wavetable.type === AL_ADPCM_WAVE) {
+      const book = this.bankFile.books[wavetable.waveInfo.book];
+      if (!book) {
+        throw new Error(`ADPCM wavetable at ${wavetable.base} has no codebook`);
+      }
+      pcm = decodeVADPCM(data, book);
+      if (wavetable.waveInfo.loop) {
+        loop = this.bankFile.loops[wavetable.waveInfo.loop];
+        // when looping, the microcode restarts the decoder at the loop start
+        // with the stored state. the encoder stores the state the decoder had
+        // at that point, so decoding straight through gives the same samples
+      }
+    } else if (wavetable.type === AL_RAW16_WAVE) {
+      pcm = new Int16Array(Math.floor(data.length / 2));
+      for (let i = 0; i < pcm.length; i++) {
+        pcm[i] = data.readInt16BE(i * 2);
+      }
+      if (wavetable.waveInfo.loop) {
+        loop = this.bankFile.loops[wavetable.waveInfo.loop];
+      }
+    } else {
+      throw new Error(`unsupported wavetable type: ${wavetable.type}`);
+    }
+
+    const samples = new Float32Array(pcm.length);
+    for (let i = 0; i < pcm.length; i++) {
+      samples[i] = pcm[i] / 32768;
+    }
+
+    let loopStart = 0;
+    let loopEnd = 0;
+    let loopCount = 0;
+    if (loop && loop.count && loop.end > loop.start && loop.end <= pcm.length) {
+      loopStart = loop.start;
+      loopEnd = loop.end;
+      // count of 0xffffffff (or -1) means loop forever
+      loopCount = loop.count >= 0x7fffffff ? Infinity : loop.count;
+    }
+    return {samples, loopStart, loopEnd, loopCount};
+  }
+}
+
+class Voice {
+  constructor(bank, channel, key, velocity, instrument, sound, startTime) {
+    this.channel = channel;
+    this.key = key;
+    this.velocity = velocity;
+    this.instrument = instrument;
+    this.sound = sound;
+    this.priority = instrument.priority;
+    this.startTime = startTime;
+    this.keyMap = bank.bankFile.keyMaps[sound.keyMap];
+    this.envelope = bank.bankFile.envelopes[sound.envelope];
+    this.wave = bank.getWave(sound.wavetable);
+    this.bankSampleRate = bank.sampleRate;
+
+    this.position = 0;
+    this.loopsRemaining = this.wave.loopCount;
+    this.released = false;
+    // note off received while the sustain pedal was down
+    this.sustained = false;
+
+    this.envStage = ENV_ATTACK;
+    this.envLevel = 0;
+    this.envFrom = 0;
+    this.envTo = 0;
+    this.envSamples = 0;
+    this.envElapsed = 0;
+  }
+
+  // the envelope ramps linearly between levels, like the synthesizer's volume
+  // ramps. times in the bank are in microseconds
+  startEnvelopeStage(stage, outputRate) {
+    const {attackTime, decayTime, releaseTime} = this.envelope;
+    const attackVolume = this.envelope.attackVolume & 0xff;
+    const decayVolume = this.envelope.decayVolume & 0xff;
+    this.envStage = stage;
+    this.envFrom = this.envLevel;
+    this.envElapsed = 0;
+    let time = 0;
+    switch (stage) {
+      case ENV_ATTACK:
+        this.envFrom = 0;
+        this.envTo = attackVolume;
+        time = attackTime;
+        break;
+      case ENV_DECAY:
+        this.envTo = decayVolume;
+        time = decayTime;
+        break;
+      case ENV_SUSTAIN:
+        this.envTo = this.envLevel;
+        time = 0;
+        break;
+      case ENV_RELEASE:
+        this.envTo = 0;
+        time = releaseTime;
+        break;
+    }
+    // a negative decay time (AL_USEC_PER_SEC * -1 in the sdk banks) means
+    // decay never ends
+    this.envSamples =
+      time < 0 ? Infinity : Math.max(1, Math.round((time / 1e6) * outputRate));
+  }
+
+  advanceEnvelope(samples, outputRate) {
+    if (this.envStage === ENV_SUSTAIN || this.envStage === ENV_DONE) return;
+    this.envElapsed += samples;
+    if (this.envElapsed >= this.envSamples) {
+      this.envLevel = this.envTo;
+      if (this.envStage === ENV_ATTACK) {
+        this.startEnvelopeStage(ENV_DECAY, outputRate);
+      } else if (this.envStage === ENV_DECAY) {
+        this.startEnvelopeStage(ENV_SUSTAIN, outputRate);
+      } else if (this.envStage === ENV_RELEASE) {
+        this.envStage = ENV_DONE;
+      }
+    } else {
+      this.envLevel =
+        this.envFrom +
+        (this.envTo - this.envFrom) * (this.envElapsed / this.envSamples);
+    }
+  }
+
+  release(outputRate) {
+    if (this.released) return;
+    this.released = true;
+    this.sustained = false;
+    this.startEnvelopeStage(ENV_RELEASE, outputRate);
+  }
+
+  get done() {
+    return this.envStage === ENV_DONE || this.position < 0;
+  }
+}
+
+class SeqRenderer {
+  constructor(
+    bank,
+    {
+      sampleRate = DEFAULT_SAMPLE_RATE,
+      maxVoices = DEFAULT_MAX_VOICES,
+      tailSeconds = DEFAULT_TAIL_SECONDS,
+    } = {}
+  ) {
+    this.bank = bank;
+    this.sampleRate = sampleRate;
+    this.maxVoices = maxVoices;
+    this.tailSeconds = tailSeconds;
+    this.voices = [];
+    this.channels = [];
+    for (let i = 0; i < 16; i++) {
+      this.channels.push({
+        program: 0,
+        instrument: bank.getInstrument(0),
+        volume: AL_VOL_FULL,
+        pan: AL_PAN_CENTER,
+        sustain: false,
+        bend: 0, // -1..1
+      });
+      this.setProgram(this.channels[i], 0);
+    }
+    this.time = 0; // in output samples
+    this.stats = {notes: 0, stolen: 0, dropped: 0, maxVoices: 0};
+  }
+
+  setProgram(channel, program) {
+    const instrument = this.bank.getInstrument(program);
+    if (!instrument) return; // the seq player ignores unknown programs
+    channel.program = program;
+    channel.instrument = instrument;
+    // the seq player resets these from the instrument on program change
+    channel.volume = instrument.volume;
+    channel.pan = instrument.pan;
+  }
+
+  noteOn(channelIndex, key, velocity) {
+    const channel = this.channels[channelIndex];
+    const instrument = channel.instrument;
+    if (!instrument) return;
+    const sound = this.bank.findSound(instrument, key, velocity);
+    if (!sound) return;
+
+    if (this.voices.length >= this.maxVoices) {
+      // steal the oldest voice of the lowest priority, preferring voices which
+      // are already releasing
+      let victim = null;
+      for (const voice of this.voices) {
+        if (
+          !victim ||
+          voice.released > victim.released ||
+          (voice.released === victim.released &&
+            (voice.priority < victim.priority ||
+              (voice.priority === victim.priority &&
+                voice.startTime < victim.startTime)))
+        ) {
+          victim = voice;
+        }
+      }
+      if (!victim.released && victim.priority > instrument.priority) {
+        this.stats.dropped++;
+        return;
+      }
+      this.voices.splice(this.voices.indexOf(victim), 1);
+      this.stats.stolen++;
+    }
+
+    const voice = new Voice(
+      this.bank,
+      channelIndex,
+      key,
+      velocity,
+      instrument,
+      sound,
+      this.time
+    );
+    voice.startEnvelopeStage(ENV_ATTACK, this.sampleRate);
+    this.voices.push(voice);
+    this.stats.notes++;
+    this.stats.maxVoices = Math.max(this.stats.maxVoices, this.voices.length);
+  }
+
+  noteOff(channelIndex, key) {
+    const channel = this.channels[channelIndex];
+    for (const voice of this.voices) {
+      if (
+        voice.channel === channelIndex &&
+        voice.key === key &&
+        !voice.released
+      ) {
+        if (channel.sustain) {
+          voice.sustained = true;
+        } else {
+          voice.release(this.sampleRate);
+        }
+      }
+    }
+  }
+
+  controlChange(channelIndex, controller, value) {
+    const channel = this.channels[channelIndex];
+    switch (controller) {
+      case MIDI_CC_VOLUME:
+        channel.volume = value;
+        break;
+      case MIDI_CC_PAN:
+        channel.pan = value;
+        break;
+      case MIDI_CC_SUSTAIN:
+        channel.sustain = value >= 64;
+        if (!channel.sustain) {
+          for (const voice of this.voices) {
+            if (voice.channel === channelIndex && voice.sustained) {
+              voice.release(this.sampleRate);
+            }
+          }
+        }
+        break;
+      case MIDI_CC_ALL_SOUND_OFF:
+        this.voices = this.voices.filter((v) => v.channel !== channelIndex);
+        break;
+      case MIDI_CC_ALL_NOTES_OFF:
+        for (const voice of this.voices) {
+          if (voice.channel === channelIndex) voice.release(this.sampleRate);
+        }
+        break;
+    }
+  }
+
+  handleEvent(event) {
+    switch (event.type) {
+      case 'noteOn':
+        if (event.velocity === 0) {
+          this.noteOff(event.channel, event.noteNumber);
+        } else {
+          this.noteOn(event.channel, event.noteNumber, event.velocity);
+        }
+        break;
+      case 'noteOff':
+        this.noteOff(event.channel, event.noteNumber);
+        break;
+      case 'controller':
+        this.controlChange(event.channel, event.controllerType, event.value);
+        break;
+      case 'programChange':
+        this.setProgram(this.channels[event.channel], event.programNumber);
+        break;
+      case 'pitchBend':
+        this.channels[event.channel].bend = event.value / MIDI_PITCH_BEND_RANGE;
+        break;
+    }
+  }
+
+  // mix all voices into the interleaved stereo output from sample `start` for
+  // `length` samples
+  mix(output, start, length) {
+    for (
+      let blockStart = 0;
+      blockStart < length;
+      blockStart += ENV_BLOCK_SIZE
+    ) {
+      const blockLength = Math.min(ENV_BLOCK_SIZE, length - blockStart);
+      for (let v = 0; v < this.voices.length; v++) {
+        this.mixVoice(this.voices[v], output, start + blockStart, blockLength);
+      }
+      this.voices = this.voices.filter((voice) => !voice.done);
+    }
+    this.time += length;
+  }
+
+  mixVoice(voice, output, start, length) {
+    const channel = this.channels[voice.channel];
+    const {samples, loopStart, loopEnd} = voice.wave;
+
+    // gain is a product of the 0-127 scaled volumes along the chain. the
+    // instrument's volume is already in channel.volume, set by setProgram
+    const gain =
+      (voice.envLevel / AL_VOL_FULL) *
+      (voice.velocity / AL_VOL_FULL) *
+      (channel.volume / AL_VOL_FULL) *
+      (voice.sound.sampleVolume / AL_VOL_FULL);
+
+    let pan = channel.pan - AL_PAN_CENTER + voice.sound.samplePan;
+    pan = Math.max(0, Math.min(127, pan));
+    const panAngle = (pan / 127) * (Math.PI / 2);
+    const gainL = gain * Math.cos(panAngle);
+    const gainR = gain * Math.sin(panAngle);
+
+    const cents =
+      (voice.key - voice.keyMap.keyBase) * 100 +
+      voice.keyMap.detune +
+      channel.bend * voice.instrument.bendRange;
+    const step = Math.min(
+      Math.pow(2, cents / 1200) *
+        (voice.bankSampleRate / this.sampleRate),
+      MAX_PITCH_RATIO * (voice.bankSampleRate / this.sampleRate)
+    );
+
+    let position = voice.position;
+    const looping = loopEnd > loopStart;
+    const end = samples.length;
+    for (let i = 0; i < length; i++) {
+      if (looping && voice.loopsRemaining > 0 && position >= loopEnd) {
+        position -= loopEnd - loopStart;
+        voice.loopsRemaining--;
+      }
+      const index = position | 0;
+      if (index >= end) {
+        position = -1;
+        break;
+      }
+      const frac = position - index;
+      let next;
+      if (index + 1 < end) {
+        next = samples[index + 1];
+      } else {
+        next = 0;
+      }
+      if (looping && voice.loopsRemaining > 0 && index + 1 >= loopEnd) {
+        next = samples[loopStart + (index + 1 - loopEnd)];
+      }
+      const value = samples[index] + (next - samples[index]) * frac;
+      const out = (start + i) * 2;
+      output[out] += value * gainL;
+      output[out + 1] += value * gainR;
+      position += step;
+    }
+    voice.position = position;
+    voice.advanceEnvelope(length, this.sampleRate);
+  }
+
+  // render a parsed midi file, returning interleaved stereo float samples
+  renderMidi(midi) {
+    const events = flattenMidiTracks(midi);
+    const ticksPerBeat = midi.header.ticksPerBeat;
+    if (!ticksPerBeat) {
+      throw new Error('SMPTE time division is not supported');
+    }
+
+    // convert tick times to output sample times through the tempo map
+    let tempo = DEFAULT_TEMPO;
+    let lastTick = 0;
+    let lastSeconds = 0;
+    const timed = [];
+    for (const event of events) {
+      lastSeconds +=
+        ((event.tick - lastTick) * tempo) / (ticksPerBeat * 1e6);
+      lastTick = event.tick;
+      if (event.type === 'setTempo') {
+        tempo = event.microsecondsPerBeat;
+      }
+      timed.push({time: Math.round(lastSeconds * this.sampleRate), event});
+    }
+
+    const endTime = timed.length ? timed[timed.length - 1].time : 0;
+    const maxLength = endTime + Math.ceil(this.tailSeconds * this.sampleRate);
+    const output = new Float32Array(maxLength * 2);
+
+    for (const {time, event} of timed) {
+      if (time > this.time) {
+        this.mix(output, this.time, time - this.time);
+      }
+      this.handleEvent(event);
+    }
+    // let the remaining voices ring out, up to the tail limit
+    while (this.voices.length && this.time < maxLength) {
+      this.mix(output, this.time, Math.min(4096, maxLength - this.time));
+    }
+    return output.subarray(0, this.time * 2);
+  }
+}
+
+// merge the tracks of a type 0 or type 1 midi file into one list of events
+// with absolute tick times. events at the same tick keep track order
+function flattenMidiTracks(midi) {
+  const events = [];
+  midi.tracks.forEach((track, trackIndex) => {
+    let tick = 0;
+    track.forEach((event, index) => {
+      tick += event.deltaTime;
+      events.push({...event, tick, trackIndex, index});
+    });
+  });
+  events.sort(
+    (a, b) =>
+      a.tick - b.tick || a.trackIndex - b.trackIndex || a.index - b.index
+  );
+  return events;
+}
+
+// convert interleaved float samples to a 16 bit little endian buffer, as
+// used by wave.js
+function floatToS16LEBuffer(samples) {
+  const buffer = Buffer.alloc(samples.length * 2);
+  for (let i = 0; i < samples.length; i++) {
+    const value = Math.round(samples[i] * 32767);
+    buffer.writeInt16LE(
+      value > 32767 ? 32767 : value < -32768 ? -32768 : value,
+      i * 2
+    );
+  }
+  return buffer;
+}
+
+// render a .seq (midi) file buffer with a bank, returning the info needed to
+// write a wave file
+function renderSeq(seqBuffer, bank, options = {}) {
+  const midi = parseMidi(seqBuffer);
+  const renderer = new SeqRenderer(bank, options);
+  const samples = renderer.renderMidi(midi);
+  return {
+    sampleRate: renderer.sampleRate,
+    numChannels: 2,
+    samples,
+    stats: renderer.stats,
+  };
+}
+
+module.exports = {
+  SynthBank,
+  SeqRenderer,
+  renderSeq,
+  flattenMidiTracks,
+  floatToS16LEBuffer,
+  DEFAULT_SAMPLE_RATE,
+  DEFAULT_MAX_VOICES,
+};
@@ -0,0 +1,235 @@
+// VADPCM codebook training, doing the job of the sdk's tabledesign tool
+//
+// each 16 sample frame of the input is summarised by its autocorrelation
+// statistics. the frames are then clustered into `npredictors` groups with the
+// LBG algorithm (split, then alternately assign frames to the predictor with
+// the least prediction error and re-solve each predictor from its frames), and
+// each predictor's coefficients are turned into a codebook entry: the first 8
+// samples of the predictor's response to each of the previous `order` samples.
+
+const FRAME_SAMPLES = 16;
+const VECTOR_SIZE = 8;
+const COEF_SCALE = 1 << 11;
+
+const DEFAULT_ORDER = 2;
+const DEFAULT_PREDICTOR_BITS = 2; // 4 predictors
+const DEFAULT_REFINE_ITERATIONS = 8;
+// frames quieter than this (sum of squares) are ignored for training
+const DEFAULT_ENERGY_THRESHOLD = 16 * 10 * 10;
+const SPLIT_DELTA = 0.01;
+const REGULARIZATION = 1e-9;
+
+// samples before the start and after the end (padding the last frame) are 0
+function sampleAt(samples, n) {
+  return n >= 0 && n < samples.length ? samples[n] : 0;
+}
+
+// per frame autocorrelation: r0 = sum x[n]^2, r[i] = sum x[n]x[n-1-i],
+// R[i][j] = sum x[n-1-i]x[n-1-j], over the samples of the frame
+function computeFrameStats(samples, order) {
+  const frames = Math.ceil(samples.length / FRAME_SAMPLES);
+  const stats = [];
+  for (let f = 0; f < frames; f++) {
+    const start = f * FRAME_SAMPLES;
+    const r = new Float64Array(order);
+    const R = new Float64Array(order * order);
+    let r0 = 0;
+    for (let n = start; n < start + FRAME_SAMPLES; n++) {
+      const x = sampleAt(samples, n);
+      r0 += x * x;
+      for (let i = 0; i < order; i++) {
+        const xi = sampleAt(samples, n - 1 - i);
+        r[i] += x * xi;
+        for (let j = 0; j < order; j++) {
+          const xj = sampleAt(samples, n - 1 - j);
+          R[i * order + j] += xi * xj;
+        }
+      }
+    }
+    stats.push({r0, r, R});
+  }
+  return stats;
+}
+
+// solve R a = r by gaussian elimination with partial pivoting. a little
+// regularization keeps silent or perfectly periodic input from being singular
+function solve(R, r, order) {
+  const m = new Float64Array(order * (order + 1));
+  let trace = 0;
+  for (let i = 0; i < order; i++) trace += R[i * order + i];
+  const ridge = (trace / order) * REGULARIZATION + 1e-12;
+  for (let i = 0; i < order; i++) {
+    for (let j = 0; j < order; j++) {
+      m[i * (order + 1) + j] = R[i * order + j] + (i === j ? ridge : 0);
+    }
+    m[i * (order + 1) + order] = r[i];
+  }
+  const w = order + 1;
+  for (let col = 0; col < order; col++) {
+    let pivot = col;
+    for (let row = col + 1; row < order; row++) {
+      if (Math.abs(m[row * w + col]) > Math.abs(m[pivot * w + col])) {
+        pivot = row;
+      }
+    }
+    if (pivot !== col) {
+      for (let k = 0; k < w; k++) {
+        const tmp = m[col * w + k];
+        m[col * w + k] = m[pivot * w + k];
+        m[pivot * w + k] = tmp;
+      }
+    }
+    const div = m[col * w + col];
+    if (div === 0) continue;
+    for (let row = col + 1; row < order; row++) {
+      const factor = m[row * w + col] / div;
+      for (let k = col; k < w; k++) {
+        m[row * w + k] -= factor * m[col * w + k];
+      }
+    }
+  }
+  const a = new Float64Array(order);
+  for (let i = order - 1; i >= 0; i--) {
+    let sum = m[i * w + order];
+    for (let k = i + 1; k < order; k++) {
+      sum -= m[i * w + k] * a[k];
+    }
+    const div = m[i * w + i];
+    a[i] = div === 0 ? 0 : sum / div;
+  }
+  return a;
+}
+
+// squared prediction error of a frame with predictor a:
+// r0 - 2 a.r + a^T R a
+function predictionError(frame, a, order) {
+  let error = frame.r0;
+  for (let i = 0; i < order; i++) {
+    error -= 2 * a[i] * frame.r[i];
+    for (let j = 0; j < order; j++) {
+      error += a[i] * frame.R[i * order + j] * a[j];
+    }
+  }
+  return error;
+}
+
+function solveCluster(frames, order) {
+  const r = new Float64Array(order);
+  const R = new Float64Array(order * order);
+  frames.forEach((frame) => {
+    for (let i = 0; i < order; i++) r[i] += frame.r[i];
+    for (let i = 0; i < order * order; i++) R[i] += frame.R[i];
+  });
+  return solve(R, r, order);
+}
+
+// a predictor whose response grows without bound amplifies quantization error
+// until the output saturates, and one whose first 8 response samples don't fit
+// the s16 codebook can't be represented. shrink the coefficients of such
+// predictors (moving the poles towards the origin) until they're usable
+function stabilize(a, order) {
+  let coefs = a;
+  for (let attempt = 0; attempt < 64; attempt++) {
+    const response = predictorResponse(coefs, order, order - 1, 256);
+    let early = 0;
+    let late = 0;
+    for (let i = 0; i < 128; i++) early = Math.max(early, Math.abs(response[i]));
+    for (let i = 128; i < 256; i++) late = Math.max(late, Math.abs(response[i]));
+    let fits = true;
+    for (let j = 0; j < order && fits; j++) {
+      const rows = predictorResponse(coefs, order, j, VECTOR_SIZE);
+      fits = rows.every((value) => Math.abs(value * COEF_SCALE) < 32768);
+    }
+    if (fits && late <= early * 1.5) return coefs;
+    coefs = coefs.map((c, i) => c * Math.pow(0.98, i + 1));
+  }
+  return coefs;
+}
+
+// response of predictor a to a unit impulse in history slot j (where slot
+// order - 1 is the sample immediately before the output) with no residual
+function predictorResponse(a, order, j, length) {
+  const history = new Float64Array(order + length);
+  history[j] = 1;
+  for (let k = 0; k < length; k++) {
+    let sum = 0;
+    for (let i = 0; i < order; i++) {
+      sum += a[i] * history[order + k - 1 - i];
+    }
+    history[order + k] = sum;
+  }
+  return history.subarray(order);
+}
+
+// convert predictor coefficients to the codebook rows for that predictor, as
+// the big endian s16 layout used by ALADPCMBook/VADPCMCODES
+function predictorsToBook(predictors, order) {
+  const book = Buffer.alloc(predictors.length * order * VECTOR_SIZE * 2);
+  let pos = 0;
+  predictors.forEach((a) => {
+    for (let j = 0; j < order; j++) {
+      const response = predictorResponse(a, order, j, VECTOR_SIZE);
+      for (let k = 0; k < VECTOR_SIZE; k++) {
+        const value = Math.round(response[k] * COEF_SCALE);
+        book.writeInt16BE(Math.max(-32768, Math.min(32767, value)), pos);
+        pos += 2;
+      }
+    }
+  });
+  return book;
+}
+
+// train a codebook for 16 bit samples (any array of numbers).
+// returns {order, npredictors, book} like VADPCMBookChunkStruct
+function designCodebook(
+  samples,
+  {
+    order = DEFAULT_ORDER,
+    predictorBits = DEFAULT_PREDICTOR_BITS,
+    refineIterations = DEFAULT_REFINE_ITERATIONS,
+    energyThreshold = DEFAULT_ENERGY_THRESHOLD,
+  } = {}
+) {
+  const npredictors = 1 << predictorBits;
+  const allFrames = computeFrameStats(samples, order);
+  let frames = allFrames.filter((frame) => frame.r0 > energyThreshold);
+  if (!frames.length) frames = allFrames;
+
+  let predictors = [solveCluster(frames, order)];
+  while (predictors.length < npredictors) {
+    // split each predictor in two, then refine
+    predictors = predictors.flatMap((a) => [
+      a.map((c) => c * (1 + SPLIT_DELTA)),
+      a.map((c) => c * (1 - SPLIT_DELTA)),
+    ]);
+    for (let iter = 0; iter < refineIterations; iter++) {
+      const clusters = predictors.map(() => []);
+      frames.forEach((frame) => {
+        let best = 0;
+        let bestError = Infinity;
+        predictors.forEach((a, i) => {
+          const error = predictionError(frame, a, order);
+          if (error < bestError) {
+            bestError = error;
+            best = i;
+          }
+        });
+        clusters[best].push(frame);
+      });
+      predictors = predictors.map((a, i) =>
+        clusters[i].length ? solveCluster(clusters[i], order) : a
+      );
+    }
+  }
+
+  predictors = predictors.map((a) => stabilize(a, order));
+  return {order, npredictors, book: predictorsToBook(predictors, order)};
+}
+
+module.exports = {
+  designCodebook,
+  computeFrameStats,
+  predictorsToBook,
+  DEFAULT_ORDER,
+  DEFAULT_PREDICTOR_BITS,
+};
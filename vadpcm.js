@@ -0,0 +1,606 @@
+// VADPCM codec, as used by the n64 audio microcode and the sdk's
+// vadpcm_enc/vadpcm_dec tools. codebooks are trained by tabledesign.js
+//
+// a VADPCM sample is a series of 9 byte frames, each decoding to 16 samples.
+// the first byte of each frame is a header: the high nibble is the log2 of the
+// scale applied to the residuals, the low nibble selects which predictor from
+// the codebook to use. the remaining 8 bytes are 16 signed 4 bit residuals.
+
+const FRAME_SIZE = 9; // bytes per frame
+const FRAME_SAMPLES = 16; // samples per frame
+const HALF_FRAME_SAMPLES = 8;
+const VECTOR_SIZE = 8; // ADPCMVSIZE, number of values per codebook row
+const COEF_SHIFT = 11; // codebook values are fixed point with 11 fractional bits
+
+function clampS16(value) {
+  return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+// read the raw codebook (big endian s16 values, in the layout of ALADPCMBook or
+// the AIFC VADPCMCODES chunk) as a predictor -> order -> 8 values array
+function readCodebook(order, npredictors, bookBuffer) {
+  const expectedSize = npredictors * order * VECTOR_SIZE * 2;
+  if (bookBuffer.length < expectedSize) {
+    throw new Error(
+      `codebook too small: expected ${expectedSize} bytes, got ${bookBuffer.length}`
+    );
+  }
+  const book = [];
+  let pos = 0;
+  for (let i = 0; i < npredictors; i++) {
+    const rows = [];
+    for (let j = 0; j < order; j++) {
+      const row = new Int32Array(VECTOR_SIZE);
+      for (let k = 0; k < VECTOR_SIZE; k++) {
+        row[k] = bookBuffer.readInt16BE(pos);
+        pos += 2;
+      }
+      rows.push(row);
+    }
+    book.push(rows);
+  }
+  return book;
+}
+
+// expands each predictor of the codebook into an 8 x (order + 8) matrix, where
+// row k holds the coefficients used to predict sample k of a half frame from the
+// last `order` samples of the previous half frame, followed by the residuals of
+// the samples before k in this half frame.
+// this mirrors the way vadpcm_dec and the microcode compute each sample.
+function expandCodebook({order, npredictors, book}) {
+  const rawBook = Buffer.isBuffer(book)
+    ? readCodebook(order, npredictors, book)
+    : book;
+  const width = order + VECTOR_SIZE;
+  const predictors = [];
+  for (let i = 0; i < npredictors; i++) {
+    const table = [];
+    for (let k = 0; k < VECTOR_SIZE; k++) {
+      table.push(new Int32Array(width));
+    }
+    for (let j = 0; j < order; j++) {
+      for (let k = 0; k < VECTOR_SIZE; k++) {
+        table[k][j] = rawBook[i][j][k];
+      }
+    }
+    for (let k = 1; k < VECTOR_SIZE; k++) {
+      table[k][order] = table[k - 1][order - 1];
+    }
+    table[0][order] = 1 << COEF_SHIFT;
+    for (let k = 1; k < VECTOR_SIZE; k++) {
+      let j = 0;
+      for (; j < k; j++) {
+        table[j][k + order] = 0;
+      }
+      for (; j < VECTOR_SIZE; j++) {
+        table[j][k + order] = table[j - k][order];
+      }
+    }
+    predictors.push(table);
+  }
+  return {order, npredictors, predictors};
+}
+
+// divide by 2^11, rounding towards negative infinity
+function innerProduct(length, coefs, values) {
+  let out = 0;
+  for (let j = 0; j < length; j++) {
+    out += coefs[j] * values[j];
+  }
+  return Math.floor(out / (1 << COEF_SHIFT));
+}
+
+// decodes one frame at `offset` in `input` into `output` at `outOffset`.
+// `state` holds the last 16 decoded samples and is updated in place, so the
+// same state should be passed when decoding consecutive frames.
+function decodeFrame(input, offset, output, outOffset, state, codebook) {
+  const {order, predictors} = codebook;
+  const header = input[offset];
+  const scale = 1 << (header >> 4);
+  const predictorIndex = header & 0xf;
+  const table = predictors[predictorIndex];
+  if (!table) {
+    throw new Error(
+      `invalid predictor ${predictorIndex} in frame at ${offset}, codebook has ${predictors.length}`
+    );
+  }
+
+  const residuals = new Int32Array(FRAME_SAMPLES);
+  for (let i = 0; i < FRAME_SAMPLES; i += 2) {
+    const byte = input[offset + 1 + i / 2];
+    const hi = byte >> 4;
+    const lo = byte & 0xf;
+    residuals[i] = (hi > 7 ? hi - 16 : hi) * scale;
+    residuals[i + 1] = (lo > 7 ? lo - 16 : lo) * scale;
+  }
+
+  const inVec = new Int32Array(order + VECTOR_SIZE);
+  for (let half = 0; half < 2; half++) {
+    // the previous half frame's last `order` samples
+    const prevEnd = half === 0 ? FRAME_SAMPLES : HALF_FRAME_SAMPLES;
+    for (let i = 0; i < order; i++) {
+      inVec[i] = state[prevEnd - order + i];
+    }
+    for (let i = 0; i < HALF_FRAME_SAMPLES; i++) {
+      const index = half * HALF_FRAME_SAMPLES + i;
+      inVec[order + i] = residuals[index];
+      state[index] = clampS16(
+        innerProduct(order + i, table[i], inVec) + residuals[index]
+      );
+    }
+  }
+
+  for (let i = 0; i < FRAME_SAMPLES; i++) {
+    output[outOffset + i] = state[i];
+  }
+}
+
+// the hot path: a decoder for many consecutive frames, generated per codebook
+// order with every inner product unrolled into straight line code over local
+// variables, so the js engine can keep the whole frame in registers instead of
+// going through the per-sample loops and temporary arrays of decodeFrame.
+// decodeFrame is kept as the reference implementation and the two must give
+// identical output (see bench/vadpcmkernel.js)
+const frameKernels = new Map();
+
+function clampExpr(value) {
+  return `(${value} > 32767 ? 32767 : ${value} < -32768 ? -32768 : ${value})`;
+}
+
+function buildFrameKernel(order) {
+  const width = order + VECTOR_SIZE;
+  const tableSize = VECTOR_SIZE * width;
+  const lines = [];
+  const prev = (k) => `p${k}`;
+
+  // the last `order` samples of the previous half frame
+  for (let k = 0; k < order; k++) {
+    lines.push(`let ${prev(k)} = state[${FRAME_SAMPLES - order + k}];`);
+  }
+  lines.push(
+    `for (let f = 0; f < frames; f++, inOffset += ${FRAME_SIZE}, outOffset += ${FRAME_SAMPLES}) {`,
+    `  const header = input[inOffset];`,
+    `  const scale = 1 << (header >> 4);`,
+    `  const predictor = header & 0xf;`,
+    `  if (predictor >= npredictors) throw new Error('invalid predictor ' + predictor + ' in frame at ' + inOffset + ', codebook has ' + npredictors);`,
+    `  const t = predictor * ${tableSize};`,
+    `  let b;`
+  );
+  for (let i = 0; i < FRAME_SAMPLES; i += 2) {
+    lines.push(
+      `  b = input[inOffset + ${1 + i / 2}];`,
+      `  const r${i} = (((b >> 4) ^ 8) - 8) * scale;`,
+      `  const r${i + 1} = (((b & 0xf) ^ 8) - 8) * scale;`
+    );
+  }
+  for (let half = 0; half < 2; half++) {
+    for (let i = 0; i < HALF_FRAME_SAMPLES; i++) {
+      const index = half * HALF_FRAME_SAMPLES + i;
+      const terms = [];
+      for (let k = 0; k < order; k++) {
+        terms.push(`table[t + ${i * width + k}] * ${prev(k)}`);
+      }
+      for (let m = 0; m < i; m++) {
+        terms.push(
+          `table[t + ${i * width + order + m}] * r${half * HALF_FRAME_SAMPLES + m}`
+        );
+      }
+      lines.push(
+        `  let s${index} = Math.floor((${terms.join(' + ')}) / ${
+          1 << COEF_SHIFT
+        }) + r${index};`,
+        `  s${index} = ${clampExpr(`s${index}`)};`,
+        `  output[outOffset + ${index}] = s${index};`
+      );
+    }
+    const prevEnd = half === 0 ? HALF_FRAME_SAMPLES : FRAME_SAMPLES;
+    for (let k = 0; k < order; k++) {
+      lines.push(`  ${prev(k)} = s${prevEnd - order + k};`);
+    }
+  }
+  lines.push(`  if (f === frames - 1) {`);
+  for (let i = 0; i < FRAME_SAMPLES; i++) {
+    lines.push(`    state[${i}] = s${i};`);
+  }
+  lines.push(`  }`, `}`);
+
+  return new Function(
+    'input',
+    'inOffset',
+    'output',
+    'outOffset',
+    'state',
+    'table',
+    'npredictors',
+    'frames',
+    lines.join('\n')
+  );
+}
+
+function getFrameKernel(order) {
+  let kernel = frameKernels.get(order);
+  if (!kernel) {
+    kernel = buildFrameKernel(order);
+    frameKernels.set(order, kernel);
+  }
+  return kernel;
+}
+
+// all predictor tables of an expanded codebook in one flat array, in the
+// layout the frame kernel expects
+function getFlatTable(codebook) {
+  if (!codebook.flatTable) {
+    const width = codebook.order + VECTOR_SIZE;
+    const flatTable = new Int32Array(
+      codebook.npredictors * VECTOR_SIZE * width
+    );
+    codebook.predictors.forEach((table, i) => {
+      table.forEach((row, k) => {
+        flatTable.set(row, (i * VECTOR_SIZE + k) * width);
+      });
+    });
+    codebook.flatTable = flatTable;
+  }
+  return codebook.flatTable;
+}
+
+// decode `frames` consecutive frames with the unrolled kernel. like
+// decodeFrame, `state` is updated to continue decoding from the next frame
+function decodeFrames(
+  input,
+  offset,
+  output,
+  outOffset,
+  state,
+  codebook,
+  frames
+) {
+  if (frames <= 0) return;
+  getFrameKernel(codebook.order)(
+    input,
+    offset,
+    output,
+    outOffset,
+    state,
+    getFlatTable(codebook),
+    codebook.npredictors,
+    frames
+  );
+}
+
+// decode a whole VADPCM sample to 16 bit PCM samples.
+// book: {order, npredictors, book} as parsed from ALADPCMBook or VADPCMBookChunk
+// (or an already expanded codebook)
+function decodeVADPCM(soundData, book, initialState = null) {
+  const codebook = book.predictors ? book : expandCodebook(book);
+  const frames = Math.floor(soundData.length / FRAME_SIZE);
+  const output = new Int16Array(frames * FRAME_SAMPLES);
+  const state = new Int32Array(FRAME_SAMPLES);
+  if (initialState) state.set(initialState);
+  decodeFrames(soundData, 0, output, 0, state, codebook, frames);
+  return output;
+}
+
+// the same as decodeVADPCM, one frame at a time with decodeFrame
+function decodeVADPCMReference(soundData, book, initialState = null) {
+  const codebook = book.predictors ? book : expandCodebook(book);
+  const frames = Math.floor(soundData.length / FRAME_SIZE);
+  const output = new Int16Array(frames * FRAME_SAMPLES);
+  const state = new Int32Array(FRAME_SAMPLES);
+  if (initialState) state.set(initialState);
+  for (let i = 0; i < frames; i++) {
+    decodeFrame(
+      soundData,
+      i * FRAME_SIZE,
+      output,
+      i * FRAME_SAMPLES,
+      state,
+      codebook
+    );
+  }
+  return output;
+}
+
+const MAX_SCALE_SHIFT = 12;
+
+// predictor/scale search modes for the encoder:
+// fast: the predictor with the least open loop error, at the scale that fits
+// normal: as fast, but also tries the scales either side of that one
+// max: every predictor at every scale, quantized closed loop (~15x slower)
+const ENCODE_MODES = ['fast', 'normal', 'max'];
+
+// scratch buffers reused for every frame, to keep allocation out of the loop
+const openLoopScratch = new Float64Array(FRAME_SAMPLES);
+const nibblesScratch = new Int32Array(FRAME_SAMPLES);
+const decodedScratch = new Int32Array(FRAME_SAMPLES);
+const bestNibbles = new Int32Array(FRAME_SAMPLES);
+const bestDecoded = new Int32Array(FRAME_SAMPLES);
+
+// the coefficients below are read from the flat table (see getFlatTable) at
+// `t`, the start of the predictor's 8 x (order + 8) matrix
+
+// open loop residuals of a predictor for the frame of `x` at `offset`, ie. the
+// prediction error if every residual could be stored exactly.
+// returns the squared error, and stores the largest magnitude residual in
+// openLoopMaxAbs
+let openLoopMaxAbs = 0;
+function openLoopError(x, offset, state, table, t, order) {
+  const width = order + VECTOR_SIZE;
+  const out = openLoopScratch;
+  let energy = 0;
+  let maxAbs = 0;
+  for (let half = 0; half < 2; half++) {
+    const base = half * HALF_FRAME_SAMPLES;
+    for (let i = 0; i < HALF_FRAME_SAMPLES; i++) {
+      const row = t + i * width;
+      let sum = 0;
+      for (let k = 0; k < order; k++) {
+        const prev =
+          half === 0
+            ? state[FRAME_SAMPLES - order + k]
+            : x[offset + HALF_FRAME_SAMPLES - order + k];
+        sum += table[row + k] * prev;
+      }
+      for (let m = 0; m < i; m++) {
+        sum += table[row + order + m] * out[base + m];
+      }
+      const residual =
+        x[offset + base + i] - Math.floor(sum / (1 << COEF_SHIFT));
+      out[base + i] = residual;
+      energy += residual * residual;
+      if (residual > maxAbs) maxAbs = residual;
+      else if (-residual > maxAbs) maxAbs = -residual;
+    }
+  }
+  openLoopMaxAbs = maxAbs;
+  return energy;
+}
+
+// quantize the frame of `x` at `offset` with a predictor and scale, tracking
+// the decoder's output exactly so quantization error doesn't accumulate.
+// the 4 bit residuals go in `nibbles` and the decoded samples in `decoded`.
+// returns the squared error of the decoded frame, giving up early (returning
+// Infinity) once it exceeds `limit`
+function quantizeFrame(
+  x,
+  offset,
+  state,
+  table,
+  t,
+  order,
+  shift,
+  nibbles,
+  decoded,
+  limit
+) {
+  const width = order + VECTOR_SIZE;
+  const scale = 1 << shift;
+  let error = 0;
+  for (let half = 0; half < 2; half++) {
+    const base = half * HALF_FRAME_SAMPLES;
+    for (let i = 0; i < HALF_FRAME_SAMPLES; i++) {
+      const row = t + i * width;
+      let sum = 0;
+      for (let k = 0; k < order; k++) {
+        const prev =
+          half === 0
+            ? state[FRAME_SAMPLES - order + k]
+            : decoded[HALF_FRAME_SAMPLES - order + k];
+        sum += table[row + k] * prev;
+      }
+      for (let m = 0; m < i; m++) {
+        sum += table[row + order + m] * nibbles[base + m] * scale;
+      }
+      const prediction = Math.floor(sum / (1 << COEF_SHIFT));
+      const target = x[offset + base + i];
+      let nibble = Math.round((target - prediction) / scale);
+      nibble = nibble > 7 ? 7 : nibble < -8 ? -8 : nibble;
+      const value = clampS16(prediction + nibble * scale);
+      nibbles[base + i] = nibble;
+      decoded[base + i] = value;
+      error += (target - value) * (target - value);
+    }
+    if (error > limit) return Infinity;
+  }
+  return error;
+}
+
+function writeFrame(output, outOffset, predictor, shift, nibbles) {
+  output[outOffset] = (shift << 4) | predictor;
+  for (let i = 0; i < FRAME_SAMPLES; i += 2) {
+    output[outOffset + 1 + i / 2] =
+      ((nibbles[i] & 0xf) << 4) | (nibbles[i + 1] & 0xf);
+  }
+}
+
+// the smallest scale which fits residuals up to maxAbs in 4 bits
+function scaleShiftFor(maxAbs) {
+  let shift = 0;
+  while (shift < MAX_SCALE_SHIFT && maxAbs > 7 * (1 << shift)) {
+    shift++;
+  }
+  return shift;
+}
+
+// encode one frame with the predictor and scale chosen according to `mode`.
+// `state` holds the previous frame's decoded samples and is updated.
+// returns the squared error of the frame
+function encodeFrame(
+  x,
+  offset,
+  output,
+  outOffset,
+  state,
+  codebook,
+  mode = 'normal'
+) {
+  const {order, npredictors} = codebook;
+  const table = getFlatTable(codebook);
+  const tableSize = VECTOR_SIZE * (order + VECTOR_SIZE);
+  let bestPredictor = 0;
+  let bestShift = 0;
+  let bestError = Infinity;
+
+  const tryCandidate = (predictor, shift) => {
+    const error = quantizeFrame(
+      x,
+      offset,
+      state,
+      table,
+      predictor * tableSize,
+      order,
+      shift,
+      nibblesScratch,
+      decodedScratch,
+      bestError
+    );
+    if (error < bestError) {
+      bestError = error;
+      bestPredictor = predictor;
+      bestShift = shift;
+      bestNibbles.set(nibblesScratch);
+      bestDecoded.set(decodedScratch);
+    }
+  };
+
+  if (mode === 'max') {
+    for (let p = 0; p < npredictors; p++) {
+      for (let shift = 0; shift <= MAX_SCALE_SHIFT; shift++) {
+        tryCandidate(p, shift);
+      }
+    }
+  } else {
+    let openLoopPredictor = 0;
+    let openLoopBest = Infinity;
+    let maxAbs = 0;
+    for (let p = 0; p < npredictors; p++) {
+      const energy = openLoopError(x, offset, state, table, p * tableSize, order);
+      if (energy < openLoopBest) {
+        openLoopBest = energy;
+        openLoopPredictor = p;
+        maxAbs = openLoopMaxAbs;
+      }
+    }
+    const fitShift = scaleShiftFor(maxAbs);
+    if (mode === 'fast') {
+      tryCandidate(openLoopPredictor, fitShift);
+    } else {
+      const lastShift = Math.min(MAX_SCALE_SHIFT, fitShift + 1);
+      for (let shift = Math.max(0, fitShift - 1); shift <= lastShift; shift++) {
+        tryCandidate(openLoopPredictor, shift);
+      }
+    }
+  }
+
+  writeFrame(output, outOffset, bestPredictor, bestShift, bestNibbles);
+  state.set(bestDecoded);
+  return bestError;
+}
+
+// encode 16 bit PCM samples to VADPCM with a codebook.
+// if loopStart is given, also returns the decoder state to store in the loop
+// (the decoded samples of the frame containing loopStart, as the sdk's
+// vadpcm_enc stores it), as on looping the microcode resumes decoding at the
+// frame after that one with that state.
+// each frame's search depends on the decoded output of the frame before, so
+// frames are encoded in order; parallelism is across samples
+function encodeVADPCM(samples, book, {loopStart = null, mode = 'normal'} = {}) {
+  if (!ENCODE_MODES.includes(mode)) {
+    throw new Error(
+      `unknown encode mode '${mode}', expected one of ${ENCODE_MODES.join(', ')}`
+    );
+  }
+  const codebook = book.predictors ? book : expandCodebook(book);
+  const frames = Math.ceil(samples.length / FRAME_SAMPLES);
+  // pad the last frame with silence
+  const x = new Int32Array(frames * FRAME_SAMPLES);
+  x.set(samples);
+  const output = Buffer.alloc(frames * FRAME_SIZE);
+  const state = new Int32Array(FRAME_SAMPLES);
+  const loopFrame =
+    loopStart == null ? -1 : Math.floor(loopStart / FRAME_SAMPLES);
+  let loopState = null;
+  let error = 0;
+  for (let f = 0; f < frames; f++) {
+    error += encodeFrame(
+      x,
+      f * FRAME_SAMPLES,
+      output,
+      f * FRAME_SIZE,
+      state,
+      codebook,
+      mode
+    );
+    if (f === loopFrame) {
+      loopState = Int16Array.from(state);
+    }
+  }
+  return {data: output, loopState, error};
+}
+
+// signal to noise ratio in dB of decoded samples against the original
+function computeSNR(original, decoded) {
+  let signal = 0;
+  let noise = 0;
+  for (let i = 0; i < original.length; i++) {
+    const diff = original[i] - (i < decoded.length ? decoded[i] : 0);
+    signal += original[i] * original[i];
+    noise += diff * diff;
+  }
+  if (noise === 0) return Infinity;
+  return 10 * Math.log10(signal / noise);
+}
+
+// the loop state in the big endian layout of ALADPCMloop.state
+function writeLoopState(state) {
+  const buffer = Buffer.alloc(FRAME_SAMPLES * 2);
+  for (let i = 0; i < FRAME_SAMPLES; i++) {
+    buffer.writeInt16BE(state ? state[i] : 0, i * 2);
+  }
+  return buffer;
+}
+
+// the s16[16] ADPCM_STATE stored in a loop, as parsed from ALADPCMloop.state
+function readLoopState(stateBuffer) {
+  const state = new Int32Array(FRAME_SAMPLES);
+  for (let i = 0; i < FRAME_SAMPLES; i++) {
+    state[i] = stateBuffer.readInt16BE(i * 2);
+  }
+  return state;
+}
+
+// 16 bit samples to big endian bytes, as stored in AIFF SSND chunks
+function samplesToBigEndianBuffer(samples) {
+  const buffer = Buffer.alloc(samples.length * 2);
+  for (let i = 0; i < samples.length; i++) {
+    buffer.writeInt16BE(samples[i], i * 2);
+  }
+  return buffer;
+}
+
+function bigEndianBufferToSamples(buffer) {
+  const samples = new Int16Array(Math.floor(buffer.length / 2));
+  for (let i = 0; i < samples.length; i++) {
+    samples[i] = buffer.readInt16BE(i * 2);
+  }
+  return samples;
+}
+
+module.exports = {
+  FRAME_SIZE,
+  FRAME_SAMPLES,
+  readCodebook,
+  expandCodebook,
+  decodeFrame,
+  decodeFrames,
+  decodeVADPCM,
+  decodeVADPCMReference,
+  ENCODE_MODES,
+  encodeFrame,
+  encodeVADPCM,
+  computeSNR,
+  writeLoopState,
+  readLoopState,
+  samplesToBigEndianBuffer,
+  bigEndianBufferToSamples,
+};
@@ -1,100 +1,111 @@
 #!/usr/bin/env node
+
+// decodes VADPCM .aifc files to uncompressed .aiff, keeping the sample rate and
+// loop. directories are searched for .aifc/.aif files. files are decoded in
+// parallel on a pool of worker threads
+// eg. vadpcmdecode.js test/genmidi_samples
+
 const fs = require('fs');
-const util = require('util');
-const exec = util.promisify(require('child_process').exec);
+const path = require('path');
+const os = require('os');
+const {isMainThread} = require('worker_threads');
 const AIFF = require('./aiff');
-const arg = require('arg');
-
-const args = arg({
-  // Types
-  '--verbose': Boolean,
-  '--bin': String, // where to find vadpcm_dec
-  '--help': Boolean,
+const {
+  decodeVADPCMAIFF,
+  isInvalidAIFFFromN64SDK,
+  fixInvalidAIFFFromN64SDK,
+} = require('./soundtools');
+const {runWorkerPool, serveWorkerJobs} = require('./workerpool');
+const {findFiles} = require('./findfiles');
 
-  // Aliases
-  '-v': '--verbose',
-  '-h': '--help',
-});
+function getOutName(file) {
+  const outName = file.replace(/\.aifc?$/i, '') + '.aiff';
+  return outName === file
+    ? file.replace(/\.aiff$/i, '') + '_decoded.aiff'
+    : outName;
+}
 
-if (args['--help']) {
-  console.log(`vadpcmdecode [--bin vadpcm_dec] files to decode`);
-  process.exit(0);
+// returns a description of what was done with the file
+async function decodeFile(file) {
+  const fileContents = await fs.promises.readFile(file);
+  if (isInvalidAIFFFromN64SDK(fileContents)) {
+    fixInvalidAIFFFromN64SDK(fileContents);
+  }
+  const parsed = AIFF.parse(fileContents); // this will throw if it's not an aiff
+  if (parsed.formType === 'AIFF') {
+    const outName = file.replace(/\.aifc$/i, '.aiff');
+    if (outName !== file) {
+      await fs.promises.writeFile(outName, fileContents);
+    }
+    return {outName, converted: false};
+  }
+  if (parsed.compressionType !== 'VAPC') {
+    throw new Error(
+      `not a suitable aiff file: ${parsed.formType} ${parsed.compressionName}`
+    );
+  }
+  const outName = getOutName(file);
+  await fs.promises.writeFile(outName, decodeVADPCMAIFF(parsed, file));
+  return {outName, converted: true};
 }
 
-const vadpcmDecCmd = args['--cmd'] || 'vadpcm_dec';
+if (!isMainThread) {
+  serveWorkerJobs(async (file) => {
+    try {
+      return await decodeFile(file);
+    } catch (err) {
+      return {error: err.message.trim()};
+    }
+  });
+} else {
+  const arg = require('arg');
 
-const files = args._;
-if (!files.length) throw new Error(`missing argument`);
+  const args = arg({
+    // Types
+    '--verbose': Boolean,
+    '--jobs': Number, // max files to decode in parallel
+    '--help': Boolean,
 
-async function asyncPool(poolLimit, array, iteratorFn) {
-  const ret = [];
-  const executing = [];
-  for (const item of array) {
-    const p = Promise.resolve().then(() => iteratorFn(item, array));
-    ret.push(p);
+    // Aliases
+    '-v': '--verbose',
+    '-j': '--jobs',
+    '-h': '--help',
+  });
 
-    if (poolLimit <= array.length) {
-      const e = p.then(() => executing.splice(executing.indexOf(e), 1));
-      executing.push(e);
-      if (executing.length >= poolLimit) {
-        await Promise.race(executing);
-      }
-    }
+  if (args['--help']) {
+    console.log(`vadpcmdecode [--jobs n] files or directories to decode`);
+    process.exit(0);
   }
-  return Promise.all(ret);
-}
 
-function awaitAll(_, items, iteratorFn) {
-  return Promise.all(items.map(iteratorFn));
-}
+  const inputs = args._;
+  if (!inputs.length) throw new Error(`missing argument`);
 
-async function run() {
-  await awaitAll(10, files, async (file) => {
-    const outName = file.replace(/\.aifc$/, '.aiff');
-    try {
-      const decoded = await exec(`${vadpcmDecCmd} "${file}"`, {
-        encoding: 'buffer',
-      });
-
-      const aiff = AIFF.serialize({
-        soundData: decoded.stdout,
-        numChannels: 1,
-        sampleSize: 16,
-        sampleRate: 22050,
-      });
-      await fs.promises.writeFile(outName, aiff);
-      if (args['--verbose']) {
-        console.log(file, 'converted');
-      }
-    } catch (err) {
-      if (args['--verbose']) {
-        console.error(file, err, err.stderr && err.stderr.toString('utf8'));
-      } else {
-        console.error(file, err.message.trim());
-      }
-      try {
-        const fileContents = await fs.promises.readFile(file);
-        const parsed = AIFF.parse(fileContents); // this will throw if it's not an aiff
-        if (parsed.form === 'AIFF') {
+  async function run() {
+    const files = findFiles(inputs, /\.aifc?$/i);
+    let failed = 0;
+    await runWorkerPool({
+      workerFile: __filename,
+      jobs: files,
+      concurrency: args['--jobs'] || os.cpus().length,
+      onResult: (result, file) => {
+        if (result.error) {
+          failed++;
+          console.error(file, result.error);
+          console.error(file, `doesn't seem to be a suitable aiff, skipping`);
+        } else if (!result.converted) {
           console.log(file, 'is an uncompressed aiff, just copying');
-        } else {
-          console.log(
-            file,
-            `not a suitable aiff file`,
-            parsed.form,
-            parsed.compressionName
-          );
-          throw new Error(`not a suitable aiff file`);
+        } else if (args['--verbose']) {
+          console.log(file, 'converted');
         }
-        await fs.promises.writeFile(outName, fileContents);
-      } catch {
-        console.error(file, `doesn't seem to be a suitable aiff, skipping`);
-      }
+      },
+    });
+    if (failed) {
+      console.error(`${failed} of ${files.length} files could not be decoded`);
     }
+  }
+
+  run().catch((err) => {
+    console.error(err);
+    process.exit(1);
   });
 }
-
-run().catch((err) => {
-  console.error(err);
-  process.exit(1);
-});
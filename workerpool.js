@@ -0,0 +1,105 @@
+const os = require('os');
+const {Worker, parentPort, workerData} = require('worker_threads');
+
+// runs jobs on a bounded pool of worker threads, each running workerFile.
+// the worker file should call serveWorkerJobs() when not on the main thread.
+// results are returned in the same order as jobs. the first job to fail
+// rejects the returned promise, after the jobs already running have finished.
+function runWorkerPool({
+  workerFile,
+  workerData,
+  jobs,
+  concurrency = os.cpus().length,
+  onResult = null, // called with (result, job, index) as each job completes
+}) {
+  const results = new Array(jobs.length);
+  const poolSize = Math.max(1, Math.min(concurrency, jobs.length));
+  let nextJob = 0;
+  let failure = null;
+
+  function runWorker() {
+    return new Promise((resolve, reject) => {
+      const worker = new Worker(workerFile, {workerData});
+      let currentJob = null;
+
+      function sendNextJob() {
+        if (failure || nextJob >= jobs.length) {
+          worker.terminate().then(() => resolve());
+          return;
+        }
+        currentJob = nextJob++;
+        worker.postMessage({index: currentJob, job: jobs[currentJob]});
+      }
+
+      worker.on('message', ({index, result, error}) => {
+        if (error != null) {
+          failure = failure || new Error(error);
+        } else {
+          results[index] = result;
+          if (onResult) onResult(result, jobs[index], index);
+        }
+        sendNextJob();
+      });
+      worker.on('error', (err) => {
+        failure = failure || err;
+        resolve();
+      });
+      worker.on('exit', (code) => {
+        if (code !== 0 && currentJob != null && results[currentJob] == null) {
+          failure =
+            failure || new Error(`worker exited with code ${code} during job`);
+        }
+        resolve();
+      });
+
+      sendNextJob();
+    });
+  }
+
+  const workers = [];
+  for (let i = 0; i < poolSize; i++) {
+    workers.push(runWorker());
+  }
+  return Promise.all(workers).then(() => {
+    if (failure) throw failure;
+    return results;
+  });
+}
+
+// worker side of runWorkerPool. handler is called with (job, workerData) and
+// can return a value or a promise
+function serveWorkerJobs(handler) {
+  parentPort.on('message', async ({index, job}) => {
+    try {
+      const result = await handler(job, workerData);
+      parentPort.postMessage({index, result});
+    } catch (err) {
+      parentPort.postMessage({index, error: err.stack || String(err)});
+    }
+  });
+}
+
+// runs an async function over items with at most `limit` (at least 1) in
+// flight at once, on the current thread
+async function asyncPool(limit, items, iteratorFn) {
+  const results = new Array(items.length);
+  let next = 0;
+  async function runNext() {
+    while (next < items.length) {
+      const index = next++;
+      results[index] = await iteratorFn(items[index], index);
+    }
+  }
+  const runners = [];
+  for (let i = 0; i < Math.min(Math.max(1, limit), items.length); i++) {
+    runners.push(runNext());
+  }
+  await Promise.all(runners);
+  return results;
+}
+
+module.exports = {
+  runWorkerPool,
+  serveWorkerJobs,
+  asyncPool,
+};